@@ -0,0 +1,366 @@
+/*
+ * compile_bench: end-to-end compiler throughput. For every size, generates a
+ * program with scl_gen, compiles it with sclc (-c --no-cache -ftime-report)
+ * and records the time of every phase, lines per second overall and per
+ * phase, and the peak RSS of the compiler. The results are written as JSON,
+ * one line per size, and compared against an earlier run when a baseline is
+ * given.
+ *
+ * Usage: compile_bench [--sclc path] [--gen path] [--lib dir] [--runs n]
+ *                      [--out file] [--baseline file] [lines...]
+ */
+
+#define _GNU_SOURCE
+
+#include "common.h"
+#include "timing.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * @struct bench_result: one compile of one size.
+ */
+typedef struct bench_result {
+  u64 lines;
+  f64 wall_ms;
+  u64 peak_rss_kib;
+  f64 phase_ms[PHASE_COUNT];
+} bench_result;
+
+/*
+ * @brief: current monotonic time in seconds.
+ */
+static f64 now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (f64)ts.tv_sec + (f64)ts.tv_nsec / 1e9;
+}
+
+/*
+ * @brief: run a command in a directory with its stdout captured.
+ *
+ * @param out: buffer for the output, null terminated
+ * @param usage: resources used by the command
+ *
+ * @return: whether it exited with status 0
+ */
+static bool run(char *argv[], const char *dir, char *out, u64 out_len,
+                struct rusage *usage) {
+  int fds[2];
+  if (pipe(fds) != 0)
+    return false;
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    dup2(fds[1], STDOUT_FILENO);
+    close(fds[0]);
+    close(fds[1]);
+    if (dir && chdir(dir) != 0)
+      _exit(127);
+    execv(argv[0], argv);
+    _exit(127);
+  }
+  close(fds[1]);
+
+  u64 len = 0;
+  ssize_t n;
+  while ((n = read(fds[0], out + len, out_len - len - 1)) > 0)
+    len += n;
+  out[len] = '\0';
+  close(fds[0]);
+
+  int status;
+  if (wait4(pid, &status, 0, usage) < 0)
+    return false;
+
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/*
+ * @brief: read the phase times from the "total" row of -ftime-report.
+ */
+static bool parse_report(const char *report, f64 phase_ms[PHASE_COUNT]) {
+  const char *row = strstr(report, "  total ");
+  if (!row)
+    return false;
+
+  char *p = (char *)row + strlen("  total ");
+  for (u32 i = 0; i < PHASE_COUNT; i++) {
+    char *end;
+    phase_ms[i] = strtod(p, &end);
+    if (end == p)
+      return false;
+    p = end;
+  }
+
+  return true;
+}
+
+/*
+ * @brief: generate a program of about lines lines and compile it runs times,
+ * keeping the fastest compile.
+ */
+static bool bench_size(bench_result *result, u64 lines, u32 runs, char *sclc,
+                       char *gen, const char *lib) {
+  char dir[] = "/tmp/sclc_compile_bench.XXXXXX";
+  if (!mkdtemp(dir)) {
+    fprintf(stderr, "could not create a scratch directory\n");
+    return false;
+  }
+
+  static char out[1 << 16];
+  struct rusage usage;
+  bool ok = false;
+
+  char lines_arg[32];
+  snprintf(lines_arg, sizeof(lines_arg), "%lu", lines);
+  char *gen_argv[] = {gen, lines_arg, dir, NULL};
+
+  char io[PATH_MAX], io_link[PATH_MAX];
+  snprintf(io, sizeof(io), "%s/io.scl", lib);
+  snprintf(io_link, sizeof(io_link), "%s/io.scl", dir);
+
+  if (!run(gen_argv, NULL, out, sizeof(out), &usage) ||
+      symlink(io, io_link) != 0) {
+    fprintf(stderr, "could not generate a program of %lu lines\n", lines);
+    goto cleanup;
+  }
+
+  result->lines = strtoull(out, NULL, 10);
+  result->wall_ms = 0;
+
+  char *sclc_argv[] = {sclc, "-c",  "--no-cache", "-ftime-report",
+                       "-i", dir,   "gen.scl",    NULL};
+
+  for (u32 r = 0; r < runs; r++) {
+    f64 start = now();
+    if (!run(sclc_argv, dir, out, sizeof(out), &usage)) {
+      fprintf(stderr, "sclc failed on %lu lines:\n%s", lines, out);
+      goto cleanup;
+    }
+    f64 wall_ms = (now() - start) * 1e3;
+
+    f64 phase_ms[PHASE_COUNT];
+    if (!parse_report(out, phase_ms)) {
+      fprintf(stderr, "no time report from sclc\n");
+      goto cleanup;
+    }
+
+    if (r == 0 || wall_ms < result->wall_ms) {
+      result->wall_ms = wall_ms;
+      result->peak_rss_kib = (u64)usage.ru_maxrss;
+      memcpy(result->phase_ms, phase_ms, sizeof(phase_ms));
+    }
+  }
+
+  ok = true;
+
+cleanup:;
+  char cmd[PATH_MAX];
+  snprintf(cmd, sizeof(cmd), "rm -rf '%s'", dir);
+  if (system(cmd) != 0)
+    fprintf(stderr, "could not remove %s\n", dir);
+
+  return ok;
+}
+
+/*
+ * @brief: lines per second of a phase, 0 when it took no measurable time.
+ */
+static f64 lines_per_sec(u64 lines, f64 ms) {
+  return ms > 0 ? lines / ms * 1e3 : 0;
+}
+
+static void print_result(const bench_result *result) {
+  printf("  %9lu lines %10.1f ms %12.0f lines/s %9lu KiB peak RSS\n",
+         result->lines, result->wall_ms,
+         lines_per_sec(result->lines, result->wall_ms), result->peak_rss_kib);
+
+  for (u32 i = 0; i < PHASE_COUNT; i++) {
+    printf("    %-10s %10.1f ms %12.0f lines/s\n", time_phase_name(i),
+           result->phase_ms[i],
+           lines_per_sec(result->lines, result->phase_ms[i]));
+  }
+}
+
+/*
+ * @brief: write a result as one line of JSON.
+ */
+static void write_result(FILE *f, const bench_result *result) {
+  fprintf(f,
+          "{\"lines\": %lu, \"wall_ms\": %.3f, \"lines_per_sec\": %.1f, "
+          "\"peak_rss_kib\": %lu, \"phases\": {",
+          result->lines, result->wall_ms,
+          lines_per_sec(result->lines, result->wall_ms), result->peak_rss_kib);
+
+  for (u32 i = 0; i < PHASE_COUNT; i++) {
+    fprintf(f, "%s\"%s\": {\"ms\": %.3f, \"lines_per_sec\": %.1f}",
+            i ? ", " : "", time_phase_name(i), result->phase_ms[i],
+            lines_per_sec(result->lines, result->phase_ms[i]));
+  }
+
+  fprintf(f, "}}");
+}
+
+/*
+ * @brief: find the result for a size in results written by an earlier run.
+ */
+static bool read_baseline(const char *path, u64 lines, bench_result *result) {
+  FILE *f = fopen(path, "r");
+  if (!f)
+    return false;
+
+  char line[4096];
+  bool found = false;
+
+  while (!found && fgets(line, sizeof(line), f)) {
+    const char *p = strstr(line, "{\"lines\": ");
+    if (!p || strtoull(p + 10, NULL, 10) != lines)
+      continue;
+
+    result->lines = lines;
+    if (sscanf(strstr(line, "\"wall_ms\": "), "\"wall_ms\": %lf",
+               &result->wall_ms) != 1 ||
+        sscanf(strstr(line, "\"peak_rss_kib\": "), "\"peak_rss_kib\": %lu",
+               &result->peak_rss_kib) != 1)
+      continue;
+
+    found = true;
+    for (u32 i = 0; i < PHASE_COUNT && found; i++) {
+      char key[64];
+      snprintf(key, sizeof(key), "\"%s\": {\"ms\": ", time_phase_name(i));
+      const char *v = strstr(line, key);
+      found = v && sscanf(v + strlen(key), "%lf", &result->phase_ms[i]) == 1;
+    }
+  }
+
+  fclose(f);
+  return found;
+}
+
+/*
+ * @brief: change from the baseline in percent, positive when slower or
+ * larger.
+ */
+static f64 delta(f64 base, f64 value) {
+  return base > 0 ? (value - base) / base * 100 : 0;
+}
+
+static void print_comparison(const bench_result *base,
+                             const bench_result *result) {
+  printf("    vs baseline: wall %+.1f%%, peak RSS %+.1f%%",
+         delta(base->wall_ms, result->wall_ms),
+         delta(base->peak_rss_kib, result->peak_rss_kib));
+
+  for (u32 i = 0; i < PHASE_COUNT; i++) {
+    // phases that take next to no time only add noise
+    if (base->phase_ms[i] >= 1)
+      printf(", %s %+.1f%%", time_phase_name(i),
+             delta(base->phase_ms[i], result->phase_ms[i]));
+  }
+
+  printf("\n");
+}
+
+/*
+ * @brief: resolve a path before the benchmark leaves the current directory.
+ */
+static char *absolute(const char *path) {
+  char *resolved = realpath(path, NULL);
+  if (!resolved) {
+    fprintf(stderr, "not found: %s\n", path);
+    exit(1);
+  }
+  return resolved;
+}
+
+int main(int argc, char *argv[]) {
+  const char *sclc_path = "bin-release/sclc";
+  const char *gen_path = "bin/bench/scl_gen";
+  const char *lib_path = "lib";
+  const char *out_path = "bin/bench/results.json";
+  const char *baseline = NULL;
+  u32 runs = 1;
+
+  u64 sizes[64];
+  u32 count = 0;
+
+  for (int i = 1; i < argc; i++) {
+    bool has_value = i + 1 < argc;
+
+    if (strcmp(argv[i], "--sclc") == 0 && has_value)
+      sclc_path = argv[++i];
+    else if (strcmp(argv[i], "--gen") == 0 && has_value)
+      gen_path = argv[++i];
+    else if (strcmp(argv[i], "--lib") == 0 && has_value)
+      lib_path = argv[++i];
+    else if (strcmp(argv[i], "--runs") == 0 && has_value)
+      runs = (u32)atoi(argv[++i]);
+    else if (strcmp(argv[i], "--out") == 0 && has_value)
+      out_path = argv[++i];
+    else if (strcmp(argv[i], "--baseline") == 0 && has_value)
+      baseline = argv[++i];
+    else if (argv[i][0] != '-' && count < 64)
+      sizes[count++] = strtoull(argv[i], NULL, 10);
+    else {
+      fprintf(stderr, "unknown argument: %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  if (count == 0) {
+    u64 defaults[] = {1000, 10000, 100000, 1000000};
+    memcpy(sizes, defaults, sizeof(defaults));
+    count = 4;
+  }
+  if (runs == 0)
+    runs = 1;
+
+  char *sclc = absolute(sclc_path);
+  char *gen = absolute(gen_path);
+  char *lib = absolute(lib_path);
+
+  FILE *f = fopen(out_path, "w");
+  if (!f) {
+    fprintf(stderr, "could not write %s\n", out_path);
+    return 1;
+  }
+
+  printf("compile_bench: %s, best of %u run(s), -c --no-cache\n", sclc, runs);
+  fprintf(f, "{\"sclc\": \"%s\", \"runs\": %u, \"results\": [\n", sclc, runs);
+
+  int status = 0;
+  for (u32 i = 0; i < count; i++) {
+    bench_result result;
+    if (!bench_size(&result, sizes[i], runs, sclc, gen, lib)) {
+      status = 1;
+      break;
+    }
+
+    print_result(&result);
+    fprintf(f, "%s", i ? ",\n" : "");
+    write_result(f, &result);
+    fflush(stdout);
+
+    bench_result base;
+    if (baseline && read_baseline(baseline, result.lines, &base))
+      print_comparison(&base, &result);
+  }
+
+  fprintf(f, "\n]}\n");
+  fclose(f);
+  printf("results written to %s\n", out_path);
+
+  free(sclc);
+  free(gen);
+  free(lib);
+  return status;
+}
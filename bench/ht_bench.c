@@ -0,0 +1,97 @@
+/*
+ * ht_bench: measures insert and lookup throughput of the ht hash table with
+ * identifier shaped keys, similar to what the semantic analysis does.
+ *
+ * Usage: ht_bench [key_count] [lookup_rounds]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "common.h"
+#include "ds/ht.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * @brief: current monotonic time in seconds.
+ */
+static f64 now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (f64)ts.tv_sec + (f64)ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+  u64 key_count = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000;
+  u64 rounds = argc > 2 ? strtoull(argv[2], NULL, 10) : 2000;
+
+  char **keys = malloc(key_count * sizeof(char *));
+  char **misses = malloc(key_count * sizeof(char *));
+  for (u64 i = 0; i < key_count; i++) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "counter_%lu", i);
+    keys[i] = strdup(buf);
+    snprintf(buf, sizeof(buf), "missing_%lu", i);
+    misses[i] = strdup(buf);
+  }
+
+  // same shape as a variable, a name pointer plus a few fields
+  typedef struct {
+    char *name;
+    u64 stack_offset;
+    u32 type;
+  } value;
+
+  f64 start = now();
+  ht table;
+  ht_init(&table, sizeof(value));
+  for (u64 i = 0; i < key_count; i++) {
+    value v = {.name = keys[i], .stack_offset = i, .type = 0};
+    ht_insert(&table, keys[i], &v);
+  }
+  f64 insert_time = now() - start;
+
+  u64 found = 0;
+  start = now();
+  for (u64 r = 0; r < rounds; r++) {
+    for (u64 i = 0; i < key_count; i++) {
+      value *v = ht_search(&table, keys[i]);
+      found += v != NULL && v->stack_offset == i;
+    }
+  }
+  f64 hit_time = now() - start;
+
+  u64 missed = 0;
+  start = now();
+  for (u64 r = 0; r < rounds; r++) {
+    for (u64 i = 0; i < key_count; i++)
+      missed += ht_search(&table, misses[i]) == NULL;
+  }
+  f64 miss_time = now() - start;
+
+  ht_free(&table);
+
+  if (found != key_count * rounds || missed != key_count * rounds) {
+    fprintf(stderr, "ht_bench: wrong results (%lu found, %lu missed)\n",
+            found, missed);
+    return 1;
+  }
+
+  f64 lookups = (f64)(key_count * rounds);
+  printf("keys: %lu, lookups: %lu\n", key_count, key_count * rounds);
+  printf("insert: %8.2f Mops/s\n", (f64)key_count / insert_time / 1e6);
+  printf("hit:    %8.2f Mops/s\n", lookups / hit_time / 1e6);
+  printf("miss:   %8.2f Mops/s\n", lookups / miss_time / 1e6);
+
+  for (u64 i = 0; i < key_count; i++) {
+    free(keys[i]);
+    free(misses[i]);
+  }
+  free(keys);
+  free(misses);
+
+  return 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * lex_bench: measures lexer throughput on a generated source file of the given
+ * size, or on an existing .scl file.
+ *
+ * Usage: lex_bench [megabytes] [rounds] [file]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "common.h"
+#include "include_cache.h"
+#include "intern.h"
+#include "lexer.h"
+#include "scan.h"
+#include "source.h"
+#include "token.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * @brief: current monotonic time in seconds.
+ */
+static f64 now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (f64)ts.tv_sec + (f64)ts.tv_nsec / 1e9;
+}
+
+/*
+ * @brief: generate at least size bytes of scull source, a mix of functions,
+ * declarations, loops, calls, comments and literals with distinct names. The
+ * source is followed by SCAN_PADDING zero bytes, like a mapped file.
+ */
+static char *generate_source(u64 size, u64 *len) {
+  u64 capacity = size + 4096;
+  char *buf = malloc(capacity);
+  u64 pos = 0;
+
+  for (u64 i = 0; pos < size; i++) {
+    pos += snprintf(buf + pos, capacity - pos,
+                    "-- function number %lu\n"
+                    "fn compute_%lu(int a, int *ptr) : int {\n"
+                    "  int value_%lu = a * 2 + 17\n"
+                    "  int items_%lu[4] = [1, 2, 3, 4]\n"
+                    "  if value_%lu >= 100 then printf(\"big %%d\\n\", "
+                    "value_%lu)\n"
+                    "  while value_%lu < 1000 {\n"
+                    "    value_%lu = value_%lu + items_%lu[a %% 4] - 1\n"
+                    "  }\n"
+                    "  scanf(\"%%d\", &value_%lu)\n"
+                    "  return value_%lu\n"
+                    "}\n\n",
+                    i, i, i, i, i, i, i, i, i, i, i, i);
+
+    if (capacity - pos < 1024) {
+      capacity *= 2;
+      buf = realloc(buf, capacity);
+    }
+  }
+
+  memset(buf + pos, 0, SCAN_PADDING);
+
+  *len = pos;
+  return buf;
+}
+
+int main(int argc, char *argv[]) {
+  u64 megabytes = argc > 1 ? strtoull(argv[1], NULL, 10) : 8;
+  u64 rounds = argc > 2 ? strtoull(argv[2], NULL, 10) : 5;
+
+  char *source;
+  u64 source_len;
+  if (argc > 3)
+    source = scu_map_file(argv[3], &source_len);
+  else
+    source = generate_source(megabytes << 20, &source_len);
+
+  intern_init();
+  scan_init();
+
+  include_cache cache;
+  include_cache_init(&cache, ".");
+
+  u64 token_count = 0;
+  f64 best = 0, best_lines = 0;
+
+  for (u64 r = 0; r < rounds; r++) {
+    source_map sources;
+    source_map_init(&sources);
+    u32 file =
+        source_map_add_shared(&sources, "bench.scl", source, source_len);
+
+    token_stream tokens;
+    token_stream_init(&tokens, &sources, file, &cache);
+
+    f64 start = now();
+    u64 count = 0;
+    while (token_stream_next(&tokens).kind != TOKEN_END)
+      count++;
+    f64 elapsed = now() - start;
+
+    if (r == 0 || elapsed < best)
+      best = elapsed;
+    token_count = count + 1;
+
+    // first line lookup builds the line table of the whole file
+    start = now();
+    source_map_line(&sources, source_len);
+    elapsed = now() - start;
+
+    if (r == 0 || elapsed < best_lines)
+      best_lines = elapsed;
+
+    token_stream_free(&tokens);
+    source_map_free(&sources);
+  }
+
+  include_cache_free(&cache);
+  intern_free();
+  if (argc > 3)
+    scu_unmap_file(source, source_len);
+  else
+    free(source);
+
+  printf("input: %.2f MiB, tokens: %lu, token size: %zu bytes, scan: %s\n",
+         (f64)source_len / (1 << 20), token_count, sizeof(token),
+         scan_isa());
+  printf("lex:   %8.2f Mtokens/s %8.2f MiB/s (best of %lu)\n",
+         (f64)token_count / best / 1e6, (f64)source_len / best / (1 << 20),
+         rounds);
+  printf("lines: %8.2f MiB/s\n", (f64)source_len / best_lines / (1 << 20));
+
+  return 0;
+}
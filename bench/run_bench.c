@@ -0,0 +1,213 @@
+/*
+ * run_bench: compares the time to the first output of a program run with
+ * `sclc --run` (JIT in process) against compiling and linking it with sclc
+ * and then running the executable. Both compile with --no-cache, and the
+ * program reads its stdin from /dev/null.
+ *
+ * Usage: run_bench [runs] [file] [sclc] [include_dir]
+ */
+
+#define _GNU_SOURCE
+
+#include "common.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+extern char **environ;
+
+/*
+ * @brief: current monotonic time in seconds.
+ */
+static f64 now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (f64)ts.tv_sec + (f64)ts.tv_nsec / 1e9;
+}
+
+/*
+ * @brief: start a process reading /dev/null, its stdout going to out_fd (or
+ * /dev/null when out_fd is negative) and its stderr discarded.
+ */
+static pid_t spawn(char *argv[], int out_fd) {
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null",
+                                   O_RDONLY, 0);
+  if (out_fd >= 0)
+    posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+  else
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null",
+                                     O_WRONLY, 0);
+  posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null",
+                                   O_WRONLY, 0);
+
+  pid_t pid;
+  if (posix_spawn(&pid, argv[0], &actions, NULL, argv, environ) != 0) {
+    fprintf(stderr, "could not run %s\n", argv[0]);
+    exit(1);
+  }
+
+  posix_spawn_file_actions_destroy(&actions);
+  return pid;
+}
+
+/*
+ * @brief: wait for a process and check that it succeeded.
+ */
+static void reap(pid_t pid, const char *name) {
+  int status;
+  waitpid(pid, &status, 0);
+
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "%s failed\n", name);
+    exit(1);
+  }
+}
+
+/*
+ * @brief: run a command until it writes its first byte, then let it finish.
+ *
+ * @return: seconds from start to the first byte of output
+ */
+static f64 first_output(char *argv[], f64 start) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    fprintf(stderr, "could not create a pipe\n");
+    exit(1);
+  }
+
+  pid_t pid = spawn(argv, fds[1]);
+  close(fds[1]);
+
+  char buf[4096];
+  f64 first = 0;
+  ssize_t n;
+  while ((n = read(fds[0], buf, sizeof(buf))) > 0) {
+    if (first == 0)
+      first = now();
+  }
+  close(fds[0]);
+
+  reap(pid, argv[0]);
+
+  if (first == 0) {
+    fprintf(stderr, "%s printed nothing\n", argv[0]);
+    exit(1);
+  }
+
+  return first - start;
+}
+
+/*
+ * @brief: time to first output of sclc --run, in milliseconds.
+ */
+static f64 run_jit(char *argv[]) { return first_output(argv, now()) * 1e3; }
+
+/*
+ * @brief: time to first output of compiling, linking and running the
+ * executable, in milliseconds.
+ */
+static f64 run_compiled(char *argv[]) {
+  f64 start = now();
+  reap(spawn(argv, -1), argv[0]);
+
+  char *program[] = {"./input", NULL};
+  return first_output(program, start) * 1e3;
+}
+
+static int cmp_f64(const void *a, const void *b) {
+  f64 x = *(const f64 *)a, y = *(const f64 *)b;
+  return (x > y) - (x < y);
+}
+
+/*
+ * @brief: time runs of one way of running the program and print the median,
+ * mean and minimum.
+ *
+ * @return: median in milliseconds
+ */
+static f64 measure(const char *label, f64 (*run)(char *argv[]), char *argv[],
+                   u32 runs) {
+  f64 *times = malloc(runs * sizeof(f64));
+  f64 sum = 0;
+
+  // one untimed run to fault in the binaries
+  run(argv);
+
+  for (u32 i = 0; i < runs; i++) {
+    times[i] = run(argv);
+    sum += times[i];
+  }
+
+  qsort(times, runs, sizeof(f64), cmp_f64);
+  f64 median = times[runs / 2];
+
+  printf("  %-22s median %7.2f ms  mean %7.2f ms  min %7.2f ms\n", label,
+         median, sum / runs, times[0]);
+
+  free(times);
+  return median;
+}
+
+/*
+ * @brief: resolve a path before leaving the current directory.
+ */
+static char *absolute(const char *path) {
+  char *resolved = realpath(path, NULL);
+  if (!resolved) {
+    fprintf(stderr, "not found: %s\n", path);
+    exit(1);
+  }
+  return resolved;
+}
+
+int main(int argc, char *argv[]) {
+  u32 runs = argc > 1 ? (u32)atoi(argv[1]) : 20;
+  char *file = absolute(argc > 2 ? argv[2] : "examples/fizzbuzz.scl");
+  char *sclc = absolute(argc > 3 ? argv[3] : "bin/sclc");
+  char *include_dir = absolute(argc > 4 ? argv[4] : "lib");
+
+  if (runs == 0)
+    runs = 1;
+
+  // the executable is written to the current directory, so work in a
+  // scratch one
+  char dir[] = "/tmp/sclc_run_bench.XXXXXX";
+  if (!mkdtemp(dir) || chdir(dir) != 0) {
+    fprintf(stderr, "could not create a scratch directory\n");
+    return 1;
+  }
+
+  char cmd[PATH_MAX * 2];
+  snprintf(cmd, sizeof(cmd), "cp '%s' input.scl", file);
+  if (system(cmd) != 0)
+    return 1;
+
+  char *jit[] = {sclc, "--no-cache", "--run", "-i", include_dir, "input.scl",
+                 NULL};
+  char *compiled[] = {sclc, "--no-cache", "-i", include_dir, "input.scl",
+                      "-o", "input", NULL};
+
+  printf("run_bench: %s, %u runs, time to first output\n", file, runs);
+
+  f64 compiled_ms = measure("compile, link and run", run_compiled, compiled,
+                            runs);
+  f64 jit_ms = measure("sclc --run", run_jit, jit, runs);
+  printf("  speedup %.2fx\n", compiled_ms / jit_ms);
+
+  snprintf(cmd, sizeof(cmd), "rm -rf '%s'", dir);
+  system(cmd);
+
+  free(file);
+  free(sclc);
+  free(include_dir);
+  return 0;
+}
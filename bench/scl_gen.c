@@ -0,0 +1,248 @@
+/*
+ * scl_gen: generates a scull program of about the given number of lines, to
+ * benchmark the compiler on inputs of any size. The program is split between
+ * a main file and include files that it pulls in with -include, and is made
+ * of numbered functions with nested control flow, long expression chains,
+ * loops of every kind and matches. It compiles, links and runs (printing a
+ * checksum), so every phase of the compiler has work to do.
+ *
+ * Usage: scl_gen <lines> <dir> [includes]
+ *
+ * Writes <dir>/gen.scl and <dir>/gen_inc_<n>.scl, and prints the number of
+ * lines written. The files include io.scl, compile with -i <dir> after
+ * linking lib/io.scl there.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "common.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Lines of one generated function, roughly.
+ */
+#define GEN_FN_LINES 60
+
+/*
+ * Depth of the nested ifs and loops in every function.
+ */
+#define GEN_DEPTH 6
+
+/*
+ * Terms of the long expressions.
+ */
+#define GEN_CHAIN 16
+
+/*
+ * @struct gen_file: a file being written, with its line count.
+ */
+typedef struct gen_file {
+  FILE *f;
+  u64 lines;
+} gen_file;
+
+static void gen_open(gen_file *out, const char *path) {
+  out->f = fopen(path, "w");
+  out->lines = 0;
+  if (!out->f) {
+    fprintf(stderr, "could not write %s\n", path);
+    exit(1);
+  }
+}
+
+/*
+ * @brief: write one line, indented by depth levels.
+ */
+static void gen_line(gen_file *out, u32 depth, const char *fmt, ...) {
+  fprintf(out->f, "%*s", depth * 2, "");
+
+  va_list args;
+  va_start(args, fmt);
+  vfprintf(out->f, fmt, args);
+  va_end(args);
+
+  fputc('\n', out->f);
+  out->lines++;
+}
+
+/*
+ * @brief: write a chain of GEN_CHAIN terms over a and b, without a newline.
+ */
+static void gen_chain(gen_file *out, u64 seed) {
+  static const char ops[] = {'+', '-', '*', '+'};
+
+  fprintf(out->f, "(a + %lu)", seed % 97);
+  for (u32 t = 1; t < GEN_CHAIN; t++) {
+    u64 k = seed * 31 + t;
+    fprintf(out->f, " %c (%s %c %lu)", ops[k % 4], t % 2 ? "b" : "a",
+            t % 3 ? '*' : '+', k % 13 + 1);
+  }
+}
+
+/*
+ * @brief: write the nested part of a function: GEN_DEPTH levels of
+ * alternating ifs, whiles and fors, with work at every level. The loops run
+ * lim times.
+ */
+static void gen_nest(gen_file *out, u64 n, u32 level) {
+  u32 depth = level + 1;
+
+  if (level == GEN_DEPTH) {
+    gen_line(out, depth, "acc = acc + %lu", n % 5 + 1);
+    return;
+  }
+
+  switch (level % 3) {
+  case 0:
+    // conditions compare terms, not expressions
+    gen_line(out, depth, "int m%u = acc %% %u", level, level + 2);
+    gen_line(out, depth, "if m%u == %lu {", level, n % (level + 2));
+    gen_nest(out, n, level + 1);
+    gen_line(out, depth, "} else {");
+    gen_line(out, depth + 1, "acc = acc - %u", level + 1);
+    gen_line(out, depth, "}");
+    break;
+  case 1:
+    gen_line(out, depth, "int w%u = 0", level);
+    gen_line(out, depth, "while w%u < lim {", level);
+    gen_nest(out, n, level + 1);
+    gen_line(out, depth + 1, "w%u = w%u + 1", level, level);
+    gen_line(out, depth, "}");
+    break;
+  default:
+    gen_line(out, depth, "for i%u in 1...lim {", level);
+    gen_line(out, depth + 1, "acc = acc + i%u", level);
+    gen_nest(out, n, level + 1);
+    gen_line(out, depth, "}");
+    break;
+  }
+}
+
+/*
+ * @brief: write function number n. Every function but the first calls the
+ * one before it, so none of them is dead code.
+ */
+static void gen_function(gen_file *out, u64 n) {
+  gen_line(out, 0, "-- generated function %lu", n);
+  gen_line(out, 0, "fn f%lu(int a, int b) : int {", n);
+  gen_line(out, 1, "int acc = a %% 1000");
+  // trip counts the optimizer cannot see, or it unrolls the nest fully
+  gen_line(out, 1, "int lim = b %% 3");
+
+  fprintf(out->f, "  int chain = ");
+  gen_chain(out, n);
+  gen_line(out, 0, "");
+
+  gen_line(out, 1, "int values[8] = {%lu, %lu, 3, 4, 5, 6, 7, 8}", n % 11,
+           n % 7);
+  gen_line(out, 1, "int k = 0");
+  gen_line(out, 1, "while k < 8 {");
+  gen_line(out, 2, "values[k] = values[k] * 2 + chain %% 17");
+  gen_line(out, 2, "k = k + 1");
+  gen_line(out, 1, "}");
+
+  gen_nest(out, n, 0);
+
+  gen_line(out, 1, "match b %% 6 {");
+  gen_line(out, 2, "0 => acc = acc + values[1]");
+  gen_line(out, 2, "1 => acc = acc - values[2]");
+  gen_line(out, 2, "2...3 => {");
+  gen_line(out, 3, "acc = acc * 2");
+  gen_line(out, 3, "acc = acc %% 100003");
+  gen_line(out, 2, "}");
+  gen_line(out, 2, "_ => acc = acc + chain %% 31");
+  gen_line(out, 1, "}");
+
+  gen_line(out, 1, "int n = 0");
+  gen_line(out, 1, "loop {");
+  gen_line(out, 2, "n = n + 1");
+  gen_line(out, 2, "if n > 3 {");
+  gen_line(out, 3, "break");
+  gen_line(out, 2, "}");
+  gen_line(out, 2, "acc = acc + n");
+  gen_line(out, 1, "}");
+
+  gen_line(out, 1, "dowhile {");
+  gen_line(out, 2, "n = n - 1");
+  gen_line(out, 1, "} n > 0");
+
+  gen_line(out, 1, "acc = acc %% 1000003");
+  if (n > 0)
+    gen_line(out, 1, "acc = acc + f%lu(a + 1, b + acc %% 5) %% 7", n - 1);
+  gen_line(out, 1, "return acc");
+  gen_line(out, 0, "}");
+  gen_line(out, 0, "");
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s <lines> <dir> [includes]\n", argv[0]);
+    return 1;
+  }
+
+  u64 lines = strtoull(argv[1], NULL, 10);
+  const char *dir = argv[2];
+  u32 includes = argc > 3 ? (u32)atoi(argv[3]) : 16;
+
+  u64 functions = lines / GEN_FN_LINES;
+  if (functions == 0)
+    functions = 1;
+  if (includes > functions / 2)
+    includes = functions / 2;
+
+  char path[4096];
+  u64 total = 0;
+
+  // the first half of the functions goes to the include files, in order,
+  // so that every function is defined before it is called
+  u64 included = includes ? functions / 2 : 0;
+  u64 per_include = includes ? (included + includes - 1) / includes : 0;
+
+  for (u32 i = 0; i < includes; i++) {
+    gen_file inc;
+    snprintf(path, sizeof(path), "%s/gen_inc_%u.scl", dir, i);
+    gen_open(&inc, path);
+
+    gen_line(&inc, 0, "-* generated include %u *-", i);
+    gen_line(&inc, 0, "-include \"io.scl\"");
+    if (i > 0)
+      gen_line(&inc, 0, "-include \"gen_inc_%u.scl\"", i - 1);
+    for (u64 n = i * per_include; n < (i + 1) * per_include && n < included;
+         n++)
+      gen_function(&inc, n);
+
+    total += inc.lines;
+    fclose(inc.f);
+  }
+
+  gen_file out;
+  snprintf(path, sizeof(path), "%s/gen.scl", dir);
+  gen_open(&out, path);
+
+  gen_line(&out, 0, "-include \"io.scl\"");
+  for (u32 i = 0; i < includes; i++)
+    gen_line(&out, 0, "-include \"gen_inc_%u.scl\"", i);
+  gen_line(&out, 0, "");
+
+  for (u64 n = included; n < functions; n++)
+    gen_function(&out, n);
+
+  gen_line(&out, 0, "fn main() : int {");
+  gen_line(&out, 1, "int sum = 0");
+  for (u64 n = 0; n < functions; n += functions / 64 + 1)
+    gen_line(&out, 1, "sum = (sum + f%lu(%lu, %lu)) %% 1000003", n, n % 10,
+             n % 6);
+  gen_line(&out, 1, "sum = (sum + f%lu(1, 2)) %% 1000003", functions - 1);
+  gen_line(&out, 1, "printf(\"%%d\\n\", sum)");
+  gen_line(&out, 1, "return 0");
+  gen_line(&out, 0, "}");
+
+  total += out.lines;
+  fclose(out.f);
+
+  printf("%lu\n", total);
+  return 0;
+}
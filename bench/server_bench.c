@@ -0,0 +1,181 @@
+/*
+ * server_bench: compares the latency of compiling a file with a fresh sclc
+ * (cold) and through sclc-client and a running `sclc --server` (warm). Both
+ * compile with -c and --no-cache, so every run does the whole pipeline.
+ *
+ * Usage: server_bench [runs] [file] [sclc] [sclc-client] [include_dir]
+ */
+
+#define _GNU_SOURCE
+
+#include "common.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+extern char **environ;
+
+/*
+ * @brief: current monotonic time in seconds.
+ */
+static f64 now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (f64)ts.tv_sec + (f64)ts.tv_nsec / 1e9;
+}
+
+/*
+ * @brief: start a process with stdout and stderr discarded.
+ */
+static pid_t spawn(char *argv[]) {
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null",
+                                   O_WRONLY, 0);
+  posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null",
+                                   O_WRONLY, 0);
+
+  pid_t pid;
+  if (posix_spawn(&pid, argv[0], &actions, NULL, argv, environ) != 0) {
+    fprintf(stderr, "could not run %s\n", argv[0]);
+    exit(1);
+  }
+
+  posix_spawn_file_actions_destroy(&actions);
+  return pid;
+}
+
+/*
+ * @brief: run a command to completion.
+ *
+ * @return: wall time in milliseconds
+ */
+static f64 run(char *argv[]) {
+  f64 start = now();
+
+  int status;
+  waitpid(spawn(argv), &status, 0);
+
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "%s failed\n", argv[0]);
+    exit(1);
+  }
+
+  return (now() - start) * 1e3;
+}
+
+static int cmp_f64(const void *a, const void *b) {
+  f64 x = *(const f64 *)a, y = *(const f64 *)b;
+  return (x > y) - (x < y);
+}
+
+/*
+ * @brief: time runs of a command and print the median, mean and minimum.
+ *
+ * @return: median in milliseconds
+ */
+static f64 measure(const char *label, char *argv[], u32 runs) {
+  f64 *times = malloc(runs * sizeof(f64));
+  f64 sum = 0;
+
+  // one untimed run to fault in the binaries
+  run(argv);
+
+  for (u32 i = 0; i < runs; i++) {
+    times[i] = run(argv);
+    sum += times[i];
+  }
+
+  qsort(times, runs, sizeof(f64), cmp_f64);
+  f64 median = times[runs / 2];
+
+  printf("  %-20s median %7.2f ms  mean %7.2f ms  min %7.2f ms\n", label,
+         median, sum / runs, times[0]);
+
+  free(times);
+  return median;
+}
+
+/*
+ * @brief: resolve a path before leaving the current directory.
+ */
+static char *absolute(const char *path) {
+  char *resolved = realpath(path, NULL);
+  if (!resolved) {
+    fprintf(stderr, "not found: %s\n", path);
+    exit(1);
+  }
+  return resolved;
+}
+
+int main(int argc, char *argv[]) {
+  u32 runs = argc > 1 ? (u32)atoi(argv[1]) : 50;
+  char *file = absolute(argc > 2 ? argv[2] : "examples/arrays.scl");
+  char *sclc = absolute(argc > 3 ? argv[3] : "bin/sclc");
+  char *client = absolute(argc > 4 ? argv[4] : "bin/sclc-client");
+  char *include_dir = absolute(argc > 5 ? argv[5] : "lib");
+
+  if (runs == 0)
+    runs = 1;
+
+  // objects are written next to the source, so compile a copy in a scratch
+  // directory
+  char dir[] = "/tmp/sclc_server_bench.XXXXXX";
+  if (!mkdtemp(dir) || chdir(dir) != 0) {
+    fprintf(stderr, "could not create a scratch directory\n");
+    return 1;
+  }
+
+  char cmd[PATH_MAX * 2];
+  snprintf(cmd, sizeof(cmd), "cp '%s' input.scl", file);
+  if (system(cmd) != 0)
+    return 1;
+
+  char *socket_path = "server.sock";
+
+  char *cold[] = {sclc,        "--no-cache", "-c", "-i",
+                  include_dir, "input.scl",  NULL};
+  char *warm[] = {client, "--socket",  socket_path, "--no-cache", "-c",
+                  "-i",   include_dir, "input.scl", NULL};
+  char *server[] = {sclc, "--server", "--socket", socket_path, NULL};
+
+  pid_t server_pid = spawn(server);
+
+  // wait for the server to listen
+  struct stat st;
+  for (u32 i = 0; i < 500 && stat(socket_path, &st) != 0; i++)
+    usleep(10000);
+
+  // otherwise sclc-client would quietly fall back to a cold sclc
+  if (stat(socket_path, &st) != 0) {
+    fprintf(stderr, "the server did not start\n");
+    return 1;
+  }
+
+  printf("server_bench: %s, %u runs, -c --no-cache\n", file, runs);
+
+  f64 cold_ms = measure("cold (sclc)", cold, runs);
+  f64 warm_ms = measure("warm (sclc-client)", warm, runs);
+  printf("  speedup %.2fx\n", cold_ms / warm_ms);
+
+  kill(server_pid, SIGTERM);
+  waitpid(server_pid, NULL, 0);
+
+  snprintf(cmd, sizeof(cmd), "rm -rf '%s'", dir);
+  system(cmd);
+
+  free(file);
+  free(sclc);
+  free(client);
+  free(include_dir);
+  return 0;
+}
@@ -0,0 +1,47 @@
+/*
+ * sclc-client: thin client of `sclc --server`.
+ *
+ * Forwards its command line to the server, so a build pays for neither
+ * loading LLVM nor initializing the targets. Takes the same options as sclc
+ * (plus --socket) and falls back to running the sclc next to it when no
+ * server is listening.
+ *
+ * Usage: sclc-client [OPTIONS] <input_files>
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "server.h"
+#include "utils.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+int main(int argc, char *argv[]) {
+  char *socket_path = server_socket_path(argc, argv);
+  int status = server_forward(socket_path, argc, argv);
+  free(socket_path);
+
+  if (status >= 0)
+    return status;
+
+  // no server, compile with the sclc installed along with this client
+  char self[PATH_MAX];
+  ssize_t len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+  if (len > 0) {
+    self[len] = '\0';
+    char *slash = strrchr(self, '/');
+    char *sclc = scu_format_string("%.*s/sclc", (int)(slash - self), self);
+    argv[0] = sclc;
+    execv(sclc, argv);
+    free(sclc);
+  }
+
+  argv[0] = "sclc";
+  execvp("sclc", argv);
+
+  scu_perror("No server is listening and sclc could not be run\n");
+  return 1;
+}
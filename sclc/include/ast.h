@@ -1,11 +1,19 @@
 /*
  * ast: Abstract Syntax Tree implementation and node definitions.
+ *
+ * Expressions, terms and instructions are kept in a contiguous pool per kind
+ * and refer to each other by 32-bit index, as do the payloads of the large
+ * instructions (array literals, control flow, functions) and the parameters
+ * of functions. Index 0 of every pool is a null node, so a zeroed id means no
+ * node. Lists of children (blocks of instructions, arguments, elements, else
+ * ifs, match cases, parameters, return types) are ranges of ids in the shared
+ * extra array. An ast holds no pointers into itself and can be moved; string
+ * literals point into the source_map of the file.
  */
 
 #ifndef AST
 #define AST
 
-#include "ds/arena.h"
 #include "ds/dynamic_array.h"
 #include "token.h"
 #include "var.h"
@@ -29,14 +37,34 @@ typedef enum term_kind {
   TERM_FUNCTION_CALL,
 } term_kind;
 
-typedef struct expr_node expr_node;
+/*
+ * Indices of nodes in the pools of an ast.
+ */
+typedef u32 expr_id;
+typedef u32 term_id;
+typedef u32 instr_id;
+typedef u32 array_init_id;
+typedef u32 if_id;
+typedef u32 match_id;
+typedef u32 case_id;
+typedef u32 loop_id;
+typedef u32 fn_id;
+typedef u32 var_id;
+
+/*
+ * @struct node_list: a list of node ids, stored in the extra array of an ast.
+ */
+typedef struct node_list {
+  u32 start;
+  u32 count;
+} node_list;
 
 /*
  * @struct array_access_node: represents an array access or subscript node.
  */
 typedef struct array_access_node {
   variable array_var;
-  expr_node *index_expr;
+  expr_id index_expr;
 } array_access_node;
 
 /*
@@ -44,14 +72,24 @@ typedef struct array_access_node {
  * declare and define arrays.
  */
 typedef struct array_literal_node {
-  dynamic_array elements;
+  node_list elements; // expr_id
 } array_literal_node;
 
 typedef struct fn_call_node {
-  char *name;
-  dynamic_array parameters;
+  sym_id name;
+  node_list parameters; // expr_id
 } fn_call_node;
 
+/*
+ * @union literal_value: holds the value of a literal term. String literals
+ * point into the string table of the file's source_map.
+ */
+typedef union literal_value {
+  u32 integer;
+  char character;
+  char *str;
+} literal_value;
+
 /*
  * @struct term_node: represents a term.
  */
@@ -59,7 +97,7 @@ typedef struct term_node {
   term_kind kind;
   u64 line;
   union {
-    token_literal_value value;
+    literal_value value;
     variable identifier;
     array_access_node array_access;
     array_literal_node array_literal;
@@ -71,8 +109,8 @@ typedef struct term_node {
  * @struct term_binary_node: represents a binary term.
  */
 typedef struct term_binary_node {
-  term_node lhs;
-  term_node rhs;
+  term_id lhs;
+  term_id rhs;
 } term_binary_node;
 
 /*
@@ -94,10 +132,10 @@ typedef struct expr_node {
   expr_kind kind;
   u64 line;
   union {
-    term_node term;
+    term_id term;
     struct {
-      struct expr_node *left;
-      struct expr_node *right;
+      expr_id left;
+      expr_id right;
     } binary;
   };
 } expr_node;
@@ -157,29 +195,29 @@ typedef struct instr_node instr_node;
 
 typedef struct initialize_variable_node {
   variable var;
-  expr_node *expr;
+  expr_id expr;
 } initialize_variable_node;
 
 typedef struct declare_array_node {
   variable var;
-  expr_node *size_expr;
+  expr_id size_expr;
 } declare_array_node;
 
 typedef struct initialize_array_node {
   variable var;
-  expr_node *size_expr;
+  expr_id size_expr;
   array_literal_node literal;
 } initialize_array_node;
 
 typedef struct assign_node {
   variable identifier;
-  expr_node *expr;
+  expr_id expr;
 } assign_node;
 
 typedef struct assign_to_array_subscript_node {
   variable var;
-  expr_node *index_expr;
-  expr_node *expr_to_assign;
+  expr_id index_expr;
+  expr_id expr_to_assign;
 } assign_to_array_subscript_node;
 
 typedef enum cond_block_kind {
@@ -191,17 +229,23 @@ typedef struct cond_block_node {
   cond_block_kind kind;
 
   union {
-    instr_node *single;
-    dynamic_array multi;
+    instr_id single;
+    node_list multi; // instr_id
   };
 } cond_block_node;
 
+/*
+ * @struct if_node: an if, the else ifs are if_nodes without else ifs or else
+ * of their own.
+ */
 typedef struct if_node {
   rel_node rel;
 
   cond_block_node then;
-  dynamic_array else_ifs;
-  cond_block_node *else_;
+  node_list else_ifs; // if_id
+
+  bool has_else;
+  cond_block_node else_;
 } if_node;
 
 typedef enum match_case_kind {
@@ -211,12 +255,12 @@ typedef enum match_case_kind {
 } match_case_kind;
 
 typedef struct match_case_values_node {
-  dynamic_array values;
+  node_list values; // expr_id
 } match_case_values_node;
 
 typedef struct match_case_range_node {
-  expr_node *start;
-  expr_node *end;
+  expr_id start;
+  expr_id end;
 } match_case_range_node;
 
 typedef struct match_case_node {
@@ -231,16 +275,16 @@ typedef struct match_case_node {
 } match_case_node;
 
 typedef struct match_node {
-  expr_node *expr;
-  dynamic_array cases;
+  expr_id expr;
+  node_list cases; // case_id
 } match_node;
 
 typedef struct goto_node {
-  const char *label;
+  sym_id label;
 } goto_node;
 
 typedef struct label_node {
-  const char *label;
+  sym_id label;
 } label_node;
 
 typedef enum loop_kind {
@@ -253,8 +297,7 @@ typedef enum loop_kind {
 typedef struct loop_node {
   loop_kind kind;
 
-  ht *variables;
-  dynamic_array instrs;
+  node_list instrs; // instr_id
 
   union {
     struct {
@@ -267,8 +310,8 @@ typedef struct loop_node {
 
     struct {
       variable iterator;
-      expr_node *range_start;
-      expr_node *range_end;
+      expr_id range_start;
+      expr_id range_end;
     } _for;
   };
 } loop_node;
@@ -279,32 +322,34 @@ typedef enum fn_kind {
 } fn_kind;
 
 typedef struct fn_node {
-  char *name;
+  sym_id name;
   fn_kind kind;
-  dynamic_array returntypes;
+  node_list returntypes; // type
 
   bool is_variadic;
-  dynamic_array parameters;
+  node_list parameters; // var_id
 
   union {
     struct {
-      ht *variables;
-      dynamic_array instrs;
+      node_list instrs; // instr_id
     } defined;
 
     struct {
       // JUST A PLACEHOLDER, MIGHT APPEAR IN WARNINGS
-      u8 *placeholder_buffer;
+      u8 placeholder_buffer;
     } declared;
   };
 } fn_node;
 
 typedef struct return_node {
-  dynamic_array returnvals;
+  node_list returnvals; // expr_id
 } return_node;
 
 /*
  * @struct instr_node: represents an instruction. (definition)
+ *
+ * The large variants (arrays with literals, control flow and functions) live
+ * in pools of their own and only their id is kept here.
  */
 typedef struct instr_node {
   instr_kind kind;
@@ -313,34 +358,190 @@ typedef struct instr_node {
     variable declare_variable;
     initialize_variable_node initialize_variable;
     declare_array_node declare_array;
-    initialize_array_node initialize_array;
+    array_init_id initialize_array;
     assign_node assign;
     assign_to_array_subscript_node assign_to_array_subscript;
-    if_node if_;
-    match_node match;
+    if_id if_;
+    match_id match;
     goto_node goto_;
     label_node label;
-    loop_node loop;
-    fn_node fn_define_node;
-    fn_node fn_declare_node;
+    loop_id loop;
+    fn_id fn_define_node;
+    fn_id fn_declare_node;
     return_node ret_node;
     fn_call_node fn_call;
   };
 } instr_node;
 
+_Static_assert(sizeof(instr_node) <= 64, "instr_node should stay 64 bytes");
+_Static_assert(sizeof(expr_node) <= 24, "expr_node should stay 24 bytes");
+
 /*
  * @struct ast: Contains the abstract syntax tree for a compilation unit.
  */
 typedef struct ast {
-  mem_arena arena;
-  dynamic_array instrs;
+  /*
+   * Node pools and the lists of ids.
+   */
+  dynamic_array exprs;  // expr_node
+  dynamic_array terms;  // term_node
+  dynamic_array instrs; // instr_node
+  dynamic_array extra;  // u32
+
+  /*
+   * Payload pools of the large instructions, and the parameters of functions.
+   */
+  dynamic_array array_inits; // initialize_array_node
+  dynamic_array ifs;         // if_node
+  dynamic_array matches;     // match_node
+  dynamic_array cases;       // match_case_node
+  dynamic_array loops;       // loop_node
+  dynamic_array fns;         // fn_node
+  dynamic_array vars;        // variable
+
+  /*
+   * Top level instructions of the compilation unit.
+   */
+  node_list body; // instr_id
 } ast;
 
+/*
+ * @struct fn_ref: a function and the ast it belongs to, how the function
+ * tables refer to functions of other asts (the inputs of --repl).
+ */
+typedef struct fn_ref {
+  ast *program;
+  fn_id fn;
+} fn_ref;
+
 /*
  * @brief: initializes an ast struct.
  */
 void ast_init(ast *a);
 
+/*
+ * @brief: add an expression to the pool of an ast.
+ *
+ * @param a: pointer to an initialized ast
+ * @param expr: pointer to the node (will be copied)
+ *
+ * @return: id of the node
+ */
+expr_id ast_add_expr(ast *a, expr_node *expr);
+
+/*
+ * @brief: add a term to the pool of an ast.
+ *
+ * @param a: pointer to an initialized ast
+ * @param term: pointer to the node (will be copied)
+ *
+ * @return: id of the node
+ */
+term_id ast_add_term(ast *a, term_node *term);
+
+/*
+ * @brief: add an instruction to the pool of an ast.
+ *
+ * @param a: pointer to an initialized ast
+ * @param instr: pointer to the node (will be copied)
+ *
+ * @return: id of the node
+ */
+instr_id ast_add_instr(ast *a, instr_node *instr);
+
+/*
+ * @brief: add the payload of a large instruction, or a parameter, to its pool
+ * in an ast.
+ *
+ * @param a: pointer to an initialized ast
+ * @param node: pointer to the payload (will be copied)
+ *
+ * @return: id of the payload
+ */
+array_init_id ast_add_array_init(ast *a, initialize_array_node *node);
+if_id ast_add_if(ast *a, if_node *node);
+match_id ast_add_match(ast *a, match_node *node);
+case_id ast_add_case(ast *a, match_case_node *node);
+loop_id ast_add_loop(ast *a, loop_node *node);
+fn_id ast_add_fn(ast *a, fn_node *node);
+var_id ast_add_var(ast *a, variable *node);
+
+/*
+ * @brief: add a list of node ids to the extra array of an ast.
+ *
+ * @param a: pointer to an initialized ast
+ * @param ids: the ids (will be copied)
+ * @param count: number of ids
+ *
+ * @return: the list
+ */
+node_list ast_add_list(ast *a, const u32 *ids, u32 count);
+
+/*
+ * Pointers to nodes, valid until a node of the same kind is added.
+ */
+static inline expr_node *ast_expr(ast *a, expr_id id) {
+  return (expr_node *)a->exprs.items + id;
+}
+
+static inline term_node *ast_term(ast *a, term_id id) {
+  return (term_node *)a->terms.items + id;
+}
+
+static inline instr_node *ast_instr(ast *a, instr_id id) {
+  return (instr_node *)a->instrs.items + id;
+}
+
+static inline initialize_array_node *ast_array_init(ast *a,
+                                                    array_init_id id) {
+  return (initialize_array_node *)a->array_inits.items + id;
+}
+
+static inline if_node *ast_if(ast *a, if_id id) {
+  return (if_node *)a->ifs.items + id;
+}
+
+static inline match_node *ast_match(ast *a, match_id id) {
+  return (match_node *)a->matches.items + id;
+}
+
+static inline match_case_node *ast_case(ast *a, case_id id) {
+  return (match_case_node *)a->cases.items + id;
+}
+
+static inline loop_node *ast_loop(ast *a, loop_id id) {
+  return (loop_node *)a->loops.items + id;
+}
+
+static inline fn_node *ast_fn(ast *a, fn_id id) {
+  return (fn_node *)a->fns.items + id;
+}
+
+static inline variable *ast_var(ast *a, var_id id) {
+  return (variable *)a->vars.items + id;
+}
+
+/*
+ * @brief: get the ids of a list, valid until a list is added.
+ */
+static inline u32 *ast_list(ast *a, node_list list) {
+  return (u32 *)a->extra.items + list.start;
+}
+
+/*
+ * @brief: get the i-th parameter of a function.
+ */
+static inline variable *ast_param(ast *a, fn_node *fn, u32 i) {
+  return ast_var(a, ast_list(a, fn->parameters)[i]);
+}
+
+/*
+ * @brief: get the i-th return type of a function.
+ */
+static inline type ast_returntype(ast *a, fn_node *fn, u32 i) {
+  return (type)ast_list(a, fn->returntypes)[i];
+}
+
 /*
  * @brief: Frees all memory associated with an ast.
  *
@@ -351,9 +552,10 @@ void ast_free(ast *program_ast);
 /*
  * @brief: prints all information about a single instruction.
  *
- * @param program: pointer to an instruction node
+ * @param program_ast: pointer to the ast of the instruction
+ * @param instr: pointer to an instruction node
  */
-void print_instr(instr_node *instr);
+void print_instr(ast *program_ast, instr_node *instr);
 
 /*
  * @brief: prints all the information about the whole AST (all instructions).
@@ -20,6 +20,11 @@ typedef struct backend {
   void (*cleanup)(cstate *cst, fstate *fst);  // cleanup file specific resources
 
   void (*link)(cstate *cst); // link all object files
+  int (*run)(cstate *cst);   // run the program in process, returns its status
+
+  bool (*eval)(cstate *cst, fstate *fst); // add a compiled --repl input to the
+                                          // session and run its statements
+  void (*eval_end)(cstate *cst);          // end the --repl session
 } backend;
 
 /*
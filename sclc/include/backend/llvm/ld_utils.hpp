@@ -1,20 +1,58 @@
 /*
  * ld_utils: contains functions for the ld.lld linker
+ *
+ * When sclc is built with lld (SCLC_HAVE_LLD), executables are linked in
+ * process by lld's ELF driver, against the C runtime found by ld_find_libc.
+ * Otherwise, or when asked to (--link-cc), objects are linked by running cc.
+ * lld runs one link at a time, and is left for cc once it reports that it
+ * cannot run again.
  */
 
 #ifndef LD_UTILS
 #define LD_UTILS
 
+#include <string>
 #include <vector>
 
+/*
+ * @struct ld_libc: where the pieces of the C runtime a program links against
+ * are.
+ */
+struct ld_libc {
+  std::string crt_dir;        // Scrt1.o, crti.o, crtn.o and libc
+  std::string gcc_dir;        // crtbeginS.o, crtendS.o and libgcc, optional
+  std::string dynamic_linker; // interpreter of the executable
+};
+
+/*
+ * @brief: look for the C runtime in the usual places of x86_64 Linux
+ * distributions (multiarch and lib64 layouts).
+ *
+ * @param libc: filled in with what was found.
+ *
+ * @return: whether the start files, libc and the dynamic linker were found.
+ */
+bool ld_find_libc(ld_libc &libc);
+
 /*
  * @brief: helper function to link the generated output object file to an
  * executable binary.
  *
  * @param output_file: name to be given to the output executable binary.
  * @param obj_files: vector of object files to be linked.
+ * @param use_cc: link by running cc, even when lld is built in.
  */
 void ld_link(const char *output_file,
-             const std::vector<const char *> &obj_files);
+             const std::vector<const char *> &obj_files, bool use_cc);
+
+/*
+ * @brief: combine object files into one relocatable object file (ld -r).
+ *
+ * @param output_file: path of the combined object file.
+ * @param obj_files: vector of object files to be combined, in order.
+ * @param use_cc: run cc, even when lld is built in.
+ */
+void ld_relocatable(const char *output_file,
+                    const std::vector<const char *> &obj_files, bool use_cc);
 
 #endif // !LD_UTILS
@@ -59,6 +59,37 @@ void llvm_backend_cleanup(cstate *cst, fstate *fst);
  */
 void llvm_backend_link(cstate *cst);
 
+/*
+ * @brief: JITs the compiled modules and calls main in process (--run).
+ * Functions are compiled as they are first called, and the C library is
+ * resolved from the compiler's own process.
+ *
+ * @param cst: Pointer to compiler state containing global compilation context
+ *
+ * @return: exit status of the program
+ */
+int llvm_backend_run(cstate *cst);
+
+/*
+ * @brief: adds an input of --repl, compiled by llvm_backend_compile, to the
+ * session's JIT and runs its top level statements. Top level variables are
+ * kept in globals of the session between inputs.
+ *
+ * @param cst: Pointer to compiler state containing global compilation context
+ * @param fst: Pointer to file state of the input
+ *
+ * @return: whether the input was added to the session
+ */
+bool llvm_backend_eval(cstate *cst, fstate *fst);
+
+/*
+ * @brief: ends the --repl session, freeing its JIT and everything it
+ * compiled.
+ *
+ * @param cst: Pointer to compiler state containing global compilation context
+ */
+void llvm_backend_eval_end(cstate *cst);
+
 #ifdef __cplusplus
 }
 #endif
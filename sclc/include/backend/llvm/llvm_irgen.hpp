@@ -7,14 +7,51 @@
 
 extern "C" {
 #include "ast.h"
+#include "intern.h"
 }
 
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/Target/TargetMachine.h>
 
+#include <algorithm>
+#include <string>
+#include <vector>
+
 /*
- * @struct llvm_backend_ctx: LLVM backend context containing IR generation state
+ * @struct llvm_sym_table: maps symbol ids to LLVM objects, stored as an array
+ * indexed by the id. The ids that were set are remembered, so clearing the
+ * table between functions only touches those.
+ */
+template <typename T> struct llvm_sym_table {
+  std::vector<T *> slots;
+  std::vector<sym_id> used;
+
+  T *get(sym_id id) const { return id < slots.size() ? slots[id] : nullptr; }
+
+  void set(sym_id id, T *value) {
+    if (id >= slots.size())
+      slots.resize(std::max<size_t>(id + 1, slots.size() * 2), nullptr);
+    if (!slots[id])
+      used.push_back(id);
+    slots[id] = value;
+  }
+
+  void erase(sym_id id) {
+    if (id < slots.size())
+      slots[id] = nullptr;
+  }
+
+  void clear() {
+    for (sym_id id : used)
+      slots[id] = nullptr;
+    used.clear();
+  }
+};
+
+/*
+ * @struct llvm_backend_ctx: LLVM backend context containing IR generation
+ * state. One is created per file so that files can be compiled in parallel.
  */
 typedef struct llvm_backend_ctx {
   llvm::LLVMContext *context;
@@ -22,12 +59,32 @@ typedef struct llvm_backend_ctx {
   llvm::IRBuilder<> *builder;
   llvm::TargetMachine *target_machine;
   std::string target_triple;
+
+  /*
+   * The ast being generated, nodes are resolved by id in it.
+   */
+  ast *program;
+
+  /*
+   * Allocas of the function currently being generated, indexed by the slot
+   * the semantic pass gave each variable, and its labels.
+   */
+  std::vector<llvm::AllocaInst *> locals;
+  llvm_sym_table<llvm::BasicBlock> label_blocks;
+
+  /*
+   * Targets for continue / break of the innermost loop.
+   */
+  llvm::BasicBlock *current_loop_header;
+  llvm::BasicBlock *current_loop_exit;
 } llvm_backend_ctx;
 
 /*
  * @brief: Clears the symbol table used during IR generation.
+ *
+ * @param ctx: Reference to LLVM backend context
  */
-void llvm_irgen_clear_symbol_table();
+void llvm_irgen_clear_symbol_table(llvm_backend_ctx &ctx);
 
 /*
  * @brief: Generates LLVM IR for a single instruction node.
@@ -14,6 +14,8 @@
 #include "common.h"
 #include "ds/arena.h"
 #include "ds/dynamic_array.h"
+#include "include_cache.h"
+#include "obj_cache.h"
 
 /*
  * @enum opt_level: represents optimization levels
@@ -27,6 +29,25 @@ typedef enum opt_level {
   OPT_Oz      // optimize for minimum size
 } opt_level;
 
+/*
+ * @enum lto_mode: link time optimization across the files of a program
+ */
+typedef enum lto_mode {
+  LTO_NONE = 0, // every file is optimized on its own
+  LTO_FULL,     // files merged into one module, optimized as a whole
+  LTO_THIN      // summary based imports between files, optimized in parallel
+} lto_mode;
+
+/*
+ * @enum emit_kind: artifacts a file is compiled to, combined as flags
+ */
+typedef enum emit_kind {
+  EMIT_OBJ = 1 << 0, // object file, linked unless -c
+  EMIT_LL = 1 << 1,  // LLVM IR, <file>.ll
+  EMIT_BC = 1 << 2,  // LLVM bitcode, <file>.bc
+  EMIT_ASM = 1 << 3  // target assembly, <file>.s
+} emit_kind;
+
 /*
  * @struct coptions: represents the options described in the command when the
  * binary is executed.
@@ -47,6 +68,11 @@ typedef struct coptions {
    */
   bool compile_only;
 
+  /*
+   * Link by running cc instead of with lld in process (--link-cc).
+   */
+  bool link_cc;
+
   /*
    * Weather an include directory was specified in the command.
    */
@@ -55,16 +81,77 @@ typedef struct coptions {
   bool target_specified;
 
   /*
-   * Emit LLVM IR
+   * Artifacts written for every file, a set of emit_kind (--emit=<kinds>,
+   * --emit-llvm, --emit-asm), all from one optimized module. Nothing is
+   * linked without an object.
    */
-  bool emit_llvm;
+  u32 emit;
+
+  opt_level opt_level;
 
   /*
-   * Emit target assembly
+   * Link time optimization (-flto), files are emitted as bitcode and
+   * optimized and code generated when linking. Has no effect with -c.
    */
-  bool emit_asm;
+  lto_mode lto;
 
-  opt_level opt_level;
+  /*
+   * Number of files compiled in parallel (-j), 1 compiles serially.
+   */
+  u32 jobs;
+
+  /*
+   * Number of parts every module is split into for code generation, each
+   * emitted on its own thread (--codegen-threads), 1 emits it whole.
+   */
+  u32 codegen_threads;
+
+  /*
+   * Object cache: disabled with --no-cache, directory and size limit
+   * overridden with --cache-dir and --cache-size, counts printed after the
+   * build with --cache-stats.
+   */
+  bool no_cache;
+  bool cache_stats;
+  char *cache_dir;
+  u64 cache_max_size;
+
+  /*
+   * Stay resident and compile the requests of --client (--server), listening
+   * on socket_path.
+   */
+  bool server;
+  char *socket_path;
+
+  /*
+   * Print the time spent in every phase (-ftime-report), write a trace of the
+   * build (-ftime-trace[=<path>]).
+   */
+  bool time_report;
+  bool time_trace;
+  char *time_trace_path;
+
+  /*
+   * Print allocations, arena use and peak RSS per phase, also written as JSON
+   * to mem_report_path (--mem-report[=<path>]).
+   */
+  bool mem_report;
+  char *mem_report_path;
+
+  /*
+   * JIT the program and run it in process instead of linking it (--run),
+   * passing it the arguments after "--".
+   */
+  bool run;
+  u32 run_argc;
+  char **run_argv;
+
+  /*
+   * Read definitions and statements from stdin and run them as they are
+   * entered, on a JIT kept for the whole session (--repl). The input files
+   * are loaded into the session first.
+   */
+  bool repl;
 } coptions;
 
 /*
@@ -87,7 +174,18 @@ typedef struct cstate {
   char *include_dir;
 
   /*
-   * all the '.o' object files seperated with spaces
+   * Included files, read and lexed once for all the files.
+   */
+  include_cache includes;
+
+  /*
+   * Objects of files compiled by earlier builds.
+   */
+  obj_cache cache;
+
+  /*
+   * all the '.o' object files seperated with spaces, in-memory files
+   * (/proc/self/fd/N) when linking in process
    */
   dynamic_array obj_file_list;
 
@@ -114,6 +212,14 @@ typedef struct cstate {
  */
 void cstate_init(cstate *cst, u32 argc, char *argv[]);
 
+/*
+ * @brief: free a path of obj_file_list, closing the in-memory object file it
+ * names.
+ *
+ * @param obj: path of the object.
+ */
+void cstate_free_obj(char *obj);
+
 /*
  * @brief: Free all associated memory of a compiler state
  *
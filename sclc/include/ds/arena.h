@@ -3,6 +3,23 @@
  *
  * initial implementation inspired from "i hate malloc/free with a passion" by
  * MagicalBat on YouTube (https://youtu.be/jgiMagdjA1s)
+ *
+ * The arena is a chain of blocks mapped straight from the OS. When the current
+ * block is full a new one is mapped and linked in front of it, so pushes never
+ * fail and pointers stay valid until the memory is popped. Positions are
+ * counted over the whole chain, which lets callers take a checkpoint with
+ * arena_temp_begin and roll back to it with arena_temp_end.
+ *
+ * Usage:
+ * mem_arena arena;
+ * arena_init(&arena, ARENA_DEFAULT_BLOCK_SIZE);
+ *
+ * mem_arena_temp tmp = arena_temp_begin(&arena);
+ * char *buf = arena_push(tmp.arena, 128);
+ * ...
+ * arena_temp_end(tmp);
+ *
+ * arena_free(&arena);
  */
 
 #ifndef ARENA_H
@@ -10,38 +27,96 @@
 
 #include "common.h"
 
-typedef struct mem_arena {
+/*
+ * Default size of a block, big allocations get a block of their own.
+ */
+#define ARENA_DEFAULT_BLOCK_SIZE (64 << 10)
+
+/*
+ * @struct mem_arena_block: header placed at the start of every mapped block,
+ * the usable memory follows it.
+ */
+typedef struct mem_arena_block {
+  struct mem_arena_block *prev;
+
+  /*
+   * Usable bytes in this block.
+   */
   u64 capacity;
+
+  /*
+   * Position of the first byte of this block within the whole arena.
+   */
+  u64 base;
+
+  /*
+   * Bytes used in this block.
+   */
   u64 pos;
-  u8 *buffer;
+
+  /*
+   * Bytes of this block that were ever handed out, everything above is still
+   * zero from the OS and does not have to be cleared again.
+   */
+  u64 dirty;
+} mem_arena_block;
+
+typedef struct mem_arena {
+  /*
+   * Block allocations are currently served from, NULL until the first push.
+   */
+  mem_arena_block *current;
+
+  /*
+   * Minimum usable size of newly mapped blocks.
+   */
+  u64 block_size;
 } mem_arena;
 
 /*
- * @brief: Initializes an already allocated memory arena with the specified
- * capacity.
+ * @struct mem_arena_temp: a checkpoint of an arena, everything pushed after
+ * arena_temp_begin is released by arena_temp_end.
+ */
+typedef struct mem_arena_temp {
+  mem_arena *arena;
+  u64 pos;
+} mem_arena_temp;
+
+/*
+ * @brief: Initializes an already allocated memory arena. No memory is mapped
+ * until the first push.
  *
  * @param arena: pointer to a mem_arena
- * @param capacity: Maximum size in bytes that the arena can hold
+ * @param block_size: minimum size in bytes of each block the arena maps
  */
-void arena_init(mem_arena *arena, u64 capacity);
+void arena_init(mem_arena *arena, u64 block_size);
 
 /*
- * @brief: Frees a mem_arena
+ * @brief: Frees a mem_arena, unmapping all of its blocks.
  *
  * @param arena: pointer to a mem_arena
  */
 void arena_free(mem_arena *arena);
 
 /*
- * @brief: Allocates memory from the arena.
+ * @brief: Allocates zeroed memory from the arena, mapping a new block if the
+ * current one is full.
  *
  * @param arena: Pointer to the arena to allocate from
  * @param size: Number of bytes to allocate
  *
- * @return: Pointer to allocated memory, or NULL if arena is full
+ * @return: Pointer to allocated memory, exits if the OS is out of memory
  */
 void *arena_push(mem_arena *arena, u64 size);
 
+/*
+ * @brief: Returns the current position of the arena, to be used with
+ * arena_pop_to.
+ *
+ * @param arena: Pointer to the arena
+ */
+u64 arena_pos(mem_arena *arena);
+
 /*
  * @brief: Deallocates the most recently allocated memory from the arena.
  *
@@ -52,6 +127,7 @@ void arena_pop(mem_arena *arena, u64 size);
 
 /*
  * @brief: Resets arena to a specific position, freeing all memory above it.
+ * Blocks that end up entirely above pos are unmapped.
  *
  * @param arena: Pointer to the arena
  * @param pos: Position in bytes to reset the arena to
@@ -59,12 +135,46 @@ void arena_pop(mem_arena *arena, u64 size);
 void arena_pop_to(mem_arena *arena, u64 pos);
 
 /*
- * @brief: Clears the entire arena, freeing all allocated memory.
+ * @brief: Clears the entire arena, freeing all allocated memory. The first
+ * block stays mapped for reuse.
  *
  * @param arena: Pointer to the arena to clear
  */
 void arena_clear(mem_arena *arena);
 
+/*
+ * @brief: Takes a checkpoint of the arena.
+ *
+ * @param arena: Pointer to the arena
+ *
+ * @return: checkpoint to be passed to arena_temp_end
+ */
+mem_arena_temp arena_temp_begin(mem_arena *arena);
+
+/*
+ * @brief: Releases everything pushed since the checkpoint was taken.
+ *
+ * @param temp: checkpoint returned by arena_temp_begin
+ */
+void arena_temp_end(mem_arena_temp temp);
+
+/*
+ * @brief: Gets a thread local scratch arena for short lived allocations,
+ * checkpointed so that arena_temp_end releases them again. Scratch arenas nest
+ * like a stack.
+ *
+ * @param conflict: an arena the caller is already allocating its results in
+ * (may be NULL), a different scratch arena is returned if it is one of them.
+ *
+ * @return: checkpoint of the scratch arena, allocate from its arena member
+ */
+mem_arena_temp arena_scratch_begin(mem_arena *conflict);
+
+/*
+ * @brief: Unmaps the calling thread's scratch arenas.
+ */
+void arena_scratch_release();
+
 /*
  * @brief: Helper macro to allocate and return a pointer to a struct of type T
  *
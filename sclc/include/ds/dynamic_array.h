@@ -14,6 +14,17 @@ void dynamic_array_init(dynamic_array *da, u64 size);
 
 u32 dynamic_array_get(dynamic_array *da, u64 index, void *item);
 
+/*
+ * @brief: get a pointer to an item in place, without copying it. The pointer
+ * is invalidated by anything that grows or shrinks the array.
+ *
+ * @param da: pointer to an initialized dynamic_array
+ * @param index: index of the item, must be less than da->count
+ */
+static inline void *dynamic_array_at(dynamic_array *da, u64 index) {
+  return (char *)da->items + index * da->item_size;
+}
+
 u32 dynamic_array_set(dynamic_array *da, u64 index, void *item);
 
 u32 dynamic_array_append(dynamic_array *da, void *item);
@@ -0,0 +1,114 @@
+/*
+ * hash: fast non-cryptographic hashing of byte strings.
+ *
+ * A compact variant of wyhash (https://github.com/wangyi-fudan/wyhash, public
+ * domain): one 64x64->128 bit multiply per 16 bytes, which makes it very cheap
+ * for the short identifiers the compiler hashes most of the time.
+ */
+
+#ifndef HASH_H
+#define HASH_H
+
+#include "common.h"
+
+#include <string.h>
+
+/*
+ * @brief: multiplies a and b to 128 bits and folds the halves together.
+ */
+static inline u64 scu_hash_mix(u64 a, u64 b) {
+  __uint128_t r = (__uint128_t)a * b;
+  return (u64)r ^ (u64)(r >> 64);
+}
+
+static inline u64 scu_hash_read8(const u8 *p) {
+  u64 v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline u64 scu_hash_read4(const u8 *p) {
+  u32 v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+/*
+ * @brief: hashes len bytes starting at key.
+ *
+ * @param key: pointer to the bytes to hash
+ * @param len: number of bytes
+ * @param seed: seed, different seeds give independent hash functions
+ *
+ * @return: 64 bit hash
+ */
+static inline u64 scu_hash_bytes(const void *key, u64 len, u64 seed) {
+  static const u64 secret[4] = {0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+                                0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull};
+
+  const u8 *p = key;
+  u64 a, b;
+
+  seed ^= scu_hash_mix(seed ^ secret[0], secret[1]);
+
+  if (len <= 16) {
+    if (len >= 4) {
+      u64 step = (len >> 3) << 2;
+      a = (scu_hash_read4(p) << 32) | scu_hash_read4(p + step);
+      b = (scu_hash_read4(p + len - 4) << 32) |
+          scu_hash_read4(p + len - 4 - step);
+    } else if (len > 0) {
+      a = ((u64)p[0] << 16) | ((u64)p[len >> 1] << 8) | p[len - 1];
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    u64 i = len;
+
+    if (i >= 48) {
+      u64 see1 = seed, see2 = seed;
+      do {
+        seed = scu_hash_mix(scu_hash_read8(p) ^ secret[1],
+                            scu_hash_read8(p + 8) ^ seed);
+        see1 = scu_hash_mix(scu_hash_read8(p + 16) ^ secret[2],
+                            scu_hash_read8(p + 24) ^ see1);
+        see2 = scu_hash_mix(scu_hash_read8(p + 32) ^ secret[3],
+                            scu_hash_read8(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i >= 48);
+      seed ^= see1 ^ see2;
+    }
+
+    while (i > 16) {
+      seed = scu_hash_mix(scu_hash_read8(p) ^ secret[1],
+                          scu_hash_read8(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+
+    a = scu_hash_read8(p + i - 16);
+    b = scu_hash_read8(p + i - 8);
+  }
+
+  a ^= secret[1];
+  b ^= seed;
+
+  __uint128_t r = (__uint128_t)a * b;
+  a = (u64)r;
+  b = (u64)(r >> 64);
+
+  return scu_hash_mix(a ^ secret[0] ^ len, b ^ secret[1]);
+}
+
+/*
+ * @brief: hashes a null terminated string.
+ *
+ * @param s: string to hash
+ */
+static inline u64 scu_hash_str(const char *s) {
+  return scu_hash_bytes(s, strlen(s), 0);
+}
+
+#endif // !HASH_H
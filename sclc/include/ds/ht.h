@@ -1,30 +1,68 @@
 /*
  * ht: contains the hash table struct and its interface.
+ *
+ * Open addressing with linear probing over a power of two array of slots.
+ * Every slot caches the full 64 bit hash of its key, so probing only touches
+ * the key bytes on a real match. Keys and values are copied into an arena
+ * owned by the table: a value pointer returned by ht_search stays valid until
+ * the table is freed, even if the table grows.
+ *
+ * Usage:
+ * ht table;
+ * ht_init(&table, sizeof(variable));
+ * ht_insert(&table, var.name, &var);
+ *
+ * u64 it = 0;
+ * const char *key;
+ * void *value;
+ * while (ht_next(&table, &it, &key, &value))
+ *   ...
+ *
+ * ht_free(&table);
  */
 
 #ifndef HT_H
 #define HT_H
 
 #include "common.h"
+#include "ds/arena.h"
 
 /*
- * @struct ht_item: represents an individual item inside a hash table.
+ * @struct ht_slot: represents an individual slot inside a hash table.
  */
-typedef struct ht_item {
-  char *key;
+typedef struct ht_slot {
+  /*
+   * Hash of the key, with the reserved values HT_EMPTY and HT_TOMBSTONE for
+   * unused slots.
+   */
+  u64 hash;
+
+  /*
+   * Arena copies of the key (null terminated) and the value.
+   */
+  const char *key;
   void *value;
-} ht_item;
+  u64 key_len;
+} ht_slot;
 
 /*
  * @struct ht: represents the hash table.
  */
 typedef struct ht {
-  u64 base_capacity;
+  /*
+   * Number of slots, zero or a power of two.
+   */
   u64 capacity;
   u64 count;
+  u64 tombstones;
 
-  ht_item **items;
+  ht_slot *slots;
   u64 value_size;
+
+  /*
+   * Backing memory for keys and values.
+   */
+  mem_arena arena;
 } ht;
 
 /*
@@ -44,7 +82,8 @@ ht *ht_create(const u64 value_size);
 void ht_destroy(ht *table);
 
 /*
- * @brief: initialize a new hash table.
+ * @brief: initialize a new hash table. No memory is allocated until the first
+ * insert.
  *
  * @param table: pointer to an already allocated ht
  * @param value_size: size of the value (void *) of each item.
@@ -59,7 +98,8 @@ void ht_init(ht *table, const u64 value_size);
 void ht_free(ht *table);
 
 /*
- * @brief: insert a key value pair into the hash table.
+ * @brief: insert a key value pair into the hash table, overwriting the value
+ * of an existing key in place.
  *
  * @param table: pointer to an initialized ht (hash table) struct.
  * @param key: key string literal.
@@ -72,6 +112,8 @@ void ht_insert(ht *table, const char *key, const void *value);
  *
  * @param table: pointer to an initialized ht (hash table) struct.
  * @param key: key string literal
+ *
+ * @return: pointer to the stored value, or NULL if the key is not present.
  */
 void *ht_search(ht *table, const char *key);
 
@@ -83,4 +125,17 @@ void *ht_search(ht *table, const char *key);
  */
 void ht_delete(ht *table, const char *key);
 
+/*
+ * @brief: iterate over the key-value pairs of the hash table, in no particular
+ * order. The table must not be modified during the iteration.
+ *
+ * @param table: pointer to an initialized ht (hash table) struct.
+ * @param iter: iteration state, must be set to 0 before the first call.
+ * @param key: set to the key of the next pair (may be NULL).
+ * @param value: set to the value of the next pair (may be NULL).
+ *
+ * @return: false once all pairs were visited.
+ */
+bool ht_next(ht *table, u64 *iter, const char **key, void **value);
+
 #endif // !HT_H
@@ -0,0 +1,120 @@
+/*
+ * scope_map: a table keyed by symbol id with nested scopes.
+ *
+ * Bindings are kept on a stack, each one linked to the binding of the same
+ * symbol it shadows, and a sym_map points every symbol to its innermost
+ * binding. Entering a scope is O(1), leaving it unlinks only the bindings
+ * made in it, lookups are an index at any depth and nothing is copied from
+ * outer scopes. An isolated scope (a function body) hides the bindings of the
+ * scopes around it.
+ *
+ * Usage:
+ * scope_map variables;
+ * scope_map_init(&variables, sizeof(variable));
+ * scope_map_push(&variables, false);
+ * scope_map_bind(&variables, var.name, &var);
+ * variable *found = scope_map_get(&variables, var.name);
+ * scope_map_pop(&variables);
+ * scope_map_free(&variables);
+ */
+
+#ifndef SCOPE_MAP_H
+#define SCOPE_MAP_H
+
+#include "common.h"
+#include "ds/dynamic_array.h"
+#include "ds/sym_map.h"
+#include "intern.h"
+
+/*
+ * @struct scope_map: represents the table.
+ */
+typedef struct scope_map {
+  u64 value_size;
+
+  /*
+   * Stack of bindings, a scope_binding header followed by the value, stride
+   * bytes each.
+   */
+  u8 *bindings;
+  u64 stride;
+  u64 count;
+  u64 capacity;
+
+  /*
+   * Index of the innermost binding of every bound symbol.
+   */
+  sym_map innermost; // u32
+
+  /*
+   * Open scopes (scope_frame), and the depth of the innermost isolated one.
+   * Bindings made below it are hidden.
+   */
+  dynamic_array scopes;
+  u32 floor;
+} scope_map;
+
+/*
+ * @brief: initialize an empty scope_map, symbols bound before the first push
+ * belong to the outermost scope.
+ *
+ * @param map: pointer to an already allocated scope_map
+ * @param value_size: size of each value in bytes
+ */
+void scope_map_init(scope_map *map, u64 value_size);
+
+/*
+ * @brief: free all memory associated with a scope_map.
+ *
+ * @param map: pointer to an initialized scope_map
+ */
+void scope_map_free(scope_map *map);
+
+/*
+ * @brief: enter a new scope.
+ *
+ * @param map: pointer to an initialized scope_map
+ * @param isolated: whether the bindings of the enclosing scopes are hidden
+ */
+void scope_map_push(scope_map *map, bool isolated);
+
+/*
+ * @brief: leave the innermost scope, dropping its bindings and uncovering
+ * the ones they shadowed.
+ *
+ * @param map: pointer to an initialized scope_map
+ */
+void scope_map_pop(scope_map *map);
+
+/*
+ * @brief: drop the bindings made after the map held count of them, newest
+ * first, uncovering the ones they shadowed. They must all belong to the
+ * innermost scope.
+ *
+ * @param map: pointer to an initialized scope_map
+ * @param count: number of bindings to keep
+ */
+void scope_map_truncate(scope_map *map, u64 count);
+
+/*
+ * @brief: bind a value to a symbol in the innermost scope, shadowing any
+ * binding of the symbol in the enclosing scopes. Pointers returned by
+ * scope_map_get are invalidated.
+ *
+ * @param map: pointer to an initialized scope_map
+ * @param id: symbol id
+ * @param value: pointer to the value (will be copied)
+ */
+void scope_map_bind(scope_map *map, sym_id id, const void *value);
+
+/*
+ * @brief: get the innermost visible value bound to a symbol.
+ *
+ * @param map: pointer to an initialized scope_map
+ * @param id: symbol id
+ *
+ * @return: pointer to the value, or NULL if the symbol is not visible
+ */
+void *scope_map_get(scope_map *map, sym_id id);
+
+#endif // !SCOPE_MAP_H
@@ -0,0 +1,88 @@
+/*
+ * sym_map: a table keyed by symbol id (see intern.h), stored as a plain array
+ * indexed by the id. Lookups are a bounds check and an index, no hashing.
+ *
+ * Usage:
+ * sym_map functions;
+ * sym_map_init(&functions, sizeof(fn_node));
+ * sym_map_set(&functions, fn.name, &fn);
+ * fn_node *found = sym_map_get(&functions, fn.name);
+ * sym_map_free(&functions);
+ */
+
+#ifndef SYM_MAP_H
+#define SYM_MAP_H
+
+#include "common.h"
+#include "intern.h"
+
+/*
+ * @struct sym_map: represents the table.
+ */
+typedef struct sym_map {
+  u64 value_size;
+
+  /*
+   * Number of ids covered by values and present.
+   */
+  u64 capacity;
+  u8 *values;
+
+  /*
+   * Bitmap of the ids that hold a value.
+   */
+  u64 *present;
+  u64 count;
+} sym_map;
+
+/*
+ * @brief: initialize a new sym_map, nothing is allocated until the first set.
+ *
+ * @param map: pointer to an already allocated sym_map
+ * @param value_size: size of each value in bytes
+ */
+void sym_map_init(sym_map *map, u64 value_size);
+
+/*
+ * @brief: free all memory associated with a sym_map.
+ *
+ * @param map: pointer to an initialized sym_map
+ */
+void sym_map_free(sym_map *map);
+
+/*
+ * @brief: store a value for a symbol, overwriting an existing one. May move
+ * the values, pointers returned by sym_map_get are invalidated.
+ *
+ * @param map: pointer to an initialized sym_map
+ * @param id: symbol id
+ * @param value: pointer to the value (will be copied)
+ */
+void sym_map_set(sym_map *map, sym_id id, const void *value);
+
+/*
+ * @brief: get the value stored for a symbol.
+ *
+ * @param map: pointer to an initialized sym_map
+ * @param id: symbol id
+ *
+ * @return: pointer to the stored value, or NULL if there is none
+ */
+void *sym_map_get(sym_map *map, sym_id id);
+
+/*
+ * @brief: remove the value of a symbol, if any.
+ *
+ * @param map: pointer to an initialized sym_map
+ * @param id: symbol id
+ */
+void sym_map_remove(sym_map *map, sym_id id);
+
+/*
+ * @brief: remove all values, keeping the memory for reuse.
+ *
+ * @param map: pointer to an initialized sym_map
+ */
+void sym_map_clear(sym_map *map);
+
+#endif // !SYM_MAP_H
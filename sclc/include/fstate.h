@@ -8,8 +8,10 @@
 #include "ast.h"
 #include "common.h"
 #include "ds/dynamic_array.h"
-#include "ds/ht.h"
+#include "ds/scope_map.h"
 #include "ds/stack.h"
+#include "ds/sym_map.h"
+#include "source.h"
 
 typedef struct fstate {
   /*
@@ -26,19 +28,23 @@ typedef struct fstate {
   char *extracted_filepath;
 
   /*
-   * Source buffer and its size in bytes.
+   * Source buffers of the file (index 0) and everything it includes.
    */
-  char *code_buffer;
-  u64 code_buffer_len;
+  source_map sources;
 
   /*
    * Variables / artifacts for the whole compiler pipeline.
    */
-  dynamic_array tokens;
   ast program_ast;
-  ht variables;
+  scope_map variables;
   stack loops;
-  ht functions;
+  sym_map functions;
+
+  /*
+   * Backend specific per-file state (LLVM context, module, ...), owned by the
+   * backend between compile and cleanup.
+   */
+  void *backend_ctx;
 } fstate;
 
 /*
@@ -49,6 +55,18 @@ typedef struct fstate {
  */
 void fstate_init(fstate *fst, const char *filepath);
 
+/*
+ * @brief: initializes a existing file state for source text already in memory
+ * (an input of --repl).
+ *
+ * @param fst: Pointer to a fstate
+ * @param name: Name the source is reported under
+ * @param buffer: Source text followed by SCAN_PADDING zero bytes, must
+ * outlive the fstate
+ * @param len: Length of the source text in bytes
+ */
+void fstate_init_buffer(fstate *fst, const char *name, char *buffer, u64 len);
+
 /*
  * @brief: Frees all memory associated with a file state.
  *
@@ -0,0 +1,100 @@
+/*
+ * include_cache: tokens of the included files of a build, shared by all of its
+ * files.
+ *
+ * An included file is read and lexed once per build, however many files
+ * include it (files that include it at the same moment may each lex it, the
+ * first entry is kept). Its tokens are kept with locations relative to the
+ * start of the file and string literals indexed in the entry, the
+ * token_stream of each including file rebases them into its own source_map.
+ * Entries are keyed by the real path of the file and rebuilt when its size or
+ * mtime changes. The cache may be used from several threads.
+ *
+ * Usage:
+ * include_cache cache;
+ * include_cache_init(&cache, include_dir);
+ * include_file *file = include_cache_get(&cache, "lib/io.scl");
+ * include_cache_free(&cache);
+ */
+
+#ifndef INCLUDE_CACHE_H
+#define INCLUDE_CACHE_H
+
+#include "common.h"
+#include "ds/dynamic_array.h"
+#include "ds/ht.h"
+#include "source.h"
+
+#include <pthread.h>
+#include <time.h>
+
+/*
+ * @struct include_file: an included file and its tokens.
+ */
+typedef struct include_file {
+  /*
+   * Real path of the file, and the state it was lexed in.
+   */
+  char *path;
+  u64 size;
+  struct timespec mtime;
+
+  /*
+   * Owns the buffer (file 0, at location 0) and the string literals.
+   */
+  source_map sources;
+
+  /*
+   * Tokens of the file ending with TOKEN_END, include directives are kept.
+   */
+  dynamic_array tokens;
+} include_file;
+
+/*
+ * @struct include_cache: included files by real path.
+ */
+typedef struct include_cache {
+  /*
+   * Directory searched for included files.
+   */
+  const char *include_dir;
+
+  ht files; // real path -> include_file *
+
+  /*
+   * Every entry ever built, outdated ones included since they may still be
+   * referred to by a source_map.
+   */
+  dynamic_array entries; // include_file *
+
+  pthread_mutex_t lock;
+} include_cache;
+
+/*
+ * @brief: initialize an empty include cache.
+ *
+ * @param cache: pointer to an already allocated include_cache
+ * @param include_dir: directory searched for included files (borrowed)
+ */
+void include_cache_init(include_cache *cache, const char *include_dir);
+
+/*
+ * @brief: free all entries of an include cache. No source_map using them may
+ * be used afterwards.
+ *
+ * @param cache: pointer to an initialized include_cache
+ */
+void include_cache_free(include_cache *cache);
+
+/*
+ * @brief: get an included file, reading and lexing it if it is not cached or
+ * changed since.
+ *
+ * @param cache: pointer to an initialized include_cache
+ * @param path: path of the file
+ *
+ * @return: the entry of the file, valid until include_cache_free
+ */
+include_file *include_cache_get(include_cache *cache, const char *path);
+
+#endif // !INCLUDE_CACHE_H
@@ -0,0 +1,84 @@
+/*
+ * intern: global string interner, maps every distinct identifier to a dense
+ * 32 bit symbol id.
+ *
+ * Identifiers are interned once by the lexer, every later phase compares and
+ * indexes by sym_id instead of hashing and comparing strings. Ids are dense
+ * (1, 2, 3, ...), so tables keyed by symbol can be plain arrays (see
+ * ds/sym_map.h). The interner is shared by all files of a compilation and safe
+ * to use from several threads (-j).
+ *
+ * Usage:
+ * intern_init();
+ * sym_id id = intern("main", 4);
+ * printf("%s\n", intern_str(id));
+ * intern_free();
+ */
+
+#ifndef INTERN_H
+#define INTERN_H
+
+#include "common.h"
+
+/*
+ * @brief: a dense identifier of an interned string.
+ */
+typedef u32 sym_id;
+
+/*
+ * Id that no string maps to, used for "no symbol".
+ */
+#define SYM_NONE ((sym_id)0)
+
+/*
+ * @brief: initialize the global interner, must be called before any other
+ * intern function.
+ */
+void intern_init();
+
+/*
+ * @brief: free all memory of the global interner, every interned string
+ * becomes invalid.
+ */
+void intern_free();
+
+/*
+ * @brief: intern a string, the same bytes always map to the same id.
+ *
+ * @param str: pointer to the string (does not have to be null terminated)
+ * @param len: length of the string in bytes
+ *
+ * @return: symbol id of the string, never SYM_NONE
+ */
+sym_id intern(const char *str, u64 len);
+
+/*
+ * @brief: intern a null terminated string.
+ *
+ * @param str: null terminated string
+ */
+sym_id intern_cstr(const char *str);
+
+/*
+ * @brief: get the string of a symbol.
+ *
+ * @param id: symbol id returned by intern
+ *
+ * @return: null terminated string, valid until intern_free, NULL for SYM_NONE
+ */
+const char *intern_str(sym_id id);
+
+/*
+ * @brief: get the length of the string of a symbol.
+ *
+ * @param id: symbol id returned by intern
+ */
+u64 intern_len(sym_id id);
+
+/*
+ * @brief: upper bound of the symbol ids handed out so far, every id is
+ * smaller than this.
+ */
+u32 intern_count();
+
+#endif // !INTERN_H
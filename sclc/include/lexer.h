@@ -7,34 +7,160 @@
 
 #include "common.h"
 #include "ds/dynamic_array.h"
+#include "ds/ht.h"
+#include "ds/stack.h"
+#include "include_cache.h"
+#include "source.h"
+#include "token.h"
 
 /*
  * @struct lexer: maintains state of the lexer for tokenizing the source buffer.
  */
 typedef struct lexer {
   /*
-   * Pointer to source buffer and its size in bytes.
+   * Pointer to source buffer and its size in bytes, the buffer is followed by
+   * SCAN_PADDING zero bytes.
    */
   const char *buffer;
   u64 buffer_len;
 
+  /*
+   * Source map owning the buffer and the location of its first byte.
+   */
+  source_map *sources;
+  source_loc base;
+
   /*
    * Data concerned with current lexer state.
    */
-  u64 line;     // <-- tracks the current line
   u64 pos;      // <-- current position in buffer
   u64 read_pos; // <-- next read position (usually pos + 1)
   char ch;      // <-- character at buffer[read_pos]
+
+  /*
+   * Reused buffer for decoding string literals.
+   */
+  char *str_buf;
+  u64 str_cap;
 } lexer;
 
 /*
- * @brief: Tokenize a string buffer into a dynamic_array of tokens.
+ * @brief: Tokenize a single source file into a dynamic_array of tokens ending
+ * with TOKEN_END. Include directives are kept as tokens, not followed.
  *
- * @param buffer: string to be tokenized.
- * @param buffer_len size of buffer (in bytes).
+ * @param sources: source_map holding the file.
+ * @param file: index of the file in sources.
  * @param tokens: dynamic_array of tokens (should be initialized).
  */
-void lexer_tokenize(const char *buffer, u64 buffer_len, dynamic_array *tokens,
-                    const char *include_dir);
+void lexer_tokenize(source_map *sources, u32 file, dynamic_array *tokens);
+
+/*
+ * Number of tokens the token_stream can look ahead.
+ */
+#define TOKEN_STREAM_LOOKAHEAD 4
+
+/*
+ * Number of tokens lexed at a time, the size of the ring (power of two, at
+ * least TOKEN_STREAM_LOOKAHEAD).
+ */
+#define TOKEN_STREAM_CHUNK 64
+
+/*
+ * @struct include_frame: position in the tokens of an included file.
+ */
+typedef struct include_frame {
+  include_file *file;
+  u64 next; // index of the next token
+
+  /*
+   * Location of the file and index of its first string literal in the
+   * source_map of the stream.
+   */
+  source_loc base;
+  u32 strings;
+} include_frame;
+
+/*
+ * @struct token_stream: pulls tokens from a source file on demand. The main
+ * file is lexed as tokens are asked for, included files are taken from the
+ * include cache and entered at most once, through a stack of include frames.
+ * A small ring buffer holds the tokens looked ahead. Memory use does not
+ * depend on the size of the source.
+ *
+ * Usage:
+ * token_stream ts;
+ * token_stream_init(&ts, sources, 0, cache);
+ * while (token_stream_peek(&ts, 0).kind != TOKEN_END)
+ *   token_stream_advance(&ts);
+ * token_stream_free(&ts);
+ */
+typedef struct token_stream {
+  lexer lexer;
+
+  /*
+   * Included files being read, innermost on top, and the real paths of every
+   * file included so far.
+   */
+  stack includes;
+  ht included;
+
+  /*
+   * Ring buffer of tokens already lexed but not consumed.
+   */
+  token ring[TOKEN_STREAM_CHUNK];
+  u32 head;
+  u32 count;
+
+  /*
+   * End token of the main file, repeated once it was reached.
+   */
+  token end;
+  bool done;
+
+  source_map *sources;
+  include_cache *cache;
+} token_stream;
+
+/*
+ * @brief: Start streaming the tokens of a source file.
+ *
+ * @param ts: pointer to an uninitialized token_stream.
+ * @param sources: source_map holding the file, included files are added to it.
+ * @param file: index of the file in sources.
+ * @param cache: include cache of the build.
+ */
+void token_stream_init(token_stream *ts, source_map *sources, u32 file,
+                       include_cache *cache);
+
+/*
+ * @brief: Look at a token ahead without consuming it.
+ *
+ * @param ts: pointer to the token_stream.
+ * @param n: distance from the current token (less than TOKEN_STREAM_LOOKAHEAD).
+ *
+ * @return: the n-th token from the current one, TOKEN_END past the end.
+ */
+token token_stream_peek(token_stream *ts, u32 n);
+
+/*
+ * @brief: Consume the current token.
+ *
+ * @param ts: pointer to the token_stream.
+ */
+void token_stream_advance(token_stream *ts);
+
+/*
+ * @brief: Consume and return the current token.
+ *
+ * @param ts: pointer to the token_stream.
+ */
+token token_stream_next(token_stream *ts);
+
+/*
+ * @brief: Free the memory of a token_stream.
+ *
+ * @param ts: pointer to the token_stream.
+ */
+void token_stream_free(token_stream *ts);
 
 #endif // !LEXER_H
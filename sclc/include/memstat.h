@@ -0,0 +1,133 @@
+/*
+ * memstat: memory accounting of a build (--mem-report).
+ *
+ * Every allocation made through scu_checked_malloc / scu_checked_realloc is
+ * counted, along with the blocks mapped by arenas, under the phase running on
+ * the calling thread (see timing.h) and the kind of memory it is for. The
+ * kind is set by the data structures and the front end around their
+ * allocations with memstat_tag; the outermost tag wins, so the pools of an
+ * ast count as ast although they are dynamic_arrays. Memory LLVM allocates
+ * on its own is measured as the growth of the heap while a module is
+ * generated, only when files are compiled one at a time: the heap is the
+ * whole process', so with -j the MEM_LLVM row is reported as not measured.
+ * The peak RSS is sampled at the end of every phase.
+ *
+ * Allocated bytes are allocation traffic, not memory in use: every
+ * reallocation counts its full new size and frees are not subtracted. The
+ * arena high-water mark and the peak RSS tell what was in use.
+ *
+ * Counting costs a branch per allocation when the report is off.
+ *
+ * Usage:
+ * memstat_init(true);
+ * mem_kind prev = memstat_tag(MEM_AST);
+ * ... allocations ...
+ * memstat_untag(prev);
+ * memstat_report(json_path);
+ */
+
+#ifndef MEMSTAT_H
+#define MEMSTAT_H
+
+#include "common.h"
+
+/*
+ * @enum mem_kind: what an allocation is for.
+ */
+typedef enum mem_kind {
+  MEM_OTHER = 0,
+  MEM_TOKENS, // lexer buffers, tokens of included files
+  MEM_AST,    // node and payload pools, lists
+  MEM_TABLES, // ht, sym_map, scope_map and the interner
+  MEM_ARRAYS, // dynamic_array and stack growth
+  MEM_LLVM,   // heap growth while generating a module
+  MEM_KIND_COUNT
+} mem_kind;
+
+/*
+ * @brief: start counting allocations.
+ *
+ * @param enabled: whether to count at all
+ */
+void memstat_init(bool enabled);
+
+/*
+ * @brief: whether allocations are being counted.
+ */
+bool memstat_enabled();
+
+/*
+ * @brief: set the phase allocations of the calling thread count for, called
+ * by the timing module.
+ *
+ * @param phase: a time_phase, or PHASE_COUNT outside of any phase
+ */
+void memstat_set_phase(u32 phase);
+
+/*
+ * @brief: mark the allocations of the calling thread as being of a kind,
+ * unless an enclosing tag is active.
+ *
+ * @param kind: kind of the following allocations
+ *
+ * @return: tag to restore with memstat_untag
+ */
+mem_kind memstat_tag(mem_kind kind);
+
+/*
+ * @brief: restore the tag returned by memstat_tag.
+ */
+void memstat_untag(mem_kind prev);
+
+/*
+ * @brief: count a heap allocation (or reallocation, to its new size) of size
+ * bytes.
+ */
+void memstat_alloc(u64 size);
+
+/*
+ * @brief: count an arena block being mapped or unmapped.
+ *
+ * @param size: size of the mapping in bytes
+ * @param mapped: true when mapped, false when unmapped
+ */
+void memstat_arena(u64 size, bool mapped);
+
+/*
+ * @brief: bytes of heap currently in use, to measure memory allocated outside
+ * of scu_checked_* (LLVM).
+ */
+u64 memstat_heap_in_use();
+
+/*
+ * @brief: count bytes of a kind without an allocation of ours, like the
+ * growth of the heap while LLVM builds a module.
+ *
+ * @param kind: kind of the memory
+ * @param size: size in bytes
+ */
+void memstat_add(mem_kind kind, u64 size);
+
+/*
+ * @brief: mark a kind as not measured in this build, it is reported as such
+ * instead of with the bytes counted for it.
+ *
+ * @param kind: kind of the memory
+ */
+void memstat_unmeasured(mem_kind kind);
+
+/*
+ * @brief: sample the peak RSS of the process at the end of a phase.
+ *
+ * @param phase: the time_phase that ended
+ */
+void memstat_phase_end(u32 phase);
+
+/*
+ * @brief: print the report and write it as JSON.
+ *
+ * @param json_path: path of the JSON file, NULL for none
+ */
+void memstat_report(const char *json_path);
+
+#endif // !MEMSTAT_H
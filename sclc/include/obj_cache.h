@@ -0,0 +1,153 @@
+/*
+ * obj_cache: on-disk, content-addressed cache of object and bitcode files.
+ *
+ * An entry is keyed by a 128 bit hash of everything that determines it: the
+ * bytes of the file and of every file it includes, the target triple, the
+ * optimization level, the number of code generation partitions, what the
+ * entry holds (obj_cache_kind) and the compiler itself (its executable and
+ * the LLVM version). Entries are files named after the key in the cache
+ * directory. A hit refreshes the mtime of the entry, so eviction, which removes
+ * the least recently used entries once the directory grows past its size
+ * limit, goes by mtime. Hit and miss counts are kept in a stats file next to
+ * the entries. The cache may be used from several threads.
+ *
+ * Usage:
+ * obj_cache cache;
+ * obj_cache_init(&cache, dir, max_size);
+ * obj_cache_key(&cache, &fst->sources, triple, opt_level, partitions,
+ *               OBJ_CACHE_OBJECT, key);
+ * char *entry = obj_cache_lookup(&cache, key);
+ * if (!entry) { compile to obj_path; obj_cache_store(&cache, key, obj_path); }
+ * obj_cache_free(&cache);
+ */
+
+#ifndef OBJ_CACHE_H
+#define OBJ_CACHE_H
+
+#include "common.h"
+#include "source.h"
+
+/*
+ * Length of a key in hex digits, with the null terminator.
+ */
+#define OBJ_CACHE_KEY_LEN 33
+
+/*
+ * Default size limit of the cache directory.
+ */
+#define OBJ_CACHE_DEFAULT_MAX_SIZE (256ull << 20)
+
+/*
+ * @enum obj_cache_kind: what an entry holds. Bitcode is cached as it comes
+ * out of the pipeline it was optimized with, which -flto changes.
+ */
+typedef enum obj_cache_kind {
+  OBJ_CACHE_OBJECT = 0,       // object file
+  OBJ_CACHE_BITCODE,          // bitcode (--emit=bc)
+  OBJ_CACHE_BITCODE_FULL_LTO, // bitcode of -flto=full, its objects too
+  OBJ_CACHE_BITCODE_THIN_LTO  // bitcode with a ThinLTO summary
+} obj_cache_kind;
+
+/*
+ * @struct obj_cache: a cache directory and the counters of this build.
+ */
+typedef struct obj_cache {
+  /*
+   * Directory of the entries, NULL when the cache is disabled.
+   */
+  char *dir;
+  u64 max_size;
+
+  /*
+   * Hash of the compiler executable and the LLVM version, part of every key.
+   */
+  u64 compiler_id;
+
+  /*
+   * Counts of this build, updated atomically since files are compiled in
+   * parallel (the header is shared with C++, which has no _Atomic).
+   */
+  u64 hits;
+  u64 misses;
+  u64 stores;
+} obj_cache;
+
+/*
+ * @brief: open a cache directory, creating it if needed. The cache is
+ * disabled if dir is NULL or cannot be created.
+ *
+ * @param cache: pointer to an already allocated obj_cache
+ * @param dir: path of the cache directory (copied), may be NULL
+ * @param max_size: size limit of the directory in bytes
+ */
+void obj_cache_init(obj_cache *cache, const char *dir, u64 max_size);
+
+/*
+ * @brief: evict entries past the size limit, add the counters of this build
+ * to the stats file and free the cache.
+ *
+ * @param cache: pointer to an initialized obj_cache
+ */
+void obj_cache_free(obj_cache *cache);
+
+/*
+ * @brief: get the default cache directory, $XDG_CACHE_HOME/sclc or
+ * $HOME/.cache/sclc.
+ *
+ * @return: malloc'd path, or NULL if neither variable is set
+ */
+char *obj_cache_default_dir();
+
+/*
+ * @brief: compute the key of a file.
+ *
+ * @param cache: pointer to an initialized obj_cache
+ * @param sources: source_map holding the file and everything it includes
+ * @param triple: target triple
+ * @param opt_level: optimization level
+ * @param partitions: number of parts the module is code generated in
+ * @param kind: what the entry holds
+ * @param key: receives the key as a null terminated hex string
+ */
+void obj_cache_key(obj_cache *cache, source_map *sources, const char *triple,
+                   u32 opt_level, u32 partitions, obj_cache_kind kind,
+                   char key[OBJ_CACHE_KEY_LEN]);
+
+/*
+ * @brief: look up an entry and count the hit or miss.
+ *
+ * @param cache: pointer to an initialized obj_cache
+ * @param key: key from obj_cache_key
+ *
+ * @return: malloc'd path of the cached entry, or NULL on a miss
+ */
+char *obj_cache_lookup(obj_cache *cache, const char *key);
+
+/*
+ * @brief: copy a freshly compiled object or bitcode file into the cache.
+ *
+ * @param cache: pointer to an initialized obj_cache
+ * @param key: key from obj_cache_key
+ * @param obj_path: path of the object or bitcode file
+ */
+void obj_cache_store(obj_cache *cache, const char *key, const char *obj_path);
+
+/*
+ * @brief: print the size of the cache and its hit / miss counts, including the
+ * ones of this build.
+ *
+ * @param cache: pointer to an initialized obj_cache
+ */
+void obj_cache_print_stats(obj_cache *cache);
+
+/*
+ * @brief: copy a file.
+ *
+ * @param from: path of the source file
+ * @param to: path of the destination, created or truncated
+ *
+ * @return: true on success
+ */
+bool obj_cache_copy(const char *from, const char *to);
+
+#endif // !OBJ_CACHE_H
@@ -6,15 +6,18 @@
 #define PARSER_H
 
 #include "ast.h"
-#include "ds/dynamic_array.h"
+#include "lexer.h"
+#include "source.h"
 
 /*
- * @brief: parses a dynamic_array of tokens into an AST.
+ * @brief: parses a stream of tokens into an AST, pulling tokens as it goes.
  *
- * @param tokens: pointer to dynamic_array of tokens.
+ * @param tokens: pointer to an initialized token_stream.
+ * @param sources: source_map the tokens are lexed from.
  * @param program: pointer to a program_node (empty dynamic_array of
  * instructions).
  */
-void parser_parse_program(dynamic_array *tokens, ast *program);
+void parser_parse_program(token_stream *tokens, source_map *sources,
+                          ast *program);
 
 #endif // !PARSER_H
@@ -0,0 +1,34 @@
+/*
+ * repl: interactive session of sclc (--repl).
+ *
+ * Definitions and statements are read from stdin, one input at a time: a
+ * line, or as many lines as it takes to close the braces it opens. Every
+ * input is parsed and checked against the variables and functions of the
+ * inputs before it, compiled into a module of its own and added to a JIT kept
+ * for the whole session, then its top level statements are run. Functions
+ * are compiled once, calling them again from a later input costs nothing but
+ * the call.
+ *
+ * Errors are reported and drop the input they are in, the session carries
+ * on. It ends at the end of stdin or with :quit.
+ *
+ * Usage:
+ * int status = repl_run(&cst); // sclc --repl [files]
+ */
+
+#ifndef REPL_H
+#define REPL_H
+
+#include "cstate.h"
+
+/*
+ * @brief: load the input files of the compiler state into a new session, then
+ * read and run inputs from stdin until it ends. Frees the compiler state.
+ *
+ * @param cst: pointer to an initialized compiler state.
+ *
+ * @return: exit status
+ */
+int repl_run(cstate *cst);
+
+#endif // !REPL_H
@@ -0,0 +1,89 @@
+/*
+ * scan: vectorized byte scanning for the lexer.
+ *
+ * Each function classifies 16 (SSE2) or 32 (AVX2) bytes per step and returns
+ * the position of the first byte that ends the run, or len if the run reaches
+ * the end of the buffer. The implementation is picked at runtime by
+ * scan_init, other targets use a portable table driven loop.
+ *
+ * Buffers must be followed by SCAN_PADDING zero bytes (as source buffers from
+ * scu_map_file are). A zero byte ends every run, so the loops need no bounds
+ * checks and read whole vectors up to the padding.
+ *
+ * Usage:
+ * scan_init();
+ * pos = scan_whitespace(buf, pos);
+ * u64 end = scan_ident(buf, pos);
+ */
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#include "common.h"
+
+/*
+ * Number of zero bytes that must follow a scanned buffer.
+ */
+#define SCAN_PADDING 32
+
+/*
+ * @brief: pick the fastest implementation the cpu supports. Optional, the
+ * portable (or SSE2 on x86_64) implementation is used until it is called.
+ */
+void scan_init();
+
+/*
+ * @brief: name of the implementation in use ("avx2", "sse2" or "portable").
+ */
+const char *scan_isa();
+
+/*
+ * @brief: skip whitespace (' ', '\t', '\n', '\v', '\f', '\r').
+ *
+ * @param buf: source buffer
+ * @param pos: position to start at, at most the size of buf
+ *
+ * @return: position of the first non whitespace byte at or after pos
+ */
+u64 scan_whitespace(const char *buf, u64 pos);
+
+/*
+ * @brief: skip identifier characters ([A-Za-z0-9_]).
+ *
+ * @return: position of the first non identifier byte at or after pos
+ */
+u64 scan_ident(const char *buf, u64 pos);
+
+/*
+ * @brief: find a byte.
+ *
+ * @param len: size of buf in bytes
+ * @param c: byte to look for
+ *
+ * @return: position of the first c at or after pos, or len
+ */
+u64 scan_until(const char *buf, u64 pos, u64 len, char c);
+
+/*
+ * @brief: skip the plain characters of a string literal body.
+ *
+ * @return: position of the first '"', '\\' or '\0' at or after pos
+ */
+u64 scan_string(const char *buf, u64 pos);
+
+/*
+ * @brief: count the newlines in a buffer.
+ *
+ * @param len: size of buf in bytes
+ */
+u64 scan_count_newlines(const char *buf, u64 len);
+
+/*
+ * @brief: store the offset following every newline of a buffer, which is
+ * where each line after the first starts.
+ *
+ * @param starts: array of at least scan_count_newlines(buf, len) entries
+ */
+void scan_line_starts(const char *buf, u64 len, u32 *starts);
+
+#endif // !SCAN_H
@@ -9,27 +9,45 @@
 #include "ast.h"
 #include "common.h"
 #include "ds/dynamic_array.h"
-#include "ds/ht.h"
+#include "ds/scope_map.h"
+#include "ds/sym_map.h"
 
 #include <stddef.h>
 
 /*
  * @brief: evaluate a constant expression to extract integer value
  *
- * @param expr: pointer to an expr_node
+ * @param program_ast: pointer to the ast of the expression
+ * @param id: id of an expr_node
  *
  * @return: the integer value of the constant expression
  */
-u32 evaluate_const_expr(expr_node *expr);
+u32 evaluate_const_expr(ast *program_ast, expr_id id);
 
 /*
  * @brief: go through all the variables and labels in the parse tree and check
  * for any erorrs.
  *
- * @param instrs: pointer to the dynamic_array of instructions.
- * @param variables: pointer to hash table of variable.
- * @param functions: pointer to the functions hash table.
+ * @param program_ast: pointer to the ast of the compilation unit.
+ * @param variables: pointer to the scope_map of variables, its outermost scope
+ * holds the globals.
+ * @param functions: pointer to the functions sym_map.
  */
-void check_semantics(dynamic_array *instrs, ht *variables, ht *functions);
+void check_semantics(ast *program_ast, scope_map *variables,
+                     sym_map *functions);
+
+/*
+ * @brief: check one input of a session (--repl) against the variables and
+ * functions of the inputs before it. Its top level variables are bound in the
+ * outermost scope and keep their slots for the rest of the session.
+ *
+ * @param program_ast: pointer to the ast of the input.
+ * @param variables: pointer to the scope_map of the session's variables.
+ * @param functions: pointer to the session's functions sym_map.
+ * @param next_slot: first free top level slot, advanced past the variables
+ * this input declares, even when it has errors.
+ */
+void check_semantics_incremental(ast *program_ast, scope_map *variables,
+                                 sym_map *functions, u32 *next_slot);
 
 #endif // !SEMANTIC_H
@@ -0,0 +1,81 @@
+/*
+ * server: persistent compile server and its thin client.
+ *
+ * `sclc --server` initializes the LLVM targets and the front end tables once
+ * and then listens on a Unix domain socket. Every connection carries one
+ * command line, the working directory of the client and its stdin, stdout and
+ * stderr (passed as file descriptors). The server forks a worker per request,
+ * which inherits the warm process, runs the command line as a normal sclc
+ * invocation in the client's directory and writes straight to the client's
+ * terminal. The exit status of the worker is sent back to the client.
+ *
+ * Since workers are forked, a request cannot corrupt the server, exit() and
+ * scu_check_errors() behave exactly as in a standalone sclc, and requests are
+ * served concurrently. Both ends check that the other runs as the same user,
+ * and refuse to talk to anyone else.
+ *
+ * Usage:
+ * server_run(socket_path, handler);               // sclc --server
+ * int status = server_forward(socket_path, argc, argv); // sclc --client
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "common.h"
+
+/*
+ * @brief: runs one request in a worker process.
+ *
+ * @param argc: count of args
+ * @param argv: command line of the client, argv[0] included
+ *
+ * @return: exit status sent back to the client
+ */
+typedef int (*server_handler)(u32 argc, char *argv[]);
+
+/*
+ * @brief: get the default socket path, $XDG_RUNTIME_DIR/sclc.sock or
+ * /tmp/sclc-<uid>/sclc.sock, in a directory only the user can enter.
+ *
+ * @return: malloc'd path
+ */
+char *server_default_socket();
+
+/*
+ * @brief: get the socket given with --socket on a command line, or the
+ * default one.
+ *
+ * @param argc: count of args
+ * @param argv: array of arguments (string)
+ *
+ * @return: malloc'd path
+ */
+char *server_socket_path(u32 argc, char *argv[]);
+
+/*
+ * @brief: listen on a socket and serve requests until the server is
+ * interrupted. Refuses to start if another server already listens there.
+ * Connections from other users are refused.
+ *
+ * @param socket_path: path of the Unix domain socket
+ * @param handler: function running a request in the worker processes
+ *
+ * @return: exit status of the server
+ */
+int server_run(const char *socket_path, server_handler handler);
+
+/*
+ * @brief: send a command line to a running server and wait for it to be
+ * compiled. Output of the compilation goes to this process' stdout / stderr.
+ *
+ * @param socket_path: path of the Unix domain socket
+ * @param argc: count of args
+ * @param argv: command line, argv[0] included
+ *
+ * @return: exit status of the request, or -1 if no server of this user is
+ * listening
+ */
+int server_forward(const char *socket_path, u32 argc, char *argv[]);
+
+#endif // !SERVER_H
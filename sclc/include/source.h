@@ -0,0 +1,175 @@
+/*
+ * source: owns the source buffers of a compilation unit (the main file and
+ * everything it includes) and the decoded string literals.
+ *
+ * Every byte of every buffer gets a 32 bit source_loc, buffers are laid out
+ * one after the other in a single location space. Tokens only store a
+ * location, the file, line and text are looked up from it when needed. The
+ * line start table of a file is only built on its first line lookup.
+ *
+ * Usage:
+ * source_map sources;
+ * source_map_init(&sources);
+ * u32 file = source_map_add(&sources, "main.scl", buffer, buffer_len);
+ * source_loc loc = source_map_file(&sources, file)->base + offset;
+ * u64 line = source_map_line(&sources, loc);
+ * source_map_free(&sources);
+ */
+
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include "common.h"
+#include "ds/arena.h"
+#include "ds/dynamic_array.h"
+
+/*
+ * @brief: position of a byte in the location space of a source_map.
+ */
+typedef u32 source_loc;
+
+/*
+ * @struct source_file: a source buffer registered in a source_map.
+ */
+typedef struct source_file {
+  char *path;
+  char *buffer;
+  u64 len;
+  bool owned; // buffer is freed with the map
+
+  /*
+   * Location of the first byte, the locations base .. base + len (the end of
+   * the buffer) belong to this file.
+   */
+  source_loc base;
+
+  /*
+   * Offsets of the first byte of every line, NULL until the first line
+   * lookup. last_line caches the previous lookup, since lookups mostly walk
+   * forward through the file.
+   */
+  u32 *line_starts;
+  u32 line_count;
+  u32 last_line;
+} source_file;
+
+/*
+ * @struct source_map: all sources and string literals of a compilation unit.
+ */
+typedef struct source_map {
+  dynamic_array files; // source_file
+  source_loc next_base;
+
+  /*
+   * String literals decoded by the lexer, tokens refer to them by index.
+   */
+  dynamic_array strings; // char *
+  mem_arena string_arena;
+} source_map;
+
+/*
+ * @brief: initialize an empty source_map.
+ *
+ * @param map: pointer to an already allocated source_map
+ */
+void source_map_init(source_map *map);
+
+/*
+ * @brief: free all memory of a source_map, including the registered buffers.
+ *
+ * @param map: pointer to an initialized source_map
+ */
+void source_map_free(source_map *map);
+
+/*
+ * @brief: register a source buffer, the map takes ownership of it.
+ *
+ * @param map: pointer to an initialized source_map
+ * @param path: path of the file (copied)
+ * @param buffer: source buffer returned by scu_map_file
+ * @param len: size of buffer in bytes
+ *
+ * @return: index of the new file
+ */
+u32 source_map_add(source_map *map, const char *path, char *buffer, u64 len);
+
+/*
+ * @brief: register a source buffer owned by someone else, such as a file
+ * shared by several source_maps. The buffer must outlive the map.
+ *
+ * @param map: pointer to an initialized source_map
+ * @param path: path of the file (copied)
+ * @param buffer: source buffer followed by SCAN_PADDING zero bytes
+ * @param len: size of buffer in bytes
+ *
+ * @return: index of the new file
+ */
+u32 source_map_add_shared(source_map *map, const char *path, char *buffer,
+                          u64 len);
+
+/*
+ * @brief: get a registered file by index. The pointer is invalidated by the
+ * next source_map_add.
+ *
+ * @param map: pointer to an initialized source_map
+ * @param index: index returned by source_map_add
+ */
+source_file *source_map_file(source_map *map, u32 index);
+
+/*
+ * @brief: find the file containing a location.
+ *
+ * @param map: pointer to an initialized source_map
+ * @param loc: a location inside one of the files
+ */
+source_file *source_map_file_at(source_map *map, source_loc loc);
+
+/*
+ * @brief: get the (1 based) line number of a location.
+ *
+ * @param map: pointer to an initialized source_map
+ * @param loc: a location inside one of the files
+ */
+u64 source_map_line(source_map *map, source_loc loc);
+
+/*
+ * @brief: get a pointer to the source text at a location, not null
+ * terminated.
+ *
+ * @param map: pointer to an initialized source_map
+ * @param loc: a location inside one of the files
+ */
+const char *source_map_text(source_map *map, source_loc loc);
+
+/*
+ * @brief: store a decoded string literal.
+ *
+ * @param map: pointer to an initialized source_map
+ * @param str: string bytes (copied, a null terminator is added)
+ * @param len: length of str in bytes
+ *
+ * @return: index of the string
+ */
+u32 source_map_add_string(source_map *map, const char *str, u64 len);
+
+/*
+ * @brief: store string literals owned by someone else, without copying them.
+ * The strings must outlive the map.
+ *
+ * @param map: pointer to an initialized source_map
+ * @param strings: array of null terminated strings
+ * @param count: number of strings
+ *
+ * @return: index of the first string, the others follow in order
+ */
+u32 source_map_add_strings(source_map *map, char **strings, u32 count);
+
+/*
+ * @brief: get a string literal by index, valid until source_map_free.
+ *
+ * @param map: pointer to an initialized source_map
+ * @param index: index returned by source_map_add_string
+ */
+char *source_map_string(source_map *map, u32 index);
+
+#endif // !SOURCE_H
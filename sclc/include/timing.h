@@ -0,0 +1,156 @@
+/*
+ * timing: per-phase, per-file timers (-ftime-report) and a Chrome / Perfetto
+ * trace of the build (-ftime-trace).
+ *
+ * Phases are timed with the monotonic wall clock. Every phase of a file adds
+ * to the row of the file being compiled on the calling thread, set with
+ * timing_begin_file, so files compiled in parallel (-j) keep separate rows.
+ * With a trace, every timed phase also becomes a span, along with the finer
+ * spans added by the backend (functions, LLVM passes). The module is global
+ * and safe to use from several threads. When neither output was asked for,
+ * recording is a no-op.
+ *
+ * Usage:
+ * timing_init(nfiles, report, trace_path);
+ * timing_begin_file(index, path);
+ * u64 start = timing_phase_begin(PHASE_PARSE);
+ * ...
+ * timing_phase_end(PHASE_PARSE, start);
+ * timing_end_file();
+ * timing_finish();
+ */
+
+#ifndef TIMING_H
+#define TIMING_H
+
+#include "common.h"
+
+/*
+ * @enum time_phase: phases of the pipeline, columns of the report.
+ */
+typedef enum time_phase {
+  PHASE_READ = 0,
+  PHASE_LEX,
+  PHASE_PARSE,
+  PHASE_SEMANTIC,
+  PHASE_IRGEN,
+  PHASE_OPTIMIZE,
+  PHASE_EMIT,
+  PHASE_LINK,
+  PHASE_COUNT
+} time_phase;
+
+/*
+ * @brief: name of a phase, as shown in the reports.
+ */
+static inline const char *time_phase_name(time_phase phase) {
+  switch (phase) {
+  case PHASE_READ:
+    return "read";
+  case PHASE_LEX:
+    return "lex";
+  case PHASE_PARSE:
+    return "parse";
+  case PHASE_SEMANTIC:
+    return "semantic";
+  case PHASE_IRGEN:
+    return "irgen";
+  case PHASE_OPTIMIZE:
+    return "optimize";
+  case PHASE_EMIT:
+    return "emit";
+  case PHASE_LINK:
+    return "link";
+  default:
+    return "misc";
+  }
+}
+
+/*
+ * @brief: enable timing for a build.
+ *
+ * @param files: number of input files, rows of the report
+ * @param report: print the report in timing_finish
+ * @param trace_path: path of the trace file to write, NULL for none
+ */
+void timing_init(u32 files, bool report, const char *trace_path);
+
+/*
+ * @brief: whether phases are being timed.
+ */
+bool timing_enabled();
+
+/*
+ * @brief: whether spans are being recorded for a trace.
+ */
+bool timing_tracing();
+
+/*
+ * @brief: current time of the monotonic clock in nanoseconds.
+ */
+u64 timing_now();
+
+/*
+ * @brief: attribute the phases timed on the calling thread to a file.
+ *
+ * @param index: index of the file
+ * @param path: path of the file, shown in the report (copied)
+ */
+void timing_begin_file(u32 index, const char *path);
+
+/*
+ * @brief: stop attributing the phases of the calling thread to a file, later
+ * phases count for the whole build.
+ */
+void timing_end_file();
+
+/*
+ * @brief: start a phase on the calling thread. Allocations count for it in
+ * the memory report until it ends.
+ *
+ * @param phase: phase that starts
+ *
+ * @return: the current time, to pass to timing_phase_end
+ */
+u64 timing_phase_begin(time_phase phase);
+
+/*
+ * @brief: add time to a phase of the current file, without a span. Time added
+ * while a phase is open on the calling thread is work done for that phase
+ * (lexing for the parser), and is taken out of it when it ends.
+ *
+ * @param phase: phase to add to
+ * @param ns: duration in nanoseconds
+ */
+void timing_add(time_phase phase, u64 ns);
+
+/*
+ * @brief: end a phase started by timing_phase_begin: add it to the report and
+ * record its span.
+ *
+ * @param phase: phase that ended
+ * @param start: value returned by timing_phase_begin
+ *
+ * @return: duration in nanoseconds
+ */
+u64 timing_phase_end(time_phase phase, u64 start);
+
+/*
+ * @brief: record a span in the trace.
+ *
+ * @param name: name of the span (copied)
+ * @param len: length of name
+ * @param category: category of the span, a string literal
+ * @param start: start time, from timing_now()
+ * @param end: end time, from timing_now()
+ */
+void timing_span(const char *name, u64 len, const char *category, u64 start,
+                 u64 end);
+
+/*
+ * @brief: print the report and write the trace, if they were asked for, and
+ * free all timing data.
+ */
+void timing_finish();
+
+#endif // !TIMING_H
@@ -7,6 +7,8 @@
 
 #include "common.h"
 #include "ds/dynamic_array.h"
+#include "intern.h"
+#include "source.h"
 
 /*
  * @enum token_kind: enumeration of all kinds of tokens supported by the lexer.
@@ -104,23 +106,35 @@ typedef enum token_kind {
 
 /*
  * @union token_literal_value: holds the "value" of any particular literal
- * token. Values can be integers, characters, or strings for labels.
+ * token. Values can be integers, characters, indices into the string table of
+ * the source_map for string literals, or symbols for identifiers, labels,
+ * pointers and addresses.
  */
 typedef union token_literal_value {
   u32 integer;
   char character;
-  char *str;
+  u32 str;    // source_map_string index of string literals
+  sym_id sym; // interned name of identifier-like tokens
 } token_literal_value;
 
 /*
- * @struct token: reprents a token and its metadata.
+ * Longest token length that can be stored, longer tokens are clamped.
+ */
+#define TOKEN_MAX_LEN UINT16_MAX
+
+/*
+ * @struct token: reprents a token and its metadata. Tokens own no memory,
+ * the text, file and line are looked up from loc in the source_map.
  */
 typedef struct token {
-  token_kind kind;
+  source_loc loc; // <-- Where the token is placed in the source_map.
   token_literal_value value;
-  u64 line; // <-- Where the token is placed in the source buffer.
+  u16 len; // <-- Length of the token text in bytes.
+  u8 kind; // <-- token_kind
 } token;
 
+_Static_assert(sizeof(token) == 12, "token should stay 12 bytes");
+
 /*
  * @brief: Converts a token_kind enum value to its string representation.
  *
@@ -130,18 +144,11 @@ typedef struct token {
 const char *lexer_token_kind_to_str(token_kind kind);
 
 /*
- * @brief: Print the whole token stream, required for debugging.
- *
- * @param tokens: dynamic_array of tokens.
- */
-void lexer_print_tokens(dynamic_array *tokens);
-
-/*
- * @brief: Free / Destroy tokens before termination. This function is needed due
- * to there being malloc'd strings in token->value.
+ * @brief: Print a token with its line, required for debugging.
  *
- * @param tokens: dynamic_array of tokens.
+ * @param token: pointer to the token.
+ * @param sources: source_map the token was lexed from.
  */
-void free_tokens(dynamic_array *tokens);
+void lexer_print_token(token *token, source_map *sources);
 
 #endif // !TOKEN
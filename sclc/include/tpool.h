@@ -0,0 +1,36 @@
+/*
+ * tpool: a small fixed-size pool of worker threads for running independent
+ * jobs in parallel.
+ */
+
+#ifndef TPOOL_H
+#define TPOOL_H
+
+#include "common.h"
+
+/*
+ * @brief: signature of a job run by the pool.
+ *
+ * @param ctx: the context pointer passed to tpool_run.
+ * @param index: index of the job, in the range [0, njobs).
+ */
+typedef void (*tpool_job_fn)(void *ctx, u64 index);
+
+/*
+ * @brief: run njobs jobs on up to nthreads threads and wait for all of them to
+ * finish. Jobs are handed out in increasing index order. With nthreads <= 1
+ * every job runs on the calling thread.
+ *
+ * @param nthreads: maximum number of threads to use.
+ * @param njobs: number of jobs to run.
+ * @param fn: function called once for every job index.
+ * @param ctx: opaque pointer passed to every invocation of fn.
+ */
+void tpool_run(u32 nthreads, u64 njobs, tpool_job_fn fn, void *ctx);
+
+/*
+ * @brief: number of processors currently online, at least 1.
+ */
+u32 tpool_cpu_count();
+
+#endif // !TPOOL_H
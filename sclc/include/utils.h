@@ -7,6 +7,39 @@
 
 #include "common.h"
 
+#include <setjmp.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * @struct scu_sink: captures everything a thread prints through the scu_*
+ * functions so that output of concurrently compiled files can be replayed in a
+ * deterministic order.
+ */
+typedef struct scu_sink {
+  /*
+   * In-memory streams replacing stdout and stderr respectively.
+   */
+  FILE *out;
+  char *out_buf;
+  size_t out_len;
+
+  FILE *err;
+  char *err_buf;
+  size_t err_len;
+
+  /*
+   * Errors reported while this sink was active.
+   */
+  u64 err_count;
+
+  /*
+   * scu_check_errors() jumps here instead of exiting when errors were
+   * reported while this sink was active.
+   */
+  jmp_buf bail;
+} scu_sink;
+
 /*
  * @brief: allocates memory with error checking.
  *
@@ -36,15 +69,24 @@ void *scu_checked_realloc(void *ptr, u64 size);
 char *scu_extract_name(const char *filename);
 
 /*
- * @brief: read the contents of a file and store them in a buffer.
+ * @brief: map the contents of a file read-only. The buffer is followed by at
+ * least SCAN_PADDING zero bytes, so buffer[len] is a '\0' sentinel and
+ * scanning up to SCAN_PADDING bytes past the end is safe.
  *
  * @param path: path to file
- * @param buffer: pointer to a string where the contents of the file are to be
- * stored.
+ * @param len: set to the size of the file in bytes
  *
- * @return number of bytes read
+ * @return pointer to the mapped contents, released with scu_unmap_file
  */
-u32 scu_read_file(const char *path, char **buffer);
+char *scu_map_file(const char *path, u64 *len);
+
+/*
+ * @brief: release a buffer returned by scu_map_file.
+ *
+ * @param buffer: mapped buffer
+ * @param len: size of the file in bytes
+ */
+void scu_unmap_file(char *buffer, u64 len);
 
 /*
  * @brief: formats a string with variable arguments.
@@ -93,9 +135,42 @@ void scu_pwarning(char *__restrict __format, ...);
  */
 void scu_perror(char *__restrict __format, ...);
 
+/*
+ * @brief: print formatted output to stdout, or to the current thread's sink.
+ *
+ * @param __format: a format string containing format specifiers.
+ * @param ...: variable arguments corresponsing to the format specifiers in
+ * __format.
+ */
+void scu_printf(char *__restrict __format, ...);
+
 /*
  * @brief: exit the compiler pipeline if errors are found.
+ *
+ * When a sink is active on the calling thread, only the errors reported into
+ * that sink are considered and the thread longjmps to sink->bail instead of
+ * exiting.
  */
 void scu_check_errors();
 
+/*
+ * @brief: redirect all scu_* output of the calling thread into a sink.
+ *
+ * @param sink: pointer to an uninitialized scu_sink.
+ */
+void scu_sink_begin(scu_sink *sink);
+
+/*
+ * @brief: stop redirecting the calling thread's output.
+ */
+void scu_sink_end();
+
+/*
+ * @brief: write the captured output of a sink to stdout / stderr and release
+ * its buffers.
+ *
+ * @param sink: pointer to a sink previously passed to scu_sink_begin.
+ */
+void scu_sink_flush(scu_sink *sink);
+
 #endif
@@ -6,7 +6,8 @@
 #define VAR
 
 #include "common.h"
-#include "ds/ht.h"
+#include "ds/scope_map.h"
+#include "intern.h"
 
 /*
  * @enum type: represents data types.
@@ -21,12 +22,16 @@ typedef enum type {
 
 /*
  * @struct variable: represents a variable.
+ *
+ * slot is the index of the variable among the locals of its function, given
+ * to declarations by the semantic pass and copied to every use it resolves
+ * along with the declared type. Slot 0 means unresolved.
  */
 typedef struct variable {
   type type;
-  char *name;
+  sym_id name;
   u64 line;
-  u64 stack_offset;
+  u32 slot;
 
   bool is_array;
   u64 dimensions;
@@ -43,25 +48,15 @@ typedef struct variable {
 u32 get_type_size(type t);
 
 /*
- * @brief: check if a certain variable exists in a dynamic_array of variables.
- *
- * @param variables: pointer to hash table of variables.
- * @param var_to_find: pointer to a variable struct which we intend to find in
- * the dynamic_array.
- *
- * @return: int
- */
-u64 get_var_stack_offset(ht *variables, variable *var_to_find);
-
-/*
- * @brief: check for a variable's type by its name / identifier and line data.
+ * @brief: resolve a use of a variable to its declaration, annotating the use
+ * with the declared type and slot.
  *
- * @param variables: pointer to hash table of variable.
- * @param var_to_find: pointer to a variable struct which we intend to find in
- * the dynamic_array.
+ * @param variables: pointer to the scope_map of variables.
+ * @param use: pointer to the variable struct of the use, it is annotated in
+ * place.
  *
  * @return: data type of the variable (enumeration)
  */
-type get_var_type(ht *variables, variable *var_to_find);
+type resolve_var(scope_map *variables, variable *use);
 
 #endif // !VARE
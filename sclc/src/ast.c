@@ -1,15 +1,105 @@
 #include "ast.h"
 #include "common.h"
-#include "ds/arena.h"
 #include "ds/dynamic_array.h"
-#include "ds/ht.h"
+#include "intern.h"
+#include "memstat.h"
+#include "utils.h"
 
+#include <assert.h>
 #include <stdio.h>
 #include <string.h>
 
+/*
+ * @brief: initialize a pool of an ast with its null node.
+ *
+ * @param pool: pointer to an uninitialized dynamic_array.
+ * @param item_size: size of the nodes of the pool.
+ */
+static void ast_pool_init(dynamic_array *pool, u64 item_size) {
+  static const u8 null_node[128] = {0};
+  assert(item_size <= sizeof(null_node));
+
+  dynamic_array_init(pool, item_size);
+  dynamic_array_append(pool, (void *)null_node);
+}
+
+/*
+ * @brief: add a node to a pool of an ast.
+ *
+ * @param pool: pointer to the pool.
+ * @param node: pointer to the node (will be copied).
+ *
+ * @return: id of the node.
+ */
+static u32 ast_pool_add(dynamic_array *pool, void *node) {
+  mem_kind prev = memstat_tag(MEM_AST);
+  dynamic_array_append(pool, node);
+  memstat_untag(prev);
+  return pool->count - 1;
+}
+
 void ast_init(ast *a) {
-  arena_init(&a->arena, 5 << 20); // allocate 5 megabytes for now
-  dynamic_array_init(&a->instrs, sizeof(instr_node));
+  mem_kind prev = memstat_tag(MEM_AST);
+  ast_pool_init(&a->exprs, sizeof(expr_node));
+  ast_pool_init(&a->terms, sizeof(term_node));
+  ast_pool_init(&a->instrs, sizeof(instr_node));
+  ast_pool_init(&a->extra, sizeof(u32));
+
+  ast_pool_init(&a->array_inits, sizeof(initialize_array_node));
+  ast_pool_init(&a->ifs, sizeof(if_node));
+  ast_pool_init(&a->matches, sizeof(match_node));
+  ast_pool_init(&a->cases, sizeof(match_case_node));
+  ast_pool_init(&a->loops, sizeof(loop_node));
+  ast_pool_init(&a->fns, sizeof(fn_node));
+  ast_pool_init(&a->vars, sizeof(variable));
+  memstat_untag(prev);
+
+  a->body = (node_list){0};
+}
+
+expr_id ast_add_expr(ast *a, expr_node *expr) {
+  return ast_pool_add(&a->exprs, expr);
+}
+
+term_id ast_add_term(ast *a, term_node *term) {
+  return ast_pool_add(&a->terms, term);
+}
+
+instr_id ast_add_instr(ast *a, instr_node *instr) {
+  return ast_pool_add(&a->instrs, instr);
+}
+
+array_init_id ast_add_array_init(ast *a, initialize_array_node *node) {
+  return ast_pool_add(&a->array_inits, node);
+}
+
+if_id ast_add_if(ast *a, if_node *node) { return ast_pool_add(&a->ifs, node); }
+
+match_id ast_add_match(ast *a, match_node *node) {
+  return ast_pool_add(&a->matches, node);
+}
+
+case_id ast_add_case(ast *a, match_case_node *node) {
+  return ast_pool_add(&a->cases, node);
+}
+
+loop_id ast_add_loop(ast *a, loop_node *node) {
+  return ast_pool_add(&a->loops, node);
+}
+
+fn_id ast_add_fn(ast *a, fn_node *node) { return ast_pool_add(&a->fns, node); }
+
+var_id ast_add_var(ast *a, variable *node) {
+  return ast_pool_add(&a->vars, node);
+}
+
+node_list ast_add_list(ast *a, const u32 *ids, u32 count) {
+  node_list list = {.start = a->extra.count, .count = count};
+  mem_kind prev = memstat_tag(MEM_AST);
+  for (u32 i = 0; i < count; i++)
+    dynamic_array_append(&a->extra, (void *)&ids[i]);
+  memstat_untag(prev);
+  return list;
 }
 
 /*
@@ -22,10 +112,10 @@ static void check_var_and_print(variable *var) {
   case TYPE_INT:
   case TYPE_CHAR:
   case TYPE_STRING:
-    printf("%s", var->name);
+    scu_printf("%s", intern_str(var->name));
     break;
   case TYPE_POINTER:
-    printf("*%s", var->name);
+    scu_printf("*%s", intern_str(var->name));
     break;
   case TYPE_VOID:
     break;
@@ -35,60 +125,61 @@ static void check_var_and_print(variable *var) {
 /*
  * @brief: prints an expression node. (declaration)
  *
- * @param expr: pointer to an expression node.
+ * @param a: pointer to the ast.
+ * @param id: id of an expression node.
  */
-static void check_expr_and_print(expr_node *expr);
+static void check_expr_and_print(ast *a, expr_id id);
 
 /*
  * @brief: prints a term node.
  *
- * @param expr: pointer to a term node.
+ * @param a: pointer to the ast.
+ * @param id: id of a term node.
  */
-static void check_term_and_print(term_node *term) {
+static void check_term_and_print(ast *a, term_id id) {
+  term_node *term = ast_term(a, id);
   switch (term->kind) {
   case TERM_INT:
-    printf("%d", term->value.integer);
+    scu_printf("%d", term->value.integer);
     break;
   case TERM_CHAR:
-    printf("\'%c\'", term->value.character);
+    scu_printf("\'%c\'", term->value.character);
     break;
   case TERM_STRING:
     char *str = term->value.str;
     u64 len = strlen(str);
     if (len >= 1 && str[len - 1] == '\n')
-      printf("\"%.*s\"", (int)(len - 1), str);
+      scu_printf("\"%.*s\"", (int)(len - 1), str);
     else
-      printf("\"%s\"", str);
+      scu_printf("\"%s\"", str);
     break;
   case TERM_IDENTIFIER:
-    printf("%s", term->identifier.name);
+    scu_printf("%s", intern_str(term->identifier.name));
     break;
   case TERM_POINTER:
   case TERM_DEREF:
-    printf("*%s", term->identifier.name);
+    scu_printf("*%s", intern_str(term->identifier.name));
     break;
   case TERM_ADDOF:
-    printf("&%s", term->identifier.name);
+    scu_printf("&%s", intern_str(term->identifier.name));
     break;
   case TERM_ARRAY_ACCESS:
-    printf("%s[", term->array_access.array_var.name);
-    check_expr_and_print(term->array_access.index_expr);
-    printf("]");
+    scu_printf("%s[", intern_str(term->array_access.array_var.name));
+    check_expr_and_print(a, term->array_access.index_expr);
+    scu_printf("]");
     break;
   case TERM_ARRAY_LITERAL:
-    printf("{...}");
+    scu_printf("{...}");
     break;
   case TERM_FUNCTION_CALL:
-    printf("%s(", term->fn_call.name);
+    scu_printf("%s(", intern_str(term->fn_call.name));
     for (u64 i = 0; i < term->fn_call.parameters.count; i++) {
-      expr_node arg;
-      dynamic_array_get(&term->fn_call.parameters, i, &arg);
-      check_expr_and_print(&arg);
+      check_expr_and_print(a, ast_list(a, term->fn_call.parameters)[i]);
       if (i < term->fn_call.parameters.count - 1) {
-        printf(", ");
+        scu_printf(", ");
       }
     }
-    printf(")");
+    scu_printf(")");
     break;
   }
 }
@@ -96,47 +187,49 @@ static void check_term_and_print(term_node *term) {
 /*
  * @brief: prints an expression node. (definition)
  *
- * @param expr: pointer to an expression node.
+ * @param a: pointer to the ast.
+ * @param id: id of an expression node.
  */
-static void check_expr_and_print(expr_node *expr) {
+static void check_expr_and_print(ast *a, expr_id id) {
+  expr_node *expr = ast_expr(a, id);
   switch (expr->kind) {
   case EXPR_TERM:
-    check_term_and_print(&expr->term);
+    check_term_and_print(a, expr->term);
     break;
   case EXPR_ADD:
-    printf("(");
-    check_expr_and_print(expr->binary.left);
-    printf(" + ");
-    check_expr_and_print(expr->binary.right);
-    printf(")");
+    scu_printf("(");
+    check_expr_and_print(a, expr->binary.left);
+    scu_printf(" + ");
+    check_expr_and_print(a, expr->binary.right);
+    scu_printf(")");
     break;
   case EXPR_SUBTRACT:
-    printf("(");
-    check_expr_and_print(expr->binary.left);
-    printf(" - ");
-    check_expr_and_print(expr->binary.right);
-    printf(")");
+    scu_printf("(");
+    check_expr_and_print(a, expr->binary.left);
+    scu_printf(" - ");
+    check_expr_and_print(a, expr->binary.right);
+    scu_printf(")");
     break;
   case EXPR_MULTIPLY:
-    printf("(");
-    check_expr_and_print(expr->binary.left);
-    printf(" * ");
-    check_expr_and_print(expr->binary.right);
-    printf(")");
+    scu_printf("(");
+    check_expr_and_print(a, expr->binary.left);
+    scu_printf(" * ");
+    check_expr_and_print(a, expr->binary.right);
+    scu_printf(")");
     break;
   case EXPR_DIVIDE:
-    printf("(");
-    check_expr_and_print(expr->binary.left);
-    printf(" / ");
-    check_expr_and_print(expr->binary.right);
-    printf(")");
+    scu_printf("(");
+    check_expr_and_print(a, expr->binary.left);
+    scu_printf(" / ");
+    check_expr_and_print(a, expr->binary.right);
+    scu_printf(")");
     break;
   case EXPR_MODULO:
-    printf("(");
-    check_expr_and_print(expr->binary.left);
-    printf(" %% ");
-    check_expr_and_print(expr->binary.right);
-    printf(")");
+    scu_printf("(");
+    check_expr_and_print(a, expr->binary.left);
+    scu_printf(" %% ");
+    check_expr_and_print(a, expr->binary.right);
+    scu_printf(")");
     break;
   }
 }
@@ -147,33 +240,33 @@ static void check_expr_and_print(expr_node *expr) {
  * @param bnode: pointer to a binary node.
  * @param operator: the operator to print between the two nodes.
  */
-static void check_binary_node_and_print(term_binary_node *bnode,
+static void check_binary_node_and_print(ast *a, term_binary_node *bnode,
                                         char *operator) {
-  check_term_and_print(&bnode->lhs);
-  printf(" %s ", operator);
-  check_term_and_print(&bnode->rhs);
-  printf("\n");
+  check_term_and_print(a, bnode->lhs);
+  scu_printf(" %s ", operator);
+  check_term_and_print(a, bnode->rhs);
+  scu_printf("\n");
 }
 
-static void check_rel_node_and_print(rel_node *rel) {
+static void check_rel_node_and_print(ast *a, rel_node *rel) {
   switch (rel->kind) {
   case REL_IS_EQUAL:
-    check_binary_node_and_print(&rel->comparison, "==");
+    check_binary_node_and_print(a, &rel->comparison, "==");
     break;
   case REL_NOT_EQUAL:
-    check_binary_node_and_print(&rel->comparison, "!=");
+    check_binary_node_and_print(a, &rel->comparison, "!=");
     break;
   case REL_LESS_THAN:
-    check_binary_node_and_print(&rel->comparison, "<");
+    check_binary_node_and_print(a, &rel->comparison, "<");
     break;
   case REL_LESS_THAN_OR_EQUAL:
-    check_binary_node_and_print(&rel->comparison, "<=");
+    check_binary_node_and_print(a, &rel->comparison, "<=");
     break;
   case REL_GREATER_THAN:
-    check_binary_node_and_print(&rel->comparison, ">");
+    check_binary_node_and_print(a, &rel->comparison, ">");
     break;
   case REL_GREATER_THAN_OR_EQUAL:
-    check_binary_node_and_print(&rel->comparison, ">=");
+    check_binary_node_and_print(a, &rel->comparison, ">=");
     break;
   }
 }
@@ -181,63 +274,115 @@ static void check_rel_node_and_print(rel_node *rel) {
 /*
  * Counts the indentation for ast printing
  */
-static u32 icount = 0;
+static _Thread_local u32 icount = 0;
 
 #define PRINT_INDENTATION                                                      \
   for (u32 i = 0; i < icount; i++)                                             \
-    fputc('\t', stdout);
+    scu_printf("\t");
 
-static void print_cond_block(cond_block_node *block) {
+/*
+ * @brief: print a list of instructions.
+ *
+ * @param a: pointer to the ast.
+ * @param instrs: list of instruction ids.
+ */
+static void print_instrs(ast *a, node_list instrs) {
+  for (u32 i = 0; i < instrs.count; i++)
+    print_instr(a, ast_instr(a, ast_list(a, instrs)[i]));
+}
+
+static void print_cond_block(ast *a, cond_block_node *block) {
   if (!block)
     return;
 
   icount++;
 
   if (block->kind == COND_SINGLE_INSTR) {
-    print_instr(block->single);
+    print_instr(a, ast_instr(a, block->single));
   } else {
-    for (u64 i = 0; i < block->multi.count; i++) {
-      instr_node instr;
-      dynamic_array_get(&block->multi, i, &instr);
-      print_instr(&instr);
-    }
+    print_instrs(a, block->multi);
   }
 
   icount--;
 }
 
+/*
+ * @brief: print the parameters and return types of a function, after its
+ * name.
+ *
+ * @param a: pointer to the ast.
+ * @param fn: pointer to a function node.
+ */
+static void print_fn_signature(ast *a, fn_node *fn) {
+  for (u64 i = 0; i < fn->parameters.count; i++) {
+    check_var_and_print(ast_param(a, fn, i));
+    if (i < fn->parameters.count - 1) {
+      scu_printf(", ");
+    }
+  }
+  if (fn->is_variadic) {
+    scu_printf(", ...");
+  }
+  scu_printf(")");
+
+  if (fn->returntypes.count > 0) {
+    scu_printf(" : ");
+    for (u64 i = 0; i < fn->returntypes.count; i++) {
+      switch (ast_returntype(a, fn, i)) {
+      case TYPE_INT:
+        scu_printf("int");
+        break;
+      case TYPE_CHAR:
+        scu_printf("char");
+        break;
+      case TYPE_POINTER:
+        scu_printf("pointer");
+        break;
+      default:
+        scu_printf("unknown");
+        break;
+      }
+      if (i < fn->returntypes.count - 1) {
+        scu_printf(", ");
+      }
+    }
+  }
+  scu_printf("\n");
+}
+
 /*
  * @brief: print an instruction.
  *
+ * @param a: pointer to the ast of the instruction.
  * @param instr: pointer to an instruction.
  */
-void print_instr(instr_node *instr) {
+void print_instr(ast *a, instr_node *instr) {
   PRINT_INDENTATION
 
-  printf("[line %zu] ", instr->line);
+  scu_printf("[line %zu] ", instr->line);
 
   switch (instr->kind) {
   case INSTR_DECLARE:
-    printf("declare: ");
+    scu_printf("declare: ");
     check_var_and_print(&instr->declare_variable);
-    printf("\n");
+    scu_printf("\n");
     break;
 
   case INSTR_INITIALIZE:
-    printf("initialize: ");
+    scu_printf("initialize: ");
     check_var_and_print(&instr->initialize_variable.var);
-    printf(" = ");
+    scu_printf(" = ");
     switch (instr->initialize_variable.var.type) {
     case TYPE_INT:
     case TYPE_POINTER:
-      check_expr_and_print(instr->initialize_variable.expr);
-      printf("\n");
+      check_expr_and_print(a, instr->initialize_variable.expr);
+      scu_printf("\n");
       break;
     case TYPE_CHAR:
-      switch (instr->initialize_variable.expr->kind) {
+      expr_node *expr = ast_expr(a, instr->initialize_variable.expr);
+      switch (expr->kind) {
       case EXPR_TERM:
-        printf("\'%c\'\n",
-               instr->initialize_variable.expr->term.value.character);
+        scu_printf("\'%c\'\n", ast_term(a, expr->term)->value.character);
         break;
       default:
         break;
@@ -249,505 +394,238 @@ void print_instr(instr_node *instr) {
     break;
 
   case INSTR_ASSIGN:
-    printf("assign: ");
+    scu_printf("assign: ");
     check_var_and_print(&instr->assign.identifier);
-    printf(" = ");
-    check_expr_and_print(instr->assign.expr);
-    printf("\n");
+    scu_printf(" = ");
+    check_expr_and_print(a, instr->assign.expr);
+    scu_printf("\n");
     break;
 
   case INSTR_ASSIGN_TO_ARRAY_SUBSCRIPT:
-    printf("assign to array subscript: ");
+    scu_printf("assign to array subscript: ");
     check_var_and_print(&instr->assign_to_array_subscript.var);
-    printf("[");
-    check_expr_and_print(instr->assign_to_array_subscript.index_expr);
-    printf("] = ");
-    check_expr_and_print(instr->assign_to_array_subscript.expr_to_assign);
-    printf("\n");
+    scu_printf("[");
+    check_expr_and_print(a, instr->assign_to_array_subscript.index_expr);
+    scu_printf("] = ");
+    check_expr_and_print(a, instr->assign_to_array_subscript.expr_to_assign);
+    scu_printf("\n");
     break;
 
   case INSTR_DECLARE_ARRAY:
-    printf("declare array: ");
+    scu_printf("declare array: ");
     check_var_and_print(&instr->declare_array.var);
-    printf("[");
-    check_expr_and_print(instr->declare_array.size_expr);
-    printf("]\n");
-    break;
-
-  case INSTR_INITIALIZE_ARRAY:
-    printf("initialize array: ");
-    check_var_and_print(&instr->initialize_array.var);
-    printf("[");
-    check_expr_and_print(instr->initialize_array.size_expr);
-    printf("] = {");
-    for (u64 i = 0; i < instr->initialize_array.literal.elements.count; i++) {
-      expr_node elem;
-      dynamic_array_get(&instr->initialize_array.literal.elements, i, &elem);
-      check_expr_and_print(&elem);
-      if (i < instr->initialize_array.literal.elements.count - 1) {
-        printf(", ");
+    scu_printf("[");
+    check_expr_and_print(a, instr->declare_array.size_expr);
+    scu_printf("]\n");
+    break;
+
+  case INSTR_INITIALIZE_ARRAY: {
+    initialize_array_node *arr = ast_array_init(a, instr->initialize_array);
+    scu_printf("initialize array: ");
+    check_var_and_print(&arr->var);
+    scu_printf("[");
+    check_expr_and_print(a, arr->size_expr);
+    scu_printf("] = {");
+    node_list elements = arr->literal.elements;
+    for (u64 i = 0; i < elements.count; i++) {
+      check_expr_and_print(a, ast_list(a, elements)[i]);
+      if (i < elements.count - 1) {
+        scu_printf(", ");
       }
     }
-    printf("}\n");
+    scu_printf("}\n");
     break;
+  }
 
   case INSTR_IF: {
-    if_node *ifn = &instr->if_;
-    printf("if ");
-    check_rel_node_and_print(&ifn->rel);
+    if_node *ifn = ast_if(a, instr->if_);
+    scu_printf("if ");
+    check_rel_node_and_print(a, &ifn->rel);
     PRINT_INDENTATION
-    printf("then:\n");
-    print_cond_block(&ifn->then);
-    if (ifn->else_) {
+    scu_printf("then:\n");
+    print_cond_block(a, &ifn->then);
+    if (ifn->has_else) {
       PRINT_INDENTATION
-      printf("else:\n");
-      print_cond_block(ifn->else_);
+      scu_printf("else:\n");
+      print_cond_block(a, &ifn->else_);
     }
     break;
   }
 
   case INSTR_MATCH: {
-    match_node *match = &instr->match;
+    match_node *match = ast_match(a, instr->match);
 
-    printf("match ");
-    check_expr_and_print(match->expr);
-    printf(" {\n");
+    scu_printf("match ");
+    check_expr_and_print(a, match->expr);
+    scu_printf(" {\n");
 
     icount++;
 
     for (u64 i = 0; i < match->cases.count; i++) {
-      match_case_node case_node;
-      dynamic_array_get(&match->cases, i, &case_node);
+      match_case_node *case_node = ast_case(a, ast_list(a, match->cases)[i]);
 
       PRINT_INDENTATION
 
-      printf("case ");
+      scu_printf("case ");
 
-      switch (case_node.kind) {
+      switch (case_node->kind) {
       case MATCH_CASE_VALUES: {
-        for (u64 j = 0; j < case_node.values.values.count; j++) {
-          expr_node *val;
-          dynamic_array_get(&case_node.values.values, j, &val);
-          check_expr_and_print(val);
-          if (j < case_node.values.values.count - 1)
-            printf(", ");
+        for (u64 j = 0; j < case_node->values.values.count; j++) {
+          check_expr_and_print(a, ast_list(a, case_node->values.values)[j]);
+          if (j < case_node->values.values.count - 1)
+            scu_printf(", ");
         }
-        printf(":\n");
+        scu_printf(":\n");
         break;
       }
 
       case MATCH_CASE_RANGE: {
-        check_expr_and_print(case_node.range.start);
-        printf("...");
-        check_expr_and_print(case_node.range.end);
-        printf(":\n");
+        check_expr_and_print(a, case_node->range.start);
+        scu_printf("...");
+        check_expr_and_print(a, case_node->range.end);
+        scu_printf(":\n");
         break;
       }
 
       case MATCH_CASE_DEFAULT: {
-        printf("_:\n");
+        scu_printf("_:\n");
         break;
       }
       }
 
-      print_cond_block(&case_node.body);
+      print_cond_block(a, &case_node->body);
     }
 
     icount--;
 
     PRINT_INDENTATION
 
-    printf("}\n");
+    scu_printf("}\n");
 
     break;
   }
 
   case INSTR_GOTO:
-    printf("goto: %s\n", instr->goto_.label);
+    scu_printf("goto: %s\n", intern_str(instr->goto_.label));
     break;
 
   case INSTR_LABEL:
-    printf("label: %s\n", instr->label.label);
+    scu_printf("label: %s\n", intern_str(instr->label.label));
     break;
 
-  case INSTR_LOOP:
-    switch (instr->loop.kind) {
+  case INSTR_LOOP: {
+    loop_node *loop = ast_loop(a, instr->loop);
+    switch (loop->kind) {
     case LOOP_UNCONDITIONAL:
-      printf("loop starts: \n");
+      scu_printf("loop starts: \n");
       break;
 
     case LOOP_WHILE:
-      printf("while loop starts, break condition: ");
-      check_rel_node_and_print(&instr->loop.conditional.break_condition);
+      scu_printf("while loop starts, break condition: ");
+      check_rel_node_and_print(a, &loop->conditional.break_condition);
       break;
 
     case LOOP_DO_WHILE:
-      printf("do-while-loop starts, break condition: ");
-      check_rel_node_and_print(&instr->loop.conditional.break_condition);
+      scu_printf("do-while-loop starts, break condition: ");
+      check_rel_node_and_print(a, &loop->conditional.break_condition);
       break;
 
     case LOOP_FOR:
-      printf("for %s in ", instr->loop._for.iterator.name);
-      check_expr_and_print(instr->loop._for.range_start);
-      printf("...");
-      check_expr_and_print(instr->loop._for.range_end);
-      printf(" {\n");
+      scu_printf("for %s in ", intern_str(loop->_for.iterator.name));
+      check_expr_and_print(a, loop->_for.range_start);
+      scu_printf("...");
+      check_expr_and_print(a, loop->_for.range_end);
+      scu_printf(" {\n");
       break;
     }
 
     icount++;
 
-    for (u64 i = 0; i < instr->loop.instrs.count; i++) {
-      instr_node _instr;
-      dynamic_array_get(&instr->loop.instrs, i, &_instr);
-      print_instr(&_instr);
-    }
+    print_instrs(a, loop->instrs);
 
     icount--;
     break;
+  }
 
   case INSTR_LOOP_BREAK:
-    printf("loop break\n");
+    scu_printf("loop break\n");
     break;
 
   case INSTR_LOOP_CONTINUE:
-    printf("loop continue\n");
+    scu_printf("loop continue\n");
     break;
 
-  case INSTR_FN_DECLARE:
-    printf("function %s: %s(",
-           instr->fn_declare_node.kind == FN_DECLARED ? "declaration"
-                                                      : "definition",
-           instr->fn_declare_node.name);
+  case INSTR_FN_DECLARE: {
+    fn_node *fn = ast_fn(a, instr->fn_declare_node);
+    scu_printf("function %s: %s(",
+               fn->kind == FN_DECLARED ? "declaration" : "definition",
+               intern_str(fn->name));
+    print_fn_signature(a, fn);
 
-    for (u64 i = 0; i < instr->fn_declare_node.parameters.count; i++) {
-      variable param;
-      dynamic_array_get(&instr->fn_declare_node.parameters, i, &param);
-      check_var_and_print(&param);
-      if (i < instr->fn_declare_node.parameters.count - 1) {
-        printf(", ");
-      }
-    }
-    if (instr->fn_declare_node.is_variadic) {
-      printf(", ...");
-    }
-    printf(")");
-
-    if (instr->fn_declare_node.returntypes.count > 0) {
-      printf(" : ");
-      for (u64 i = 0; i < instr->fn_declare_node.returntypes.count; i++) {
-        type ret_type;
-        dynamic_array_get(&instr->fn_declare_node.returntypes, i, &ret_type);
-        switch (ret_type) {
-        case TYPE_INT:
-          printf("int");
-          break;
-        case TYPE_CHAR:
-          printf("char");
-          break;
-        case TYPE_POINTER:
-          printf("pointer");
-          break;
-        default:
-          printf("unknown");
-          break;
-        }
-        if (i < instr->fn_declare_node.returntypes.count - 1) {
-          printf(", ");
-        }
-      }
-    }
-    printf("\n");
-
-    if (instr->fn_declare_node.kind == FN_DEFINED) {
-      for (u64 i = 0; i < instr->fn_declare_node.defined.instrs.count; i++) {
-        instr_node body_instr;
-        dynamic_array_get(&instr->fn_declare_node.defined.instrs, i,
-                          &body_instr);
-        print_instr(&body_instr);
-      }
-    }
+    if (fn->kind == FN_DEFINED)
+      print_instrs(a, fn->defined.instrs);
     break;
+  }
 
-  case INSTR_FN_DEFINE:
-    printf("function definition: %s(", instr->fn_define_node.name);
-    for (u64 i = 0; i < instr->fn_define_node.parameters.count; i++) {
-      variable param;
-      dynamic_array_get(&instr->fn_define_node.parameters, i, &param);
-      check_var_and_print(&param);
-      if (i < instr->fn_define_node.parameters.count - 1) {
-        printf(", ");
-      }
-    }
-    if (instr->fn_define_node.is_variadic) {
-      printf(", ...");
-    }
-    printf(")");
-
-    if (instr->fn_define_node.returntypes.count > 0) {
-      printf(" : ");
-      for (u64 i = 0; i < instr->fn_define_node.returntypes.count; i++) {
-        type ret_type;
-        dynamic_array_get(&instr->fn_define_node.returntypes, i, &ret_type);
-        switch (ret_type) {
-        case TYPE_INT:
-          printf("int");
-          break;
-        case TYPE_CHAR:
-          printf("char");
-          break;
-        case TYPE_POINTER:
-          printf("pointer");
-          break;
-        default:
-          printf("unknown");
-          break;
-        }
-        if (i < instr->fn_define_node.returntypes.count - 1) {
-          printf(", ");
-        }
-      }
-    }
-    printf("\n");
+  case INSTR_FN_DEFINE: {
+    fn_node *fn = ast_fn(a, instr->fn_define_node);
+    scu_printf("function definition: %s(", intern_str(fn->name));
+    print_fn_signature(a, fn);
 
     icount++;
 
-    for (u64 i = 0; i < instr->fn_define_node.defined.instrs.count; i++) {
-      instr_node body_instr;
-      dynamic_array_get(&instr->fn_define_node.defined.instrs, i, &body_instr);
-      print_instr(&body_instr);
-    }
+    print_instrs(a, fn->defined.instrs);
 
     icount--;
     break;
+  }
 
   case INSTR_RETURN:
-    printf("return: ");
+    scu_printf("return: ");
     if (instr->ret_node.returnvals.count == 0) {
-      printf("void\n");
+      scu_printf("void\n");
     } else {
       for (u64 i = 0; i < instr->ret_node.returnvals.count; i++) {
-        expr_node ret_expr;
-        dynamic_array_get(&instr->ret_node.returnvals, i, &ret_expr);
-        check_expr_and_print(&ret_expr);
+        check_expr_and_print(a, ast_list(a, instr->ret_node.returnvals)[i]);
         if (i < instr->ret_node.returnvals.count - 1) {
-          printf(", ");
+          scu_printf(", ");
         }
       }
-      printf("\n");
+      scu_printf("\n");
     }
     break;
 
   case INSTR_FN_CALL:
-    printf("function call: %s(", instr->fn_call.name);
+    scu_printf("function call: %s(", intern_str(instr->fn_call.name));
     for (u64 i = 0; i < instr->fn_call.parameters.count; i++) {
-      expr_node arg;
-      dynamic_array_get(&instr->fn_call.parameters, i, &arg);
-      check_expr_and_print(&arg);
+      check_expr_and_print(a, ast_list(a, instr->fn_call.parameters)[i]);
       if (i < instr->fn_call.parameters.count - 1) {
-        printf(", ");
+        scu_printf(", ");
       }
     }
-    printf(")\n");
+    scu_printf(")\n");
     break;
   }
 }
 
 void print_ast(ast *program_ast) {
-  for (u64 i = 0; i < program_ast->instrs.count; i++) {
-    instr_node instr;
-    dynamic_array_get(&program_ast->instrs, i, &instr);
-    print_instr(&instr);
-  }
-}
-
-static void free_expr_node(expr_node *expr);
-
-static void free_exprs(dynamic_array *exprs);
-
-static void free_term_node(term_node *term) {
-  switch (term->kind) {
-  case TERM_INT:
-  case TERM_CHAR:
-  case TERM_STRING:
-  case TERM_IDENTIFIER:
-  case TERM_POINTER:
-  case TERM_DEREF:
-  case TERM_ADDOF:
-    break;
-  case TERM_ARRAY_ACCESS:
-    free_expr_node(term->array_access.index_expr);
-    break;
-  case TERM_ARRAY_LITERAL:
-    dynamic_array_free(&term->array_literal.elements);
-    break;
-  case TERM_FUNCTION_CALL:
-    free_exprs(&term->fn_call.parameters);
-    break;
-  }
-}
-
-static void free_expr_node(expr_node *expr) {
-  switch (expr->kind) {
-  case EXPR_TERM:
-    free_term_node(&expr->term);
-    break;
-  case EXPR_ADD:
-  case EXPR_SUBTRACT:
-  case EXPR_MULTIPLY:
-  case EXPR_DIVIDE:
-  case EXPR_MODULO:
-    free_expr_node(expr->binary.left);
-    free_expr_node(expr->binary.right);
-    break;
-  }
-}
-
-static void free_exprs(dynamic_array *exprs) {
-  for (u64 i = 0; i < exprs->count; i++) {
-    expr_node expr;
-    dynamic_array_get(exprs, i, &expr);
-    free_expr_node(&expr);
-  }
-  dynamic_array_free(exprs);
-}
-
-static void free_rel_node(rel_node *rel) {
-  free_term_node(&rel->comparison.lhs);
-  free_term_node(&rel->comparison.rhs);
-}
-
-static void free_instrs(dynamic_array *instrs);
-
-static void free_instr(instr_node *instr);
-
-static void free_cond_block_node(cond_block_node *block) {
-  if (!block)
-    return;
-
-  if (block->kind == COND_MULTI_INSTR)
-    free_instrs(&block->multi);
-  else
-    free_instr(block->single);
-}
-
-static void free_instr(instr_node *instr) {
-  switch (instr->kind) {
-  case INSTR_INITIALIZE:
-    free_expr_node(instr->initialize_variable.expr);
-    break;
-
-  case INSTR_DECLARE_ARRAY:
-    free_expr_node(instr->declare_array.size_expr);
-    break;
-
-  case INSTR_INITIALIZE_ARRAY:
-    free_expr_node(instr->initialize_array.size_expr);
-    free_exprs(&instr->initialize_array.literal.elements);
-    break;
-
-  case INSTR_ASSIGN:
-    free_expr_node(instr->assign.expr);
-    break;
-
-  case INSTR_ASSIGN_TO_ARRAY_SUBSCRIPT:
-    free_expr_node(instr->assign_to_array_subscript.index_expr);
-    free_expr_node(instr->assign_to_array_subscript.expr_to_assign);
-    break;
-
-  case INSTR_IF:
-    free_rel_node(&instr->if_.rel);
-    free_cond_block_node(&instr->if_.then);
-    free_cond_block_node(instr->if_.else_);
-    break;
-
-  case INSTR_MATCH:
-    free_expr_node(instr->match.expr);
-
-    for (u64 i = 0; i < instr->match.cases.count; i++) {
-      match_case_node case_node;
-      dynamic_array_get(&instr->match.cases, i, &case_node);
-
-      switch (case_node.kind) {
-      case MATCH_CASE_VALUES:
-        for (u64 j = 0; j < case_node.values.values.count; j++) {
-          expr_node *expr;
-          dynamic_array_get(&case_node.values.values, j, &expr);
-          free_expr_node(expr);
-        }
-        dynamic_array_free(&case_node.values.values);
-        break;
-
-      case MATCH_CASE_RANGE:
-        free_expr_node(case_node.range.start);
-        free_expr_node(case_node.range.end);
-        break;
-
-      case MATCH_CASE_DEFAULT:
-        break;
-      }
-
-      free_cond_block_node(&case_node.body);
-    }
-
-    dynamic_array_free(&instr->match.cases);
-    break;
-
-  case INSTR_LOOP:
-    switch (instr->loop.kind) {
-    case LOOP_DO_WHILE:
-    case LOOP_WHILE:
-      free_rel_node(&instr->loop.conditional.break_condition);
-      break;
-    case LOOP_FOR:
-      free_expr_node(instr->loop._for.range_start);
-      free_expr_node(instr->loop._for.range_end);
-      break;
-    case LOOP_UNCONDITIONAL:
-      break;
-    }
-
-    ht_destroy(instr->loop.variables);
-    free_instrs(&instr->loop.instrs);
-    break;
-
-  case INSTR_FN_DEFINE:
-    ht_destroy(instr->fn_define_node.defined.variables);
-    free_instrs(&instr->fn_define_node.defined.instrs);
-  case INSTR_FN_DECLARE:
-    dynamic_array_free(&instr->fn_declare_node.returntypes);
-    dynamic_array_free(&instr->fn_declare_node.parameters);
-    break;
-
-  case INSTR_RETURN:
-    free_exprs(&instr->ret_node.returnvals);
-    break;
-
-  case INSTR_FN_CALL:
-    free_exprs(&instr->fn_call.parameters);
-    break;
-
-  case INSTR_DECLARE:
-  case INSTR_GOTO:
-  case INSTR_LABEL:
-  case INSTR_LOOP_BREAK:
-  case INSTR_LOOP_CONTINUE:
-    break;
-  }
-}
-
-static void free_instrs(dynamic_array *instrs) {
-  for (u64 i = 0; i < instrs->count; i++) {
-    instr_node instr;
-    dynamic_array_get(instrs, i, &instr);
-    free_instr(&instr);
-  }
-  dynamic_array_free(instrs);
+  print_instrs(program_ast, program_ast->body);
 }
 
 void ast_free(ast *program_ast) {
   if (program_ast == NULL)
     return;
-  free_instrs(&program_ast->instrs);
-  arena_free(&program_ast->arena);
+
+  dynamic_array_free(&program_ast->exprs);
+  dynamic_array_free(&program_ast->terms);
+  dynamic_array_free(&program_ast->instrs);
+  dynamic_array_free(&program_ast->extra);
+
+  dynamic_array_free(&program_ast->array_inits);
+  dynamic_array_free(&program_ast->ifs);
+  dynamic_array_free(&program_ast->matches);
+  dynamic_array_free(&program_ast->cases);
+  dynamic_array_free(&program_ast->loops);
+  dynamic_array_free(&program_ast->fns);
+  dynamic_array_free(&program_ast->vars);
 }
@@ -1,5 +1,7 @@
 #include "backend/backend.h"
 #include "backend/llvm/llvm.h"
+#include "memstat.h"
+#include "timing.h"
 
 #include <stdlib.h>
 
@@ -12,20 +14,42 @@ void backend_init(backend *backend, cstate *cst) {
   backend->cleanup = llvm_backend_cleanup;
 
   backend->link = llvm_backend_link;
+  backend->run = llvm_backend_run;
+  backend->eval = llvm_backend_eval;
+  backend->eval_end = llvm_backend_eval_end;
 
   // one-time backend setup
   backend->setup(cst);
 }
 
 void backend_compile(backend *backend, cstate *cst, fstate *fst) {
+  // what the backend allocates on its own shows as growth of the heap, which
+  // is the whole process': other files compiled meanwhile (-j) would count
+  bool measure = memstat_enabled() &&
+                 (cst->options.jobs == 1 || cst->files.count == 1);
+  u64 heap = measure ? memstat_heap_in_use() : 0;
+  if (memstat_enabled() && !measure)
+    memstat_unmeasured(MEM_LLVM);
+
+  u64 start = timing_phase_begin(PHASE_IRGEN);
   if (backend->compile)
     backend->compile(cst, fst);
 
+  if (measure) {
+    u64 grown = memstat_heap_in_use();
+    memstat_add(MEM_LLVM, grown > heap ? grown - heap : 0);
+  }
+  timing_phase_end(PHASE_IRGEN, start);
+
+  start = timing_phase_begin(PHASE_OPTIMIZE);
   if (backend->optimize)
     backend->optimize(cst, fst);
+  timing_phase_end(PHASE_OPTIMIZE, start);
 
+  start = timing_phase_begin(PHASE_EMIT);
   if (backend->emit)
     backend->emit(cst, fst);
+  timing_phase_end(PHASE_EMIT, start);
 
   if (backend->cleanup)
     backend->cleanup(cst, fst);
@@ -39,4 +63,7 @@ void backend_free(backend *backend) {
   backend->compile = NULL;
   backend->emit = NULL;
   backend->cleanup = NULL;
+  backend->run = NULL;
+  backend->eval = NULL;
+  backend->eval_end = NULL;
 }
@@ -6,16 +6,190 @@ extern "C" {
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <vector>
 
-void ld_link(const char *output_file,
-             const std::vector<const char *> &obj_files) {
+#ifdef SCLC_HAVE_LLD
+#include <lld/Common/Driver.h>
+#include <llvm/Support/raw_ostream.h>
+#include <mutex>
+
+LLD_HAS_DRIVER(elf)
+#endif
+
+/*
+ * Directories searched for the start files and libc, multiarch first.
+ */
+static const char *const crt_dirs[] = {
+    "/usr/lib/x86_64-linux-gnu",
+    "/usr/lib64",
+    "/lib64",
+    "/usr/lib",
+    "/lib",
+};
+
+/*
+ * Directories holding one directory per installed gcc version, which has
+ * crtbeginS.o, crtendS.o and libgcc.
+ */
+static const char *const gcc_roots[] = {
+    "/usr/lib/gcc/x86_64-linux-gnu",
+    "/usr/lib/gcc/x86_64-pc-linux-gnu",
+    "/usr/lib64/gcc/x86_64-pc-linux-gnu",
+    "/usr/lib/gcc/x86_64-redhat-linux",
+    "/usr/lib64/gcc/x86_64-suse-linux",
+};
+
+/*
+ * Where the dynamic linker is, the path of the x86_64 ABI first.
+ */
+static const char *const dynamic_linkers[] = {
+    "/lib64/ld-linux-x86-64.so.2",
+    "/lib/x86_64-linux-gnu/ld-linux-x86-64.so.2",
+    "/usr/lib64/ld-linux-x86-64.so.2",
+};
+
+static bool ld_exists(const std::string &path) {
+  return access(path.c_str(), R_OK) == 0;
+}
+
+bool ld_find_libc(ld_libc &libc) {
+  libc = ld_libc{};
+
+  for (const char *dir : crt_dirs) {
+    std::string d = dir;
+    if (ld_exists(d + "/Scrt1.o") && ld_exists(d + "/crti.o") &&
+        ld_exists(d + "/crtn.o") &&
+        (ld_exists(d + "/libc.so") || ld_exists(d + "/libc.a"))) {
+      libc.crt_dir = d;
+      break;
+    }
+  }
+
+  for (const char *path : dynamic_linkers) {
+    if (ld_exists(path)) {
+      libc.dynamic_linker = path;
+      break;
+    }
+  }
+
+  // the newest gcc has the runtime the system's own programs link against
+  for (const char *root : gcc_roots) {
+    std::error_code ec;
+    for (const auto &entry : std::filesystem::directory_iterator(root, ec)) {
+      std::string d = entry.path().string();
+      if (!ld_exists(d + "/crtbeginS.o") || !ld_exists(d + "/crtendS.o"))
+        continue;
+      if (libc.gcc_dir.empty() ||
+          strverscmp(d.c_str(), libc.gcc_dir.c_str()) > 0)
+        libc.gcc_dir = d;
+    }
+    if (!libc.gcc_dir.empty())
+      break;
+  }
+
+  return !libc.crt_dir.empty() && !libc.dynamic_linker.empty();
+}
+
+#ifdef SCLC_HAVE_LLD
+/*
+ * lld keeps its state in globals, so one link runs at a time (files compiled
+ * by -j jobs combine their partitions concurrently). Once lld reports that it
+ * cannot run again, the links after it run cc.
+ */
+static std::mutex lld_mutex;
+static bool lld_can_run = true;
+
+/*
+ * @brief: run lld's ELF driver in this process, exiting if the link fails.
+ *
+ * @param argv: arguments, starting with "ld.lld".
+ *
+ * @return: false if lld cannot be run anymore and nothing was linked.
+ */
+static bool ld_run_lld(const std::vector<std::string> &argv) {
+  std::vector<const char *> args;
+  for (const std::string &arg : argv)
+    args.push_back(arg.c_str());
+
+  std::lock_guard<std::mutex> lock(lld_mutex);
+  if (!lld_can_run)
+    return false;
+
+  lld::Result result = lld::lldMain(args, llvm::outs(), llvm::errs(),
+                                    {{lld::Gnu, &lld::elf::link}});
+  llvm::outs().flush();
+  llvm::errs().flush();
+  lld_can_run = result.canRunAgain;
+
+  if (result.retCode != 0) {
+    scu_perror((char *)"Linking failed\n");
+    exit(1);
+  }
+
+  return true;
+}
+
+/*
+ * @brief: link with lld's ELF driver in this process, with the arguments cc
+ * would pass to the system linker for a position independent executable.
+ *
+ * @return: false if lld cannot be run anymore and nothing was linked.
+ */
+static bool ld_link_lld(const char *output_file,
+                        const std::vector<const char *> &obj_files,
+                        const ld_libc &libc) {
+  bool gcc = !libc.gcc_dir.empty();
+  const std::string &crt = libc.crt_dir;
+
+  std::vector<std::string> argv = {
+      "ld.lld", "--eh-frame-hdr", "-m", "elf_x86_64", "--hash-style=gnu",
+      "-pie", "-dynamic-linker", libc.dynamic_linker, "-o", output_file,
+      crt + "/Scrt1.o", crt + "/crti.o",
+  };
+  if (gcc)
+    argv.push_back(libc.gcc_dir + "/crtbeginS.o");
+
+  argv.push_back("-L" + crt);
+  if (gcc)
+    argv.push_back("-L" + libc.gcc_dir);
+
+  argv.insert(argv.end(), obj_files.begin(), obj_files.end());
+
+  // libgcc around libc, as cc does
+  std::vector<std::string> libgcc;
+  if (gcc)
+    libgcc = {"-lgcc", "--push-state", "--as-needed", "-lgcc_s",
+              "--pop-state"};
+  argv.insert(argv.end(), libgcc.begin(), libgcc.end());
+  argv.push_back("-lc");
+  argv.insert(argv.end(), libgcc.begin(), libgcc.end());
+
+  if (gcc)
+    argv.push_back(libc.gcc_dir + "/crtendS.o");
+  argv.push_back(crt + "/crtn.o");
+
+  return ld_run_lld(argv);
+}
+#endif
+
+/*
+ * @brief: link by running cc, which runs the system linker.
+ *
+ * @param flags: flags passed to cc before the output file.
+ */
+static void ld_link_cc(const char *output_file,
+                       const std::vector<const char *> &obj_files,
+                       const std::vector<const char *> &flags = {}) {
   std::vector<const char *> args;
 
   args.push_back("cc");
+  args.insert(args.end(), flags.begin(), flags.end());
 
   args.push_back("-o");
   args.push_back(output_file);
@@ -46,3 +220,36 @@ void ld_link(const char *output_file,
     exit(1);
   }
 }
+
+void ld_link(const char *output_file,
+             const std::vector<const char *> &obj_files, bool use_cc) {
+#ifdef SCLC_HAVE_LLD
+  if (!use_cc) {
+    ld_libc libc;
+    if (!ld_find_libc(libc))
+      scu_pwarning((char *)"C runtime not found, linking with cc\n");
+    else if (ld_link_lld(output_file, obj_files, libc))
+      return;
+  }
+#else
+  (void)use_cc;
+#endif
+
+  ld_link_cc(output_file, obj_files);
+}
+
+void ld_relocatable(const char *output_file,
+                    const std::vector<const char *> &obj_files, bool use_cc) {
+#ifdef SCLC_HAVE_LLD
+  if (!use_cc) {
+    std::vector<std::string> argv = {"ld.lld", "-r", "-o", output_file};
+    argv.insert(argv.end(), obj_files.begin(), obj_files.end());
+    if (ld_run_lld(argv))
+      return;
+  }
+#else
+  (void)use_cc;
+#endif
+
+  ld_link_cc(output_file, obj_files, {"-r", "-nostdlib"});
+}
@@ -1,8 +1,15 @@
 #include "backend/llvm/llvm.h"
 #include "backend/llvm/ld_utils.hpp"
 #include "backend/llvm/llvm_irgen.hpp"
+#include <atomic>
+#include <cstdio>
 #include <filesystem>
+#include <memory>
 #include <stddef.h>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
 
 extern "C" {
 #include "ast.h"
@@ -11,48 +18,706 @@ extern "C" {
 #include "cstate.h"
 #include "ds/dynamic_array.h"
 #include "fstate.h"
+#include "timing.h"
+#include "tpool.h"
 #include "utils.h"
 }
 
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Analysis/ModuleSummaryAnalysis.h>
+#include <llvm/Analysis/ProfileSummaryInfo.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/IRPartitionLayer.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/LegacyPassManager.h>
 #include <llvm/IR/Module.h>
+#include <llvm/IR/PassInstrumentation.h>
 #include <llvm/IR/PassManager.h>
 #include <llvm/IR/Verifier.h>
+#include <llvm/LTO/LTO.h>
 #include <llvm/MC/TargetRegistry.h>
 #include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/CachePruning.h>
+#include <llvm/Support/Caching.h>
 #include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/Threading.h>
 #include <llvm/Target/TargetMachine.h>
 #include <llvm/Target/TargetOptions.h>
 #include <llvm/TargetParser/Host.h>
 #include <llvm/TargetParser/Triple.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/SplitModule.h>
 
 typedef struct llvm_backend_ctx llvm_backend_ctx;
 
-static llvm_backend_ctx bctx;
+/*
+ * Target looked up once in llvm_backend_init, shared by every file.
+ */
+static const llvm::Target *target = nullptr;
 
-extern "C" {
-void llvm_backend_init(cstate *cst) {
-  llvm::InitializeNativeTarget();
-  llvm::InitializeNativeTargetAsmParser();
-  llvm::InitializeNativeTargetAsmPrinter();
+/*
+ * Modules kept for the JIT with --run, one per file in input order, filled in
+ * by llvm_backend_emit.
+ */
+static std::vector<llvm::orc::ThreadSafeModule> jit_modules;
 
-  bctx.context = new llvm::LLVMContext();
+/*
+ * @struct llvm_session_global: global holding a top level variable of --repl
+ * between inputs.
+ */
+struct llvm_session_global {
+  std::string name;
+  llvm::Type *type;
+};
 
-  std::string module_name = cst->output_filepath;
-  bctx.module = new llvm::Module(module_name, *bctx.context);
+/*
+ * @struct llvm_session: state of --repl kept between inputs. Every input is
+ * compiled into a module of its own, all in one context so that the types
+ * recorded here stay valid.
+ */
+struct llvm_session {
+  llvm::orc::ThreadSafeContext context;
+  llvm::LLVMContext *llvm_context;
+  std::unique_ptr<llvm::orc::LLJIT> jit;
+
+  /*
+   * Functions of earlier inputs, declared in every new module so that calls
+   * to them resolve to the code already in the JIT.
+   */
+  llvm::StringMap<llvm::FunctionType *> functions;
+
+  /*
+   * Globals of the top level variables, indexed by slot, type is null for
+   * slots without one.
+   */
+  std::vector<llvm_session_global> globals;
+
+  /*
+   * What the input being compiled adds to the above, recorded once it runs,
+   * and the name of its entry function (empty when it has no statements).
+   */
+  std::vector<std::pair<std::string, llvm::FunctionType *>> new_functions;
+  std::vector<std::pair<u32, llvm_session_global>> new_globals;
+  std::string entry;
+
+  u64 inputs;
+};
+
+/*
+ * Session of --repl, created with the context of its first input.
+ */
+static llvm_session *session = nullptr;
+
+/*
+ * @brief: record a span for every pass the new pass manager runs. Passes nest
+ * (pass managers and adaptors are passes too), so their start times are kept
+ * on a stack.
+ *
+ * @param PIC: callbacks handed to the PassBuilder
+ * @param starts: stack of start times, must outlive the pipeline run
+ */
+static void llvm_trace_passes(llvm::PassInstrumentationCallbacks &PIC,
+                              std::vector<u64> &starts) {
+  PIC.registerBeforeNonSkippedPassCallback(
+      [&starts](llvm::StringRef, llvm::Any) {
+        starts.push_back(timing_now());
+      });
+
+  auto end = [&starts](llvm::StringRef name) {
+    if (starts.empty())
+      return;
+    timing_span(name.data(), name.size(), "pass", starts.back(), timing_now());
+    starts.pop_back();
+  };
+
+  PIC.registerAfterPassCallback(
+      [end](llvm::StringRef name, llvm::Any, const llvm::PreservedAnalyses &) {
+        end(name);
+      });
+  PIC.registerAfterPassInvalidatedCallback(
+      [end](llvm::StringRef name, const llvm::PreservedAnalyses &) {
+        end(name);
+      });
+}
+
+/*
+ * @brief: create a target machine for a target triple. Target machines are
+ * not shared between threads, every module (and partition) gets its own.
+ */
+static llvm::TargetMachine *llvm_target_machine(const std::string &triple) {
+  llvm::TargetOptions opt;
+  llvm::Reloc::Model RM = llvm::Reloc::PIC_;
+
+  return target->createTargetMachine(llvm::Triple(triple), "generic", "", opt,
+                                     RM, llvm::CodeModel::Small);
+}
+
+/*
+ * @struct llvm_memory_objects: objects generated in memory, handed to the
+ * linker as memory files (/proc/self/fd/N), which are closed with it.
+ */
+struct llvm_memory_objects {
+  std::vector<int> fds;
+  std::vector<std::string> paths;
+
+  ~llvm_memory_objects() {
+    for (int fd : fds)
+      close(fd);
+  }
+
+  bool add(llvm::StringRef object) {
+    int fd = memfd_create("sclc.o", 0);
+    if (fd < 0)
+      return false;
+    fds.push_back(fd);
+    paths.push_back("/proc/self/fd/" + std::to_string(fd));
+
+    for (u64 off = 0; off < object.size();) {
+      ssize_t written = write(fd, object.data() + off, object.size() - off);
+      if (written <= 0)
+        return false;
+      off += written;
+    }
+    return true;
+  }
+
+  std::vector<const char *> files() const {
+    std::vector<const char *> files;
+    for (const std::string &path : paths)
+      files.push_back(path.c_str());
+    return files;
+  }
+};
+
+/*
+ * @struct llvm_partitions: the parts a module was split into for parallel
+ * code generation, as bitcode, and the object emitted for every part.
+ */
+struct llvm_partitions {
+  std::string triple;
+  std::vector<llvm::SmallVector<char, 0>> bitcode;
+  std::vector<llvm::SmallVector<char, 0>> objects;
+  std::atomic<bool> failed{false};
+};
+
+/*
+ * @brief: tpool job emitting the object of one partition. The partition is
+ * read back into a context of its own, so jobs share nothing but the target.
+ */
+static void llvm_emit_partition(void *ctx, u64 index) {
+  llvm_partitions *parts = static_cast<llvm_partitions *>(ctx);
+  u64 start = timing_now();
+
+  llvm::LLVMContext context;
+  const llvm::SmallVector<char, 0> &bitcode = parts->bitcode[index];
+  llvm::Expected<std::unique_ptr<llvm::Module>> module =
+      llvm::parseBitcodeFile(
+          llvm::MemoryBufferRef(llvm::StringRef(bitcode.data(), bitcode.size()),
+                                "partition"),
+          context);
+
+  if (!module) {
+    llvm::consumeError(module.takeError());
+    parts->failed = true;
+    return;
+  }
+
+  std::unique_ptr<llvm::TargetMachine> target_machine(
+      llvm_target_machine(parts->triple));
+  llvm::raw_svector_ostream dest(parts->objects[index]);
+  llvm::legacy::PassManager pass;
+
+  if (!target_machine ||
+      target_machine->addPassesToEmitFile(pass, dest, nullptr,
+                                          llvm::CodeGenFileType::ObjectFile)) {
+    parts->failed = true;
+    return;
+  }
+
+  pass.run(**module);
+
+  if (timing_tracing()) {
+    std::string name = "partition " + std::to_string(index);
+    timing_span(name.data(), name.size(), "codegen", start, timing_now());
+  }
+}
+
+/*
+ * @brief: emit the object of a module in n parts code generated in parallel
+ * (--codegen-threads), combined into one relocatable object. How the module
+ * is split only depends on the module and n, so the object is the same from
+ * build to build for a given n.
+ *
+ * @return: whether the object was written.
+ */
+static bool llvm_emit_split(cstate *cst, llvm_backend_ctx *bctx,
+                            const std::string &obj_filename) {
+  u32 n = cst->options.codegen_threads;
+
+  llvm_partitions parts;
+  parts.triple = bctx->target_triple;
+
+  // locals stay local (and with their users), so the parts of every file of
+  // the program can be linked together without their names clashing
+  llvm::SplitModule(
+      *bctx->module, n,
+      [&parts](std::unique_ptr<llvm::Module> part) {
+        parts.bitcode.emplace_back();
+        llvm::raw_svector_ostream os(parts.bitcode.back());
+        llvm::WriteBitcodeToFile(*part, os);
+      },
+      /*PreserveLocals=*/true, /*RoundRobin=*/true);
+
+  parts.objects.resize(parts.bitcode.size());
+  tpool_run(n, parts.bitcode.size(), llvm_emit_partition, &parts);
+
+  if (parts.failed) {
+    scu_perror(const_cast<char *>("Code generation of a partition failed\n"));
+    return false;
+  }
+
+  llvm_memory_objects objects;
+  for (const llvm::SmallVector<char, 0> &object : parts.objects) {
+    if (!objects.add(llvm::StringRef(object.data(), object.size()))) {
+      scu_perror(const_cast<char *>("Could not write partition objects\n"));
+      return false;
+    }
+  }
+
+  // the linker writes its output to a temporary file it renames over it,
+  // which cannot be done to a memory file: the parts are combined on disk
+  int fd;
+  llvm::SmallString<128> combined;
+  if (llvm::sys::fs::createTemporaryFile("sclc-split", "o", fd, combined)) {
+    scu_perror(const_cast<char *>("Could not create a temporary object\n"));
+    return false;
+  }
+  close(fd);
+
+  ld_relocatable(combined.c_str(), objects.files(), cst->options.link_cc);
+
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> object =
+      llvm::MemoryBuffer::getFile(combined);
+  llvm::sys::fs::remove(combined);
+
+  std::error_code ec;
+  llvm::raw_fd_ostream dest(obj_filename, ec, llvm::sys::fs::OF_None);
+  if (!object || ec) {
+    scu_perror(const_cast<char *>("Could not write the combined object\n"));
+    return false;
+  }
+
+  dest << (*object)->getBuffer();
+  return true;
+}
+
+/*
+ * @brief: write the bitcode of a file, for --emit=bc or as its object with
+ * -flto. A summary makes it a ThinLTO input, without one it is merged into
+ * the whole program.
+ */
+static void llvm_emit_bitcode(cstate *cst, llvm_backend_ctx *bctx,
+                              const std::string &obj_filename) {
+  std::error_code ec;
+  llvm::raw_fd_ostream dest(obj_filename, ec, llvm::sys::fs::OF_None);
+
+  if (ec) {
+    scu_perror(const_cast<char *>("Could not open output file: %s\n"),
+               ec.message().c_str());
+    return;
+  }
+
+  if (cst->options.lto == LTO_THIN) {
+    llvm::ProfileSummaryInfo psi(*bctx->module);
+    llvm::ModuleSummaryIndex index =
+        llvm::buildModuleSummaryIndex(*bctx->module, nullptr, &psi);
+    // the module hash keys the ThinLTO cache
+    llvm::WriteBitcodeToFile(*bctx->module, dest, false, &index,
+                             /*GenerateHash=*/true);
+  } else {
+    llvm::WriteBitcodeToFile(*bctx->module, dest);
+  }
+}
+
+/*
+ * @brief: write the IR of a module as text (--emit=ll).
+ */
+static void llvm_emit_ir(llvm_backend_ctx *bctx, const std::string &filename) {
+  std::error_code ec;
+  llvm::raw_fd_ostream ir_file(filename, ec, llvm::sys::fs::OF_None);
+
+  if (!ec) {
+    bctx->module->print(ir_file, nullptr);
+    ir_file.close();
+  } else {
+    scu_pwarning(const_cast<char *>("Could not write IR file: %s\n"),
+                 ec.message().c_str());
+  }
+}
+
+/*
+ * @brief: write the target assembly of a module (--emit=asm).
+ */
+static void llvm_emit_asm(llvm_backend_ctx *bctx, llvm::Module &module,
+                          const std::string &filename) {
+  std::error_code ec;
+  llvm::raw_fd_ostream asm_dest(filename, ec, llvm::sys::fs::OF_None);
+
+  if (ec) {
+    scu_pwarning(const_cast<char *>("Could not open asm file: %s\n"),
+                 ec.message().c_str());
+    return;
+  }
+
+  llvm::legacy::PassManager asm_pass;
+  if (bctx->target_machine->addPassesToEmitFile(
+          asm_pass, asm_dest, nullptr, llvm::CodeGenFileType::AssemblyFile)) {
+    scu_pwarning(const_cast<char *>("TargetMachine can't emit assembly\n"));
+  } else {
+    asm_pass.run(module);
+    asm_dest.flush();
+  }
+}
+
+/*
+ * @brief: report an error of the LTO library.
+ */
+static void llvm_lto_error(const char *what, llvm::Error err) {
+  scu_perror(const_cast<char *>("%s: %s\n"), what,
+             llvm::toString(std::move(err)).c_str());
+}
+
+/*
+ * @brief: link time optimization of the bitcode files of a -flto build.
+ * With -flto=full they are merged into one module that runs the LTO pipeline
+ * as a whole (code generated in --codegen-threads parts). With -flto=thin
+ * every module imports what it needs from the others by their summaries,
+ * and the modules are optimized and code generated on -j threads, their
+ * objects cached in <cache dir>/thinlto.
+ *
+ * @param objects: receives the generated objects.
+ *
+ * @return: whether the objects were generated.
+ */
+static bool llvm_lto(cstate *cst, const std::vector<const char *> &files,
+                     llvm_memory_objects &objects) {
+  llvm::lto::Config conf;
+  conf.CPU = "generic";
+  conf.RelocModel = llvm::Reloc::PIC_;
+  conf.CodeModel = llvm::CodeModel::Small;
+  conf.DefaultTriple = cst->llvm_target_triple;
+
+  // the LTO pipelines have no size levels, -Os and -Oz run O2
+  switch (cst->options.opt_level) {
+  case OPT_O0:
+    conf.OptLevel = 0;
+    break;
+  case OPT_O1:
+    conf.OptLevel = 1;
+    break;
+  case OPT_O3:
+    conf.OptLevel = 3;
+    break;
+  default:
+    conf.OptLevel = 2;
+    break;
+  }
+  conf.CGOptLevel = *llvm::CodeGenOpt::getLevel(conf.OptLevel);
 
-  bctx.builder = new llvm::IRBuilder<>(*bctx.context);
+  llvm::lto::ThinBackend backend = llvm::lto::createInProcessThinBackend(
+      llvm::heavyweight_hardware_concurrency(cst->options.jobs));
+  llvm::lto::LTO lto(std::move(conf), backend, cst->options.codegen_threads);
 
-  bctx.target_triple = cst->llvm_target_triple;
+  // inputs refer to their buffers until the run is over
+  std::vector<std::unique_ptr<llvm::MemoryBuffer>> buffers;
+  // defined symbols, and whether one of their definitions is strong
+  llvm::StringMap<bool> defined;
+
+  for (const char *file : files) {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer =
+        llvm::MemoryBuffer::getFile(file);
+    if (!buffer) {
+      scu_perror(const_cast<char *>("Could not read bitcode: %s\n"),
+                 buffer.getError().message().c_str());
+      return false;
+    }
+
+    llvm::Expected<std::unique_ptr<llvm::lto::InputFile>> input =
+        llvm::lto::InputFile::create((*buffer)->getMemBufferRef());
+    if (!input) {
+      llvm_lto_error("Invalid bitcode", input.takeError());
+      return false;
+    }
 
-  bctx.module->setTargetTriple(llvm::Triple(bctx.target_triple));
+    std::vector<llvm::lto::SymbolResolution> resolutions;
+    bool duplicate = false;
+
+    for (const llvm::lto::InputFile::Symbol &sym : (*input)->symbols()) {
+      llvm::lto::SymbolResolution res;
+
+      // the first definition wins, and two strong ones are an error, as they
+      // would be with the linker
+      if (!sym.isUndefined()) {
+        bool strong = !sym.isWeak() && !sym.isCommon();
+        auto [seen, first] = defined.try_emplace(sym.getName(), strong);
+
+        if (!first && strong && seen->second) {
+          scu_perror(const_cast<char *>("Duplicate symbol: %s\n"),
+                     sym.getName().str().c_str());
+          duplicate = true;
+        }
+
+        seen->second |= strong;
+        res.Prevailing = first;
+      }
+
+      res.FinalDefinitionInLinkageUnit = res.Prevailing;
+      // only the C runtime refers to the program from outside, by main,
+      // everything else may be internalized
+      res.VisibleToRegularObj = sym.getName() == "main";
+      resolutions.push_back(res);
+    }
+
+    if (duplicate)
+      return false;
+
+    buffers.push_back(std::move(*buffer));
+    if (llvm::Error err = lto.add(std::move(*input), resolutions)) {
+      llvm_lto_error("LTO failed", std::move(err));
+      return false;
+    }
+  }
+
+  std::vector<llvm::SmallVector<char, 0>> outputs(lto.getMaxTasks());
+
+  llvm::AddStreamFn add_stream = [&outputs](unsigned task,
+                                            const llvm::Twine &) {
+    return std::make_unique<llvm::CachedFileStream>(
+        std::make_unique<llvm::raw_svector_ostream>(outputs[task]));
+  };
+
+  // cache hits (and misses, once written) come back as buffers
+  llvm::AddBufferFn add_buffer = [&outputs](
+                                     unsigned task, const llvm::Twine &,
+                                     std::unique_ptr<llvm::MemoryBuffer> mb) {
+    outputs[task].assign(mb->getBufferStart(), mb->getBufferEnd());
+  };
+
+  llvm::FileCache cache;
+  std::string cache_dir;
+  if (cst->options.lto == LTO_THIN && cst->cache.dir) {
+    cache_dir = std::string(cst->cache.dir) + "/thinlto";
+    llvm::Expected<llvm::FileCache> local =
+        llvm::localCache("ThinLTO", "Thin", cache_dir, add_buffer);
+
+    if (local) {
+      cache = std::move(*local);
+    } else {
+      llvm::consumeError(local.takeError());
+      scu_pwarning(const_cast<char *>("Could not use ThinLTO cache: %s\n"),
+                   cache_dir.c_str());
+      cache_dir.clear();
+    }
+  }
+
+  if (llvm::Error err = lto.run(add_stream, cache)) {
+    llvm_lto_error("LTO failed", std::move(err));
+    return false;
+  }
+
+  if (!cache_dir.empty()) {
+    llvm::CachePruningPolicy policy;
+    policy.MaxSizeBytes = cst->options.cache_max_size;
+    llvm::pruneCache(cache_dir, policy);
+  }
+
+  for (const llvm::SmallVector<char, 0> &output : outputs) {
+    if (output.empty())
+      continue;
+    if (!objects.add(llvm::StringRef(output.data(), output.size()))) {
+      scu_perror(const_cast<char *>("Could not write LTO objects\n"));
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/*
+ * @brief: context of the --repl session, which is started on first use.
+ */
+static llvm::LLVMContext *llvm_session_context() {
+  if (!session) {
+    auto context = std::make_unique<llvm::LLVMContext>();
+    session = new llvm_session();
+    session->llvm_context = context.get();
+    session->context = llvm::orc::ThreadSafeContext(std::move(context));
+  }
+
+  return session->llvm_context;
+}
+
+/*
+ * @brief: type of the global holding a top level variable of --repl, null if
+ * it cannot be kept. Arrays with an initializer are allocas of n elements,
+ * they are kept as [n x element].
+ */
+static llvm::Type *llvm_session_type(llvm::AllocaInst *local) {
+  if (!local->isArrayAllocation())
+    return local->getAllocatedType();
+
+  auto *count = llvm::dyn_cast<llvm::ConstantInt>(local->getArraySize());
+  if (!count)
+    return nullptr;
+
+  return llvm::ArrayType::get(local->getAllocatedType(),
+                              count->getZExtValue());
+}
+
+/*
+ * @brief: generate an input of --repl: its functions, then its top level
+ * statements in an entry function run by llvm_backend_eval. Variables of
+ * earlier inputs are loaded from their globals into locals of the entry on
+ * the way in, and every top level variable is stored back on the way out, so
+ * the statements see them as plain locals.
+ */
+static void llvm_session_irgen(llvm_backend_ctx &bctx) {
+  llvm::Module &module = *bctx.module;
+  llvm::LLVMContext &context = *bctx.context;
+  llvm::IRBuilder<> &builder = *bctx.builder;
+  ast *program = bctx.program;
+  node_list body = program->body;
+
+  session->new_functions.clear();
+  session->new_globals.clear();
+  session->entry.clear();
+
+  for (u64 i = 0; i < body.count; i++) {
+    instr_node *instr = ast_instr(program, ast_list(program, body)[i]);
+    if (instr->kind == INSTR_FN_DECLARE)
+      llvm_irgen_instr(bctx, instr);
+  }
+
+  for (const auto &fn : session->functions) {
+    if (!module.getFunction(fn.getKey()))
+      llvm::Function::Create(fn.getValue(), llvm::Function::ExternalLinkage,
+                             fn.getKey(), module);
+  }
+
+  std::vector<instr_node *> statements;
+  for (u64 i = 0; i < body.count; i++) {
+    instr_node *instr = ast_instr(program, ast_list(program, body)[i]);
+    if (instr->kind == INSTR_FN_DEFINE)
+      llvm_irgen_instr(bctx, instr);
+    else if (instr->kind != INSTR_FN_DECLARE)
+      statements.push_back(instr);
+  }
+
+  for (llvm::Function &fn : module) {
+    if (!session->functions.count(fn.getName()))
+      session->new_functions.push_back(
+          {fn.getName().str(), fn.getFunctionType()});
+  }
+
+  if (statements.empty())
+    return;
+
+  session->entry = "__repl_" + std::to_string(session->inputs++);
+  llvm::Function *entry = llvm::Function::Create(
+      llvm::FunctionType::get(llvm::Type::getVoidTy(context), false),
+      llvm::Function::ExternalLinkage, session->entry, module);
+  builder.SetInsertPoint(llvm::BasicBlock::Create(context, "entry", entry));
+
+  llvm_irgen_clear_symbol_table(bctx);
+  bctx.locals.resize(session->globals.size(), nullptr);
+
+  for (u32 slot = 0; slot < session->globals.size(); slot++) {
+    const llvm_session_global &global = session->globals[slot];
+    if (!global.type)
+      continue;
+
+    llvm::Constant *storage =
+        module.getOrInsertGlobal(global.name, global.type);
+    llvm::AllocaInst *local = builder.CreateAlloca(global.type);
+    builder.CreateStore(builder.CreateLoad(global.type, storage), local);
+    bctx.locals[slot] = local;
+  }
+
+  for (instr_node *instr : statements) {
+    llvm_irgen_instr(bctx, instr);
+
+    if (builder.GetInsertBlock()->getTerminator())
+      return;
+  }
+
+  for (u32 slot = 1; slot < bctx.locals.size(); slot++) {
+    llvm::AllocaInst *local = bctx.locals[slot];
+    llvm::Type *type = local ? llvm_session_type(local) : nullptr;
+    if (!type)
+      continue;
+
+    // a variable declared again with another type gets a global of its own
+    llvm::Constant *storage;
+    if (slot < session->globals.size() && session->globals[slot].type == type) {
+      storage = module.getOrInsertGlobal(session->globals[slot].name, type);
+    } else {
+      std::string name = session->entry + "_" + std::to_string(slot);
+      storage = new llvm::GlobalVariable(module, type, false,
+                                         llvm::GlobalValue::ExternalLinkage,
+                                         llvm::Constant::getNullValue(type),
+                                         name);
+      session->new_globals.push_back({slot, {name, type}});
+    }
+
+    builder.CreateStore(builder.CreateLoad(type, local), storage);
+  }
+
+  builder.CreateRetVoid();
+}
+
+/*
+ * @brief: report an error of the JIT.
+ */
+static void llvm_jit_error(const char *what, llvm::Error err) {
+  scu_perror(const_cast<char *>("%s: %s\n"), what,
+             llvm::toString(std::move(err)).c_str());
+}
+
+/*
+ * @brief: resolve the symbols the JIT'd code does not define (printf, scanf
+ * and the rest of libc) from the compiler's own process.
+ */
+static bool llvm_jit_add_host(llvm::orc::LLJIT &jit) {
+  llvm::Expected<std::unique_ptr<llvm::orc::DynamicLibrarySearchGenerator>>
+      host = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+          jit.getDataLayout().getGlobalPrefix());
+  if (!host) {
+    llvm_jit_error("Could not resolve symbols of the process",
+                   host.takeError());
+    return false;
+  }
+
+  jit.getMainJITDylib().addGenerator(std::move(*host));
+  return true;
+}
+
+extern "C" {
+void llvm_backend_init(cstate *cst) {
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmParser();
+  llvm::InitializeNativeTargetAsmPrinter();
 
   std::string error;
-  const llvm::Target *target =
-      llvm::TargetRegistry::lookupTarget(bctx.target_triple, error);
+  target = llvm::TargetRegistry::lookupTarget(cst->llvm_target_triple, error);
 
   if (!target) {
     scu_perror(const_cast<char *>("Failed to look up target: %s\n"),
@@ -60,34 +725,63 @@ void llvm_backend_init(cstate *cst) {
     return;
   }
 
-  llvm::TargetOptions opt;
-  llvm::Reloc::Model RM = llvm::Reloc::PIC_;
+  // sized up front, files compiled in parallel fill their own slot
+  if (cst->options.run)
+    jit_modules.resize(cst->files.count);
+}
+
+void llvm_backend_compile(cstate *cst, fstate *fst) {
+  if (!target)
+    return;
+
+  llvm_backend_ctx *bctx = new llvm_backend_ctx();
+  fst->backend_ctx = bctx;
+
+  // inputs of --repl share the context of the session
+  bctx->context = cst->options.repl ? llvm_session_context()
+                                    : new llvm::LLVMContext();
+
+  std::string module_name = cst->output_filepath;
+  bctx->module = new llvm::Module(module_name, *bctx->context);
+
+  bctx->builder = new llvm::IRBuilder<>(*bctx->context);
+
+  bctx->target_triple = cst->llvm_target_triple;
+
+  bctx->module->setTargetTriple(llvm::Triple(bctx->target_triple));
 
-  bctx.target_machine =
-      target->createTargetMachine(llvm::Triple(bctx.target_triple), "generic",
-                                  "", opt, RM, llvm::CodeModel::Small);
+  bctx->target_machine = llvm_target_machine(bctx->target_triple);
 
-  if (!bctx.target_machine) {
+  if (!bctx->target_machine) {
     scu_perror(const_cast<char *>("Failed to create target machine\n"));
     return;
   }
 
-  bctx.module->setDataLayout(bctx.target_machine->createDataLayout());
-}
+  bctx->module->setDataLayout(bctx->target_machine->createDataLayout());
+
+  bctx->program = &fst->program_ast;
 
-void llvm_backend_compile(cstate *, fstate *fst) {
-  for (u64 i = 0; i < fst->program_ast.instrs.count; i++) {
-    instr_node instr;
-    dynamic_array_get(&fst->program_ast.instrs, i, &instr);
+  if (cst->options.repl) {
+    llvm_session_irgen(*bctx);
+  } else {
+    node_list body = fst->program_ast.body;
+    for (u64 i = 0; i < body.count; i++) {
+      instr_node *instr =
+          ast_instr(bctx->program, ast_list(bctx->program, body)[i]);
 
-    llvm_irgen_instr(bctx, &instr);
+      llvm_irgen_instr(*bctx, instr);
+    }
   }
-  llvm_irgen_clear_symbol_table();
+  llvm_irgen_clear_symbol_table(*bctx);
 }
 
-void llvm_backend_optimize(cstate *cst, fstate *) {
+void llvm_backend_optimize(cstate *cst, fstate *fst) {
   using namespace llvm;
 
+  llvm_backend_ctx *bctx = static_cast<llvm_backend_ctx *>(fst->backend_ctx);
+  if (!bctx || !bctx->target_machine)
+    return;
+
   OptimizationLevel opt_level;
 
   switch (cst->options.opt_level) {
@@ -119,7 +813,14 @@ void llvm_backend_optimize(cstate *cst, fstate *) {
   CGSCCAnalysisManager CGAM;
   ModuleAnalysisManager MAM;
 
-  PassBuilder PB;
+  // one span per pass run in -ftime-trace
+  PassInstrumentationCallbacks PIC;
+  std::vector<u64> pass_starts;
+  if (timing_tracing())
+    llvm_trace_passes(PIC, pass_starts);
+
+  PassBuilder PB(nullptr, PipelineTuningOptions(), {},
+                 timing_tracing() ? &PIC : nullptr);
 
   PB.registerModuleAnalyses(MAM);
   PB.registerCGSCCAnalyses(CGAM);
@@ -128,67 +829,112 @@ void llvm_backend_optimize(cstate *cst, fstate *) {
 
   PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
 
-  ModulePassManager MPM = PB.buildPerModuleDefaultPipeline(opt_level);
+  // with -flto the rest of the pipeline runs when linking
+  ModulePassManager MPM;
+  switch (cst->options.lto) {
+  case LTO_NONE:
+    MPM = PB.buildPerModuleDefaultPipeline(opt_level);
+    break;
+  case LTO_FULL:
+    MPM = PB.buildLTOPreLinkDefaultPipeline(opt_level);
+    break;
+  case LTO_THIN:
+    MPM = PB.buildThinLTOPreLinkDefaultPipeline(opt_level);
+    break;
+  }
+
+  MPM.run(*bctx->module, MAM);
+}
+
+/*
+ * @brief: index of a file in cst->files, files.count if it is not there.
+ */
+static u64 llvm_file_index(cstate *cst, fstate *fst) {
+  for (u64 i = 0; i < cst->files.count; i++) {
+    fstate *file;
+    dynamic_array_get(&cst->files, i, &file);
+    if (file == fst)
+      return i;
+  }
+
+  return cst->files.count;
+}
+
+/*
+ * @brief: path the object of a file is written to, its entry in
+ * obj_file_list.
+ */
+static const char *llvm_obj_path(cstate *cst, fstate *fst) {
+  u64 index = llvm_file_index(cst, fst);
+  if (index == cst->files.count)
+    return nullptr;
 
-  MPM.run(*bctx.module, MAM);
+  char *obj;
+  dynamic_array_get(&cst->obj_file_list, index, &obj);
+  return obj;
 }
 
 void llvm_backend_emit(cstate *cst, fstate *fst) {
+  llvm_backend_ctx *bctx = static_cast<llvm_backend_ctx *>(fst->backend_ctx);
+  if (!bctx || !bctx->target_machine)
+    return;
+
   std::string error_str;
   std::error_code ec;
   llvm::raw_string_ostream error_stream(error_str);
 
-  if (llvm::verifyModule(*bctx.module, &error_stream)) {
+  if (llvm::verifyModule(*bctx->module, &error_stream)) {
     error_stream.flush();
     scu_perror(const_cast<char *>("Module verification failed: %s\n"),
                error_str.c_str());
     return;
   }
 
-  if (cst->options.emit_llvm) {
-    std::string ir_filename = std::string(fst->extracted_filepath) + ".ll";
-    llvm::raw_fd_ostream ir_file(ir_filename, ec, llvm::sys::fs::OF_None);
+  u32 emit = cst->options.emit;
+  std::string base = fst->extracted_filepath;
+
+  // IR and bitcode first, code generation lowers the module it runs on
+  if (emit & EMIT_LL)
+    llvm_emit_ir(bctx, base + ".ll");
 
-    if (!ec) {
-      bctx.module->print(ir_file, nullptr);
-      ir_file.close();
+  if (emit & EMIT_BC)
+    llvm_emit_bitcode(cst, bctx, base + ".bc");
+
+  // the object is generated from the module itself, so the assembly is
+  // generated from a copy of it, which costs less than optimizing again
+  if (emit & EMIT_ASM) {
+    if (emit & EMIT_OBJ) {
+      std::unique_ptr<llvm::Module> copy = llvm::CloneModule(*bctx->module);
+      llvm_emit_asm(bctx, *copy, base + ".s");
     } else {
-      scu_pwarning(const_cast<char *>("Could not write IR file: %s\n"),
-                   ec.message().c_str());
+      llvm_emit_asm(bctx, *bctx->module, base + ".s");
     }
-
-    return;
   }
 
-  if (cst->options.emit_asm) {
-    std::string asm_filename = std::string(fst->extracted_filepath) + ".s";
-    llvm::raw_fd_ostream asm_dest(asm_filename, ec, llvm::sys::fs::OF_None);
+  if (!(emit & EMIT_OBJ))
+    return;
 
-    if (ec) {
-      scu_pwarning(const_cast<char *>("Could not open asm file: %s\n"),
-                   ec.message().c_str());
+  // --run hands the module (and its context) over to the JIT
+  if (cst->options.run) {
+    u64 index = llvm_file_index(cst, fst);
+    if (index == jit_modules.size())
       return;
-    }
-
-    llvm::legacy::PassManager asm_pass;
-    if (bctx.target_machine->addPassesToEmitFile(
-            asm_pass, asm_dest, nullptr, llvm::CodeGenFileType::AssemblyFile)) {
-      scu_pwarning(const_cast<char *>("TargetMachine can't emit assembly\n"));
-    } else {
-      asm_pass.run(*bctx.module);
-      asm_dest.flush();
-    }
 
+    jit_modules[index] = llvm::orc::ThreadSafeModule(
+        std::unique_ptr<llvm::Module>(bctx->module),
+        std::unique_ptr<llvm::LLVMContext>(bctx->context));
+    bctx->module = nullptr;
+    bctx->context = nullptr;
     return;
   }
 
-  std::string obj_filename;
+  const char *obj = llvm_obj_path(cst, fst);
+  if (!obj)
+    return;
 
-  if (cst->options.compile_only)
-    obj_filename = std::string(fst->extracted_filepath) + ".o";
-  else {
-    obj_filename = "/tmp/sclc/" + std::string(fst->extracted_filepath) + ".o";
+  std::string obj_filename = obj;
 
+  if (!cst->options.compile_only) {
     std::filesystem::path obj_path(obj_filename);
     std::filesystem::path parent_dir = obj_path.parent_path();
 
@@ -205,6 +951,16 @@ void llvm_backend_emit(cstate *cst, fstate *fst) {
     }
   }
 
+  if (cst->options.lto != LTO_NONE) {
+    llvm_emit_bitcode(cst, bctx, obj_filename);
+    return;
+  }
+
+  if (cst->options.codegen_threads > 1) {
+    llvm_emit_split(cst, bctx, obj_filename);
+    return;
+  }
+
   llvm::raw_fd_ostream dest(obj_filename, ec, llvm::sys::fs::OF_None);
 
   if (ec) {
@@ -215,29 +971,32 @@ void llvm_backend_emit(cstate *cst, fstate *fst) {
 
   llvm::legacy::PassManager pass;
 
-  if (bctx.target_machine->addPassesToEmitFile(
+  if (bctx->target_machine->addPassesToEmitFile(
           pass, dest, nullptr, llvm::CodeGenFileType::ObjectFile)) {
     scu_perror(const_cast<char *>("TargetMachine can't emit object file\n"));
     return;
   }
 
-  pass.run(*bctx.module);
+  pass.run(*bctx->module);
   dest.flush();
 }
 
-void llvm_backend_cleanup(cstate *, fstate *) {
-  delete bctx.builder;
-  delete bctx.module;
-  delete bctx.context;
+void llvm_backend_cleanup(cstate *cst, fstate *fst) {
+  llvm_backend_ctx *bctx = static_cast<llvm_backend_ctx *>(fst->backend_ctx);
+  if (!bctx)
+    return;
+
+  delete bctx->builder;
+  delete bctx->module;
+  if (!cst->options.repl)
+    delete bctx->context;
 
-  if (bctx.target_machine) {
-    delete bctx.target_machine;
+  if (bctx->target_machine) {
+    delete bctx->target_machine;
   }
 
-  bctx.builder = nullptr;
-  bctx.module = nullptr;
-  bctx.context = nullptr;
-  bctx.target_machine = nullptr;
+  delete bctx;
+  fst->backend_ctx = nullptr;
 }
 
 void llvm_backend_link(cstate *cst) {
@@ -249,6 +1008,149 @@ void llvm_backend_link(cstate *cst) {
     obj_files.push_back(obj);
   }
 
-  ld_link(cst->output_filepath, obj_files);
+  if (cst->options.lto != LTO_NONE) {
+    llvm_memory_objects objects;
+    if (!llvm_lto(cst, obj_files, objects))
+      exit(1);
+
+    ld_link(cst->output_filepath, objects.files(), cst->options.link_cc);
+    return;
+  }
+
+  ld_link(cst->output_filepath, obj_files, cst->options.link_cc);
+}
+
+int llvm_backend_run(cstate *cst) {
+  llvm::Expected<std::unique_ptr<llvm::orc::LLLazyJIT>> jit =
+      llvm::orc::LLLazyJITBuilder().create();
+  if (!jit) {
+    llvm_jit_error("Could not create the JIT", jit.takeError());
+    return 1;
+  }
+
+  // every function is compiled when it is first called
+  (*jit)->setPartitionFunction(llvm::orc::IRPartitionLayer::compileRequested);
+
+  if (!llvm_jit_add_host(**jit))
+    return 1;
+
+  for (llvm::orc::ThreadSafeModule &module : jit_modules) {
+    if (!module)
+      continue;
+
+    if (llvm::Error err = (*jit)->addLazyIRModule(std::move(module))) {
+      llvm_jit_error("Could not add module to the JIT", std::move(err));
+      return 1;
+    }
+  }
+  jit_modules.clear();
+
+  llvm::Expected<llvm::orc::ExecutorAddr> main_addr = (*jit)->lookup("main");
+  if (!main_addr) {
+    llvm_jit_error("Could not find main", main_addr.takeError());
+    return 1;
+  }
+
+  // argv[0] is the first input, then the arguments after --
+  fstate *first;
+  dynamic_array_get(&cst->files, 0, &first);
+
+  std::vector<char *> argv = {first->filepath};
+  for (u32 i = 0; i < cst->options.run_argc; i++)
+    argv.push_back(cst->options.run_argv[i]);
+  argv.push_back(nullptr);
+
+  // flushed first, so the compiler's output comes before the program's
+  fflush(stdout);
+
+  int (*main_fn)(int, char **) = main_addr->toPtr<int (*)(int, char **)>();
+  int status = main_fn((int)argv.size() - 1, argv.data());
+
+  fflush(stdout);
+  return status;
+}
+
+bool llvm_backend_eval(cstate *, fstate *fst) {
+  llvm_backend_ctx *bctx = static_cast<llvm_backend_ctx *>(fst->backend_ctx);
+  if (!bctx || !bctx->module || !session)
+    return false;
+
+  std::string error_str;
+  llvm::raw_string_ostream error_stream(error_str);
+
+  if (llvm::verifyModule(*bctx->module, &error_stream)) {
+    error_stream.flush();
+    scu_perror(const_cast<char *>("Module verification failed: %s\n"),
+               error_str.c_str());
+    return false;
+  }
+
+  // the JIT is created with the first input that gets this far
+  if (!session->jit) {
+    llvm::Expected<std::unique_ptr<llvm::orc::LLJIT>> jit =
+        llvm::orc::LLJITBuilder().create();
+    if (!jit) {
+      llvm_jit_error("Could not create the JIT", jit.takeError());
+      return false;
+    }
+
+    if (!llvm_jit_add_host(**jit))
+      return false;
+
+    session->jit = std::move(*jit);
+  }
+
+  llvm::orc::ThreadSafeModule module(
+      std::unique_ptr<llvm::Module>(bctx->module), session->context);
+  bctx->module = nullptr;
+
+  // the input's definitions are tracked on their own, so that a failing
+  // input leaves nothing behind and its functions can be defined again
+  llvm::orc::ResourceTrackerSP tracker =
+      session->jit->getMainJITDylib().createResourceTracker();
+
+  if (llvm::Error err =
+          session->jit->addIRModule(tracker, std::move(module))) {
+    llvm_jit_error("Could not add input to the JIT", std::move(err));
+    return false;
+  }
+
+  // looking up the entry compiles the module, and fails if it calls what
+  // nothing defines
+  void (*entry)() = nullptr;
+  if (!session->entry.empty()) {
+    llvm::Expected<llvm::orc::ExecutorAddr> addr =
+        session->jit->lookup(session->entry);
+    if (!addr) {
+      llvm_jit_error("Could not compile input", addr.takeError());
+      if (llvm::Error err = tracker->remove())
+        llvm_jit_error("Could not drop input", std::move(err));
+      return false;
+    }
+    entry = addr->toPtr<void (*)()>();
+  }
+
+  for (auto &fn : session->new_functions)
+    session->functions[fn.first] = fn.second;
+
+  for (auto &global : session->new_globals) {
+    if (global.first >= session->globals.size())
+      session->globals.resize(global.first + 1, {"", nullptr});
+    session->globals[global.first] = global.second;
+  }
+
+  if (entry) {
+    // flushed first, so the compiler's output comes before the program's
+    fflush(stdout);
+    entry();
+    fflush(stdout);
+  }
+
+  return true;
+}
+
+void llvm_backend_eval_end(cstate *) {
+  delete session;
+  session = nullptr;
 }
 }
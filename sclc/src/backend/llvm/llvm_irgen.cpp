@@ -4,6 +4,8 @@
 extern "C" {
 #include "common.h"
 #include "ds/dynamic_array.h"
+#include "intern.h"
+#include "timing.h"
 #include "utils.h"
 #include "var.h"
 }
@@ -13,8 +15,6 @@ extern "C" {
 #include <llvm/IR/Type.h>
 #include <llvm/Target/TargetMachine.h>
 
-#include <map>
-
 static llvm::Type *scl_type_to_llvm(llvm_backend_ctx &ctx, type t) {
   switch (t) {
   case TYPE_INT:
@@ -30,11 +30,10 @@ static llvm::Type *scl_type_to_llvm(llvm_backend_ctx &ctx, type t) {
   }
 }
 
-static std::map<std::string, llvm::AllocaInst *> named_values;
-
-void llvm_irgen_clear_symbol_table() { named_values.clear(); }
-
-static std::map<std::string, llvm::BasicBlock *> label_blocks;
+void llvm_irgen_clear_symbol_table(llvm_backend_ctx &ctx) {
+  ctx.locals.clear();
+  ctx.label_blocks.clear();
+}
 
 static llvm::AllocaInst *create_entry_block_alloca(llvm::Function *fn,
                                                    const std::string &var_name,
@@ -46,7 +45,18 @@ static llvm::AllocaInst *create_entry_block_alloca(llvm::Function *fn,
   return tmp_builder.CreateAlloca(type, nullptr, var_name);
 }
 
-static llvm::Value *llvm_irgen_expr(llvm_backend_ctx &ctx, expr_node *expr);
+static llvm::AllocaInst *get_local(llvm_backend_ctx &ctx, variable *var) {
+  return var->slot < ctx.locals.size() ? ctx.locals[var->slot] : nullptr;
+}
+
+static void set_local(llvm_backend_ctx &ctx, variable *var,
+                      llvm::AllocaInst *alloca) {
+  if (var->slot >= ctx.locals.size())
+    ctx.locals.resize(var->slot + 1, nullptr);
+  ctx.locals[var->slot] = alloca;
+}
+
+static llvm::Value *llvm_irgen_expr(llvm_backend_ctx &ctx, expr_id id);
 
 static llvm::Value *llvm_irgen_term(llvm_backend_ctx &ctx, term_node *term) {
   switch (term->kind) {
@@ -71,34 +81,32 @@ static llvm::Value *llvm_irgen_term(llvm_backend_ctx &ctx, term_node *term) {
   }
 
   case TERM_IDENTIFIER: {
-    auto it = named_values.find(term->identifier.name);
-    if (it == named_values.end()) {
+    llvm::AllocaInst *alloca = get_local(ctx, &term->identifier);
+    if (!alloca) {
       scu_perror(const_cast<char *>("Unknown variable '%s' at line %zu"),
-                 term->identifier.name, term->line);
+                 intern_str(term->identifier.name), term->line);
       return nullptr;
     }
 
-    llvm::AllocaInst *alloca = it->second;
     return ctx.builder->CreateLoad(alloca->getAllocatedType(), alloca,
-                                   term->identifier.name);
+                                   intern_str(term->identifier.name));
   }
 
   case TERM_FUNCTION_CALL: {
     fn_call_node *call = &term->fn_call;
 
-    llvm::Function *callee = ctx.module->getFunction(call->name);
+    llvm::Function *callee = ctx.module->getFunction(intern_str(call->name));
     if (!callee) {
       scu_perror(const_cast<char *>("Unknown function '%s' at line %zu"),
-                 call->name, term->line);
+                 intern_str(call->name), term->line);
       return nullptr;
     }
 
     std::vector<llvm::Value *> args;
     for (u64 i = 0; i < call->parameters.count; i++) {
-      expr_node arg;
-      dynamic_array_get(&call->parameters, i, &arg);
+      expr_id arg = ast_list(ctx.program, call->parameters)[i];
 
-      llvm::Value *arg_val = llvm_irgen_expr(ctx, &arg);
+      llvm::Value *arg_val = llvm_irgen_expr(ctx, arg);
       if (!arg_val)
         return nullptr;
       args.push_back(arg_val);
@@ -108,16 +116,14 @@ static llvm::Value *llvm_irgen_term(llvm_backend_ctx &ctx, term_node *term) {
   }
 
   case TERM_DEREF: {
-    auto it = named_values.find(term->identifier.name);
-    if (it == named_values.end()) {
+    llvm::AllocaInst *ptr_alloca = get_local(ctx, &term->identifier);
+    if (!ptr_alloca) {
       scu_perror(
           const_cast<char *>("Unknown pointer variable '%s' at line %zu"),
-          term->identifier.name, term->line);
+          intern_str(term->identifier.name), term->line);
       return nullptr;
     }
 
-    llvm::AllocaInst *ptr_alloca = it->second;
-
     llvm::Value *ptr = ctx.builder->CreateLoad(ptr_alloca->getAllocatedType(),
                                                ptr_alloca, "ptr");
 
@@ -126,27 +132,26 @@ static llvm::Value *llvm_irgen_term(llvm_backend_ctx &ctx, term_node *term) {
   }
 
   case TERM_ADDOF: {
-    auto it = named_values.find(term->identifier.name);
-    if (it == named_values.end()) {
+    llvm::AllocaInst *alloca = get_local(ctx, &term->identifier);
+    if (!alloca) {
       scu_perror(const_cast<char *>("Unknown variable '%s' at line %zu"),
-                 term->identifier.name, term->line);
+                 intern_str(term->identifier.name), term->line);
       return nullptr;
     }
 
-    return it->second;
+    return alloca;
   }
 
   case TERM_ARRAY_ACCESS: {
     array_access_node *access = &term->array_access;
 
-    auto it = named_values.find(access->array_var.name);
-    if (it == named_values.end()) {
+    llvm::AllocaInst *array_alloca = get_local(ctx, &access->array_var);
+    if (!array_alloca) {
       scu_perror(const_cast<char *>("Unknown array '%s' at line %zu"),
-                 access->array_var.name, term->line);
+                 intern_str(access->array_var.name), term->line);
       return nullptr;
     }
 
-    llvm::AllocaInst *array_alloca = it->second;
     llvm::Type *alloca_type = array_alloca->getAllocatedType();
 
     llvm::Value *index = llvm_irgen_expr(ctx, access->index_expr);
@@ -189,10 +194,11 @@ static llvm::Value *llvm_irgen_term(llvm_backend_ctx &ctx, term_node *term) {
   }
 }
 
-static llvm::Value *llvm_irgen_expr(llvm_backend_ctx &ctx, expr_node *expr) {
+static llvm::Value *llvm_irgen_expr(llvm_backend_ctx &ctx, expr_id id) {
+  expr_node *expr = ast_expr(ctx.program, id);
   switch (expr->kind) {
   case EXPR_TERM:
-    return llvm_irgen_term(ctx, &expr->term);
+    return llvm_irgen_term(ctx, ast_term(ctx.program, expr->term));
 
   case EXPR_ADD: {
     llvm::Value *lhs = llvm_irgen_expr(ctx, expr->binary.left);
@@ -238,8 +244,10 @@ static llvm::Value *llvm_irgen_expr(llvm_backend_ctx &ctx, expr_node *expr) {
 
 static llvm::Value *llvm_irgen_relational(llvm_backend_ctx &ctx,
                                           rel_node *rel) {
-  llvm::Value *lhs = llvm_irgen_term(ctx, &rel->comparison.lhs);
-  llvm::Value *rhs = llvm_irgen_term(ctx, &rel->comparison.rhs);
+  llvm::Value *lhs =
+      llvm_irgen_term(ctx, ast_term(ctx.program, rel->comparison.lhs));
+  llvm::Value *rhs =
+      llvm_irgen_term(ctx, ast_term(ctx.program, rel->comparison.rhs));
 
   if (!lhs || !rhs)
     return nullptr;
@@ -274,13 +282,14 @@ static void llvm_irgen_instr_declare(llvm_backend_ctx &ctx, variable *var) {
   if (!fn) {
     scu_perror(const_cast<char *>(
                    "Variable declaration '%s' outside function at line %zu\n"),
-               var->name, var->line);
+               intern_str(var->name), var->line);
     return;
   }
 
-  llvm::AllocaInst *alloca = create_entry_block_alloca(fn, var->name, var_type);
+  llvm::AllocaInst *alloca =
+      create_entry_block_alloca(fn, intern_str(var->name), var_type);
 
-  named_values[var->name] = alloca;
+  set_local(ctx, var, alloca);
 }
 
 static void llvm_irgen_instr_initialize(llvm_backend_ctx &ctx,
@@ -301,20 +310,21 @@ static void llvm_irgen_instr_initialize(llvm_backend_ctx &ctx,
 
         const_cast<char *>(
             "Variable initialization '%s' outside function at line %zu\n"),
-        var->name, var->line);
+        intern_str(var->name), var->line);
     return;
   }
 
-  llvm::AllocaInst *alloca = create_entry_block_alloca(fn, var->name, var_type);
+  llvm::AllocaInst *alloca =
+      create_entry_block_alloca(fn, intern_str(var->name), var_type);
 
-  named_values[var->name] = alloca;
+  set_local(ctx, var, alloca);
 
   llvm::Value *init_value = llvm_irgen_expr(ctx, init_var->expr);
 
   if (!init_value) {
     scu_perror(const_cast<char *>("Failed to generate intiialization "
                                   "expression for '%s' at line %zu\n"),
-               var->name, var->line);
+               intern_str(var->name), var->line);
     return;
   }
 
@@ -333,7 +343,7 @@ static void llvm_irgen_instr_declare_array(llvm_backend_ctx &ctx,
     if (!size_val) {
       scu_perror(const_cast<char *>(
                      "Failed to evaluate array size for '%s' at line %zu\n"),
-                 var->name, var->line);
+                 intern_str(var->name), var->line);
       return;
     }
   }
@@ -342,7 +352,7 @@ static void llvm_irgen_instr_declare_array(llvm_backend_ctx &ctx,
   if (!fn) {
     scu_perror(const_cast<char *>(
                    "Array declaration '%s' outside function at line %zu\n"),
-               var->name, var->line);
+               intern_str(var->name), var->line);
     return;
   }
 
@@ -352,21 +362,22 @@ static void llvm_irgen_instr_declare_array(llvm_backend_ctx &ctx,
           llvm::dyn_cast<llvm::ConstantInt>(size_val)) {
     u64 array_size = const_size->getZExtValue();
     llvm::Type *array_type = llvm::ArrayType::get(elem_type, array_size);
-    alloca = create_entry_block_alloca(fn, var->name, array_type);
+    alloca = create_entry_block_alloca(fn, intern_str(var->name), array_type);
   } else {
     llvm::IRBuilder<> tmp_builder(&fn->getEntryBlock(),
                                   fn->getEntryBlock().begin());
-    alloca = tmp_builder.CreateAlloca(elem_type, size_val, var->name);
+    alloca =
+        tmp_builder.CreateAlloca(elem_type, size_val, intern_str(var->name));
   }
 
   if (!alloca) {
     scu_perror(const_cast<char *>(
                    "Failed to create array alloca for '%s' at line %zu\n"),
-               var->name, var->line);
+               intern_str(var->name), var->line);
     return;
   }
 
-  named_values[var->name] = alloca;
+  set_local(ctx, var, alloca);
 }
 
 static void llvm_irgen_initialize_array(llvm_backend_ctx &ctx,
@@ -379,7 +390,7 @@ static void llvm_irgen_initialize_array(llvm_backend_ctx &ctx,
   if (!fn) {
     scu_perror(const_cast<char *>(
                    "Array initialization '%s' outside function at line %zu\n"),
-               var->name, var->line);
+               intern_str(var->name), var->line);
     return;
   }
 
@@ -388,7 +399,7 @@ static void llvm_irgen_initialize_array(llvm_backend_ctx &ctx,
     size_val = llvm_irgen_expr(ctx, arr->size_expr);
     if (!size_val) {
       scu_perror(const_cast<char *>("Failed to evaluate array size for '%s'\n"),
-                 var->name);
+                 intern_str(var->name));
       return;
     }
   } else {
@@ -399,14 +410,13 @@ static void llvm_irgen_initialize_array(llvm_backend_ctx &ctx,
   llvm::IRBuilder<> tmp_builder(&fn->getEntryBlock(),
                                 fn->getEntryBlock().begin());
   llvm::AllocaInst *alloca =
-      tmp_builder.CreateAlloca(elem_type, size_val, var->name);
-  named_values[var->name] = alloca;
+      tmp_builder.CreateAlloca(elem_type, size_val, intern_str(var->name));
+  set_local(ctx, var, alloca);
 
   for (u64 i = 0; i < arr->literal.elements.count; i++) {
-    expr_node elem_expr;
-    dynamic_array_get(&arr->literal.elements, i, &elem_expr);
+    expr_id elem_expr = ast_list(ctx.program, arr->literal.elements)[i];
 
-    llvm::Value *elem_val = llvm_irgen_expr(ctx, &elem_expr);
+    llvm::Value *elem_val = llvm_irgen_expr(ctx, elem_expr);
 
     if (!elem_val)
       continue;
@@ -422,20 +432,18 @@ static void llvm_irgen_initialize_array(llvm_backend_ctx &ctx,
 
 static void llvm_irgen_instr_assign(llvm_backend_ctx &ctx,
                                     assign_node *assign) {
-  auto it = named_values.find(assign->identifier.name);
-  if (it == named_values.end()) {
+  llvm::AllocaInst *var_alloca = get_local(ctx, &assign->identifier);
+  if (!var_alloca) {
     scu_perror(const_cast<char *>("Unknown variable '%s' in assignment\n"),
-               assign->identifier.name);
+               intern_str(assign->identifier.name));
     return;
   }
 
-  llvm::AllocaInst *var_alloca = it->second;
-
   llvm::Value *expr_val = llvm_irgen_expr(ctx, assign->expr);
   if (!expr_val) {
     scu_perror(const_cast<char *>(
                    "Failed to evaluate expression in assignment to '%s'\n"),
-               assign->identifier.name);
+               intern_str(assign->identifier.name));
     return;
   }
 
@@ -446,13 +454,13 @@ static void llvm_irgen_instr_assign_to_array_subscript(
     llvm_backend_ctx &ctx, assign_to_array_subscript_node *assign) {
   variable *var = &assign->var;
 
-  auto it = named_values.find(var->name);
-  if (it == named_values.end()) {
-    scu_perror(const_cast<char *>("Unknown array variable '%s'\n"), var->name);
+  llvm::AllocaInst *array_alloca = get_local(ctx, var);
+  if (!array_alloca) {
+    scu_perror(const_cast<char *>("Unknown array variable '%s'\n"),
+               intern_str(var->name));
     return;
   }
 
-  llvm::AllocaInst *array_alloca = it->second;
   llvm::Type *alloca_type = array_alloca->getAllocatedType();
 
   llvm::Value *index_val = llvm_irgen_expr(ctx, assign->index_expr);
@@ -489,6 +497,18 @@ static void llvm_irgen_instr_assign_to_array_subscript(
   ctx.builder->CreateStore(rhs_val, elem_ptr);
 }
 
+static void llvm_irgen_cond_block(llvm_backend_ctx &ctx,
+                                  cond_block_node *blk) {
+  if (blk->kind == COND_SINGLE_INSTR) {
+    llvm_irgen_instr(ctx, ast_instr(ctx.program, blk->single));
+    return;
+  }
+
+  u32 *ids = ast_list(ctx.program, blk->multi);
+  for (u64 i = 0; i < blk->multi.count; i++)
+    llvm_irgen_instr(ctx, ast_instr(ctx.program, ids[i]));
+}
+
 static void llvm_irgen_instr_if(llvm_backend_ctx &ctx, if_node *if_stmt) {
   llvm::Function *fn = ctx.builder->GetInsertBlock()->getParent();
   if (!fn) {
@@ -511,7 +531,7 @@ static void llvm_irgen_instr_if(llvm_backend_ctx &ctx, if_node *if_stmt) {
   llvm::BasicBlock *else_target;
   if (if_stmt->else_ifs.count > 0) {
     else_target = llvm::BasicBlock::Create(*ctx.context, "elif.cond.0", fn);
-  } else if (if_stmt->else_) {
+  } else if (if_stmt->has_else) {
     else_target = llvm::BasicBlock::Create(*ctx.context, "if.else", fn);
   } else {
     else_target = merge_bb;
@@ -520,27 +540,19 @@ static void llvm_irgen_instr_if(llvm_backend_ctx &ctx, if_node *if_stmt) {
   ctx.builder->CreateCondBr(cond_val, then_bb, else_target);
 
   ctx.builder->SetInsertPoint(then_bb);
-  if (if_stmt->then.kind == COND_SINGLE_INSTR) {
-    llvm_irgen_instr(ctx, if_stmt->then.single);
-  } else {
-    for (u64 i = 0; i < if_stmt->then.multi.count; i++) {
-      instr_node instr;
-      dynamic_array_get(&if_stmt->then.multi, i, &instr);
-      llvm_irgen_instr(ctx, &instr);
-    }
-  }
+  llvm_irgen_cond_block(ctx, &if_stmt->then);
   if (!ctx.builder->GetInsertBlock()->getTerminator()) {
     ctx.builder->CreateBr(merge_bb);
   }
 
   for (u64 i = 0; i < if_stmt->else_ifs.count; i++) {
-    if_node elif;
-    dynamic_array_get(&if_stmt->else_ifs, i, &elif);
+    if_node *elif =
+        ast_if(ctx.program, ast_list(ctx.program, if_stmt->else_ifs)[i]);
 
     llvm::BasicBlock *elif_cond_bb = else_target;
     ctx.builder->SetInsertPoint(elif_cond_bb);
 
-    llvm::Value *elif_cond = llvm_irgen_relational(ctx, &elif.rel);
+    llvm::Value *elif_cond = llvm_irgen_relational(ctx, &elif->rel);
     if (!elif_cond) {
       scu_perror(const_cast<char *>("Failed to generate else-if condition\n"));
       return;
@@ -555,7 +567,7 @@ static void llvm_irgen_instr_if(llvm_backend_ctx &ctx, if_node *if_stmt) {
     if (i + 1 < if_stmt->else_ifs.count) {
       snprintf(buf, sizeof(buf), "elif.cond.%zu", i + 1);
       next_target = llvm::BasicBlock::Create(*ctx.context, buf, fn);
-    } else if (if_stmt->else_) {
+    } else if (if_stmt->has_else) {
       next_target = llvm::BasicBlock::Create(*ctx.context, "if.else", fn);
     } else {
       next_target = merge_bb;
@@ -564,15 +576,7 @@ static void llvm_irgen_instr_if(llvm_backend_ctx &ctx, if_node *if_stmt) {
     ctx.builder->CreateCondBr(elif_cond, elif_then_bb, next_target);
 
     ctx.builder->SetInsertPoint(elif_then_bb);
-    if (elif.then.kind == COND_SINGLE_INSTR) {
-      llvm_irgen_instr(ctx, elif.then.single);
-    } else {
-      for (u64 j = 0; j < elif.then.multi.count; j++) {
-        instr_node instr;
-        dynamic_array_get(&elif.then.multi, j, &instr);
-        llvm_irgen_instr(ctx, &instr);
-      }
-    }
+    llvm_irgen_cond_block(ctx, &elif->then);
     if (!ctx.builder->GetInsertBlock()->getTerminator()) {
       ctx.builder->CreateBr(merge_bb);
     }
@@ -580,18 +584,10 @@ static void llvm_irgen_instr_if(llvm_backend_ctx &ctx, if_node *if_stmt) {
     else_target = next_target;
   }
 
-  if (if_stmt->else_) {
+  if (if_stmt->has_else) {
     ctx.builder->SetInsertPoint(else_target);
 
-    if (if_stmt->else_->kind == COND_SINGLE_INSTR) {
-      llvm_irgen_instr(ctx, if_stmt->else_->single);
-    } else {
-      for (u64 i = 0; i < if_stmt->else_->multi.count; i++) {
-        instr_node instr;
-        dynamic_array_get(&if_stmt->else_->multi, i, &instr);
-        llvm_irgen_instr(ctx, &instr);
-      }
-    }
+    llvm_irgen_cond_block(ctx, &if_stmt->else_);
 
     if (!ctx.builder->GetInsertBlock()->getTerminator()) {
       ctx.builder->CreateBr(merge_bb);
@@ -621,16 +617,16 @@ static void llvm_irgen_instr_match(llvm_backend_ctx &ctx,
   llvm::BasicBlock *default_bb = merge_bb;
 
   for (u64 i = 0; i < match_stmt->cases.count; i++) {
-    match_case_node case_node;
-    dynamic_array_get(&match_stmt->cases, i, &case_node);
-    if (case_node.kind == MATCH_CASE_DEFAULT) {
+    match_case_node *case_node =
+        ast_case(ctx.program, ast_list(ctx.program, match_stmt->cases)[i]);
+    if (case_node->kind == MATCH_CASE_DEFAULT) {
       break;
     }
   }
 
   for (u64 i = 0; i < match_stmt->cases.count; i++) {
-    match_case_node case_node;
-    dynamic_array_get(&match_stmt->cases, i, &case_node);
+    match_case_node *case_node =
+        ast_case(ctx.program, ast_list(ctx.program, match_stmt->cases)[i]);
 
     char buf[64];
     snprintf(buf, sizeof(buf), "match.case.%zu", i);
@@ -645,13 +641,12 @@ static void llvm_irgen_instr_match(llvm_backend_ctx &ctx,
       next_case_bb = default_bb;
     }
 
-    switch (case_node.kind) {
+    switch (case_node->kind) {
     case MATCH_CASE_VALUES: {
       llvm::Value *match_cond = nullptr;
 
-      for (u64 j = 0; j < case_node.values.values.count; j++) {
-        expr_node *expr;
-        dynamic_array_get(&case_node.values.values, j, &expr);
+      for (u64 j = 0; j < case_node->values.values.count; j++) {
+        expr_id expr = ast_list(ctx.program, case_node->values.values)[j];
         llvm::Value *case_val = llvm_irgen_expr(ctx, expr);
 
         llvm::Value *cmp = ctx.builder->CreateICmpEQ(match_val, case_val);
@@ -668,8 +663,8 @@ static void llvm_irgen_instr_match(llvm_backend_ctx &ctx,
     }
 
     case MATCH_CASE_RANGE: {
-      llvm::Value *start_val = llvm_irgen_expr(ctx, case_node.range.start);
-      llvm::Value *end_val = llvm_irgen_expr(ctx, case_node.range.end);
+      llvm::Value *start_val = llvm_irgen_expr(ctx, case_node->range.start);
+      llvm::Value *end_val = llvm_irgen_expr(ctx, case_node->range.end);
 
       llvm::Value *ge_start = ctx.builder->CreateICmpSGE(match_val, start_val);
       llvm::Value *le_end = ctx.builder->CreateICmpSLE(match_val, end_val);
@@ -687,15 +682,7 @@ static void llvm_irgen_instr_match(llvm_backend_ctx &ctx,
     }
 
     ctx.builder->SetInsertPoint(case_body_bb);
-    if (case_node.body.kind == COND_SINGLE_INSTR) {
-      llvm_irgen_instr(ctx, case_node.body.single);
-    } else {
-      for (u64 j = 0; j < case_node.body.multi.count; j++) {
-        instr_node instr;
-        dynamic_array_get(&case_node.body.multi, j, &instr);
-        llvm_irgen_instr(ctx, &instr);
-      }
-    }
+    llvm_irgen_cond_block(ctx, &case_node->body);
 
     if (!ctx.builder->GetInsertBlock()->getTerminator()) {
       ctx.builder->CreateBr(merge_bb);
@@ -716,10 +703,11 @@ static void llvm_irgen_instr_goto(llvm_backend_ctx &ctx, goto_node *goto_stmt) {
     return;
   }
 
-  llvm::BasicBlock *target_bb = label_blocks[goto_stmt->label];
+  llvm::BasicBlock *target_bb = ctx.label_blocks.get(goto_stmt->label);
   if (!target_bb) {
-    target_bb = llvm::BasicBlock::Create(*ctx.context, goto_stmt->label, fn);
-    label_blocks[goto_stmt->label] = target_bb;
+    target_bb = llvm::BasicBlock::Create(*ctx.context,
+                                         intern_str(goto_stmt->label), fn);
+    ctx.label_blocks.set(goto_stmt->label, target_bb);
   }
 
   ctx.builder->CreateBr(target_bb);
@@ -733,10 +721,11 @@ static void llvm_irgen_instr_label(llvm_backend_ctx &ctx,
     return;
   }
 
-  llvm::BasicBlock *label_bb = label_blocks[label_stmt->label];
+  llvm::BasicBlock *label_bb = ctx.label_blocks.get(label_stmt->label);
   if (!label_bb) {
-    label_bb = llvm::BasicBlock::Create(*ctx.context, label_stmt->label, fn);
-    label_blocks[label_stmt->label] = label_bb;
+    label_bb = llvm::BasicBlock::Create(*ctx.context,
+                                        intern_str(label_stmt->label), fn);
+    ctx.label_blocks.set(label_stmt->label, label_bb);
   }
 
   if (!ctx.builder->GetInsertBlock()->getTerminator()) {
@@ -746,9 +735,6 @@ static void llvm_irgen_instr_label(llvm_backend_ctx &ctx,
   ctx.builder->SetInsertPoint(label_bb);
 }
 
-static llvm::BasicBlock *current_loop_header = nullptr;
-static llvm::BasicBlock *current_loop_exit = nullptr;
-
 static void llvm_irgen_instr_loop(llvm_backend_ctx &ctx, loop_node *loop) {
   llvm::Function *fn = ctx.builder->GetInsertBlock()->getParent();
   if (!fn) {
@@ -756,8 +742,8 @@ static void llvm_irgen_instr_loop(llvm_backend_ctx &ctx, loop_node *loop) {
     return;
   }
 
-  llvm::BasicBlock *prev_loop_header = current_loop_header;
-  llvm::BasicBlock *prev_loop_exit = current_loop_exit;
+  llvm::BasicBlock *prev_loop_header = ctx.current_loop_header;
+  llvm::BasicBlock *prev_loop_exit = ctx.current_loop_exit;
 
   llvm::BasicBlock *loop_header =
       llvm::BasicBlock::Create(*ctx.context, "loop.header", fn);
@@ -766,19 +752,21 @@ static void llvm_irgen_instr_loop(llvm_backend_ctx &ctx, loop_node *loop) {
   llvm::BasicBlock *loop_exit =
       llvm::BasicBlock::Create(*ctx.context, "loop.exit", fn);
 
-  current_loop_header = loop_header;
-  current_loop_exit = loop_exit;
+  ctx.current_loop_header = loop_header;
+  ctx.current_loop_exit = loop_exit;
 
   llvm::AllocaInst *iterator_ptr = nullptr;
+  llvm::AllocaInst *outer_var = nullptr;
   if (loop->kind == LOOP_FOR) {
     llvm::Type *i32_type = llvm::Type::getInt32Ty(*ctx.context);
-    iterator_ptr =
-        ctx.builder->CreateAlloca(i32_type, nullptr, loop->_for.iterator.name);
+    iterator_ptr = ctx.builder->CreateAlloca(
+        i32_type, nullptr, intern_str(loop->_for.iterator.name));
 
     llvm::Value *start_val = llvm_irgen_expr(ctx, loop->_for.range_start);
     ctx.builder->CreateStore(start_val, iterator_ptr);
 
-    named_values[loop->_for.iterator.name] = iterator_ptr;
+    outer_var = get_local(ctx, &loop->_for.iterator);
+    set_local(ctx, &loop->_for.iterator, iterator_ptr);
   }
 
   ctx.builder->CreateBr(loop_header);
@@ -795,8 +783,8 @@ static void llvm_irgen_instr_loop(llvm_backend_ctx &ctx, loop_node *loop) {
         llvm_irgen_relational(ctx, &loop->conditional.break_condition);
     if (!cond) {
       scu_perror(const_cast<char *>("Failed to generate while condition\n"));
-      current_loop_header = prev_loop_header;
-      current_loop_exit = prev_loop_exit;
+      ctx.current_loop_header = prev_loop_header;
+      ctx.current_loop_exit = prev_loop_exit;
       return;
     }
     ctx.builder->CreateCondBr(cond, loop_body, loop_exit);
@@ -822,10 +810,10 @@ static void llvm_irgen_instr_loop(llvm_backend_ctx &ctx, loop_node *loop) {
   ctx.builder->SetInsertPoint(loop_body);
 
   for (u64 i = 0; i < loop->instrs.count; i++) {
-    instr_node instr;
-    dynamic_array_get(&loop->instrs, i, &instr);
+    instr_node *instr =
+        ast_instr(ctx.program, ast_list(ctx.program, loop->instrs)[i]);
 
-    llvm_irgen_instr(ctx, &instr);
+    llvm_irgen_instr(ctx, instr);
 
     if (ctx.builder->GetInsertBlock()->getTerminator()) {
       break;
@@ -859,49 +847,46 @@ static void llvm_irgen_instr_loop(llvm_backend_ctx &ctx, loop_node *loop) {
   }
 
   if (loop->kind == LOOP_FOR) {
-    named_values.erase(loop->_for.iterator.name);
+    set_local(ctx, &loop->_for.iterator, outer_var);
   }
 
-  current_loop_header = prev_loop_header;
-  current_loop_exit = prev_loop_exit;
+  ctx.current_loop_header = prev_loop_header;
+  ctx.current_loop_exit = prev_loop_exit;
 
   ctx.builder->SetInsertPoint(loop_exit);
 }
 
 static void llvm_irgen_instr_loop_break(llvm_backend_ctx &ctx) {
-  if (!current_loop_exit) {
+  if (!ctx.current_loop_exit) {
     scu_perror(const_cast<char *>("Break statement outside loop\n"));
     return;
   }
 
-  ctx.builder->CreateBr(current_loop_exit);
+  ctx.builder->CreateBr(ctx.current_loop_exit);
 }
 
 static void llvm_irgen_instr_loop_continue(llvm_backend_ctx &ctx) {
-  if (!current_loop_header) {
+  if (!ctx.current_loop_header) {
     scu_perror(const_cast<char *>("Continue statement outside loop\n"));
     return;
   }
 
-  ctx.builder->CreateBr(current_loop_header);
+  ctx.builder->CreateBr(ctx.current_loop_header);
 }
 
 static void llvm_irgen_instr_fn_define(llvm_backend_ctx &ctx, fn_node *fn) {
-  named_values.clear();
-  label_blocks.clear();
+  llvm_irgen_clear_symbol_table(ctx);
 
   std::vector<llvm::Type *> param_types;
   for (u64 i = 0; i < fn->parameters.count; i++) {
-    variable param;
-    dynamic_array_get(&fn->parameters, i, &param);
+    variable *param = ast_param(ctx.program, fn, i);
 
-    param_types.push_back(scl_type_to_llvm(ctx, param.type));
+    param_types.push_back(scl_type_to_llvm(ctx, param->type));
   }
 
   llvm::Type *return_type = llvm::Type::getVoidTy(*ctx.context);
   if (fn->returntypes.count > 0) {
-    type ret_type;
-    dynamic_array_get(&fn->returntypes, 0, &ret_type);
+    type ret_type = ast_returntype(ctx.program, fn, 0);
 
     return_type = scl_type_to_llvm(ctx, ret_type);
   }
@@ -909,10 +894,10 @@ static void llvm_irgen_instr_fn_define(llvm_backend_ctx &ctx, fn_node *fn) {
   llvm::FunctionType *fn_type =
       llvm::FunctionType::get(return_type, param_types, fn->is_variadic);
 
-  llvm::Function *function = ctx.module->getFunction(fn->name);
+  llvm::Function *function = ctx.module->getFunction(intern_str(fn->name));
   if (!function) {
     function = llvm::Function::Create(fn_type, llvm::Function::ExternalLinkage,
-                                      fn->name, ctx.module);
+                                      intern_str(fn->name), ctx.module);
   }
 
   llvm::BasicBlock *entry =
@@ -921,24 +906,24 @@ static void llvm_irgen_instr_fn_define(llvm_backend_ctx &ctx, fn_node *fn) {
 
   unsigned idx = 0;
   for (auto &arg : function->args()) {
-    variable param;
-    dynamic_array_get(&fn->parameters, idx++, &param);
+    variable *param = ast_param(ctx.program, fn, idx++);
 
-    arg.setName(param.name);
+    arg.setName(intern_str(param->name));
 
     llvm::AllocaInst *alloca =
-        create_entry_block_alloca(function, param.name, arg.getType());
+        create_entry_block_alloca(function, intern_str(param->name),
+                                  arg.getType());
 
     ctx.builder->CreateStore(&arg, alloca);
 
-    named_values[param.name] = alloca;
+    set_local(ctx, param, alloca);
   }
 
   for (u64 i = 0; i < fn->defined.instrs.count; i++) {
-    instr_node instr;
-    dynamic_array_get(&fn->defined.instrs, i, &instr);
+    instr_node *instr =
+        ast_instr(ctx.program, ast_list(ctx.program, fn->defined.instrs)[i]);
 
-    llvm_irgen_instr(ctx, &instr);
+    llvm_irgen_instr(ctx, instr);
 
     if (ctx.builder->GetInsertBlock()->getTerminator()) {
       break;
@@ -958,16 +943,14 @@ static void llvm_irgen_instr_fn_define(llvm_backend_ctx &ctx, fn_node *fn) {
 static void llvm_irgen_instr_fn_declare(llvm_backend_ctx &ctx, fn_node *fn) {
   std::vector<llvm::Type *> param_types;
   for (u64 i = 0; i < fn->parameters.count; i++) {
-    variable param;
-    dynamic_array_get(&fn->parameters, i, &param);
+    variable *param = ast_param(ctx.program, fn, i);
 
-    param_types.push_back(scl_type_to_llvm(ctx, param.type));
+    param_types.push_back(scl_type_to_llvm(ctx, param->type));
   }
 
   llvm::Type *return_type = llvm::Type::getVoidTy(*ctx.context);
   if (fn->returntypes.count > 0) {
-    type ret_type;
-    dynamic_array_get(&fn->returntypes, 0, &ret_type);
+    type ret_type = ast_returntype(ctx.program, fn, 0);
 
     return_type = scl_type_to_llvm(ctx, ret_type);
   }
@@ -975,18 +958,17 @@ static void llvm_irgen_instr_fn_declare(llvm_backend_ctx &ctx, fn_node *fn) {
   llvm::FunctionType *fn_type =
       llvm::FunctionType::get(return_type, param_types, fn->is_variadic);
 
-  llvm::Function::Create(fn_type, llvm::Function::ExternalLinkage, fn->name,
-                         ctx.module);
+  llvm::Function::Create(fn_type, llvm::Function::ExternalLinkage,
+                         intern_str(fn->name), ctx.module);
 }
 
 static void llvm_irgen_instr_return(llvm_backend_ctx &ctx, return_node *ret) {
   if (ret->returnvals.count == 0) {
     ctx.builder->CreateRetVoid();
   } else {
-    expr_node ret_expr;
-    dynamic_array_get(&ret->returnvals, 0, &ret_expr);
+    expr_id ret_expr = ast_list(ctx.program, ret->returnvals)[0];
 
-    llvm::Value *ret_val = llvm_irgen_expr(ctx, &ret_expr);
+    llvm::Value *ret_val = llvm_irgen_expr(ctx, ret_expr);
 
     if (!ret_val) {
       scu_perror(const_cast<char *>("Failed to generate return expression\n"));
@@ -1000,25 +982,24 @@ static void llvm_irgen_instr_return(llvm_backend_ctx &ctx, return_node *ret) {
 
 static void llvm_irgen_instr_fn_call(llvm_backend_ctx &ctx,
                                      fn_call_node *call) {
-  llvm::Function *callee = ctx.module->getFunction(call->name);
+  llvm::Function *callee = ctx.module->getFunction(intern_str(call->name));
 
   if (!callee) {
     scu_perror(const_cast<char *>("Unknown function '%s' in call\n"),
-               call->name);
+               intern_str(call->name));
     return;
   }
 
   std::vector<llvm::Value *> args;
   for (u64 i = 0; i < call->parameters.count; i++) {
-    expr_node arg_expr;
-    dynamic_array_get(&call->parameters, i, &arg_expr);
+    expr_id arg_expr = ast_list(ctx.program, call->parameters)[i];
 
-    llvm::Value *arg_val = llvm_irgen_expr(ctx, &arg_expr);
+    llvm::Value *arg_val = llvm_irgen_expr(ctx, arg_expr);
 
     if (!arg_val) {
       scu_perror(const_cast<char *>(
                      "Failed to evaluate argument %zu in call to '%s'\n"),
-                 i, call->name);
+                 i, intern_str(call->name));
       return;
     }
 
@@ -1043,7 +1024,8 @@ void llvm_irgen_instr(llvm_backend_ctx &ctx, instr_node *instr) {
     break;
 
   case INSTR_INITIALIZE_ARRAY:
-    llvm_irgen_initialize_array(ctx, &instr->initialize_array);
+    llvm_irgen_initialize_array(
+        ctx, ast_array_init(ctx.program, instr->initialize_array));
     break;
 
   case INSTR_ASSIGN:
@@ -1056,11 +1038,11 @@ void llvm_irgen_instr(llvm_backend_ctx &ctx, instr_node *instr) {
     break;
 
   case INSTR_IF:
-    llvm_irgen_instr_if(ctx, &instr->if_);
+    llvm_irgen_instr_if(ctx, ast_if(ctx.program, instr->if_));
     break;
 
   case INSTR_MATCH:
-    llvm_irgen_instr_match(ctx, &instr->match);
+    llvm_irgen_instr_match(ctx, ast_match(ctx.program, instr->match));
     break;
 
   case INSTR_GOTO:
@@ -1072,7 +1054,7 @@ void llvm_irgen_instr(llvm_backend_ctx &ctx, instr_node *instr) {
     break;
 
   case INSTR_LOOP:
-    llvm_irgen_instr_loop(ctx, &instr->loop);
+    llvm_irgen_instr_loop(ctx, ast_loop(ctx.program, instr->loop));
     break;
 
   case INSTR_LOOP_BREAK:
@@ -1083,12 +1065,23 @@ void llvm_irgen_instr(llvm_backend_ctx &ctx, instr_node *instr) {
     llvm_irgen_instr_loop_continue(ctx);
     break;
 
-  case INSTR_FN_DEFINE:
-    llvm_irgen_instr_fn_define(ctx, &instr->fn_define_node);
+  case INSTR_FN_DEFINE: {
+    fn_node *fn = ast_fn(ctx.program, instr->fn_define_node);
+    u64 start = timing_tracing() ? timing_now() : 0;
+    llvm_irgen_instr_fn_define(ctx, fn);
+
+    // one span per function in -ftime-trace
+    if (timing_tracing()) {
+      sym_id name = fn->name;
+      timing_span(intern_str(name), intern_len(name), "irgen", start,
+                  timing_now());
+    }
     break;
+  }
 
   case INSTR_FN_DECLARE:
-    llvm_irgen_instr_fn_declare(ctx, &instr->fn_declare_node);
+    llvm_irgen_instr_fn_declare(ctx,
+                                ast_fn(ctx.program, instr->fn_declare_node));
     break;
 
   case INSTR_RETURN:
@@ -1101,7 +1094,7 @@ void llvm_irgen_instr(llvm_backend_ctx &ctx, instr_node *instr) {
 
   default:
     scu_perror(const_cast<char *>("Unexpected instr type: %s"));
-    print_instr(instr);
+    print_instr(ctx.program, instr);
     break;
   }
 }
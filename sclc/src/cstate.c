@@ -1,9 +1,17 @@
+#define _GNU_SOURCE
+
 #include "cstate.h"
 #include "backend/backend.h"
 #include "common.h"
 #include "ds/arena.h"
 #include "ds/dynamic_array.h"
 #include "fstate.h"
+#include "include_cache.h"
+#include "memstat.h"
+#include "obj_cache.h"
+#include "server.h"
+#include "timing.h"
+#include "tpool.h"
 #include "utils.h"
 
 #include <llvm-c/Core.h>
@@ -13,7 +21,77 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Prefix of the paths of in-memory object files.
+ */
+#define MEMORY_OBJ_PREFIX "/proc/self/fd/"
+
+/*
+ * @brief: create an in-memory object file for a file that is linked in
+ * process. The descriptor is inherited by cc, should linking fall back to it.
+ *
+ * @return: path of the object file, NULL if it could not be created.
+ */
+static char *cstate_memory_obj(fstate *fst) {
+  int fd = memfd_create(fst->extracted_filepath, 0);
+  if (fd < 0)
+    return NULL;
+
+  return scu_format_string(MEMORY_OBJ_PREFIX "%d", fd);
+}
+
+void cstate_free_obj(char *obj) {
+  if (strncmp(obj, MEMORY_OBJ_PREFIX, strlen(MEMORY_OBJ_PREFIX)) == 0)
+    close(atoi(obj + strlen(MEMORY_OBJ_PREFIX)));
+
+  free(obj);
+}
+
+/*
+ * @brief: add the comma separated kinds of --emit=<kinds> to a set of
+ * emit_kind.
+ *
+ * @return: false if a kind is unknown.
+ */
+static bool cstate_parse_emit(const char *kinds, u32 *emit) {
+  static const struct {
+    const char *name;
+    emit_kind kind;
+  } names[] = {
+      {"obj", EMIT_OBJ},
+      {"ll", EMIT_LL},
+      {"bc", EMIT_BC},
+      {"asm", EMIT_ASM},
+  };
+
+  const char *kind = kinds;
+  for (;;) {
+    u64 len = strcspn(kind, ",");
+    bool known = false;
+
+    for (u64 i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+      if (strlen(names[i].name) == len &&
+          strncmp(kind, names[i].name, len) == 0) {
+        *emit |= names[i].kind;
+        known = true;
+      }
+    }
+
+    if (!known) {
+      scu_perror("Unknown kind in --emit: '%.*s' (obj, ll, bc or asm)\n",
+                 (int)len, kind);
+      return false;
+    }
+
+    if (kind[len] == '\0')
+      return true;
+    kind += len + 1;
+  }
+}
 
 void cstate_init(cstate *cst, u32 argc, char *argv[]) {
   if (argc <= 1) {
@@ -46,8 +124,63 @@ void cstate_init(cstate *cst, u32 argc, char *argv[]) {
     printf("--emit-asm                            Emit target assembly along "
            "with object file.\n");
 
+    printf("--emit=<obj,ll,bc,asm>                Write any of object, IR, "
+           "bitcode and assembly\n"
+           "                                      from one compile (links "
+           "with obj).\n");
+
     printf("-O0, -O1, -O2, -O3, -Os, -Oz          Optimization levels\n");
 
+    printf("-flto, -flto=full, -flto=thin         Link time optimization "
+           "across files.\n");
+
+    printf("--run [-- <args>]                     JIT and run the program in "
+           "process, with args.\n");
+
+    printf("--repl                                Read and run definitions and "
+           "statements interactively.\n");
+
+    printf("--link-cc                             Link by running cc instead "
+           "of the built-in lld.\n");
+
+    printf("-j <N>                                Compile up to N files in "
+           "parallel (0 = all cores).\n");
+
+    printf("--codegen-threads <N>                 Split every module in N "
+           "parts code generated in\n"
+           "                                      parallel (0 = all "
+           "cores).\n");
+
+    printf("--no-cache                            Do not use the object "
+           "cache.\n");
+
+    printf("--cache-dir <path_to_dir>             Object cache directory "
+           "(default ~/.cache/sclc).\n");
+
+    printf("--cache-size <MiB>                    Size limit of the object "
+           "cache (default 256).\n");
+
+    printf("--cache-stats                         Print object cache "
+           "statistics.\n");
+
+    printf("--server                              Stay resident and compile "
+           "requests from --client.\n");
+
+    printf("--client                              Forward the command to a "
+           "running server (first option).\n");
+
+    printf("--socket <path>                       Socket of the server "
+           "(default $XDG_RUNTIME_DIR/sclc.sock).\n");
+
+    printf("-ftime-report                         Print the time spent in "
+           "every phase.\n");
+
+    printf("-ftime-trace[=<path>]                 Write a Chrome trace of the "
+           "build (default <output>.json).\n");
+
+    printf("--mem-report[=<path>]                 Print allocations per phase, "
+           "also as JSON (default <output>.mem.json).\n");
+
     printf("\n");
 
     /*
@@ -71,6 +204,9 @@ void cstate_init(cstate *cst, u32 argc, char *argv[]) {
   cst->include_dir = NULL;
   cst->llvm_target_triple = LLVMGetDefaultTargetTriple();
   cst->options.opt_level = OPT_O2;
+  cst->options.jobs = 1;
+  cst->options.codegen_threads = 1;
+  cst->options.cache_max_size = OBJ_CACHE_DEFAULT_MAX_SIZE;
 
   while (i < argc) {
     char *arg = argv[i];
@@ -174,16 +310,185 @@ void cstate_init(cstate *cst, u32 argc, char *argv[]) {
       continue;
     }
 
+    if (strcmp(arg, "--run") == 0) {
+      cst->options.run = true;
+      i++;
+      continue;
+    }
+
+    if (strcmp(arg, "--repl") == 0) {
+      cst->options.repl = true;
+      i++;
+      continue;
+    }
+
+    // everything after -- belongs to the program run by --run
+    if (strcmp(arg, "--") == 0) {
+      cst->options.run_argv = argv + i + 1;
+      cst->options.run_argc = argc - i - 1;
+      break;
+    }
+
+    if (strcmp(arg, "--link-cc") == 0) {
+      cst->options.link_cc = true;
+      i++;
+      continue;
+    }
+
     if (strcmp(arg, "--emit-llvm") == 0) {
-      cst->options.emit_llvm = true;
-      cst->options.compile_only = true;
+      cst->options.emit |= EMIT_LL;
       i++;
       continue;
     }
 
     if (strcmp(arg, "--emit-asm") == 0) {
-      cst->options.emit_asm = true;
-      cst->options.compile_only = true;
+      cst->options.emit |= EMIT_ASM;
+      i++;
+      continue;
+    }
+
+    if (strncmp(arg, "--emit=", 7) == 0) {
+      if (!cstate_parse_emit(arg + 7, &cst->options.emit)) {
+        free(cst);
+        exit(1);
+      }
+      i++;
+      continue;
+    }
+
+    if (strncmp(arg, "-j", 2) == 0) {
+      char *count = arg + 2;
+
+      if (*count == '\0') {
+        if (i + 1 >= argc) {
+          scu_perror("Missing job count after %s\n", arg);
+          free(cst);
+          exit(1);
+        }
+        count = argv[++i];
+      }
+
+      char *end = NULL;
+      long jobs = strtol(count, &end, 10);
+      if (end == count || *end != '\0' || jobs < 0) {
+        scu_perror("Invalid job count: %s\n", count);
+        free(cst);
+        exit(1);
+      }
+
+      cst->options.jobs = jobs == 0 ? tpool_cpu_count() : (u32)jobs;
+      i++;
+      continue;
+    }
+
+    if (strcmp(arg, "--codegen-threads") == 0) {
+      if (i + 1 >= argc) {
+        scu_perror("Missing thread count after %s\n", arg);
+        free(cst);
+        exit(1);
+      }
+
+      char *count = argv[i + 1];
+      char *end = NULL;
+      long threads = strtol(count, &end, 10);
+      if (end == count || *end != '\0' || threads < 0) {
+        scu_perror("Invalid thread count: %s\n", count);
+        free(cst);
+        exit(1);
+      }
+
+      cst->options.codegen_threads =
+          threads == 0 ? tpool_cpu_count() : (u32)threads;
+      i += 2;
+      continue;
+    }
+
+    if (strcmp(arg, "--no-cache") == 0) {
+      cst->options.no_cache = true;
+      i++;
+      continue;
+    }
+
+    if (strcmp(arg, "--cache-stats") == 0) {
+      cst->options.cache_stats = true;
+      i++;
+      continue;
+    }
+
+    if (strcmp(arg, "--cache-dir") == 0) {
+      if (i + 1 >= argc) {
+        scu_perror("Missing directory path after %s\n", arg);
+        free(cst);
+        exit(1);
+      }
+
+      free(cst->options.cache_dir);
+      cst->options.cache_dir = strdup(argv[i + 1]);
+      i += 2;
+      continue;
+    }
+
+    if (strcmp(arg, "--cache-size") == 0) {
+      if (i + 1 >= argc) {
+        scu_perror("Missing size after %s\n", arg);
+        free(cst);
+        exit(1);
+      }
+
+      char *end = NULL;
+      long mib = strtol(argv[i + 1], &end, 10);
+      if (end == argv[i + 1] || *end != '\0' || mib < 0) {
+        scu_perror("Invalid cache size: %s\n", argv[i + 1]);
+        free(cst);
+        exit(1);
+      }
+
+      cst->options.cache_max_size = (u64)mib << 20;
+      i += 2;
+      continue;
+    }
+
+    if (strcmp(arg, "--server") == 0) {
+      cst->options.server = true;
+      i++;
+      continue;
+    }
+
+    if (strcmp(arg, "--socket") == 0) {
+      if (i + 1 >= argc) {
+        scu_perror("Missing socket path after %s\n", arg);
+        free(cst);
+        exit(1);
+      }
+
+      free(cst->options.socket_path);
+      cst->options.socket_path = strdup(argv[i + 1]);
+      i += 2;
+      continue;
+    }
+
+    if (strcmp(arg, "-ftime-report") == 0) {
+      cst->options.time_report = true;
+      i++;
+      continue;
+    }
+
+    if (strncmp(arg, "-ftime-trace", 12) == 0 &&
+        (arg[12] == '\0' || arg[12] == '=')) {
+      cst->options.time_trace = true;
+
+      free(cst->options.time_trace_path);
+      cst->options.time_trace_path = arg[12] == '=' ? strdup(arg + 13) : NULL;
+      i++;
+      continue;
+    }
+
+    if (strncmp(arg, "--mem-report", 12) == 0 &&
+        (arg[12] == '\0' || arg[12] == '=')) {
+      cst->options.mem_report = true;
+
+      free(cst->options.mem_report_path);
+      cst->options.mem_report_path = arg[12] == '=' ? strdup(arg + 13) : NULL;
       i++;
       continue;
     }
@@ -231,21 +536,91 @@ void cstate_init(cstate *cst, u32 argc, char *argv[]) {
       continue;
     }
 
+    if (strcmp(arg, "-flto") == 0 || strcmp(arg, "-flto=full") == 0) {
+      cst->options.lto = LTO_FULL;
+      i++;
+      continue;
+    }
+
+    if (strcmp(arg, "-flto=thin") == 0) {
+      cst->options.lto = LTO_THIN;
+      i++;
+      continue;
+    }
+
     scu_perror("Unknown option: %s\n", arg);
     free(cst);
     exit(1);
   }
 
+  // an object is emitted by default, without one nothing is linked
+  if (cst->options.emit == 0)
+    cst->options.emit = EMIT_OBJ;
+  else if (!(cst->options.emit & EMIT_OBJ))
+    cst->options.compile_only = true;
+
+  if (cst->options.run_argv && !cst->options.run) {
+    scu_perror("Arguments after -- need --run\n");
+    free(cst);
+    exit(1);
+  }
+
+  if (cst->options.run &&
+      (cst->options.compile_only || cst->options.emit != EMIT_OBJ)) {
+    scu_perror("--run cannot be combined with -c or --emit*\n");
+    free(cst);
+    exit(1);
+  }
+
+  if (cst->options.repl &&
+      (cst->options.compile_only || cst->options.emit != EMIT_OBJ ||
+       cst->options.run || cst->options.server)) {
+    scu_perror("--repl cannot be combined with -c, --emit*, --run or "
+               "--server\n");
+    free(cst);
+    exit(1);
+  }
+
+  // objects of -c are linked elsewhere, they cannot be bitcode, and --run and
+  // --repl generate code as the program calls it
+  if (cst->options.lto != LTO_NONE &&
+      (cst->options.compile_only || cst->options.run || cst->options.repl)) {
+    scu_pwarning("-flto has no effect with %s\n",
+                 cst->options.repl  ? "--repl"
+                 : cst->options.run ? "--run"
+                                    : "-c");
+    cst->options.lto = LTO_NONE;
+  }
+
   if (cst->include_dir == NULL)
     cst->include_dir = strdup(".");
 
-  if (filenames.count == 0) {
+  include_cache_init(&cst->includes, cst->include_dir);
+
+  if (cst->options.no_cache) {
+    obj_cache_init(&cst->cache, NULL, 0);
+  } else {
+    char *cache_dir = cst->options.cache_dir ? strdup(cst->options.cache_dir)
+                                             : obj_cache_default_dir();
+    obj_cache_init(&cst->cache, cache_dir, cst->options.cache_max_size);
+    free(cache_dir);
+  }
+
+  if (filenames.count == 0 && cst->options.cache_stats) {
+    obj_cache_print_stats(&cst->cache);
+    exit(0);
+  }
+
+  if (cst->options.server && cst->options.socket_path == NULL)
+    cst->options.socket_path = server_default_socket();
+
+  if (filenames.count == 0 && !cst->options.server && !cst->options.repl) {
     scu_perror("Missing input filename\n");
     free(cst);
     exit(1);
   }
 
-  if (cst->output_filepath == NULL) {
+  if (cst->output_filepath == NULL && filenames.count) {
     char *first_filename;
     dynamic_array_get(&filenames, 0, &first_filename);
     cst->output_filepath = scu_extract_name(first_filename);
@@ -254,19 +629,49 @@ void cstate_init(cstate *cst, u32 argc, char *argv[]) {
       free(cst);
       exit(1);
     }
+  } else if (cst->output_filepath == NULL && cst->options.repl) {
+    cst->output_filepath = strdup("repl");
   }
 
-  arena_init(&cst->file_arena, 1 << 9);
+  // the server times nothing itself, its requests do
+  if (!cst->options.server) {
+    if (cst->options.time_trace && cst->options.time_trace_path == NULL)
+      cst->options.time_trace_path =
+          scu_format_string("%s.json", cst->output_filepath);
+
+    timing_init(filenames.count, cst->options.time_report,
+                cst->options.time_trace ? cst->options.time_trace_path : NULL);
+
+    if (cst->options.mem_report && cst->options.mem_report_path == NULL)
+      cst->options.mem_report_path =
+          scu_format_string("%s.mem.json", cst->output_filepath);
+
+    memstat_init(cst->options.mem_report);
+  }
+
+#ifdef SCLC_HAVE_LLD
+  bool in_memory = !cst->options.link_cc;
+#else
+  bool in_memory = false;
+#endif
+
+  arena_init(&cst->file_arena, filenames.count * sizeof(fstate));
   dynamic_array_init(&cst->files, sizeof(fstate *));
 
   for (u64 i = 0; i < filenames.count; i++) {
     char *filepath;
     dynamic_array_get(&filenames, i, &filepath);
 
+    timing_begin_file(i, filepath);
+    u64 start = timing_phase_begin(PHASE_READ);
+
     fstate *fst = arena_push_struct(&cst->file_arena, fstate);
     fstate_init(fst, filepath);
     dynamic_array_append(&cst->files, &fst);
 
+    timing_phase_end(PHASE_READ, start);
+    timing_end_file();
+
     u64 len;
     char *obj;
 
@@ -274,6 +679,8 @@ void cstate_init(cstate *cst, u32 argc, char *argv[]) {
       len = strlen(fst->extracted_filepath) + 3;
       obj = scu_checked_malloc(len);
       snprintf(obj, len, "%s.o", fst->extracted_filepath);
+    } else if (in_memory && (obj = cstate_memory_obj(fst)) != NULL) {
+      // never touches the disk, lld reads it where the backend wrote it
     } else {
       len = strlen(fst->extracted_filepath) + 13;
       obj = scu_checked_malloc(len);
@@ -292,6 +699,13 @@ void cstate_free(cstate *cst) {
   if (cst == NULL)
     return;
 
+  include_cache_free(&cst->includes);
+  obj_cache_free(&cst->cache);
+  free(cst->options.cache_dir);
+  free(cst->options.socket_path);
+  free(cst->options.time_trace_path);
+  free(cst->options.mem_report_path);
+
   if (cst->include_dir != NULL)
     free(cst->include_dir);
 
@@ -305,13 +719,14 @@ void cstate_free(cstate *cst) {
     fstate *fst;
     dynamic_array_get(&cst->files, i, &fst);
     fstate_free(fst);
-    arena_free(&cst->file_arena);
   }
 
+  arena_free(&cst->file_arena);
+
   for (u64 i = 0; i < cst->obj_file_list.count; i++) {
     char *objfname;
     dynamic_array_get(&cst->obj_file_list, i, &objfname);
-    free(objfname);
+    cstate_free_obj(objfname);
   }
 
   dynamic_array_free(&cst->obj_file_list);
@@ -1,55 +1,173 @@
+#define _DEFAULT_SOURCE
+
 #include "ds/arena.h"
 #include "common.h"
+#include "memstat.h"
 #include "utils.h"
 
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #define ALIGN_UP_POW2(n, p) ((u64)n + ((u64)p - 1)) & (~((u64)p - 1))
 
 #define ARENA_ALIGN (sizeof(void *))
 
-void arena_init(mem_arena *arena, u64 capacity) {
-  arena->buffer = (u8 *)scu_checked_malloc(capacity);
-  arena->capacity = capacity;
-  arena->pos = 0;
+#define ARENA_HEADER_SIZE                                                      \
+  (ALIGN_UP_POW2(sizeof(mem_arena_block), ARENA_ALIGN))
+
+/*
+ * Scratch arenas of the calling thread, see arena_scratch_begin.
+ */
+#define ARENA_SCRATCH_COUNT 2
+static _Thread_local mem_arena scratch_arenas[ARENA_SCRATCH_COUNT];
+
+/*
+ * @brief: maps a new block able to hold at least size bytes and links it in
+ * front of the current block.
+ *
+ * @param arena: pointer to a mem_arena
+ * @param size: minimum usable size of the block
+ */
+static mem_arena_block *arena_map_block(mem_arena *arena, u64 size) {
+  u64 page = (u64)sysconf(_SC_PAGESIZE);
+
+  if (size < arena->block_size)
+    size = arena->block_size;
+
+  u64 map_size = ALIGN_UP_POW2(ARENA_HEADER_SIZE + size, page);
+
+  void *mem = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    scu_perror("Failed to map arena block of %lu bytes\n", map_size);
+    exit(1);
+  }
+  memstat_arena(map_size, true);
+
+  mem_arena_block *block = mem;
+  block->prev = arena->current;
+  block->capacity = map_size - ARENA_HEADER_SIZE;
+  block->base =
+      arena->current ? arena->current->base + arena->current->pos : 0;
+  block->pos = 0;
+  block->dirty = 0;
+
+  arena->current = block;
+  return block;
+}
+
+/*
+ * @brief: unmaps a single block.
+ */
+static void arena_unmap_block(mem_arena_block *block) {
+  memstat_arena(ARENA_HEADER_SIZE + block->capacity, false);
+  munmap(block, ARENA_HEADER_SIZE + block->capacity);
+}
+
+void arena_init(mem_arena *arena, u64 block_size) {
+  arena->current = NULL;
+  arena->block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK_SIZE;
 }
 
 void arena_free(mem_arena *arena) {
   if (arena == NULL)
     return;
-  free(arena->buffer);
-  arena->buffer = NULL;
-  arena->capacity = 0;
-  arena->pos = 0;
+
+  mem_arena_block *block = arena->current;
+  while (block) {
+    mem_arena_block *prev = block->prev;
+    arena_unmap_block(block);
+    block = prev;
+  }
+
+  arena->current = NULL;
 }
 
 void *arena_push(mem_arena *arena, u64 size) {
-  u64 pos_aligned = ALIGN_UP_POW2(arena->pos, ARENA_ALIGN);
+  mem_arena_block *block = arena->current;
+
+  u64 pos_aligned = block ? ALIGN_UP_POW2(block->pos, ARENA_ALIGN) : 0;
   u64 new_pos = pos_aligned + size;
 
-  if (new_pos > arena->capacity) {
-    scu_perror(
-        "Failed to allocate memory (requested more than available capacity)\n");
+  if (block == NULL || new_pos > block->capacity) {
+    block = arena_map_block(arena, size);
+    pos_aligned = 0;
+    new_pos = size;
+  }
+
+  u8 *out = (u8 *)block + ARENA_HEADER_SIZE + pos_aligned;
+  block->pos = new_pos;
 
-    return NULL;
+  // memory above the dirty mark is fresh from mmap and already zeroed
+  if (pos_aligned < block->dirty) {
+    u64 end = new_pos < block->dirty ? new_pos : block->dirty;
+    memset(out, 0, end - pos_aligned);
   }
+  if (new_pos > block->dirty)
+    block->dirty = new_pos;
 
-  void *out = arena->buffer + pos_aligned;
-  arena->pos = new_pos;
-  memset(out, 0, size);
   return out;
 }
 
+u64 arena_pos(mem_arena *arena) {
+  mem_arena_block *block = arena->current;
+  return block ? block->base + block->pos : 0;
+}
+
 void arena_pop(mem_arena *arena, u64 size) {
-  if (size > arena->pos)
-    size = arena->pos;
-  arena->pos -= size;
+  u64 pos = arena_pos(arena);
+  if (size > pos)
+    size = pos;
+  arena_pop_to(arena, pos - size);
 }
 
 void arena_pop_to(mem_arena *arena, u64 pos) {
-  if (pos <= arena->pos)
-    arena->pos = pos;
+  if (pos > arena_pos(arena))
+    return;
+
+  mem_arena_block *block = arena->current;
+  while (block && block->prev && block->base >= pos) {
+    mem_arena_block *prev = block->prev;
+    arena_unmap_block(block);
+    block = prev;
+  }
+
+  arena->current = block;
+  if (block)
+    block->pos = pos - block->base;
 }
 
-void arena_clear(mem_arena *arena) { arena->pos = 0; }
+void arena_clear(mem_arena *arena) { arena_pop_to(arena, 0); }
+
+mem_arena_temp arena_temp_begin(mem_arena *arena) {
+  return (mem_arena_temp){.arena = arena, .pos = arena_pos(arena)};
+}
+
+void arena_temp_end(mem_arena_temp temp) {
+  arena_pop_to(temp.arena, temp.pos);
+}
+
+mem_arena_temp arena_scratch_begin(mem_arena *conflict) {
+  for (u32 i = 0; i < ARENA_SCRATCH_COUNT; i++) {
+    mem_arena *scratch = &scratch_arenas[i];
+    if (scratch == conflict)
+      continue;
+
+    if (scratch->block_size == 0)
+      arena_init(scratch, ARENA_DEFAULT_BLOCK_SIZE);
+
+    return arena_temp_begin(scratch);
+  }
+
+  // unreachable with more than one scratch arena
+  return (mem_arena_temp){0};
+}
+
+void arena_scratch_release() {
+  for (u32 i = 0; i < ARENA_SCRATCH_COUNT; i++) {
+    arena_free(&scratch_arenas[i]);
+    scratch_arenas[i].block_size = 0;
+  }
+}
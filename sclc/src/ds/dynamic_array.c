@@ -1,5 +1,6 @@
 #include "ds/dynamic_array.h"
 #include "common.h"
+#include "memstat.h"
 #include "utils.h"
 
 #include <stdlib.h>
@@ -42,8 +43,10 @@ u32 dynamic_array_append(dynamic_array *da, void *item) {
   }
 
   if (da->capacity == 0) {
+    mem_kind prev = memstat_tag(MEM_ARRAYS);
     da->capacity = 4;
     da->items = scu_checked_malloc(da->item_size * da->capacity);
+    memstat_untag(prev);
     if (!da->items) {
       scu_perror("Failed to allocate dynamic array\n");
       return -1;
@@ -51,11 +54,13 @@ u32 dynamic_array_append(dynamic_array *da, void *item) {
   }
 
   if (da->count == da->capacity) {
+    mem_kind prev = memstat_tag(MEM_ARRAYS);
     u64 new_capacity = da->capacity * 2;
     void *new_items =
         scu_checked_realloc(da->items, da->item_size * new_capacity);
     da->items = new_items;
     da->capacity = new_capacity;
+    memstat_untag(prev);
   }
 
   memcpy((char *)da->items + (da->count * da->item_size), item, da->item_size);
@@ -70,11 +75,13 @@ u32 dynamic_array_insert(dynamic_array *da, u64 index, void *item) {
   }
 
   if (da->count == da->capacity) {
+    mem_kind prev = memstat_tag(MEM_ARRAYS);
     u64 new_capacity = da->capacity * 2;
     void *new_items =
         scu_checked_realloc(da->items, da->item_size * new_capacity);
     da->items = new_items;
     da->capacity = new_capacity;
+    memstat_untag(prev);
   }
 
   memmove((char *)da->items + (index * da->item_size) + da->item_size,
@@ -1,306 +1,282 @@
 #include "ds/ht.h"
 #include "common.h"
+#include "ds/arena.h"
+#include "ds/hash.h"
+#include "memstat.h"
 #include "utils.h"
 
-#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
 /*
- * @brief: check if x is prime.
+ * Reserved hash values marking unused slots, real hashes are moved out of this
+ * range by ht_hash.
  */
-static u32 is_prime(const u32 x) {
-  if (x < 2) {
-    return -1;
-  }
-  if (x < 4) {
-    return 1;
-  }
-  if ((x % 2) == 0) {
-    return 0;
-  }
-  for (u32 i = 3; i <= floor(sqrt((double)x)); i += 2) {
-    if ((x % i) == 0) {
-      return 0;
-    }
-  }
-  return 1;
-}
+#define HT_EMPTY 0
+#define HT_TOMBSTONE 1
+#define HT_FIRST_HASH 2
+
+#define HT_MIN_CAPACITY 16
 
 /*
- * @brief: find the next prime number which is greater than x.
+ * Arena block size for keys and values, most tables are small scopes.
  */
-static u32 next_prime(u32 x) {
-  while (is_prime(x) != 1) {
-    x++;
-  }
-  return x;
-}
+#define HT_ARENA_BLOCK_SIZE (4 << 10)
 
 /*
- * @brief: a simple hash function.
+ * @brief: hash a key, never returns one of the reserved values.
  *
- * @param s: string to hash
- * @param prime: a prime number
- * @param m: size of the hash table
+ * @param key: key string
+ * @param len: length of the key
  */
-static inline u32 ht_hash(const char *s, const u32 prime, const u32 m) {
-  long hash = 0;
-  const u32 len_s = strlen(s);
-  long p_pow = 1;
-
-  for (u32 i = 0; i < len_s; i++) {
-    hash = (hash + s[i] * p_pow) % m;
-    p_pow = (p_pow * prime) % m;
-  }
-
-  return (u32)hash;
+static inline u64 ht_hash(const char *key, const u64 len) {
+  u64 hash = scu_hash_bytes(key, len, 0);
+  return hash < HT_FIRST_HASH ? hash + HT_FIRST_HASH : hash;
 }
 
 /*
- * @brief: implements double-hashing to avoid collissions.
- *
- * @param s: string to hash
- * @param num_buckets: size of the hash table
- * @param attempts: number of attempts it took to hash the current string
+ * @brief: check if slot holds a key.
  */
-static u32 ht_get_hash(const char *s, const u32 num_buckets,
-                       const u32 attempt) {
-#define HT_PRIME_1 0x21914047
-#define HT_PRIME_2 0x1b873593
-  const u32 hash_a = ht_hash(s, HT_PRIME_1, num_buckets);
-  const u32 hash_b = ht_hash(s, HT_PRIME_2, num_buckets);
-  return (hash_a + (attempt * (hash_b + 1))) % num_buckets;
-#undef HT_PRIME_1
-#undef HT_PRIME_2
+static inline bool ht_slot_used(const ht_slot *slot) {
+  return slot->hash >= HT_FIRST_HASH;
 }
 
 /*
- * @brief: allocate and initialize a new ht_item and return its memory address.
+ * @brief: find the slot holding key, or NULL.
  *
- * @param k: key string literal.
- * @param v: pointer to the value to be stored.
- * @param value_size: number of bytes to be copied.
+ * @param table: pointer to an initialized ht struct.
+ * @param key: key string
+ * @param len: length of the key
+ * @param hash: ht_hash of the key
  */
-static ht_item *ht_new_item(const char *k, const void *v,
-                            const u64 value_size) {
-  ht_item *i = scu_checked_malloc(sizeof(ht_item));
-  i->key = strdup(k);
-  i->value = scu_checked_malloc(value_size);
-  memcpy(i->value, v, value_size);
-  return i;
+static ht_slot *ht_find(ht *table, const char *key, const u64 len,
+                        const u64 hash) {
+  if (table->capacity == 0)
+    return NULL;
+
+  const u64 mask = table->capacity - 1;
+
+  for (u64 i = hash & mask;; i = (i + 1) & mask) {
+    ht_slot *slot = &table->slots[i];
+
+    if (slot->hash == HT_EMPTY)
+      return NULL;
+
+    if (slot->hash == hash && slot->key_len == len &&
+        memcmp(slot->key, key, len) == 0)
+      return slot;
+  }
 }
 
 /*
- * @brief: free / delete an existing ht_item.
- *
- * @param i: pointer to the item to be freed.
+ * @brief: test / set a bit in a bitmap.
  */
-static void ht_del_item(ht_item *i) {
-  free(i->key);
-  free(i->value);
-  free(i);
+static inline bool ht_bit(const u64 *bits, const u64 i) {
+  return (bits[i >> 6] >> (i & 63)) & 1;
 }
 
-/*
- * @brief: represents a deleted or NULL hash table item.
- */
-static ht_item HT_DELETED_ITEM = {NULL, NULL};
+static inline void ht_bit_set(u64 *bits, const u64 i) {
+  bits[i >> 6] |= (u64)1 << (i & 63);
+}
 
 /*
- * @brief : create a new sized hash table
+ * @brief: rehash the table in place into new_capacity slots (which may equal
+ * the current capacity to get rid of tombstones).
  *
- * @param base_capacity
- * @param value_size: number of bytes the value will occupy.
+ * The slot array is grown with realloc, then every old entry is moved to its
+ * new home. An entry landing on a slot that still holds an entry which was not
+ * moved yet kicks that one out, which is then placed the same way. A bitmap
+ * tracks which slots already hold their final entry.
+ *
+ * @param table: pointer to an initialized ht struct.
+ * @param new_capacity: power of two, at least the current capacity.
  */
-static ht *ht_new_sized(const u64 base_capacity, const u64 value_size) {
-  ht *table = scu_checked_malloc(sizeof(ht));
-
-  table->base_capacity = base_capacity;
-  table->capacity = next_prime(table->base_capacity);
-  table->count = 0;
-  table->items = scu_checked_malloc(table->capacity * sizeof(ht_item *));
-  table->value_size = value_size;
+static void ht_rehash(ht *table, const u64 new_capacity) {
+  const u64 old_capacity = table->capacity;
+  mem_kind prev = memstat_tag(MEM_TABLES);
+
+  table->slots =
+      scu_checked_realloc(table->slots, new_capacity * sizeof(ht_slot));
+  memset(table->slots + old_capacity, 0,
+         (new_capacity - old_capacity) * sizeof(ht_slot));
+
+  u64 *placed = scu_checked_malloc(((new_capacity + 63) / 64) * sizeof(u64));
+  memstat_untag(prev);
+  const u64 mask = new_capacity - 1;
+
+  for (u64 j = 0; j < old_capacity; j++) {
+    if (ht_bit(placed, j))
+      continue;
+
+    if (!ht_slot_used(&table->slots[j])) {
+      table->slots[j].hash = HT_EMPTY;
+      continue;
+    }
 
-  return table;
-}
+    ht_slot moving = table->slots[j];
+    table->slots[j].hash = HT_EMPTY;
 
-ht *ht_create(const u64 value_size) { return ht_new_sized(53, value_size); }
+    while (1) {
+      u64 i = moving.hash & mask;
+      while (ht_bit(placed, i))
+        i = (i + 1) & mask;
 
-void ht_destroy(ht *table) {
-  if (table == NULL)
-    return;
+      ht_bit_set(placed, i);
 
-  if (table->items != NULL) {
-    for (u64 i = 0; i < table->capacity; i++) {
-      ht_item *item = table->items[i];
-      if (item != NULL && item != &HT_DELETED_ITEM) { // Skip sentinel
-        ht_del_item(item);
+      ht_slot *slot = &table->slots[i];
+      if (i < old_capacity && ht_slot_used(slot)) {
+        // not moved yet, take its place and move it next
+        ht_slot kicked = *slot;
+        *slot = moving;
+        moving = kicked;
+        continue;
       }
+
+      *slot = moving;
+      break;
     }
-    free(table->items);
   }
-  free(table);
-}
 
-void ht_init(ht *table, const u64 value_size) {
-  table->base_capacity = 53;
-  table->capacity = next_prime(table->base_capacity);
-  table->count = 0;
-  table->items = scu_checked_malloc(table->capacity * sizeof(ht_item *));
-  table->value_size = value_size;
-}
-
-void ht_free(ht *table) {
-  if (table == NULL)
-    return;
+  free(placed);
 
-  if (table->items != NULL) {
-    for (u64 i = 0; i < table->capacity; i++) {
-      ht_item *item = table->items[i];
-      if (item != NULL && item != &HT_DELETED_ITEM) { // Skip sentinel
-        ht_del_item(item);
-      }
-    }
-    free(table->items);
-  }
+  table->capacity = new_capacity;
+  table->tombstones = 0;
 }
 
 /*
- * @brief: resize an existing hash table to avoid high collission rates and keep
- * storing more key-value pairs.
+ * @brief: make room for one more entry, growing or cleaning up the table when
+ * the load factor would exceed 70%.
  *
  * @param table: pointer to an initialized ht struct.
- * @param base_capacity
  */
-static void ht_resize(ht *table, const u64 base_capacity) {
-  if (base_capacity < 53) {
+static void ht_reserve_one(ht *table) {
+  if (table->capacity == 0) {
+    ht_rehash(table, HT_MIN_CAPACITY);
     return;
   }
 
-  ht *new_ht = ht_new_sized(base_capacity, table->value_size);
-  for (u64 i = 0; i < table->capacity; i++) {
-    ht_item *item = table->items[i];
-    if (item != NULL && item != &HT_DELETED_ITEM) {
-      ht_insert(new_ht, item->key, item->value);
-    }
-  }
+  const u64 limit = table->capacity * 7 / 10;
 
-  table->base_capacity = new_ht->base_capacity;
-  table->count = new_ht->count;
+  if (table->count + table->tombstones + 1 <= limit)
+    return;
 
-  const u64 tmp_size = table->capacity;
-  table->capacity = new_ht->capacity;
-  new_ht->capacity = tmp_size;
+  if (table->count + 1 > limit / 2)
+    ht_rehash(table, table->capacity * 2);
+  else
+    ht_rehash(table, table->capacity);
+}
 
-  ht_item **tmp_items = table->items;
-  table->items = new_ht->items;
-  new_ht->items = tmp_items;
+ht *ht_create(const u64 value_size) {
+  ht *table = scu_checked_malloc(sizeof(ht));
+  ht_init(table, value_size);
+  return table;
+}
 
-  ht_destroy(new_ht);
+void ht_destroy(ht *table) {
+  if (table == NULL)
+    return;
+
+  ht_free(table);
+  free(table);
 }
 
-/*
- * @brief: wrapper function to make the hash table bigger.
- *
- * @param table: pointer to an initialized ht struct.
- */
-static void ht_resize_up(ht *table) {
-  const u64 new_size = table->base_capacity * 2;
-  ht_resize(table, new_size);
+void ht_init(ht *table, const u64 value_size) {
+  table->capacity = 0;
+  table->count = 0;
+  table->tombstones = 0;
+  table->slots = NULL;
+  table->value_size = value_size;
+  arena_init(&table->arena, HT_ARENA_BLOCK_SIZE);
 }
 
-/*
- * @brief: wrapper function to make the hash table smaller.
- *
- * @param table: pointer to an initialized ht struct.
- */
-static void ht_resize_down(ht *table) {
-  const u64 new_size = table->base_capacity / 2;
-  ht_resize(table, new_size);
+void ht_free(ht *table) {
+  if (table == NULL)
+    return;
+
+  free(table->slots);
+  table->slots = NULL;
+  table->capacity = 0;
+  table->count = 0;
+  table->tombstones = 0;
+
+  arena_free(&table->arena);
 }
 
 void ht_insert(ht *table, const char *key, const void *value) {
   if (table == NULL || key == NULL)
     return;
 
-  const u64 load = table->count * 100 / table->capacity;
-  if (load > 70) {
-    ht_resize_up(table);
+  const u64 len = strlen(key);
+  const u64 hash = ht_hash(key, len);
+
+  ht_slot *slot = ht_find(table, key, len, hash);
+  if (slot) {
+    memcpy(slot->value, value, table->value_size);
+    return;
   }
 
-  ht_item *item = ht_new_item(key, value, table->value_size);
+  ht_reserve_one(table);
 
-  u64 i = 0;
-  u64 max_probes = table->capacity;
+  const u64 mask = table->capacity - 1;
+  u64 i = hash & mask;
+  while (ht_slot_used(&table->slots[i]))
+    i = (i + 1) & mask;
 
-  u32 index = ht_get_hash(item->key, table->capacity, i);
-  ht_item *current = table->items[index];
+  slot = &table->slots[i];
+  if (slot->hash == HT_TOMBSTONE)
+    table->tombstones--;
 
-  while (current != NULL && i < max_probes) {
-    if (current != &HT_DELETED_ITEM) {
-      if (strcmp(current->key, key) == 0) {
-        ht_del_item(current);
-        table->items[index] = item;
-        return;
-      }
-    }
-    i++;
-    index = ht_get_hash(item->key, table->capacity, (int)i);
-    current = table->items[index];
-  }
+  // value first to keep it aligned, key bytes right after
+  u8 *mem = arena_push(&table->arena, table->value_size + len + 1);
+  memcpy(mem, value, table->value_size);
+  memcpy(mem + table->value_size, key, len + 1);
 
-  if (i >= max_probes) {
-    ht_del_item(item);
-    ht_resize_up(table);
-    ht_insert(table, key, value);
-    return;
-  }
+  slot->hash = hash;
+  slot->value = mem;
+  slot->key = (char *)mem + table->value_size;
+  slot->key_len = len;
 
-  table->items[index] = item;
   table->count++;
 }
 
 void *ht_search(ht *table, const char *key) {
-  u64 index = ht_get_hash(key, table->capacity, 0);
-  ht_item *item = table->items[index];
-
-  u64 i = 1;
-  while (item != NULL) {
-    if (item != &HT_DELETED_ITEM) {
-      if (strcmp(item->key, key) == 0) {
-        return item->value;
-      }
-    }
-    index = ht_get_hash(key, table->capacity, i);
-    item = table->items[index];
-    i++;
-  }
+  if (table == NULL || key == NULL)
+    return NULL;
 
-  return NULL;
+  const u64 len = strlen(key);
+  ht_slot *slot = ht_find(table, key, len, ht_hash(key, len));
+  return slot ? slot->value : NULL;
 }
 
 void ht_delete(ht *table, const char *key) {
-  u64 index = ht_get_hash(key, table->capacity, 0);
-  ht_item *item = table->items[index];
-
-  u64 i = 1;
-  while (item != NULL) {
-    if (item != &HT_DELETED_ITEM) {
-      if (strcmp(item->key, key) == 0) {
-        ht_del_item(item);
-        table->items[index] = &HT_DELETED_ITEM;
-        table->count--;
-
-        const u64 load = table->count * 100 / table->capacity;
-        if (load < 10)
-          ht_resize_down(table);
-
-        return;
-      }
+  if (table == NULL || key == NULL)
+    return;
+
+  const u64 len = strlen(key);
+  ht_slot *slot = ht_find(table, key, len, ht_hash(key, len));
+  if (!slot)
+    return;
+
+  // the key and value stay in the arena until the table is freed
+  slot->hash = HT_TOMBSTONE;
+  slot->key = NULL;
+  slot->value = NULL;
+  table->count--;
+  table->tombstones++;
+}
+
+bool ht_next(ht *table, u64 *iter, const char **key, void **value) {
+  while (*iter < table->capacity) {
+    ht_slot *slot = &table->slots[(*iter)++];
+
+    if (ht_slot_used(slot)) {
+      if (key)
+        *key = slot->key;
+      if (value)
+        *value = slot->value;
+      return true;
     }
-    index = ht_get_hash(key, table->capacity, i);
-    item = table->items[index];
-    i++;
   }
+
+  return false;
 }
@@ -0,0 +1,134 @@
+#include "ds/scope_map.h"
+#include "common.h"
+#include "ds/dynamic_array.h"
+#include "ds/sym_map.h"
+#include "intern.h"
+#include "memstat.h"
+#include "utils.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SCOPE_MAP_MIN_CAPACITY 16
+#define SCOPE_MAP_NONE UINT32_MAX
+
+/*
+ * @struct scope_binding: header of a binding, followed by its value.
+ */
+typedef struct scope_binding {
+  sym_id id;
+  u32 depth;  // number of scopes open when it was made
+  u32 shadow; // index of the binding it shadows, or SCOPE_MAP_NONE
+} scope_binding;
+
+/*
+ * @struct scope_frame: an open scope.
+ */
+typedef struct scope_frame {
+  u64 start; // number of bindings when it was entered
+  u32 floor; // floor of the enclosing scope
+} scope_frame;
+
+/*
+ * Alignment of bindings and of their values, which may hold any type.
+ */
+#define SCOPE_MAP_ALIGN ((u64)_Alignof(max_align_t))
+#define SCOPE_MAP_ROUND(n)                                                     \
+  (((n) + SCOPE_MAP_ALIGN - 1) & ~(SCOPE_MAP_ALIGN - 1))
+
+/*
+ * Offset of the value in a binding, past the header.
+ */
+#define SCOPE_MAP_VALUE_OFFSET SCOPE_MAP_ROUND(sizeof(scope_binding))
+
+static inline scope_binding *scope_map_binding(scope_map *map, u64 index) {
+  return (scope_binding *)(map->bindings + index * map->stride);
+}
+
+static inline void *scope_map_value(scope_binding *binding) {
+  return (u8 *)binding + SCOPE_MAP_VALUE_OFFSET;
+}
+
+void scope_map_init(scope_map *map, u64 value_size) {
+  map->value_size = value_size;
+  map->stride = SCOPE_MAP_ROUND(SCOPE_MAP_VALUE_OFFSET + value_size);
+  map->bindings = NULL;
+  map->count = 0;
+  map->capacity = 0;
+  sym_map_init(&map->innermost, sizeof(u32));
+  dynamic_array_init(&map->scopes, sizeof(scope_frame));
+  map->floor = 0;
+}
+
+void scope_map_free(scope_map *map) {
+  free(map->bindings);
+  map->bindings = NULL;
+  map->count = 0;
+  map->capacity = 0;
+  sym_map_free(&map->innermost);
+  dynamic_array_free(&map->scopes);
+  map->floor = 0;
+}
+
+void scope_map_push(scope_map *map, bool isolated) {
+  scope_frame frame = {.start = map->count, .floor = map->floor};
+  dynamic_array_append(&map->scopes, &frame);
+
+  if (isolated)
+    map->floor = map->scopes.count;
+}
+
+void scope_map_pop(scope_map *map) {
+  scope_frame frame;
+  dynamic_array_get(&map->scopes, map->scopes.count - 1, &frame);
+  dynamic_array_remove(&map->scopes, map->scopes.count - 1);
+
+  scope_map_truncate(map, frame.start);
+  map->floor = frame.floor;
+}
+
+void scope_map_truncate(scope_map *map, u64 count) {
+  // unlink in reverse, a symbol bound twice in the scope ends up uncovered
+  while (map->count > count) {
+    scope_binding *binding = scope_map_binding(map, --map->count);
+    if (binding->shadow == SCOPE_MAP_NONE)
+      sym_map_remove(&map->innermost, binding->id);
+    else
+      sym_map_set(&map->innermost, binding->id, &binding->shadow);
+  }
+}
+
+void scope_map_bind(scope_map *map, sym_id id, const void *value) {
+  if (map->count == map->capacity) {
+    map->capacity =
+        map->capacity ? map->capacity * 2 : SCOPE_MAP_MIN_CAPACITY;
+    mem_kind prev = memstat_tag(MEM_TABLES);
+    map->bindings =
+        scu_checked_realloc(map->bindings, map->capacity * map->stride);
+    memstat_untag(prev);
+  }
+
+  u32 *innermost = sym_map_get(&map->innermost, id);
+  u32 index = map->count++;
+
+  scope_binding *binding = scope_map_binding(map, index);
+  binding->id = id;
+  binding->depth = map->scopes.count;
+  binding->shadow = innermost ? *innermost : SCOPE_MAP_NONE;
+  memcpy(scope_map_value(binding), value, map->value_size);
+
+  sym_map_set(&map->innermost, id, &index);
+}
+
+void *scope_map_get(scope_map *map, sym_id id) {
+  u32 *innermost = sym_map_get(&map->innermost, id);
+  if (!innermost)
+    return NULL;
+
+  scope_binding *binding = scope_map_binding(map, *innermost);
+  if (binding->depth < map->floor)
+    return NULL;
+
+  return scope_map_value(binding);
+}
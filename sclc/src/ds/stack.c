@@ -1,5 +1,6 @@
 #include "ds/stack.h"
 #include "common.h"
+#include "memstat.h"
 #include "utils.h"
 
 #include <stdlib.h>
@@ -12,7 +13,9 @@ u32 stack_init(stack *s, u64 item_size) {
   }
   s->item_size = item_size;
   s->capacity = STACK_INITIAL_CAPACITY;
+  mem_kind prev = memstat_tag(MEM_ARRAYS);
   s->items = scu_checked_malloc(s->item_size * s->capacity);
+  memstat_untag(prev);
   s->count = 0;
   return 0;
 }
@@ -27,7 +30,9 @@ static u32 stack_expand(stack *s) {
     return -1;
   }
   u64 new_capacity = s->capacity * STACK_RESIZE_FACTOR;
+  mem_kind prev = memstat_tag(MEM_ARRAYS);
   void *new_items = scu_checked_realloc(s->items, s->item_size * new_capacity);
+  memstat_untag(prev);
   s->items = new_items;
   s->capacity = new_capacity;
   return 0;
@@ -0,0 +1,94 @@
+#include "ds/sym_map.h"
+#include "common.h"
+#include "intern.h"
+#include "memstat.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SYM_MAP_MIN_CAPACITY 64
+
+/*
+ * @brief: grow the map so that id fits, covering at least all symbols
+ * interned so far to avoid growing again right away.
+ */
+static void sym_map_reserve(sym_map *map, sym_id id) {
+  u64 new_capacity = map->capacity ? map->capacity : SYM_MAP_MIN_CAPACITY;
+  u64 wanted = (u64)id + 1;
+
+  if (wanted < intern_count())
+    wanted = intern_count();
+
+  while (new_capacity < wanted)
+    new_capacity *= 2;
+
+  mem_kind prev = memstat_tag(MEM_TABLES);
+  map->values =
+      scu_checked_realloc(map->values, new_capacity * map->value_size);
+  map->present =
+      scu_checked_realloc(map->present, (new_capacity / 64) * sizeof(u64));
+  memstat_untag(prev);
+
+  memset(map->present + map->capacity / 64, 0,
+         ((new_capacity - map->capacity) / 64) * sizeof(u64));
+
+  map->capacity = new_capacity;
+}
+
+static inline bool sym_map_has(sym_map *map, sym_id id) {
+  return id < map->capacity && (map->present[id >> 6] >> (id & 63)) & 1;
+}
+
+void sym_map_init(sym_map *map, u64 value_size) {
+  map->value_size = value_size;
+  map->capacity = 0;
+  map->values = NULL;
+  map->present = NULL;
+  map->count = 0;
+}
+
+void sym_map_free(sym_map *map) {
+  if (map == NULL)
+    return;
+
+  free(map->values);
+  free(map->present);
+  map->values = NULL;
+  map->present = NULL;
+  map->capacity = 0;
+  map->count = 0;
+}
+
+void sym_map_set(sym_map *map, sym_id id, const void *value) {
+  if (id >= map->capacity)
+    sym_map_reserve(map, id);
+
+  if (!sym_map_has(map, id)) {
+    map->present[id >> 6] |= (u64)1 << (id & 63);
+    map->count++;
+  }
+
+  memcpy(map->values + (u64)id * map->value_size, value, map->value_size);
+}
+
+void *sym_map_get(sym_map *map, sym_id id) {
+  if (!sym_map_has(map, id))
+    return NULL;
+
+  return map->values + (u64)id * map->value_size;
+}
+
+void sym_map_remove(sym_map *map, sym_id id) {
+  if (!sym_map_has(map, id))
+    return;
+
+  map->present[id >> 6] &= ~((u64)1 << (id & 63));
+  map->count--;
+}
+
+void sym_map_clear(sym_map *map) {
+  if (map->present)
+    memset(map->present, 0, (map->capacity / 64) * sizeof(u64));
+  map->count = 0;
+}
@@ -1,50 +1,60 @@
 #include "fstate.h"
 #include "ast.h"
 #include "ds/dynamic_array.h"
-#include "ds/ht.h"
+#include "ds/scope_map.h"
+#include "ds/sym_map.h"
+#include "source.h"
 #include "utils.h"
 #include "var.h"
 
 #include <stdlib.h>
 #include <string.h>
 
-void fstate_init(fstate *fst, const char *filepath) {
+/*
+ * @brief: initialize everything of a file state but its sources.
+ */
+static void fstate_init_common(fstate *fst, const char *filepath) {
   fst->filepath_len = strlen(filepath) + 1;
   fst->filepath = scu_checked_malloc(fst->filepath_len * sizeof(char));
   strcpy(fst->filepath, filepath);
 
   fst->extracted_filepath = scu_extract_name(fst->filepath);
 
-  fst->code_buffer_len = scu_read_file(fst->filepath, &fst->code_buffer);
-  if (fst->code_buffer == NULL) {
-    scu_perror("Failed to read file: %s\n", fst->filepath);
-    exit(1);
-  }
-
-  dynamic_array_init(&fst->tokens, sizeof(token));
+  source_map_init(&fst->sources);
 
   ast_init(&fst->program_ast);
 
   stack_init(&fst->loops, sizeof(loop_node));
 
-  ht_init(&fst->variables, sizeof(variable));
+  scope_map_init(&fst->variables, sizeof(variable));
+
+  sym_map_init(&fst->functions, sizeof(fn_ref));
+}
+
+void fstate_init(fstate *fst, const char *filepath) {
+  fstate_init_common(fst, filepath);
+
+  u64 code_buffer_len;
+  char *code_buffer = scu_map_file(fst->filepath, &code_buffer_len);
 
-  ht_init(&fst->functions, sizeof(fn_node));
+  source_map_add(&fst->sources, fst->filepath, code_buffer, code_buffer_len);
+}
+
+void fstate_init_buffer(fstate *fst, const char *name, char *buffer, u64 len) {
+  fstate_init_common(fst, name);
+  source_map_add_shared(&fst->sources, fst->filepath, buffer, len);
 }
 
 void fstate_free(fstate *fst) {
   free(fst->filepath);
   free(fst->extracted_filepath);
-  free(fst->code_buffer);
-
-  free_tokens(&fst->tokens);
-  dynamic_array_free(&fst->tokens);
+  source_map_free(&fst->sources);
 
   ast_free(&fst->program_ast);
 
   stack_free(&fst->loops);
 
-  ht_free(&fst->variables);
+  scope_map_free(&fst->variables);
 
-  ht_free(&fst->functions);
+  sym_map_free(&fst->functions);
 }
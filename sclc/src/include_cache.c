@@ -0,0 +1,133 @@
+#define _DEFAULT_SOURCE
+
+#include "include_cache.h"
+#include "common.h"
+#include "ds/dynamic_array.h"
+#include "ds/ht.h"
+#include "lexer.h"
+#include "memstat.h"
+#include "source.h"
+#include "token.h"
+#include "utils.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+void include_cache_init(include_cache *cache, const char *include_dir) {
+  cache->include_dir = include_dir;
+  ht_init(&cache->files, sizeof(include_file *));
+  dynamic_array_init(&cache->entries, sizeof(include_file *));
+  pthread_mutex_init(&cache->lock, NULL);
+}
+
+/*
+ * @brief: free an entry.
+ */
+static void include_file_free(include_file *file) {
+  free(file->path);
+  source_map_free(&file->sources);
+  dynamic_array_free(&file->tokens);
+  free(file);
+}
+
+void include_cache_free(include_cache *cache) {
+  for (u64 i = 0; i < cache->entries.count; i++) {
+    include_file *file;
+    dynamic_array_get(&cache->entries, i, &file);
+    include_file_free(file);
+  }
+
+  dynamic_array_free(&cache->entries);
+  ht_free(&cache->files);
+  pthread_mutex_destroy(&cache->lock);
+}
+
+/*
+ * @brief: check if an entry still matches the file on disk.
+ */
+static inline bool include_file_fresh(include_file *file, struct stat *st) {
+  return file->size == (u64)st->st_size &&
+         file->mtime.tv_sec == st->st_mtim.tv_sec &&
+         file->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+/*
+ * @brief: read and lex a file into a new entry. Runs without the lock of the
+ * cache, mapping the file may bail out to the error sink of the caller.
+ *
+ * @param path: real path of the file (the entry takes ownership).
+ * @param st: stat of the file.
+ */
+static include_file *include_file_create(char *path, struct stat *st) {
+  u64 buffer_len;
+  char *buffer = scu_map_file(path, &buffer_len);
+
+  // the tokens of the file, which are most of what it takes
+  mem_kind prev = memstat_tag(MEM_TOKENS);
+
+  include_file *file = scu_checked_malloc(sizeof(include_file));
+  file->path = path;
+  file->size = st->st_size;
+  file->mtime = st->st_mtim;
+
+  source_map_init(&file->sources);
+  u32 index = source_map_add(&file->sources, path, buffer, buffer_len);
+
+  dynamic_array_init(&file->tokens, sizeof(token));
+  lexer_tokenize(&file->sources, index, &file->tokens);
+
+  memstat_untag(prev);
+  return file;
+}
+
+/*
+ * @brief: look up a fresh entry, the lock of the cache held.
+ */
+static include_file *include_cache_find(include_cache *cache,
+                                        const char *real_path,
+                                        struct stat *st) {
+  include_file **cached = ht_search(&cache->files, real_path);
+  return cached != NULL && include_file_fresh(*cached, st) ? *cached : NULL;
+}
+
+include_file *include_cache_get(include_cache *cache, const char *path) {
+  char *real_path = realpath(path, NULL);
+  struct stat st;
+  if (real_path == NULL || stat(real_path, &st) != 0 || !S_ISREG(st.st_mode)) {
+    free(real_path);
+    scu_perror("Failed to include file: %s\n", path);
+    scu_check_errors();
+  }
+
+  pthread_mutex_lock(&cache->lock);
+  include_file *file = include_cache_find(cache, real_path, &st);
+  pthread_mutex_unlock(&cache->lock);
+
+  if (file != NULL) {
+    free(real_path);
+    return file;
+  }
+
+  // lexed without the lock, files including different files don't wait for
+  // each other, and an error leaves the cache unlocked
+  include_file *created = include_file_create(real_path, &st);
+
+  pthread_mutex_lock(&cache->lock);
+
+  // another thread may have lexed it meanwhile, the first entry is kept
+  file = include_cache_find(cache, created->path, &st);
+  if (file == NULL) {
+    file = created;
+    created = NULL;
+    ht_insert(&cache->files, file->path, &file);
+    dynamic_array_append(&cache->entries, &file);
+  }
+
+  pthread_mutex_unlock(&cache->lock);
+
+  if (created != NULL)
+    include_file_free(created);
+
+  return file;
+}
@@ -0,0 +1,218 @@
+#include "intern.h"
+#include "common.h"
+#include "ds/arena.h"
+#include "ds/hash.h"
+#include "memstat.h"
+#include "utils.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * The string -> id direction is split into shards picked by the top bits of
+ * the hash, each with its own lock, so that threads lexing different files
+ * rarely wait on each other.
+ */
+#define INTERN_SHARD_BITS 4
+#define INTERN_SHARDS (1 << INTERN_SHARD_BITS)
+
+#define INTERN_MIN_CAPACITY 256
+
+/*
+ * The id -> string direction is a two level table of fixed size chunks, chunks
+ * never move so lookups need no lock.
+ */
+#define INTERN_CHUNK_BITS 12
+#define INTERN_CHUNK_SIZE (1 << INTERN_CHUNK_BITS)
+#define INTERN_MAX_CHUNKS (1 << 14)
+
+/*
+ * @struct intern_entry: string of a symbol.
+ */
+typedef struct intern_entry {
+  const char *str;
+  u64 len;
+} intern_entry;
+
+/*
+ * @struct intern_slot: slot of a shard's open addressing table, hash 0 marks
+ * an empty slot.
+ */
+typedef struct intern_slot {
+  u64 hash;
+  sym_id id;
+} intern_slot;
+
+typedef struct intern_shard {
+  pthread_mutex_t lock;
+  intern_slot *slots;
+  u64 capacity;
+  u64 count;
+
+  /*
+   * Backing memory for the interned strings.
+   */
+  mem_arena strings;
+} intern_shard;
+
+static intern_shard shards[INTERN_SHARDS];
+static _Atomic(intern_entry *) chunks[INTERN_MAX_CHUNKS];
+static _Atomic u32 next_id = 1;
+
+/*
+ * @brief: get the entry of a symbol, allocating its chunk when needed.
+ *
+ * @param id: symbol id
+ * @param create: allocate the chunk if it does not exist yet
+ */
+static intern_entry *intern_entry_of(sym_id id, bool create) {
+  _Atomic(intern_entry *) *chunk_ref = &chunks[id >> INTERN_CHUNK_BITS];
+  intern_entry *chunk = atomic_load_explicit(chunk_ref, memory_order_acquire);
+
+  if (!chunk && create) {
+    mem_kind prev = memstat_tag(MEM_TABLES);
+    intern_entry *fresh =
+        scu_checked_malloc(INTERN_CHUNK_SIZE * sizeof(intern_entry));
+    memstat_untag(prev);
+
+    if (atomic_compare_exchange_strong(chunk_ref, &chunk, fresh))
+      chunk = fresh;
+    else
+      free(fresh); // another thread won, chunk now holds its pointer
+  }
+
+  return chunk ? &chunk[id & (INTERN_CHUNK_SIZE - 1)] : NULL;
+}
+
+/*
+ * @brief: insert an id into a shard's table without checking for duplicates.
+ */
+static void intern_shard_place(intern_shard *shard, u64 hash, sym_id id) {
+  const u64 mask = shard->capacity - 1;
+  u64 i = hash & mask;
+
+  while (shard->slots[i].hash != 0)
+    i = (i + 1) & mask;
+
+  shard->slots[i] = (intern_slot){.hash = hash, .id = id};
+}
+
+/*
+ * @brief: double the capacity of a shard's table.
+ */
+static void intern_shard_grow(intern_shard *shard) {
+  intern_slot *old = shard->slots;
+  u64 old_capacity = shard->capacity;
+
+  shard->capacity = old_capacity ? old_capacity * 2 : INTERN_MIN_CAPACITY;
+  mem_kind prev = memstat_tag(MEM_TABLES);
+  shard->slots = scu_checked_malloc(shard->capacity * sizeof(intern_slot));
+  memstat_untag(prev);
+
+  for (u64 i = 0; i < old_capacity; i++)
+    if (old[i].hash != 0)
+      intern_shard_place(shard, old[i].hash, old[i].id);
+
+  free(old);
+}
+
+void intern_init() {
+  for (u32 i = 0; i < INTERN_SHARDS; i++) {
+    intern_shard *shard = &shards[i];
+    pthread_mutex_init(&shard->lock, NULL);
+    shard->slots = NULL;
+    shard->capacity = 0;
+    shard->count = 0;
+    arena_init(&shard->strings, ARENA_DEFAULT_BLOCK_SIZE);
+  }
+
+  atomic_store(&next_id, 1);
+}
+
+void intern_free() {
+  for (u32 i = 0; i < INTERN_SHARDS; i++) {
+    intern_shard *shard = &shards[i];
+    pthread_mutex_destroy(&shard->lock);
+    free(shard->slots);
+    shard->slots = NULL;
+    shard->capacity = 0;
+    shard->count = 0;
+    arena_free(&shard->strings);
+  }
+
+  for (u32 i = 0; i < INTERN_MAX_CHUNKS; i++) {
+    intern_entry *chunk = atomic_exchange(&chunks[i], NULL);
+    free(chunk);
+  }
+
+  atomic_store(&next_id, 1);
+}
+
+sym_id intern(const char *str, u64 len) {
+  u64 hash = scu_hash_bytes(str, len, 0);
+  if (hash == 0)
+    hash = 1;
+
+  intern_shard *shard = &shards[hash >> (64 - INTERN_SHARD_BITS)];
+  pthread_mutex_lock(&shard->lock);
+
+  if (shard->capacity) {
+    const u64 mask = shard->capacity - 1;
+
+    for (u64 i = hash & mask; shard->slots[i].hash != 0; i = (i + 1) & mask) {
+      if (shard->slots[i].hash != hash)
+        continue;
+
+      sym_id id = shard->slots[i].id;
+      intern_entry *entry = intern_entry_of(id, false);
+      if (entry->len == len && memcmp(entry->str, str, len) == 0) {
+        pthread_mutex_unlock(&shard->lock);
+        return id;
+      }
+    }
+  }
+
+  if ((shard->count + 1) * 2 > shard->capacity)
+    intern_shard_grow(shard);
+
+  sym_id id = atomic_fetch_add(&next_id, 1);
+  if ((id >> INTERN_CHUNK_BITS) >= INTERN_MAX_CHUNKS) {
+    scu_perror("Too many distinct identifiers\n");
+    exit(1);
+  }
+
+  char *copy = arena_push(&shard->strings, len + 1);
+  memcpy(copy, str, len);
+
+  intern_entry *entry = intern_entry_of(id, true);
+  entry->str = copy;
+  entry->len = len;
+
+  intern_shard_place(shard, hash, id);
+  shard->count++;
+
+  pthread_mutex_unlock(&shard->lock);
+  return id;
+}
+
+sym_id intern_cstr(const char *str) { return intern(str, strlen(str)); }
+
+const char *intern_str(sym_id id) {
+  if (id == SYM_NONE)
+    return NULL;
+
+  intern_entry *entry = intern_entry_of(id, false);
+  return entry ? entry->str : NULL;
+}
+
+u64 intern_len(sym_id id) {
+  if (id == SYM_NONE)
+    return 0;
+
+  intern_entry *entry = intern_entry_of(id, false);
+  return entry ? entry->len : 0;
+}
+
+u32 intern_count() { return atomic_load(&next_id); }
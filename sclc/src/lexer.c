@@ -1,6 +1,12 @@
 #include "lexer.h"
 #include "common.h"
+#include "ds/arena.h"
 #include "ds/dynamic_array.h"
+#include "intern.h"
+#include "memstat.h"
+#include "scan.h"
+#include "source.h"
+#include "timing.h"
 #include "token.h"
 #include "utils.h"
 
@@ -19,27 +25,6 @@ typedef struct string_slice {
   u64 len;
 } string_slice;
 
-/*
- * @brief: Converts a string_slice to a null terminated owned string.
- *
- * @param ss: pointer to a string_slice.
- * @param str: pointer to a char pointer where the allocated string will be
- * stored.
- */
-static u32 string_slice_to_owned(string_slice *ss, char **str) {
-  if (!ss || !ss->str || !str)
-    return -1;
-
-  *str = (char *)scu_checked_malloc(ss->len + 1);
-  if (!*str)
-    return -1;
-
-  memcpy(*str, ss->str, ss->len);
-  (*str)[ss->len] = '\0';
-
-  return 0;
-}
-
 /*
  * @brief: Read the next character.
  *
@@ -51,43 +36,74 @@ static char lexer_read_char(lexer *l);
  * Initialize Lexer
  *
  * @param l: pointer to lexer struct object.
- * @param buffer: const char* which is the source buffer to be lexed.
- * @param buffer_len: size of buffer.
+ * @param sources: source_map holding the file to be lexed.
+ * @param file: index of the file in sources.
  */
-static void lexer_init(lexer *l, const char *buffer, u64 buffer_len) {
-  l->buffer = buffer;
-  l->buffer_len = buffer_len;
-  l->line = 1;
+static void lexer_init(lexer *l, source_map *sources, u32 file) {
+  source_file *src = source_map_file(sources, file);
+  l->buffer = src->buffer;
+  l->buffer_len = src->len;
+  l->sources = sources;
+  l->base = src->base;
   l->pos = 0;
   l->read_pos = 0;
   l->ch = 0;
+  l->str_buf = NULL;
+  l->str_cap = 0;
 
   lexer_read_char(l);
 }
 
 /*
- * @brief: Peek ahead
+ * @brief: Create a token spanning from start to the current position.
  *
  * @param l: pointer to lexer struct object.
+ * @param kind: kind of the token.
+ * @param start: buffer offset of the first character of the token.
  */
-static char lexer_peek_char(lexer *l) {
-  if (l->read_pos >= l->buffer_len) {
-    return EOF;
-  }
+static inline token lexer_token(lexer *l, token_kind kind, u64 start) {
+  u64 len = l->pos - start;
+  return (token){.kind = kind,
+                 .loc = l->base + start,
+                 .len = len > TOKEN_MAX_LEN ? TOKEN_MAX_LEN : len};
+}
 
-  return l->buffer[l->read_pos];
+/*
+ * @brief: Append characters to the string literal buffer.
+ *
+ * @param l: pointer to lexer struct object.
+ * @param length: pointer to the current length of the string.
+ * @param str: characters to append.
+ * @param n: number of characters.
+ */
+static inline void lexer_str_append(lexer *l, u64 *length, const char *str,
+                                    u64 n) {
+  if (*length + n > l->str_cap) {
+    l->str_cap = l->str_cap ? l->str_cap : 64;
+    while (*length + n > l->str_cap)
+      l->str_cap *= 2;
+    mem_kind prev = memstat_tag(MEM_TOKENS);
+    l->str_buf = scu_checked_realloc(l->str_buf, l->str_cap);
+    memstat_untag(prev);
+  }
+  memcpy(l->str_buf + *length, str, n);
+  *length += n;
 }
 
+/*
+ * @brief: Peek ahead. The buffer is followed by zero bytes, the end reads as
+ * '\0' without a bounds check.
+ *
+ * @param l: pointer to lexer struct object.
+ */
+static char lexer_peek_char(lexer *l) { return l->buffer[l->read_pos]; }
+
 /*
  * @brief: Read and return the character at read position.
  *
  * @param l: pointer to lexer struct object.
  */
 static char lexer_read_char(lexer *l) {
-  if (l->ch == '\n') {
-    l->line++;
-  }
-
   l->ch = lexer_peek_char(l);
   l->pos = l->read_pos;
   l->read_pos += 1;
@@ -95,15 +111,141 @@ static char lexer_read_char(lexer *l) {
   return l->ch;
 }
 
+/*
+ * @brief: Move the lexer to a position and read the character there.
+ *
+ * @param l: pointer to lexer struct object.
+ * @param pos: new position in the buffer.
+ */
+static inline void lexer_seek(lexer *l, u64 pos) {
+  l->read_pos = pos;
+  lexer_read_char(l);
+}
+
 /*
  * @brief: Move lexer forward until it encounters another character.
  *
  * @param l: pointer to lexer struct object.
  */
 static void skip_whitespaces(lexer *l) {
-  while (isspace(l->ch)) {
-    lexer_read_char(l);
+  if (isspace(l->ch))
+    lexer_seek(l, scan_whitespace(l->buffer, l->pos));
+}
+
+/*
+ * @brief: Read an identifier starting at the current character.
+ *
+ * @param l: pointer to lexer struct object.
+ */
+static inline string_slice lexer_read_ident(lexer *l) {
+  u64 end = scan_ident(l->buffer, l->pos);
+  string_slice slice = {.str = l->buffer + l->pos, .len = end - l->pos};
+  lexer_seek(l, end);
+  return slice;
+}
+
+/*
+ * @brief: Recognize a keyword. Identifiers are split by length, then by
+ * their first character, so any identifier is compared to at most two
+ * keywords. A new keyword only needs a line in the case matching its
+ * length and first character.
+ *
+ * @param str: start of the identifier in the source buffer.
+ * @param len: length of the identifier.
+ *
+ * @return: kind of the keyword, or TOKEN_IDENTIFIER.
+ */
+static token_kind lexer_keyword(const char *str, u64 len) {
+#define LEX_KEYWORD(keyword_str, tok_kind)                                     \
+  if (memcmp(str + 1, keyword_str + 1, sizeof(keyword_str) - 2) == 0)          \
+    return tok_kind;
+
+  switch (len) {
+  case 2:
+    switch (str[0]) {
+    case 'f':
+      LEX_KEYWORD("fn", TOKEN_FN)
+      break;
+    case 'i':
+      LEX_KEYWORD("if", TOKEN_IF)
+      LEX_KEYWORD("in", TOKEN_IN)
+      break;
+    }
+    break;
+
+  case 3:
+    switch (str[0]) {
+    case 'f':
+      LEX_KEYWORD("for", TOKEN_FOR)
+      break;
+    case 'i':
+      LEX_KEYWORD("int", TOKEN_TYPE_INT)
+      break;
+    }
+    break;
+
+  case 4:
+    switch (str[0]) {
+    case 'c':
+      LEX_KEYWORD("char", TOKEN_TYPE_CHAR)
+      break;
+    case 'e':
+      LEX_KEYWORD("else", TOKEN_ELSE)
+      break;
+    case 'g':
+      LEX_KEYWORD("goto", TOKEN_GOTO)
+      break;
+    case 'l':
+      LEX_KEYWORD("loop", TOKEN_LOOP)
+      break;
+    case 't':
+      LEX_KEYWORD("then", TOKEN_THEN)
+      break;
+    }
+    break;
+
+  case 5:
+    switch (str[0]) {
+    case 'b':
+      LEX_KEYWORD("break", TOKEN_BREAK)
+      break;
+    case 'm':
+      LEX_KEYWORD("match", TOKEN_MATCH)
+      break;
+    case 'w':
+      LEX_KEYWORD("while", TOKEN_WHILE)
+      break;
+    }
+    break;
+
+  case 6:
+    switch (str[0]) {
+    case 'r':
+      LEX_KEYWORD("return", TOKEN_RETURN)
+      break;
+    }
+    break;
+
+  case 7:
+    switch (str[0]) {
+    case 'd':
+      LEX_KEYWORD("dowhile", TOKEN_DO_WHILE)
+      break;
+    }
+    break;
+
+  case 8:
+    switch (str[0]) {
+    case 'c':
+      LEX_KEYWORD("continue", TOKEN_CONTINUE)
+      break;
+    }
+    break;
   }
+
+#undef LEX_KEYWORD
+
+  return TOKEN_IDENTIFIER;
 }
 
 /*
@@ -118,25 +260,25 @@ restart:
 
   skip_whitespaces(l);
 
-  if (l->ch == EOF) {
+  u64 start = l->pos;
+  token tok;
+
+  if (l->ch == '\0' && l->pos >= l->buffer_len) {
+    tok = lexer_token(l, TOKEN_END, start);
     lexer_read_char(l);
-    return (token){.kind = TOKEN_END, .value.str = NULL, .line = l->line};
+    return tok;
   }
 
   else if (isdigit(l->ch)) {
-    string_slice slice = {.str = l->buffer + l->pos, .len = 0};
+    u32 value = 0;
     while (isdigit(l->ch)) {
-      slice.len += 1;
+      value = value * 10 + (l->ch - '0');
       lexer_read_char(l);
     }
-    char *temp = NULL;
-    string_slice_to_owned(&slice, &temp);
-
-    u32 value = atoi(temp);
-    free(temp);
 
-    return (token){
-        .kind = TOKEN_INT_LITERAL, .value.integer = value, .line = l->line};
+    tok = lexer_token(l, TOKEN_INT_LITERAL, start);
+    tok.value.integer = value;
+    return tok;
   }
 
   else if (l->ch == '\'') {
@@ -165,44 +307,27 @@ restart:
         escaped_char = '\0';
         break;
       default:
-        return (token){
-            .kind = TOKEN_INVALID, .value.character = l->ch, .line = l->line};
+        return lexer_token(l, TOKEN_INVALID, start);
       }
       char_value = escaped_char;
     }
     lexer_read_char(l);
     if (l->ch != '\'') {
-      return (token){
-          .kind = TOKEN_INVALID, .value.character = l->ch, .line = l->line};
+      return lexer_token(l, TOKEN_INVALID, start);
     }
     lexer_read_char(l);
 
-    return (token){.kind = TOKEN_CHAR_LITERAL,
-                   .value.character = char_value,
-                   .line = l->line};
+    tok = lexer_token(l, TOKEN_CHAR_LITERAL, start);
+    tok.value.character = char_value;
+    return tok;
   }
 
   else if (l->ch == '"') {
     lexer_read_char(l);
 
-    u64 capacity = 16;
     u64 length = 0;
-    char *string_value = scu_checked_malloc(capacity);
-
-    if (l->ch == '"') {
-      lexer_read_char(l);
-      string_value[0] = '\0';
-      return (token){.kind = TOKEN_STRING_LITERAL,
-                     .value.str = string_value,
-                     .line = l->line};
-    }
-
-    while (l->ch != '"' && l->ch != '\0' && l->ch != EOF) {
-      if (length >= capacity - 1) {
-        capacity *= 2;
-        string_value = scu_checked_realloc(string_value, capacity);
-      }
 
+    while (l->ch != '"' && l->ch != '\0') {
       if (l->ch == '\\') {
         lexer_read_char(l);
         char escaped_char;
@@ -226,37 +351,32 @@ restart:
           escaped_char = '\0';
           break;
         default:
-          free(string_value);
-          return (token){
-              .kind = TOKEN_INVALID, .value.character = l->ch, .line = l->line};
+          return lexer_token(l, TOKEN_INVALID, start);
         }
-        string_value[length++] = escaped_char;
-      } else if (l->ch == '\n') {
-        string_value[length++] = '\n';
-        l->line++;
+        lexer_str_append(l, &length, &escaped_char, 1);
+        lexer_read_char(l);
       } else {
-        string_value[length++] = l->ch;
+        u64 end = scan_string(l->buffer, l->pos);
+        lexer_str_append(l, &length, l->buffer + l->pos, end - l->pos);
+        lexer_seek(l, end);
       }
-      lexer_read_char(l);
     }
 
     if (l->ch != '"') {
-      free(string_value);
-      return (token){.kind = TOKEN_INVALID, .value.str = NULL, .line = l->line};
+      return lexer_token(l, TOKEN_INVALID, start);
     }
 
     lexer_read_char(l);
-    string_value[length] = '\0';
 
-    return (token){.kind = TOKEN_STRING_LITERAL,
-                   .value.str = string_value,
-                   .line = l->line};
+    tok = lexer_token(l, TOKEN_STRING_LITERAL, start);
+    tok.value.str = source_map_add_string(l->sources, l->str_buf, length);
+    return tok;
   }
 
 #define LEX_ONE_CHAR_TOKEN(chr, tok_kind)                                      \
   else if (l->ch == chr) {                                                     \
     lexer_read_char(l);                                                        \
-    return (token){.kind = tok_kind, .value.str = NULL, .line = l->line};      \
+    return lexer_token(l, tok_kind, start);                                    \
   }
 
 #define LEX_TWO_CHAR_TOKEN(ch1, ch2, tok_kind, fallback_kind)                  \
@@ -264,9 +384,9 @@ restart:
     lexer_read_char(l);                                                        \
     if (l->ch == ch2) {                                                        \
       lexer_read_char(l);                                                      \
-      return (token){.kind = tok_kind, .value.str = NULL, .line = l->line};    \
+      return lexer_token(l, tok_kind, start);                                  \
     }                                                                          \
-    return (token){.kind = fallback_kind, .value.str = NULL, .line = l->line}; \
+    return lexer_token(l, fallback_kind, start);                               \
   }
 
   // Delimiters
@@ -296,110 +416,76 @@ restart:
     lexer_read_char(l);
     if (l->ch == '=') {
       lexer_read_char(l);
-      return (token){
-          .kind = TOKEN_IS_EQUAL, .value.str = NULL, .line = l->line};
+      return lexer_token(l, TOKEN_IS_EQUAL, start);
     } else if (l->ch == '>') {
       lexer_read_char(l);
-      return (token){.kind = TOKEN_DARROW, .value.str = NULL, .line = l->line};
+      return lexer_token(l, TOKEN_DARROW, start);
     }
-    return (token){.kind = TOKEN_ASSIGN, .value.str = NULL, .line = l->line};
+    return lexer_token(l, TOKEN_ASSIGN, start);
   }
 
   else if (l->ch == '-') {
     lexer_read_char(l);
     if (l->ch == '-') {
-      while (l->ch != '\n') {
-        lexer_read_char(l);
-      }
+      lexer_seek(l, scan_until(l->buffer, l->pos, l->buffer_len, '\n'));
       goto restart;
     } else if (l->ch == '*') {
-      while (l->ch != '\0') {
-        if (l->ch == '*') {
-          lexer_read_char(l);
-          if (l->ch == '-') {
-            lexer_read_char(l);
-            goto restart;
-          }
-          continue;
-        } else {
-          lexer_read_char(l);
-          continue;
-        }
-        return (token){
-            .kind = TOKEN_INVALID, .value.character = l->ch, .line = l->line};
-      }
+      // the comment ends at the first "*-", which may share the opening '*'
+      u64 pos = l->pos;
+      while ((pos = scan_until(l->buffer, pos, l->buffer_len, '*')) <
+                 l->buffer_len &&
+             l->buffer[pos + 1] != '-')
+        pos++;
+      lexer_seek(l, pos < l->buffer_len ? pos + 2 : l->buffer_len);
+      goto restart;
     } else if (isdigit(l->ch)) {
-      string_slice slice = {.str = l->buffer + l->pos, .len = 0};
+      u32 value = 0;
       while (isdigit(l->ch)) {
-        slice.len += 1;
+        value = value * 10 + (l->ch - '0');
         lexer_read_char(l);
       }
-      char *temp = NULL;
-      string_slice_to_owned(&slice, &temp);
-      u32 value = -atoi(temp);
-      free(temp);
-      return (token){
-          .kind = TOKEN_INT_LITERAL, .value.integer = value, .line = l->line};
+      tok = lexer_token(l, TOKEN_INT_LITERAL, start);
+      tok.value.integer = -value;
+      return tok;
     } else if (isalnum(l->ch)) {
-      string_slice slice = {.str = l->buffer + l->pos, .len = 0};
-      while (isalnum(l->ch) || l->ch == '_') {
-        slice.len += 1;
-        lexer_read_char(l);
-      }
-      char *directive = NULL;
-      string_slice_to_owned(&slice, &directive);
-      if (strcmp(directive, "include") == 0) {
-        free(directive);
-        return (token){
-            .kind = TOKEN_PDIR_INCLUDE, .value.str = NULL, .line = l->line};
+      string_slice slice = lexer_read_ident(l);
+      if (slice.len == sizeof("include") - 1 &&
+          memcmp(slice.str, "include", slice.len) == 0) {
+        return lexer_token(l, TOKEN_PDIR_INCLUDE, start);
       }
     }
-    return (token){.kind = TOKEN_SUBTRACT, .value.str = NULL, .line = l->line};
+    return lexer_token(l, TOKEN_SUBTRACT, start);
   }
 
   else if (l->ch == '*') {
     lexer_read_char(l);
     if (isalnum(l->ch) || l->ch == '_') {
-      string_slice slice = {.str = l->buffer + l->pos, .len = 0};
-      while (isalnum(l->ch) || l->ch == '_') {
-        slice.len += 1;
-        lexer_read_char(l);
-      }
-      char *value = NULL;
-      string_slice_to_owned(&slice, &value);
-      return (token){
-          .kind = TOKEN_POINTER, .value.str = value, .line = l->line};
+      string_slice slice = lexer_read_ident(l);
+      tok = lexer_token(l, TOKEN_POINTER, start);
+      tok.value.sym = intern(slice.str, slice.len);
+      return tok;
     }
-    return (token){.kind = TOKEN_MULTIPLY, .value.str = NULL, .line = l->line};
+    return lexer_token(l, TOKEN_MULTIPLY, start);
   }
 
   else if (l->ch == '&') {
     lexer_read_char(l);
-    string_slice slice = {.str = l->buffer + l->pos, .len = 0};
-    while (isalnum(l->ch) || l->ch == '_') {
-      slice.len += 1;
-      lexer_read_char(l);
-    }
-    char *value = NULL;
-    string_slice_to_owned(&slice, &value);
-    return (token){
-        .kind = TOKEN_ADDRESS_OF, .value.str = value, .line = l->line};
+    string_slice slice = lexer_read_ident(l);
+    tok = lexer_token(l, TOKEN_ADDRESS_OF, start);
+    tok.value.sym = intern(slice.str, slice.len);
+    return tok;
   }
 
   else if (l->ch == ':') {
     lexer_read_char(l);
 
     if (isalnum(l->ch) || l->ch == '_') {
-      string_slice slice = {.str = l->buffer + l->pos, .len = 0};
-      while (isalnum(l->ch) || l->ch == '_') {
-        slice.len += 1;
-        lexer_read_char(l);
-      }
-      char *value = NULL;
-      string_slice_to_owned(&slice, &value);
-      return (token){.kind = TOKEN_LABEL, .value.str = value, .line = l->line};
+      string_slice slice = lexer_read_ident(l);
+      tok = lexer_token(l, TOKEN_LABEL, start);
+      tok.value.sym = intern(slice.str, slice.len);
+      return tok;
     } else {
-      return (token){.kind = TOKEN_COLON, .value.str = NULL, .line = l->line};
+      return lexer_token(l, TOKEN_COLON, start);
     }
   }
 
@@ -411,102 +497,209 @@ restart:
 
       if (l->ch == '.') {
         lexer_read_char(l);
-        return (token){
-            .kind = TOKEN_ELLIPSIS, .value.str = NULL, .line = l->line};
+        return lexer_token(l, TOKEN_ELLIPSIS, start);
       }
     }
 
-    return (token){.kind = TOKEN_INVALID, .value.str = NULL, .line = l->line};
+    return lexer_token(l, TOKEN_INVALID, start);
   }
 
   else if (isalnum(l->ch) || l->ch == '_') {
-    string_slice slice = {.str = l->buffer + l->pos, .len = 0};
-
-    while (isalnum(l->ch) || l->ch == '_') {
-      slice.len += 1;
-      lexer_read_char(l);
-    }
+    string_slice slice = lexer_read_ident(l);
 
-    char *value = NULL;
-    string_slice_to_owned(&slice, &value);
+    token_kind kind = lexer_keyword(slice.str, slice.len);
+    if (kind != TOKEN_IDENTIFIER)
+      return lexer_token(l, kind, start);
 
-#define LEX_KEYWORD(keyword_str, tok_kind)                                     \
-  if (strcmp(value, keyword_str) == 0) {                                       \
-    free(value);                                                               \
-    return (token){.kind = tok_kind, .value.str = NULL, .line = l->line};      \
-  }
-
-    // Types
-    LEX_KEYWORD("int", TOKEN_TYPE_INT)
-    LEX_KEYWORD("char", TOKEN_TYPE_CHAR)
-
-    // Control flow
-    LEX_KEYWORD("if", TOKEN_IF)
-    LEX_KEYWORD("else", TOKEN_ELSE)
-    LEX_KEYWORD("then", TOKEN_THEN)
-    LEX_KEYWORD("match", TOKEN_MATCH)
-    LEX_KEYWORD("goto", TOKEN_GOTO)
-
-    // Loops
-    LEX_KEYWORD("loop", TOKEN_LOOP)
-    LEX_KEYWORD("while", TOKEN_WHILE)
-    LEX_KEYWORD("dowhile", TOKEN_DO_WHILE)
-    LEX_KEYWORD("in", TOKEN_IN)
-    LEX_KEYWORD("for", TOKEN_FOR)
-    LEX_KEYWORD("continue", TOKEN_CONTINUE)
-    LEX_KEYWORD("break", TOKEN_BREAK)
-
-    // Functions
-    LEX_KEYWORD("fn", TOKEN_FN)
-    LEX_KEYWORD("return", TOKEN_RETURN)
-
-#undef LEX_KEYWORD
-
-    return (token){
-        .kind = TOKEN_IDENTIFIER, .value.str = value, .line = l->line};
+    tok = lexer_token(l, TOKEN_IDENTIFIER, start);
+    tok.value.sym = intern(slice.str, slice.len);
+    return tok;
   }
 
   else {
-    string_slice slice = {.str = l->buffer + l->pos, .len = 1};
-    char *value = NULL;
-    string_slice_to_owned(&slice, &value);
     lexer_read_char(l);
-    return (token){.kind = TOKEN_INVALID, .value.str = value, .line = l->line};
+    return lexer_token(l, TOKEN_INVALID, start);
   }
 }
 
-void lexer_tokenize(const char *buffer, u64 buffer_len, dynamic_array *tokens,
-                    const char *include_dir) {
+void lexer_tokenize(source_map *sources, u32 file, dynamic_array *tokens) {
   lexer lexer;
-  lexer_init(&lexer, buffer, buffer_len);
+  lexer_init(&lexer, sources, file);
 
   token tok;
   do {
     tok = lexer_next_token(&lexer);
+    dynamic_array_append(tokens, &tok);
+  } while (tok.kind != TOKEN_END);
+
+  free(lexer.str_buf);
+}
+
+/*
+ * @brief: Enter a file included by the current one, unless it was already
+ * included.
+ *
+ * @param ts: pointer to the token_stream.
+ * @param name: path of the file relative to the include directory.
+ */
+static void token_stream_include(token_stream *ts, const char *name) {
+  u64 total_len = strlen(ts->cache->include_dir) + 1 + strlen(name) + 1;
+  mem_arena_temp scratch = arena_scratch_begin(NULL);
+  char *filepath_to_include = arena_push(scratch.arena, total_len);
+  snprintf(filepath_to_include, total_len, "%s/%s", ts->cache->include_dir,
+           name);
+
+  include_file *file = include_cache_get(ts->cache, filepath_to_include);
+
+  if (ht_search(&ts->included, file->path) == NULL) {
+    bool included = true;
+    ht_insert(&ts->included, file->path, &included);
+
+    source_file *src = source_map_file(&file->sources, 0);
+    u32 index = source_map_add_shared(ts->sources, filepath_to_include,
+                                      src->buffer, src->len);
+
+    include_frame frame = {
+        .file = file,
+        .next = 0,
+        .base = source_map_file(ts->sources, index)->base,
+        .strings = source_map_add_strings(ts->sources,
+                                          file->sources.strings.items,
+                                          file->sources.strings.count),
+    };
+    stack_push(&ts->includes, &frame);
+  }
+
+  arena_temp_end(scratch);
+}
+
+/*
+ * @brief: Take the next token of the innermost file, rebased into the
+ * source_map of the stream for included files.
+ *
+ * @param ts: pointer to the token_stream.
+ */
+static token token_stream_take(token_stream *ts) {
+  if (ts->includes.count > 0) {
+    include_frame *frame = stack_top(&ts->includes);
+    token tok = ((token *)frame->file->tokens.items)[frame->next++];
+
+    tok.loc += frame->base;
+    if (tok.kind == TOKEN_STRING_LITERAL)
+      tok.value.str += frame->strings;
+
+    return tok;
+  }
+
+  if (ts->done)
+    return ts->end;
+
+  token tok = lexer_next_token(&ts->lexer);
+  if (tok.kind == TOKEN_END) {
+    ts->end = tok;
+    ts->done = true;
+  }
+
+  return tok;
+}
+
+/*
+ * @brief: Produce the next token of the stream, entering included files and
+ * returning to the including file at the end of one.
+ *
+ * @param ts: pointer to the token_stream.
+ */
+static token token_stream_lex(token_stream *ts) {
+  for (;;) {
+    token tok = token_stream_take(ts);
 
     if (tok.kind == TOKEN_PDIR_INCLUDE) {
-      token incl_str_token = lexer_next_token(&lexer);
-      u64 total_len =
-          strlen(include_dir) + 1 + strlen(incl_str_token.value.str) + 1;
-      char *filepath_to_include = malloc(total_len);
-      snprintf(filepath_to_include, total_len, "%s/%s", include_dir,
-               incl_str_token.value.str);
-      char *incl_buffer = NULL;
-      u64 incl_buffer_len = scu_read_file(filepath_to_include, &incl_buffer);
-
-      lexer_tokenize(incl_buffer, incl_buffer_len, tokens, include_dir);
-
-      dynamic_array_remove(tokens, tokens->count - 1);
-      free(filepath_to_include);
-      free(incl_str_token.value.str);
-      free(incl_buffer);
+      token incl_str_token = token_stream_take(ts);
+      if (incl_str_token.kind == TOKEN_STRING_LITERAL) {
+        token_stream_include(
+            ts, source_map_string(ts->sources, incl_str_token.value.str));
+        continue;
+      }
 
-      continue;
+      scu_perror("Expected string literal after -include [line %lu]\n",
+                 source_map_line(ts->sources, tok.loc));
+
+      // the end of a file still ends it, anything else is dropped
+      if (incl_str_token.kind != TOKEN_END)
+        continue;
+      tok = incl_str_token;
     }
 
-    if (dynamic_array_append(tokens, &tok) != 0) {
-      scu_perror("Failed to append token to array\n");
-      exit(1);
+    // the end of an included file is not a token of the including file
+    if (tok.kind == TOKEN_END && ts->includes.count > 0) {
+      include_frame done;
+      stack_pop(&ts->includes, &done);
+      continue;
     }
-  } while (tok.kind != TOKEN_END);
+
+    return tok;
+  }
+}
+
+void token_stream_init(token_stream *ts, source_map *sources, u32 file,
+                       include_cache *cache) {
+  lexer_init(&ts->lexer, sources, file);
+  stack_init(&ts->includes, sizeof(include_frame));
+  ht_init(&ts->included, sizeof(bool));
+  ts->head = 0;
+  ts->count = 0;
+  ts->end = (token){.kind = TOKEN_END};
+  ts->done = false;
+  ts->sources = sources;
+  ts->cache = cache;
+}
+
+/*
+ * @brief: Lex tokens until the ring is full or the end of the main file. The
+ * time it takes counts for the lex phase, read once per chunk rather than
+ * once per token.
+ *
+ * @param ts: pointer to the token_stream.
+ */
+static void token_stream_refill(token_stream *ts) {
+  u64 start = timing_enabled() ? timing_now() : 0;
+
+  while (ts->count < TOKEN_STREAM_CHUNK) {
+    token tok = token_stream_lex(ts);
+    ts->ring[(ts->head + ts->count) & (TOKEN_STREAM_CHUNK - 1)] = tok;
+    ts->count++;
+
+    if (tok.kind == TOKEN_END)
+      break;
+  }
+
+  if (start)
+    timing_add(PHASE_LEX, timing_now() - start);
+}
+
+token token_stream_peek(token_stream *ts, u32 n) {
+  while (ts->count <= n)
+    token_stream_refill(ts);
+
+  return ts->ring[(ts->head + n) & (TOKEN_STREAM_CHUNK - 1)];
+}
+
+void token_stream_advance(token_stream *ts) {
+  if (ts->count == 0)
+    token_stream_peek(ts, 0);
+
+  ts->head = (ts->head + 1) & (TOKEN_STREAM_CHUNK - 1);
+  ts->count--;
+}
+
+token token_stream_next(token_stream *ts) {
+  token tok = token_stream_peek(ts, 0);
+  token_stream_advance(ts);
+  return tok;
+}
+
+void token_stream_free(token_stream *ts) {
+  free(ts->lexer.str_buf);
+  stack_free(&ts->includes);
+  ht_free(&ts->included);
 }
@@ -0,0 +1,221 @@
+#define _GNU_SOURCE
+
+#include "memstat.h"
+#include "common.h"
+#include "timing.h"
+#include "utils.h"
+
+#include <malloc.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <sys/resource.h>
+
+/*
+ * Row of the allocations made outside of any phase.
+ */
+#define MEM_NO_PHASE PHASE_COUNT
+
+static const char *kind_names[MEM_KIND_COUNT] = {
+    "other", "tokens", "ast", "tables", "arrays", "llvm",
+};
+
+static struct {
+  bool enabled;
+
+  /*
+   * Counters per phase (and one row for no phase) and kind, updated by every
+   * thread.
+   */
+  _Atomic u64 allocs[PHASE_COUNT + 1][MEM_KIND_COUNT];
+  _Atomic u64 bytes[PHASE_COUNT + 1][MEM_KIND_COUNT];
+  _Atomic u64 arena_bytes[PHASE_COUNT + 1];
+
+  _Atomic u64 arena_current;
+  _Atomic u64 arena_peak;
+  _Atomic u64 arena_blocks;
+
+  /*
+   * Peak RSS in KiB seen at the end of every phase.
+   */
+  _Atomic u64 rss[PHASE_COUNT + 1];
+
+  /*
+   * Kinds that could not be measured in this build.
+   */
+  _Atomic bool unmeasured[MEM_KIND_COUNT];
+} memstat = {0};
+
+static _Thread_local u32 current_phase = MEM_NO_PHASE;
+static _Thread_local mem_kind current_kind = MEM_OTHER;
+
+void memstat_init(bool enabled) { memstat.enabled = enabled; }
+
+bool memstat_enabled() { return memstat.enabled; }
+
+void memstat_set_phase(u32 phase) {
+  current_phase = phase < PHASE_COUNT ? phase : MEM_NO_PHASE;
+}
+
+mem_kind memstat_tag(mem_kind kind) {
+  mem_kind prev = current_kind;
+  if (prev == MEM_OTHER)
+    current_kind = kind;
+  return prev;
+}
+
+void memstat_untag(mem_kind prev) { current_kind = prev; }
+
+void memstat_alloc(u64 size) {
+  if (!memstat.enabled)
+    return;
+
+  atomic_fetch_add_explicit(&memstat.allocs[current_phase][current_kind], 1,
+                            memory_order_relaxed);
+  atomic_fetch_add_explicit(&memstat.bytes[current_phase][current_kind], size,
+                            memory_order_relaxed);
+}
+
+void memstat_arena(u64 size, bool mapped) {
+  if (!memstat.enabled)
+    return;
+
+  if (!mapped) {
+    atomic_fetch_sub(&memstat.arena_current, size);
+    return;
+  }
+
+  atomic_fetch_add(&memstat.arena_bytes[current_phase], size);
+  atomic_fetch_add(&memstat.arena_blocks, 1);
+
+  u64 current = atomic_fetch_add(&memstat.arena_current, size) + size;
+  u64 peak = atomic_load(&memstat.arena_peak);
+  while (current > peak &&
+         !atomic_compare_exchange_weak(&memstat.arena_peak, &peak, current))
+    ;
+}
+
+u64 memstat_heap_in_use() { return mallinfo2().uordblks; }
+
+void memstat_add(mem_kind kind, u64 size) {
+  if (!memstat.enabled)
+    return;
+
+  atomic_fetch_add(&memstat.bytes[current_phase][kind], size);
+}
+
+void memstat_unmeasured(mem_kind kind) {
+  atomic_store(&memstat.unmeasured[kind], true);
+}
+
+/*
+ * @brief: peak resident set size of the process so far, in KiB.
+ */
+static u64 memstat_peak_rss() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+  return (u64)usage.ru_maxrss;
+}
+
+void memstat_phase_end(u32 phase) {
+  if (!memstat.enabled)
+    return;
+
+  if (phase > PHASE_COUNT)
+    phase = MEM_NO_PHASE;
+
+  u64 rss = memstat_peak_rss();
+  u64 seen = atomic_load(&memstat.rss[phase]);
+  while (rss > seen &&
+         !atomic_compare_exchange_weak(&memstat.rss[phase], &seen, rss))
+    ;
+}
+
+/*
+ * @brief: sum of a row of counters.
+ */
+static u64 memstat_sum(_Atomic u64 row[MEM_KIND_COUNT]) {
+  u64 sum = 0;
+  for (u32 k = 0; k < MEM_KIND_COUNT; k++)
+    sum += atomic_load(&row[k]);
+  return sum;
+}
+
+static void memstat_print_report(u64 peak_rss) {
+  scu_printf("Memory report:\n");
+  scu_printf("  %-10s %12s %14s %14s %12s\n", "phase", "allocs", "alloc KiB",
+             "arena KiB", "peak RSS KiB");
+
+  for (u32 p = 0; p <= PHASE_COUNT; p++) {
+    scu_printf("  %-10s %12lu %14.1f %14.1f %12lu\n", time_phase_name(p),
+               memstat_sum(memstat.allocs[p]),
+               memstat_sum(memstat.bytes[p]) / 1024.0,
+               atomic_load(&memstat.arena_bytes[p]) / 1024.0,
+               atomic_load(&memstat.rss[p]));
+  }
+
+  scu_printf("  %-10s %12s %14s\n", "kind", "allocs", "alloc KiB");
+  for (u32 k = 0; k < MEM_KIND_COUNT; k++) {
+    u64 allocs = 0, bytes = 0;
+    for (u32 p = 0; p <= PHASE_COUNT; p++) {
+      allocs += atomic_load(&memstat.allocs[p][k]);
+      bytes += atomic_load(&memstat.bytes[p][k]);
+    }
+
+    if (atomic_load(&memstat.unmeasured[k]))
+      scu_printf("  %-10s %12s %14s  (not measured with -j)\n", kind_names[k],
+                 "-", "-");
+    else
+      scu_printf("  %-10s %12lu %14.1f\n", kind_names[k], allocs,
+                 bytes / 1024.0);
+  }
+
+  scu_printf("  arena high-water %.1f KiB in %lu blocks\n",
+             atomic_load(&memstat.arena_peak) / 1024.0,
+             atomic_load(&memstat.arena_blocks));
+  scu_printf("  peak RSS %lu KiB\n", peak_rss);
+}
+
+static void memstat_write_json(const char *path, u64 peak_rss) {
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    scu_pwarning("Could not write memory report: %s\n", path);
+    return;
+  }
+
+  fprintf(f, "{\n  \"phases\": {");
+  for (u32 p = 0; p <= PHASE_COUNT; p++) {
+    fprintf(f, "%s\n    \"%s\": {\"allocs\": %lu, \"allocated\": {",
+            p ? "," : "", time_phase_name(p), memstat_sum(memstat.allocs[p]));
+    for (u32 k = 0; k < MEM_KIND_COUNT; k++) {
+      if (atomic_load(&memstat.unmeasured[k]))
+        fprintf(f, "%s\"%s\": null", k ? ", " : "", kind_names[k]);
+      else
+        fprintf(f, "%s\"%s\": %lu", k ? ", " : "", kind_names[k],
+                atomic_load(&memstat.bytes[p][k]));
+    }
+    fprintf(f, "}, \"arena_bytes\": %lu, \"peak_rss_kib\": %lu}",
+            atomic_load(&memstat.arena_bytes[p]), atomic_load(&memstat.rss[p]));
+  }
+
+  fprintf(f, "\n  },\n  \"arena\": {\"high_water_bytes\": %lu, \"blocks\": "
+             "%lu},\n  \"peak_rss_kib\": %lu\n}\n",
+          atomic_load(&memstat.arena_peak), atomic_load(&memstat.arena_blocks),
+          peak_rss);
+
+  if (fclose(f) != 0)
+    scu_pwarning("Could not write memory report: %s\n", path);
+}
+
+void memstat_report(const char *json_path) {
+  if (!memstat.enabled)
+    return;
+
+  u64 peak_rss = memstat_peak_rss();
+  memstat_print_report(peak_rss);
+
+  if (json_path)
+    memstat_write_json(json_path, peak_rss);
+
+  memstat.enabled = false;
+}
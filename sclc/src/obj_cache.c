@@ -0,0 +1,363 @@
+#define _DEFAULT_SOURCE
+
+#include "obj_cache.h"
+#include "common.h"
+#include "ds/dynamic_array.h"
+#include "ds/hash.h"
+#include "source.h"
+#include "utils.h"
+
+#include <llvm/Config/llvm-config.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Bumped whenever the layout of the entries or of the key changes.
+ */
+#define OBJ_CACHE_FORMAT 1
+
+/*
+ * @brief: create a directory and its missing parents.
+ *
+ * @return: true if the directory exists afterwards
+ */
+static bool obj_cache_mkdirs(const char *dir) {
+  char *path = strdup(dir);
+
+  for (char *p = path + 1; *p; p++) {
+    if (*p != '/')
+      continue;
+    *p = '\0';
+    mkdir(path, 0755);
+    *p = '/';
+  }
+
+  bool ok = mkdir(path, 0755) == 0 || errno == EEXIST;
+  free(path);
+  return ok;
+}
+
+/*
+ * @brief: hash of the running compiler, its executable (size and mtime) and
+ * the version of LLVM.
+ */
+static u64 obj_cache_compiler_id() {
+  u64 id = scu_hash_bytes(LLVM_VERSION_STRING, sizeof(LLVM_VERSION_STRING) - 1,
+                          OBJ_CACHE_FORMAT);
+
+  struct stat st;
+  if (stat("/proc/self/exe", &st) == 0) {
+    u64 exe[3] = {st.st_size, st.st_mtim.tv_sec, st.st_mtim.tv_nsec};
+    id = scu_hash_bytes(exe, sizeof(exe), id);
+  }
+
+  return id;
+}
+
+void obj_cache_init(obj_cache *cache, const char *dir, u64 max_size) {
+  cache->dir = NULL;
+  cache->max_size = max_size;
+  cache->compiler_id = obj_cache_compiler_id();
+  cache->hits = 0;
+  cache->misses = 0;
+  cache->stores = 0;
+
+  if (dir == NULL)
+    return;
+
+  if (!obj_cache_mkdirs(dir)) {
+    scu_pwarning("Object cache disabled, could not create %s\n", dir);
+    return;
+  }
+
+  cache->dir = strdup(dir);
+}
+
+char *obj_cache_default_dir() {
+  const char *xdg = getenv("XDG_CACHE_HOME");
+  if (xdg && *xdg)
+    return scu_format_string("%s/sclc", xdg);
+
+  const char *home = getenv("HOME");
+  if (home && *home)
+    return scu_format_string("%s/.cache/sclc", home);
+
+  return NULL;
+}
+
+void obj_cache_key(obj_cache *cache, source_map *sources, const char *triple,
+                   u32 opt_level, u32 partitions, obj_cache_kind kind,
+                   char key[OBJ_CACHE_KEY_LEN]) {
+  // two independent 64 bit hashes make up the 128 bit key
+  u64 halves[2];
+
+  for (u32 i = 0; i < 2; i++) {
+    u64 h = scu_hash_bytes(&cache->compiler_id, sizeof(u64), i);
+    h = scu_hash_bytes(triple, strlen(triple), h);
+    h = scu_hash_bytes(&opt_level, sizeof(opt_level), h);
+    h = scu_hash_bytes(&partitions, sizeof(partitions), h);
+    h = scu_hash_bytes(&kind, sizeof(kind), h);
+
+    for (u32 f = 0; f < sources->files.count; f++) {
+      source_file *file = source_map_file(sources, f);
+      h = scu_hash_bytes(file->buffer, file->len, h);
+    }
+
+    halves[i] = h;
+  }
+
+  snprintf(key, OBJ_CACHE_KEY_LEN, "%016lx%016lx", halves[0], halves[1]);
+}
+
+char *obj_cache_lookup(obj_cache *cache, const char *key) {
+  char *entry = scu_format_string("%s/%s.o", cache->dir, key);
+
+  // touching the entry checks it exists and marks it as recently used
+  if (utimensat(AT_FDCWD, entry, NULL, 0) != 0) {
+    __atomic_add_fetch(&cache->misses, 1, __ATOMIC_RELAXED);
+    free(entry);
+    return NULL;
+  }
+
+  __atomic_add_fetch(&cache->hits, 1, __ATOMIC_RELAXED);
+  return entry;
+}
+
+bool obj_cache_copy(const char *from, const char *to) {
+  int in = open(from, O_RDONLY);
+  if (in < 0)
+    return false;
+
+  int out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out < 0) {
+    close(in);
+    return false;
+  }
+
+  char buffer[1 << 16];
+  ssize_t n;
+  bool ok = true;
+
+  while ((n = read(in, buffer, sizeof(buffer))) > 0) {
+    if (write(out, buffer, n) != n) {
+      ok = false;
+      break;
+    }
+  }
+
+  if (n < 0)
+    ok = false;
+
+  close(in);
+  return close(out) == 0 && ok;
+}
+
+void obj_cache_store(obj_cache *cache, const char *key, const char *obj_path) {
+  // written under a unique name and renamed, so readers never see a partial
+  // entry, even with several builds sharing the cache
+  char *tmp = scu_format_string("%s/tmp.XXXXXX", cache->dir);
+  int fd = mkstemp(tmp);
+  if (fd < 0) {
+    free(tmp);
+    return;
+  }
+  close(fd);
+
+  char *entry = scu_format_string("%s/%s.o", cache->dir, key);
+
+  if (obj_cache_copy(obj_path, tmp) && rename(tmp, entry) == 0)
+    __atomic_add_fetch(&cache->stores, 1, __ATOMIC_RELAXED);
+  else
+    unlink(tmp);
+
+  free(entry);
+  free(tmp);
+}
+
+/*
+ * @struct obj_cache_entry: an entry found while scanning the directory.
+ */
+typedef struct obj_cache_entry {
+  char *path;
+  u64 size;
+  struct timespec mtime;
+} obj_cache_entry;
+
+/*
+ * @brief: list the entries of the cache directory.
+ *
+ * @param cache: pointer to an initialized obj_cache
+ * @param entries: initialized dynamic_array receiving obj_cache_entry
+ *
+ * @return: total size of the entries in bytes
+ */
+static u64 obj_cache_scan(obj_cache *cache, dynamic_array *entries) {
+  DIR *dir = opendir(cache->dir);
+  if (!dir)
+    return 0;
+
+  u64 total = 0;
+  struct dirent *de;
+
+  while ((de = readdir(dir)) != NULL) {
+    u64 len = strlen(de->d_name);
+    if (len != OBJ_CACHE_KEY_LEN + 1 || strcmp(de->d_name + len - 2, ".o"))
+      continue;
+
+    obj_cache_entry entry = {
+        .path = scu_format_string("%s/%s", cache->dir, de->d_name),
+    };
+
+    struct stat st;
+    if (stat(entry.path, &st) != 0) {
+      free(entry.path);
+      continue;
+    }
+
+    entry.size = st.st_size;
+    entry.mtime = st.st_mtim;
+    total += entry.size;
+    dynamic_array_append(entries, &entry);
+  }
+
+  closedir(dir);
+  return total;
+}
+
+static int obj_cache_entry_cmp(const void *a, const void *b) {
+  const obj_cache_entry *x = a, *y = b;
+
+  if (x->mtime.tv_sec != y->mtime.tv_sec)
+    return x->mtime.tv_sec < y->mtime.tv_sec ? -1 : 1;
+  if (x->mtime.tv_nsec != y->mtime.tv_nsec)
+    return x->mtime.tv_nsec < y->mtime.tv_nsec ? -1 : 1;
+  return 0;
+}
+
+/*
+ * @brief: remove the least recently used entries until the cache fits in its
+ * size limit.
+ */
+static void obj_cache_evict(obj_cache *cache) {
+  dynamic_array entries;
+  dynamic_array_init(&entries, sizeof(obj_cache_entry));
+
+  u64 total = obj_cache_scan(cache, &entries);
+
+  if (total > cache->max_size) {
+    qsort(entries.items, entries.count, sizeof(obj_cache_entry),
+          obj_cache_entry_cmp);
+
+    for (u64 i = 0; i < entries.count && total > cache->max_size; i++) {
+      obj_cache_entry *entry = dynamic_array_at(&entries, i);
+      if (unlink(entry->path) == 0)
+        total -= entry->size;
+    }
+  }
+
+  for (u64 i = 0; i < entries.count; i++) {
+    obj_cache_entry *entry = dynamic_array_at(&entries, i);
+    free(entry->path);
+  }
+  dynamic_array_free(&entries);
+}
+
+/*
+ * @brief: read the hit and miss counts of previous builds.
+ */
+static void obj_cache_read_stats(obj_cache *cache, u64 *hits, u64 *misses) {
+  *hits = 0;
+  *misses = 0;
+
+  char *path = scu_format_string("%s/stats", cache->dir);
+  FILE *f = fopen(path, "r");
+  free(path);
+
+  if (!f)
+    return;
+
+  if (fscanf(f, "hits %lu\nmisses %lu\n", hits, misses) != 2) {
+    *hits = 0;
+    *misses = 0;
+  }
+  fclose(f);
+}
+
+/*
+ * @brief: add the counts of this build to the stats file.
+ */
+static void obj_cache_write_stats(obj_cache *cache) {
+  u64 hits, misses;
+  obj_cache_read_stats(cache, &hits, &misses);
+
+  char *tmp = scu_format_string("%s/stats.XXXXXX", cache->dir);
+  int fd = mkstemp(tmp);
+  if (fd < 0) {
+    free(tmp);
+    return;
+  }
+
+  FILE *f = fdopen(fd, "w");
+  fprintf(f, "hits %lu\nmisses %lu\n", hits + cache->hits,
+          misses + cache->misses);
+
+  char *path = scu_format_string("%s/stats", cache->dir);
+  if (fclose(f) != 0 || rename(tmp, path) != 0)
+    unlink(tmp);
+
+  free(path);
+  free(tmp);
+}
+
+void obj_cache_free(obj_cache *cache) {
+  if (cache->dir == NULL)
+    return;
+
+  if (cache->stores)
+    obj_cache_evict(cache);
+
+  if (cache->hits || cache->misses)
+    obj_cache_write_stats(cache);
+
+  free(cache->dir);
+  cache->dir = NULL;
+}
+
+void obj_cache_print_stats(obj_cache *cache) {
+  if (cache->dir == NULL) {
+    scu_printf("Object cache disabled\n");
+    return;
+  }
+
+  dynamic_array entries;
+  dynamic_array_init(&entries, sizeof(obj_cache_entry));
+  u64 total = obj_cache_scan(cache, &entries);
+
+  for (u64 i = 0; i < entries.count; i++) {
+    obj_cache_entry *entry = dynamic_array_at(&entries, i);
+    free(entry->path);
+  }
+
+  u64 hits, misses;
+  obj_cache_read_stats(cache, &hits, &misses);
+  hits += cache->hits;
+  misses += cache->misses;
+
+  scu_printf("Object cache: %s\n", cache->dir);
+  scu_printf("  entries   %lu\n", entries.count);
+  scu_printf("  size      %.1f / %.1f MiB\n", total / 1048576.0,
+             cache->max_size / 1048576.0);
+  scu_printf("  hits      %lu\n", hits);
+  scu_printf("  misses    %lu\n", misses);
+  if (hits + misses)
+    scu_printf("  hit rate  %.1f%%\n", 100.0 * hits / (hits + misses));
+
+  dynamic_array_free(&entries);
+}
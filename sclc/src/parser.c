@@ -1,32 +1,82 @@
 #include "parser.h"
 #include "ast.h"
 #include "common.h"
-#include "ds/arena.h"
 #include "ds/dynamic_array.h"
-#include "ds/ht.h"
+#include "lexer.h"
+#include "source.h"
 #include "token.h"
 #include "utils.h"
 #include "var.h"
 
-static mem_arena *ast_arena;
+static _Thread_local ast *tree;
 
 /*
  * @struct parser: represents the parser's internal state.
  */
 typedef struct parser {
-  dynamic_array tokens;
-  u64 index;
+  token_stream *tokens;
+  source_map *sources;
+
+  /*
+   * Ids of the lists being parsed, innermost last.
+   */
+  dynamic_array scratch; // u32
 } parser;
 
 /*
  * @brief: Initializes the parser struct.
  *
- * @param tokens: pointer to dynamic_array of tokens.
+ * @param tokens: pointer to the token_stream to parse.
+ * @param sources: source_map the tokens are lexed from.
  * @param p: pointer to an uninitialized parser struct.
  */
-static void parser_init(dynamic_array *tokens, parser *p) {
-  p->tokens = *tokens;
-  p->index = 0;
+static void parser_init(token_stream *tokens, source_map *sources,
+                        parser *p) {
+  p->tokens = tokens;
+  p->sources = sources;
+  dynamic_array_init(&p->scratch, sizeof(u32));
+}
+
+/*
+ * @brief: start a list of node ids.
+ *
+ * @param p: pointer to the parser state.
+ *
+ * @return: base of the list, to pass to parser_end_list.
+ */
+static inline u64 parser_begin_list(parser *p) { return p->scratch.count; }
+
+/*
+ * @brief: add a node id to the innermost list.
+ *
+ * @param p: pointer to the parser state.
+ * @param id: id of the node.
+ */
+static inline void parser_push_id(parser *p, u32 id) {
+  dynamic_array_append(&p->scratch, &id);
+}
+
+/*
+ * @brief: end the innermost list, moving its ids into the ast.
+ *
+ * @param p: pointer to the parser state.
+ * @param base: base returned by parser_begin_list.
+ */
+static node_list parser_end_list(parser *p, u64 base) {
+  node_list list = ast_add_list(tree, (u32 *)p->scratch.items + base,
+                                p->scratch.count - base);
+  p->scratch.count = base;
+  return list;
+}
+
+/*
+ * @brief: get the line number of a token.
+ *
+ * @param p: pointer to the parser state.
+ * @param token: pointer to a token of the parser.
+ */
+static inline u64 parser_line(parser *p, token *token) {
+  return source_map_line(p->sources, token->loc);
 }
 
 /*
@@ -36,18 +86,28 @@ static void parser_init(dynamic_array *tokens, parser *p) {
  * @param token: pointer to a new un-initialized token struct.
  */
 static void parser_current(parser *p, token *token) {
-  dynamic_array_get(&p->tokens, p->index, token);
+  *token = token_stream_peek(p->tokens, 0);
   if (token->kind == TOKEN_END) {
     scu_check_errors();
   }
 }
 
+/*
+ * @brief: check the token following the current one.
+ *
+ * @param p: pointer to the parser state.
+ * @param token: pointer to a new un-initialized token struct.
+ */
+static void parser_next(parser *p, token *token) {
+  *token = token_stream_peek(p->tokens, 1);
+}
+
 /*
  * @brief: advance the parser state to the next token.
  *
  * @param p: pointer to the parser state.
  */
-static void parser_advance(parser *p) { p->index++; }
+static void parser_advance(parser *p) { token_stream_advance(p->tokens); }
 
 /*
  * @brief: parse an instruction. (declaration)
@@ -64,89 +124,107 @@ static bool parse_instr(parser *p, instr_node *instr);
  *
  * @param p: pointer to the parser state.
  */
-static expr_node *parse_expr(parser *p);
+static expr_id parse_expr(parser *p);
+
+/*
+ * @brief: parse the arguments of a function call, after its '('.
+ *
+ * @param p: pointer to the parser state.
+ *
+ * @return: list of the argument expressions.
+ */
+static node_list parse_fn_call_args(parser *p) {
+  token token = {0};
+  parser_current(p, &token);
+
+  u64 base = parser_begin_list(p);
+  while (token.kind != TOKEN_RPAREN) {
+    parser_push_id(p, parse_expr(p));
+
+    parser_current(p, &token);
+    if (token.kind == TOKEN_COMMA) {
+      parser_advance(p);
+      parser_current(p, &token);
+    }
+  }
+
+  return parser_end_list(p, base);
+}
 
 /*
  * @brief: parse an individual term.
  *
  * @param p: pointer to the parser state.
- * @param term: pointer to an un-initialized term_node struct.
+ *
+ * @return: id of the term.
  */
-static void parse_term_for_expr(parser *p, term_node *term) {
+static term_id parse_term_for_expr(parser *p) {
   token token = {0};
+  term_node term = {0};
 
   parser_current(p, &token);
-  term->line = token.line;
+  term.line = parser_line(p, &token);
   if (token.kind == TOKEN_INT_LITERAL) {
-    term->kind = TERM_INT;
-    term->value.integer = token.value.integer;
+    term.kind = TERM_INT;
+    term.value.integer = token.value.integer;
     parser_advance(p);
   } else if (token.kind == TOKEN_CHAR_LITERAL) {
-    term->kind = TERM_CHAR;
-    term->value.character = token.value.character;
+    term.kind = TERM_CHAR;
+    term.value.character = token.value.character;
     parser_advance(p);
   } else if (token.kind == TOKEN_STRING_LITERAL) {
-    term->kind = TERM_STRING;
-    term->value.str = token.value.str;
+    term.kind = TERM_STRING;
+    term.value.str = source_map_string(p->sources, token.value.str);
     parser_advance(p);
   } else if (token.kind == TOKEN_IDENTIFIER) {
-    term->kind = TERM_IDENTIFIER;
-    term->identifier.line = token.line;
-    term->identifier.name = token.value.str;
+    term.kind = TERM_IDENTIFIER;
+    term.identifier.line = parser_line(p, &token);
+    term.identifier.name = token.value.sym;
 
     parser_advance(p);
     parser_current(p, &token);
     if (token.kind == TOKEN_LSQBR) {
-      term->kind = TERM_ARRAY_ACCESS;
-      term->array_access.array_var.name = term->identifier.name;
-      term->array_access.array_var.line = term->identifier.line;
+      term.kind = TERM_ARRAY_ACCESS;
+      term.array_access.array_var.name = term.identifier.name;
+      term.array_access.array_var.line = term.identifier.line;
       parser_advance(p);
-      term->array_access.index_expr = parse_expr(p);
+      term.array_access.index_expr = parse_expr(p);
       parser_current(p, &token);
       if (token.kind != TOKEN_RSQBR) {
-        scu_perror("Expected ']' at line %d\n", token.line);
+        scu_perror("Expected ']' at line %d\n", parser_line(p, &token));
       }
       parser_advance(p);
     } else if (token.kind == TOKEN_LPAREN) {
-      term->kind = TERM_FUNCTION_CALL;
-      term->fn_call.name = term->identifier.name;
+      term.kind = TERM_FUNCTION_CALL;
+      term.fn_call.name = term.identifier.name;
 
-      dynamic_array_init(&term->fn_call.parameters, sizeof(expr_node));
       parser_advance(p);
-      parser_current(p, &token);
-
-      while (token.kind != TOKEN_RPAREN) {
-        expr_node *arg = parse_expr(p);
-        dynamic_array_append(&term->fn_call.parameters, arg);
-
-        parser_current(p, &token);
-        if (token.kind == TOKEN_COMMA) {
-          parser_advance(p);
-          parser_current(p, &token);
-        }
-      }
+      term.fn_call.parameters = parse_fn_call_args(p);
 
+      parser_current(p, &token);
       if (token.kind != TOKEN_RPAREN) {
-        scu_perror("Expected ')' at line %d\n", token.line);
+        scu_perror("Expected ')' at line %d\n", parser_line(p, &token));
       }
       parser_advance(p);
     }
   } else if (token.kind == TOKEN_ADDRESS_OF) {
-    term->kind = TERM_ADDOF;
-    term->identifier.line = token.line;
-    term->identifier.name = token.value.str;
+    term.kind = TERM_ADDOF;
+    term.identifier.line = parser_line(p, &token);
+    term.identifier.name = token.value.sym;
     parser_advance(p);
   } else if (token.kind == TOKEN_POINTER) {
-    term->kind = TERM_DEREF;
-    term->identifier.line = token.line;
-    term->identifier.name = token.value.str;
+    term.kind = TERM_DEREF;
+    term.identifier.line = parser_line(p, &token);
+    term.identifier.name = token.value.sym;
     parser_advance(p);
   } else {
     scu_perror("Expected a term (input, int, char, identifier, addof, "
                "pointer), got %s [line %d]\n",
-               lexer_token_kind_to_str(token.kind), token.line);
+               lexer_token_kind_to_str(token.kind), parser_line(p, &token));
     parser_advance(p);
   }
+
+  return ast_add_term(tree, &term);
 }
 
 /*
@@ -154,100 +232,33 @@ static void parse_term_for_expr(parser *p, term_node *term) {
  *
  * @param p: pointer to the parser state.
  */
-static expr_node *parse_factor(parser *p) {
+static expr_id parse_factor(parser *p) {
   token token = {0};
   parser_current(p, &token);
   if (token.kind == TOKEN_INT_LITERAL || token.kind == TOKEN_CHAR_LITERAL ||
       token.kind == TOKEN_IDENTIFIER || token.kind == TOKEN_POINTER ||
       token.kind == TOKEN_STRING_LITERAL || token.kind == TOKEN_ADDRESS_OF) {
-    expr_node *node = arena_push_struct(ast_arena, expr_node);
-    node->kind = EXPR_TERM;
-    node->line = token.line;
-
-    if (token.kind == TOKEN_INT_LITERAL) {
-      node->term.kind = TERM_INT;
-      node->term.value.integer = token.value.integer;
-      parser_advance(p);
-      return node;
-    } else if (token.kind == TOKEN_CHAR_LITERAL) {
-      node->term.kind = TERM_CHAR;
-      node->term.value.character = token.value.character;
-      parser_advance(p);
-      return node;
-    } else if (token.kind == TOKEN_STRING_LITERAL) {
-      node->term.kind = TERM_STRING;
-      node->term.value.str = token.value.str;
-      parser_advance(p);
-      return node;
-    } else if (token.kind == TOKEN_IDENTIFIER) {
-      node->term.kind = TERM_IDENTIFIER;
-      node->term.identifier.line = token.line;
-      node->term.identifier.name = token.value.str;
-      parser_advance(p);
-      parser_current(p, &token);
-      if (token.kind == TOKEN_LSQBR) {
-        node->term.kind = TERM_ARRAY_ACCESS;
-        node->term.array_access.array_var.name = node->term.identifier.name;
-        node->term.array_access.array_var.line = node->term.identifier.line;
-        parser_advance(p);
-        node->term.array_access.index_expr = parse_expr(p);
-        parser_current(p, &token);
-        if (token.kind != TOKEN_RSQBR) {
-          scu_perror("Expected ']' at line %d\n", token.line);
-        }
-        parser_advance(p);
-      } else if (token.kind == TOKEN_LPAREN) {
-        node->term.kind = TERM_FUNCTION_CALL;
-        node->term.fn_call.name = node->term.identifier.name;
-
-        dynamic_array_init(&node->term.fn_call.parameters, sizeof(expr_node));
-        parser_advance(p);
-        parser_current(p, &token);
-
-        while (token.kind != TOKEN_RPAREN) {
-          expr_node *arg = parse_expr(p);
-          dynamic_array_append(&node->term.fn_call.parameters, arg);
-
-          parser_current(p, &token);
-          if (token.kind == TOKEN_COMMA) {
-            parser_advance(p);
-            parser_current(p, &token);
-          }
-        }
-
-        if (token.kind != TOKEN_RPAREN) {
-          scu_perror("Expected ')' at line %d\n", token.line);
-        }
-        parser_advance(p);
-      }
-      return node;
-    } else if (token.kind == TOKEN_POINTER) {
-      node->term.kind = TERM_DEREF;
-      node->term.identifier.line = token.line;
-      node->term.identifier.name = token.value.str;
-      parser_advance(p);
-      return node;
-    } else if (token.kind == TOKEN_ADDRESS_OF) {
-      node->term.kind = TERM_ADDOF;
-      node->term.identifier.line = token.line;
-      node->term.identifier.name = token.value.str;
-      parser_advance(p);
-      return node;
-    }
+    expr_node node = {0};
+    node.kind = EXPR_TERM;
+    node.line = parser_line(p, &token);
+    node.term = parse_term_for_expr(p);
+    return ast_add_expr(tree, &node);
   } else if (token.kind == TOKEN_LPAREN) {
     parser_advance(p);
-    expr_node *node = parse_expr(p);
+    expr_id node = parse_expr(p);
     parser_current(p, &token);
     if (token.kind != TOKEN_RPAREN) {
-      scu_perror("Syntax error: expected ')' at line %d\n", token.line);
+      scu_perror("Syntax error: expected ')' at line %d\n",
+                 parser_line(p, &token));
     }
     parser_advance(p);
     return node;
   } else {
-    scu_perror("Syntax error: expected term or '(' at line %d\n", token.line);
+    scu_perror("Syntax error: expected term or '(' at line %d\n",
+               parser_line(p, &token));
     scu_check_errors();
   }
-  return NULL;
+  return 0;
 }
 
 /*
@@ -255,8 +266,8 @@ static expr_node *parse_factor(parser *p) {
  *
  * @param p: pointer to the parser state.
  */
-static expr_node *parse_term(parser *p) {
-  expr_node *left = parse_factor(p);
+static expr_id parse_term(parser *p) {
+  expr_id left = parse_factor(p);
   while (1) {
     token token = {0};
     parser_current(p, &token);
@@ -264,22 +275,22 @@ static expr_node *parse_term(parser *p) {
     if (token.kind == TOKEN_MULTIPLY || token.kind == TOKEN_DIVIDE ||
         token.kind == TOKEN_MODULO) {
       parser_advance(p);
-      expr_node *right = parse_factor(p);
+      expr_id right = parse_factor(p);
 
-      expr_node *parent = arena_push_struct(ast_arena, expr_node);
+      expr_node parent = {0};
 
-      parent->line = token.line;
+      parent.line = parser_line(p, &token);
 
       if (token.kind == TOKEN_MULTIPLY) {
-        parent->kind = EXPR_MULTIPLY;
+        parent.kind = EXPR_MULTIPLY;
       } else if (token.kind == TOKEN_DIVIDE) {
-        parent->kind = EXPR_DIVIDE;
+        parent.kind = EXPR_DIVIDE;
       } else {
-        parent->kind = EXPR_MODULO;
+        parent.kind = EXPR_MODULO;
       }
-      parent->binary.left = left;
-      parent->binary.right = right;
-      left = parent;
+      parent.binary.left = left;
+      parent.binary.right = right;
+      left = ast_add_expr(tree, &parent);
     } else {
       break;
     }
@@ -292,22 +303,22 @@ static expr_node *parse_term(parser *p) {
  *
  * @param p: pointer to the parser state.
  */
-static expr_node *parse_expr(parser *p) {
-  expr_node *left = parse_term(p);
+static expr_id parse_expr(parser *p) {
+  expr_id left = parse_term(p);
   while (1) {
     token token = {0};
     parser_current(p, &token);
 
     if (token.kind == TOKEN_ADD || token.kind == TOKEN_SUBTRACT) {
       parser_advance(p);
-      expr_node *right = parse_term(p);
-
-      expr_node *parent = arena_push_struct(ast_arena, expr_node);
-      parent->kind = (token.kind == TOKEN_ADD) ? EXPR_ADD : EXPR_SUBTRACT;
-      parent->line = token.line;
-      parent->binary.left = left;
-      parent->binary.right = right;
-      left = parent;
+      expr_id right = parse_term(p);
+
+      expr_node parent = {0};
+      parent.kind = (token.kind == TOKEN_ADD) ? EXPR_ADD : EXPR_SUBTRACT;
+      parent.line = parser_line(p, &token);
+      parent.binary.left = left;
+      parent.binary.right = right;
+      left = ast_add_expr(tree, &parent);
     } else {
       break;
     }
@@ -336,16 +347,15 @@ static void parse_rel(parser *p, rel_node *rel) {
       {TOKEN_GREATER_THAN_OR_EQUAL, REL_GREATER_THAN_OR_EQUAL}};
 
   token token = {0};
-  term_node lhs = {0}, rhs = {0};
 
-  parse_term_for_expr(p, &lhs);
+  term_id lhs = parse_term_for_expr(p);
   parser_current(p, &token);
-  rel->line = token.line;
+  rel->line = parser_line(p, &token);
 
   for (u64 i = 0; i < sizeof(mappings) / sizeof(mappings[0]); i++) {
     if (token.kind == mappings[i].token_type) {
       parser_advance(p);
-      parse_term_for_expr(p, &rhs);
+      term_id rhs = parse_term_for_expr(p);
 
       rel->kind = mappings[i].rel_type;
       rel->comparison.lhs = lhs;
@@ -355,7 +365,7 @@ static void parse_rel(parser *p, rel_node *rel) {
   }
 
   scu_perror("Expected a relation (==, !=, <, <=, >, >=), got %s [line %d]\n",
-             lexer_token_kind_to_str(token.kind), token.line);
+             lexer_token_kind_to_str(token.kind), parser_line(p, &token));
 }
 
 /*
@@ -365,7 +375,7 @@ static void parse_rel(parser *p, rel_node *rel) {
  * @param instr: pointer to a newly malloc'd instr struct.
  */
 static void parse_initialize(parser *p, instr_node *instr, type _type,
-                             char *_name) {
+                             sym_id _name) {
   instr->kind = INSTR_INITIALIZE;
   instr->initialize_variable.var.type = _type;
   instr->initialize_variable.var.name = _name;
@@ -381,24 +391,25 @@ static void parse_initialize(parser *p, instr_node *instr, type _type,
  * @param instr: pointer to a newly malloc'd instr struct.
  */
 static void parse_initialize_array(parser *p, instr_node *instr, type _type,
-                                   char *_name, expr_node *size_expr) {
+                                   sym_id _name, expr_id size_expr) {
   instr->kind = INSTR_INITIALIZE_ARRAY;
-  instr->initialize_array.var.type = _type;
-  instr->initialize_array.var.name = _name;
-  instr->initialize_array.size_expr = size_expr;
+  initialize_array_node arr = {0};
+  arr.var.type = _type;
+  arr.var.name = _name;
+  arr.size_expr = size_expr;
   parser_advance(p);
 
   token token = {0};
   parser_current(p, &token);
 
   if (token.kind != TOKEN_LBRACE) {
-    scu_perror("Expected '{' at line %d\n", token.line);
+    scu_perror("Expected '{' at line %d\n", parser_line(p, &token));
+    instr->initialize_array = ast_add_array_init(tree, &arr);
     return;
   }
   parser_advance(p);
 
-  dynamic_array_init(&instr->initialize_array.literal.elements,
-                     sizeof(expr_node));
+  u64 base = parser_begin_list(p);
 
   while (1) {
     parser_current(p, &token);
@@ -406,8 +417,7 @@ static void parse_initialize_array(parser *p, instr_node *instr, type _type,
       break;
     }
 
-    expr_node *elem = parse_expr(p);
-    dynamic_array_append(&instr->initialize_array.literal.elements, elem);
+    parser_push_id(p, parse_expr(p));
 
     parser_current(p, &token);
     if (token.kind == TOKEN_COMMA) {
@@ -415,12 +425,15 @@ static void parse_initialize_array(parser *p, instr_node *instr, type _type,
     } else if (token.kind == TOKEN_RBRACE) {
       break;
     } else {
-      scu_perror("Expected '}' or ',' at line %d\n", token.line);
-      return;
+      scu_perror("Expected '}' or ',' at line %d\n", parser_line(p, &token));
+      break;
     }
   }
 
-  parser_advance(p);
+  arr.literal.elements = parser_end_list(p, base);
+  instr->initialize_array = ast_add_array_init(tree, &arr);
+  if (token.kind == TOKEN_RBRACE)
+    parser_advance(p);
 }
 
 /*
@@ -433,13 +446,13 @@ static void parse_declare(parser *p, instr_node *instr) {
   token token = {0};
 
   type _type = TYPE_VOID;
-  char *_name;
+  sym_id _name;
   u32 _line;
   bool is_array = false;
-  expr_node *size_expr = NULL;
+  expr_id size_expr = 0;
 
   parser_current(p, &token);
-  instr->line = token.line;
+  instr->line = parser_line(p, &token);
   if (token.kind == TOKEN_TYPE_INT) {
     _type = TYPE_INT;
   } else if (token.kind == TOKEN_TYPE_CHAR) {
@@ -450,8 +463,8 @@ static void parse_declare(parser *p, instr_node *instr) {
   parser_current(p, &token);
   if (_type == TYPE_CHAR && token.kind == TOKEN_POINTER)
     _type = TYPE_STRING;
-  _name = token.value.str;
-  _line = token.line;
+  _name = token.value.sym;
+  _line = parser_line(p, &token);
   parser_advance(p);
 
   parser_current(p, &token);
@@ -463,7 +476,7 @@ static void parse_declare(parser *p, instr_node *instr) {
 
     parser_current(p, &token);
     if (token.kind != TOKEN_RSQBR) {
-      scu_perror("Expected ']' at line %d\n", token.line);
+      scu_perror("Expected ']' at line %d\n", parser_line(p, &token));
       return;
     }
     parser_advance(p);
@@ -504,34 +517,24 @@ static void parse_fn_call(parser *p, instr_node *instr) {
   parser_current(p, &token);
 
   instr->kind = INSTR_FN_CALL;
-  instr->line = token.line;
-  instr->fn_call.name = token.value.str;
+  instr->line = parser_line(p, &token);
+  instr->fn_call.name = token.value.sym;
 
   parser_advance(p);
   parser_current(p, &token);
 
   if (token.kind != TOKEN_LPAREN) {
-    scu_perror("Expected '(' after function name [line %d]\n", token.line);
+    scu_perror("Expected '(' after function name [line %d]\n",
+               parser_line(p, &token));
   }
 
   parser_advance(p);
-  parser_current(p, &token);
-
-  dynamic_array_init(&instr->fn_call.parameters, sizeof(expr_node));
-
-  while (token.kind != TOKEN_RPAREN) {
-    expr_node *arg = parse_expr(p);
-    dynamic_array_append(&instr->fn_call.parameters, arg);
-
-    parser_current(p, &token);
-    if (token.kind == TOKEN_COMMA) {
-      parser_advance(p);
-      parser_current(p, &token);
-    }
-  }
+  instr->fn_call.parameters = parse_fn_call_args(p);
 
+  parser_current(p, &token);
   if (token.kind != TOKEN_RPAREN) {
-    scu_perror("Expected ')' after function arguments [line %d]\n", token.line);
+    scu_perror("Expected ')' after function arguments [line %d]\n",
+               parser_line(p, &token));
   }
 
   parser_advance(p);
@@ -548,45 +551,47 @@ static void parse_assign(parser *p, instr_node *instr) {
 
   parser_current(p, &token);
 
-  u64 ident_line = instr->line = token.line;
-  char *ident_name = token.value.str;
+  u64 ident_line = instr->line = parser_line(p, &token);
+  sym_id ident_name = token.value.sym;
 
   if (token.kind == TOKEN_POINTER) {
     instr->assign.identifier.type = TYPE_POINTER;
   }
 
+  parser_next(p, &token);
+  if (token.kind == TOKEN_LPAREN) {
+    parse_fn_call(p, instr);
+    return;
+  }
+
   parser_advance(p);
   parser_current(p, &token);
 
   if (token.kind == TOKEN_LSQBR) {
     instr->kind = INSTR_ASSIGN_TO_ARRAY_SUBSCRIPT;
-    instr->line = token.line;
+    instr->line = parser_line(p, &token);
     instr->assign_to_array_subscript.var.name = ident_name;
     instr->assign_to_array_subscript.var.line = ident_line;
 
     parser_advance(p);
 
-    expr_node *index_expr = parse_expr(p);
-    instr->assign_to_array_subscript.index_expr = index_expr;
+    instr->assign_to_array_subscript.index_expr = parse_expr(p);
 
     parser_current(p, &token);
     if (token.kind != TOKEN_RSQBR) {
       scu_perror("Expected ], found %s [line %d]\n",
-                 lexer_token_kind_to_str(token.kind), token.line);
+                 lexer_token_kind_to_str(token.kind), parser_line(p, &token));
     }
     parser_advance(p);
     parser_current(p, &token);
 
     if (token.kind != TOKEN_ASSIGN) {
       scu_perror("Expected assign, found %s [line %d]\n",
-                 lexer_token_kind_to_str(token.kind), token.line);
+                 lexer_token_kind_to_str(token.kind), parser_line(p, &token));
     }
     parser_advance(p);
 
     instr->assign_to_array_subscript.expr_to_assign = parse_expr(p);
-  } else if (token.kind == TOKEN_LPAREN) {
-    p->index--;
-    parse_fn_call(p, instr);
   } else {
     instr->kind = INSTR_ASSIGN;
     instr->line = ident_line;
@@ -594,7 +599,7 @@ static void parse_assign(parser *p, instr_node *instr) {
 
     if (token.kind != TOKEN_ASSIGN) {
       scu_perror("Expected assign, found %s [line %d]\n",
-                 lexer_token_kind_to_str(token.kind), token.line);
+                 lexer_token_kind_to_str(token.kind), parser_line(p, &token));
     }
     parser_advance(p);
 
@@ -602,6 +607,17 @@ static void parse_assign(parser *p, instr_node *instr) {
   }
 }
 
+/*
+ * @brief: parse an instruction and add it to the innermost list.
+ *
+ * @param p: pointer to the parser state.
+ */
+static void parse_instr_into_list(parser *p) {
+  instr_node instr = {0};
+  if (parse_instr(p, &instr))
+    parser_push_id(p, ast_add_instr(tree, &instr));
+}
+
 /*
  * @brief: parse a conditional block.
  *
@@ -616,29 +632,29 @@ static void parse_cond_block(parser *p, cond_block_node *block) {
     block->kind = COND_MULTI_INSTR;
     parser_advance(p);
 
-    dynamic_array_init(&block->multi, sizeof(instr_node));
+    u64 base = parser_begin_list(p);
 
     parser_current(p, &token);
     while (token.kind != TOKEN_RBRACE && token.kind != TOKEN_END) {
-      instr_node *new_instr = arena_push_struct(ast_arena, instr_node);
-      if (parse_instr(p, new_instr))
-        dynamic_array_append(&block->multi, new_instr);
-
+      parse_instr_into_list(p);
       parser_current(p, &token);
     }
 
+    block->multi = parser_end_list(p, base);
+
     parser_advance(p);
     return;
   } else {
     block->kind = COND_SINGLE_INSTR;
 
-    block->single = arena_push_struct(ast_arena, instr_node);
-    parse_instr(p, block->single);
+    instr_node instr = {0};
+    parse_instr(p, &instr);
+    block->single = ast_add_instr(tree, &instr);
     return;
   }
 
   scu_perror("Expected a statement or '{', found %s [line %d]\n",
-             lexer_token_kind_to_str(token.kind), token.line);
+             lexer_token_kind_to_str(token.kind), parser_line(p, &token));
 }
 
 /*
@@ -651,19 +667,19 @@ static void parse_if(parser *p, instr_node *instr) {
   token token = {0};
 
   instr->kind = INSTR_IF;
-  instr->if_.else_ = NULL;
+  if_node if_ = {0};
 
   parser_advance(p);
-  parse_rel(p, &instr->if_.rel);
+  parse_rel(p, &if_.rel);
 
   parser_current(p, &token);
-  instr->line = token.line;
+  instr->line = parser_line(p, &token);
 
-  parse_cond_block(p, &instr->if_.then);
+  parse_cond_block(p, &if_.then);
 
   parser_current(p, &token);
 
-  dynamic_array_init(&instr->if_.else_ifs, sizeof(if_node));
+  u64 base = parser_begin_list(p);
 
   while (token.kind == TOKEN_ELSE) {
     parser_advance(p);
@@ -674,14 +690,17 @@ static void parse_if(parser *p, instr_node *instr) {
       parser_advance(p);
       parse_rel(p, &else_if.rel);
       parse_cond_block(p, &else_if.then);
-      dynamic_array_append(&instr->if_.else_ifs, &else_if);
+      parser_push_id(p, ast_add_if(tree, &else_if));
       parser_current(p, &token);
     } else {
-      instr->if_.else_ = arena_push_struct(ast_arena, cond_block_node);
-      parse_cond_block(p, instr->if_.else_);
+      if_.has_else = true;
+      parse_cond_block(p, &if_.else_);
       break;
     }
   }
+
+  if_.else_ifs = parser_end_list(p, base);
+  instr->if_ = ast_add_if(tree, &if_);
 }
 
 /*
@@ -694,22 +713,23 @@ static void parse_match(parser *p, instr_node *instr) {
   token token = {0};
 
   instr->kind = INSTR_MATCH;
-  instr->match.expr = arena_push_struct(ast_arena, expr_node);
+  match_node match = {0};
 
   parser_advance(p);
 
-  instr->match.expr = parse_expr(p);
+  match.expr = parse_expr(p);
 
   parser_current(p, &token);
-  instr->line = token.line;
+  instr->line = parser_line(p, &token);
 
   if (token.kind != TOKEN_LBRACE) {
-    scu_perror("expected '{' after match expression [line %d]\n", token.line);
+    scu_perror("expected '{' after match expression [line %d]\n",
+               parser_line(p, &token));
     scu_check_errors();
   }
   parser_advance(p);
 
-  dynamic_array_init(&instr->match.cases, sizeof(match_case_node));
+  u64 cases_base = parser_begin_list(p);
 
   parser_current(p, &token);
   while (token.kind != TOKEN_RBRACE && token.kind != TOKEN_END) {
@@ -719,8 +739,7 @@ static void parse_match(parser *p, instr_node *instr) {
       case_node.kind = MATCH_CASE_DEFAULT;
       parser_advance(p);
     } else {
-      expr_node *first_expr = arena_push_struct(ast_arena, expr_node);
-      first_expr = parse_expr(p);
+      expr_id first_expr = parse_expr(p);
 
       parser_current(p, &token);
 
@@ -730,43 +749,44 @@ static void parse_match(parser *p, instr_node *instr) {
 
         parser_advance(p);
 
-        case_node.range.end = arena_push_struct(ast_arena, expr_node);
         case_node.range.end = parse_expr(p);
       } else {
         case_node.kind = MATCH_CASE_VALUES;
-        dynamic_array_init(&case_node.values.values, sizeof(expr_node *));
-        dynamic_array_append(&case_node.values.values, &first_expr);
+        u64 base = parser_begin_list(p);
+        parser_push_id(p, first_expr);
 
         parser_current(p, &token);
         while (token.kind == TOKEN_COMMA) {
           parser_advance(p);
-
-          expr_node *next_expr = arena_push_struct(ast_arena, expr_node);
-          next_expr = parse_expr(p);
-          dynamic_array_append(&case_node.values.values, &next_expr);
-
+          parser_push_id(p, parse_expr(p));
           parser_current(p, &token);
         }
+
+        case_node.values.values = parser_end_list(p, base);
       }
     }
 
     parser_current(p, &token);
     if (token.kind != TOKEN_DARROW) {
       scu_perror("Expected '=>' after match case pattern [line %d]\n",
-                 token.line);
+                 parser_line(p, &token));
       scu_check_errors();
     }
     parser_advance(p);
 
     parse_cond_block(p, &case_node.body);
 
-    dynamic_array_append(&instr->match.cases, &case_node);
+    parser_push_id(p, ast_add_case(tree, &case_node));
 
     parser_current(p, &token);
   }
 
+  match.cases = parser_end_list(p, cases_base);
+  instr->match = ast_add_match(tree, &match);
+
   if (token.kind != TOKEN_RBRACE) {
-    scu_perror("expected '}' to close match block [line %d]\n", token.line);
+    scu_perror("expected '}' to close match block [line %d]\n",
+               parser_line(p, &token));
     scu_check_errors();
   }
   parser_advance(p);
@@ -786,14 +806,14 @@ static void parse_goto(parser *p, instr_node *instr) {
   parser_advance(p);
 
   parser_current(p, &token);
-  instr->line = token.line;
+  instr->line = parser_line(p, &token);
   if (token.kind != TOKEN_LABEL) {
     scu_perror("Expected label, found %s [line %d]\n",
-               lexer_token_kind_to_str(token.kind), token.line);
+               lexer_token_kind_to_str(token.kind), parser_line(p, &token));
   }
   parser_advance(p);
 
-  instr->goto_.label = token.value.str;
+  instr->goto_.label = token.value.sym;
 }
 
 /*
@@ -808,8 +828,8 @@ static void parse_label(parser *p, instr_node *instr) {
   instr->kind = INSTR_LABEL;
 
   parser_current(p, &token);
-  instr->line = token.line;
-  instr->label.label = token.value.str;
+  instr->line = parser_line(p, &token);
+  instr->label.label = token.value.sym;
 
   parser_advance(p);
 }
@@ -826,8 +846,9 @@ static void parse_loop(parser *p, instr_node *instr, loop_kind kind) {
 
   parser_current(p, &token);
   instr->kind = INSTR_LOOP;
-  instr->line = token.line;
-  instr->loop.kind = kind;
+  instr->line = parser_line(p, &token);
+  loop_node loop = {0};
+  loop.kind = kind;
 
   parser_advance(p);
 
@@ -835,46 +856,44 @@ static void parse_loop(parser *p, instr_node *instr, loop_kind kind) {
     parser_current(p, &token);
 
     if (token.kind != TOKEN_IDENTIFIER) {
-      scu_perror("expected identifier after 'for' [line %d]\n", token.line);
+      scu_perror("expected identifier after 'for' [line %d]\n",
+                 parser_line(p, &token));
       scu_check_errors();
     }
 
-    instr->loop._for.iterator.name = token.value.str;
-    instr->loop._for.iterator.type = TYPE_INT;
+    loop._for.iterator.name = token.value.sym;
+    loop._for.iterator.type = TYPE_INT;
 
     parser_advance(p);
     parser_current(p, &token);
 
     if (token.kind != TOKEN_IN) {
-      scu_perror("expected 'in' after loop variable [line %d]\n", token.line);
+      scu_perror("expected 'in' after loop variable [line %d]\n",
+                 parser_line(p, &token));
       scu_check_errors();
     }
 
     parser_advance(p);
 
-    instr->loop._for.range_start = arena_push_struct(ast_arena, expr_node);
-    instr->loop._for.range_start = parse_expr(p);
+    loop._for.range_start = parse_expr(p);
 
     parser_current(p, &token);
 
     if (token.kind != TOKEN_ELLIPSIS) {
-      scu_perror("expected '...' in for loop range [line %d]\n", token.line);
+      scu_perror("expected '...' in for loop range [line %d]\n",
+                 parser_line(p, &token));
       scu_check_errors();
     }
 
     parser_advance(p);
 
-    instr->loop._for.range_end = arena_push_struct(ast_arena, expr_node);
-    instr->loop._for.range_end = parse_expr(p);
+    loop._for.range_end = parse_expr(p);
 
   } else if (kind == LOOP_WHILE) {
     parser_current(p, &token);
-    parse_rel(p, &instr->loop.conditional.break_condition);
+    parse_rel(p, &loop.conditional.break_condition);
   }
 
-  instr->loop.variables = ht_create(sizeof(variable));
-  dynamic_array_init(&instr->loop.instrs, sizeof(instr_node));
-
   parser_current(p, &token);
   if (token.kind != TOKEN_LBRACE) {
     const char *loop_type;
@@ -892,25 +911,28 @@ static void parse_loop(parser *p, instr_node *instr, loop_kind kind) {
       loop_type = "unconditional";
       break;
     }
-    scu_perror("no opening brace for %s loop at %d\n", loop_type, token.line);
+    scu_perror("no opening brace for %s loop at %d\n",
+               loop_type, parser_line(p, &token));
   }
 
   parser_advance(p);
   parser_current(p, &token);
 
+  u64 base = parser_begin_list(p);
   while (token.kind != TOKEN_RBRACE) {
-    instr_node *_instr = arena_push_struct(ast_arena, instr_node);
-    if (parse_instr(p, _instr))
-      dynamic_array_append(&instr->loop.instrs, _instr);
+    parse_instr_into_list(p);
     parser_current(p, &token);
   }
+  loop.instrs = parser_end_list(p, base);
 
   parser_advance(p);
 
   if (kind == LOOP_DO_WHILE) {
     parser_current(p, &token);
-    parse_rel(p, &instr->loop.conditional.break_condition);
+    parse_rel(p, &loop.conditional.break_condition);
   }
+
+  instr->loop = ast_add_loop(tree, &loop);
 }
 
 /*
@@ -923,22 +945,24 @@ static void parse_fn(parser *p, instr_node *instr) {
   token token = {0};
   parser_current(p, &token);
   instr->kind = INSTR_FN_DECLARE;
-  instr->line = token.line;
-  instr->fn_declare_node.kind = FN_DECLARED;
+  instr->line = parser_line(p, &token);
+  fn_node fn = {0};
+  fn.kind = FN_DECLARED;
 
   parser_advance(p);
   parser_current(p, &token);
-  instr->fn_declare_node.name = token.value.str;
+  fn.name = token.value.sym;
   parser_advance(p);
 
   parser_current(p, &token);
   if (token.kind != TOKEN_LPAREN) {
     scu_perror("Syntax error: expected '('\n");
+    instr->fn_declare_node = ast_add_fn(tree, &fn);
     return;
   }
   parser_advance(p);
 
-  dynamic_array_init(&instr->fn_declare_node.parameters, sizeof(variable));
+  u64 base = parser_begin_list(p);
 
   while (1) {
     parser_current(p, &token);
@@ -947,7 +971,7 @@ static void parse_fn(parser *p, instr_node *instr) {
     }
 
     if (token.kind == TOKEN_ELLIPSIS) {
-      instr->fn_declare_node.is_variadic = true;
+      fn.is_variadic = true;
       parser_advance(p);
       break;
     }
@@ -963,7 +987,9 @@ static void parse_fn(parser *p, instr_node *instr) {
       break;
     default:
       scu_perror("Expected type, got %s line %d\n",
-                 lexer_token_kind_to_str(token.kind), token.line);
+                 lexer_token_kind_to_str(token.kind), parser_line(p, &token));
+      fn.parameters = parser_end_list(p, base);
+      instr->fn_declare_node = ast_add_fn(tree, &fn);
       return;
     }
     parser_advance(p);
@@ -975,8 +1001,8 @@ static void parse_fn(parser *p, instr_node *instr) {
     }
 
     parser_current(p, &token);
-    param.name = token.value.str;
-    dynamic_array_append(&instr->fn_declare_node.parameters, &param);
+    param.name = token.value.sym;
+    parser_push_id(p, ast_add_var(tree, &param));
     parser_advance(p);
 
     parser_current(p, &token);
@@ -985,9 +1011,10 @@ static void parse_fn(parser *p, instr_node *instr) {
     }
   }
 
+  fn.parameters = parser_end_list(p, base);
   parser_advance(p);
 
-  dynamic_array_init(&instr->fn_declare_node.returntypes, sizeof(type));
+  base = parser_begin_list(p);
   parser_current(p, &token);
   if (token.kind == TOKEN_COLON) {
     parser_advance(p);
@@ -1004,7 +1031,7 @@ static void parse_fn(parser *p, instr_node *instr) {
       default:
         break;
       }
-      dynamic_array_append(&instr->fn_declare_node.returntypes, &ret_type);
+      parser_push_id(p, ret_type);
       parser_advance(p);
       parser_current(p, &token);
       if (token.kind == TOKEN_COMMA) {
@@ -1014,25 +1041,26 @@ static void parse_fn(parser *p, instr_node *instr) {
       }
     }
   }
+  fn.returntypes = parser_end_list(p, base);
 
   parser_current(p, &token);
   if (token.kind == TOKEN_LBRACE) {
     instr->kind = INSTR_FN_DEFINE;
-    instr->fn_define_node.kind = FN_DEFINED;
-    instr->fn_define_node.defined.variables = ht_create(sizeof(variable));
-    dynamic_array_init(&instr->fn_define_node.defined.instrs,
-                       sizeof(instr_node));
+    fn.kind = FN_DEFINED;
 
     parser_advance(p);
+    base = parser_begin_list(p);
     parser_current(p, &token);
     while (token.kind != TOKEN_RBRACE && token.kind != TOKEN_END) {
-      instr_node *_instr = arena_push_struct(ast_arena, instr_node);
-      if (parse_instr(p, _instr))
-        dynamic_array_append(&instr->fn_define_node.defined.instrs, _instr);
+      parse_instr_into_list(p);
       parser_current(p, &token);
     }
+    fn.defined.instrs = parser_end_list(p, base);
     parser_advance(p);
   }
+
+  // fn_define_node and fn_declare_node share the id
+  instr->fn_declare_node = ast_add_fn(tree, &fn);
 }
 
 /*
@@ -1045,16 +1073,15 @@ static void parse_ret(parser *p, instr_node *instr) {
   token token = {0};
   parser_current(p, &token);
   instr->kind = INSTR_RETURN;
-  instr->line = token.line;
-  dynamic_array_init(&instr->ret_node.returnvals, sizeof(expr_node));
+  instr->line = parser_line(p, &token);
 
   parser_advance(p);
 
   parser_current(p, &token);
 
+  u64 base = parser_begin_list(p);
   while (token.kind != TOKEN_RBRACE) {
-    expr_node *expr = parse_expr(p);
-    dynamic_array_append(&instr->ret_node.returnvals, expr);
+    parser_push_id(p, parse_expr(p));
 
     parser_current(p, &token);
 
@@ -1065,6 +1092,7 @@ static void parse_ret(parser *p, instr_node *instr) {
       break;
     }
   }
+  instr->ret_node.returnvals = parser_end_list(p, base);
 }
 
 /*
@@ -1115,12 +1143,12 @@ static bool parse_instr(parser *p, instr_node *instr) {
     return true;
   case TOKEN_BREAK:
     instr->kind = INSTR_LOOP_BREAK;
-    instr->line = token.line;
+    instr->line = parser_line(p, &token);
     parser_advance(p);
     return true;
   case TOKEN_CONTINUE:
     instr->kind = INSTR_LOOP_CONTINUE;
-    instr->line = token.line;
+    instr->line = parser_line(p, &token);
     parser_advance(p);
     return true;
   case TOKEN_FN:
@@ -1130,31 +1158,33 @@ static bool parse_instr(parser *p, instr_node *instr) {
     parse_ret(p, instr);
     return true;
   default:
-    scu_perror("unexpected token: %s - '%s' [line %d]\n",
-               lexer_token_kind_to_str(token.kind), token.value.str,
-               token.line);
+    scu_perror("unexpected token: %s - '%.*s' [line %d]\n",
+               lexer_token_kind_to_str(token.kind), (int)token.len,
+               source_map_text(p->sources, token.loc), parser_line(p, &token));
   }
 
   scu_check_errors();
   return false;
 }
 
-void parser_parse_program(dynamic_array *tokens, ast *program) {
-  ast_arena = &program->arena;
+void parser_parse_program(token_stream *tokens, source_map *sources,
+                          ast *program) {
+  tree = program;
   parser p;
-  parser_init(tokens, &p);
+  parser_init(tokens, sources, &p);
 
   token token = {0};
   parser_current(&p, &token);
 
+  u64 base = parser_begin_list(&p);
   while (token.kind != TOKEN_END) {
-    instr_node *instr = arena_push_struct(ast_arena, instr_node);
     scu_check_errors();
-    if (parse_instr(&p, instr))
-      dynamic_array_append(&program->instrs, instr);
+    parse_instr_into_list(&p);
 
     parser_current(&p, &token);
   }
+  program->body = parser_end_list(&p, base);
 
-  ast_arena = NULL;
+  dynamic_array_free(&p.scratch);
+  tree = NULL;
 }
@@ -0,0 +1,310 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "repl.h"
+#include "ast.h"
+#include "backend/backend.h"
+#include "common.h"
+#include "cstate.h"
+#include "ds/dynamic_array.h"
+#include "ds/scope_map.h"
+#include "ds/sym_map.h"
+#include "fstate.h"
+#include "lexer.h"
+#include "parser.h"
+#include "scan.h"
+#include "semantic.h"
+#include "utils.h"
+#include "var.h"
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * @struct repl_input: an input read from stdin. Its source and ast are kept
+ * for the whole session, the function table points into them.
+ */
+typedef struct repl_input {
+  fstate *fst;
+  char *buffer;
+} repl_input;
+
+/*
+ * @struct repl_session: what the inputs of a session share.
+ */
+typedef struct repl_session {
+  cstate *cst;
+  backend backend;
+
+  /*
+   * Variables and functions of every input so far, the top level variables
+   * in the outermost scope. Top level slots are never reused, next_slot is
+   * the first free one.
+   */
+  scope_map variables;
+  sym_map functions;
+  u32 next_slot;
+
+  /*
+   * Inputs read from stdin, an array of repl_input.
+   */
+  dynamic_array inputs;
+} repl_session;
+
+/*
+ * @struct repl_scan: where the scan of an input stopped at the end of a line,
+ * block comments span lines.
+ */
+typedef struct repl_scan {
+  i64 depth;
+  bool in_comment;
+} repl_scan;
+
+/*
+ * @brief: follow the braces of one line, skipping comments and literals.
+ */
+static void repl_scan_line(repl_scan *scan, const char *line) {
+  for (const char *p = line; *p; p++) {
+    if (scan->in_comment) {
+      // the comment ends at the first "*-", which may share the opening '*'
+      if (p[0] == '*' && p[1] == '-') {
+        scan->in_comment = false;
+        p++;
+      }
+      continue;
+    }
+
+    switch (*p) {
+    case '-':
+      if (p[1] == '-')
+        return;
+      if (p[1] == '*') {
+        scan->in_comment = true;
+        p++;
+      }
+      break;
+
+    case '"':
+    case '\'': {
+      char quote = *p;
+      for (p++; *p && *p != quote; p++) {
+        if (p[0] == '\\' && p[1])
+          p++;
+      }
+      if (!*p)
+        return;
+      break;
+    }
+
+    case '{':
+      scan->depth++;
+      break;
+
+    case '}':
+      scan->depth--;
+      break;
+
+    default:
+      break;
+    }
+  }
+}
+
+/*
+ * @brief: read one input from stdin: a line, and the lines after it for as
+ * long as the braces it opens are left open.
+ *
+ * @param interactive: whether stdin is a terminal, prompts are printed.
+ * @param len: length of the input.
+ *
+ * @return: the input followed by SCAN_PADDING zero bytes, NULL at the end of
+ * stdin or on :quit.
+ */
+static char *repl_read(bool interactive, u64 *len) {
+  repl_scan scan = {0};
+  char *input = NULL;
+  u64 input_len = 0;
+
+  char *line = NULL;
+  size_t line_cap = 0;
+  ssize_t n;
+
+  do {
+    if (interactive) {
+      fputs(input ? "...> " : "scl> ", stdout);
+      fflush(stdout);
+    }
+
+    if ((n = getline(&line, &line_cap, stdin)) < 0)
+      break;
+
+    if (!input && strncmp(line, ":quit", 5) == 0 &&
+        strspn(line + 5, " \t\r\n") == (size_t)n - 5)
+      break;
+
+    repl_scan_line(&scan, line);
+
+    input = scu_checked_realloc(input, input_len + n + SCAN_PADDING);
+    memcpy(input + input_len, line, n);
+    input_len += n;
+  } while (scan.depth > 0 || scan.in_comment);
+
+  free(line);
+
+  // leaves the terminal on a new line after ^D
+  if (n < 0 && interactive)
+    fputc('\n', stdout);
+
+  // the end of stdin in the middle of an input still runs what was read
+  if (!input)
+    return NULL;
+
+  memset(input + input_len, 0, SCAN_PADDING);
+  *len = input_len;
+  return input;
+}
+
+/*
+ * @brief: collect the functions an input declares or defines that the
+ * session does not know yet, to forget them again if the input fails.
+ */
+static void repl_new_functions(repl_session *repl, ast *program,
+                               dynamic_array *added) {
+  node_list body = program->body;
+
+  for (u64 i = 0; i < body.count; i++) {
+    instr_node *instr = ast_instr(program, ast_list(program, body)[i]);
+    if (instr->kind != INSTR_FN_DECLARE && instr->kind != INSTR_FN_DEFINE)
+      continue;
+
+    sym_id name = ast_fn(program, instr->fn_declare_node)->name;
+    if (!sym_map_get(&repl->functions, name))
+      dynamic_array_append(added, &name);
+  }
+}
+
+/*
+ * @brief: parse, check, compile and run one input. Its output, and the errors
+ * that drop it, are printed once it is done.
+ *
+ * @return: whether the input was added to the session.
+ */
+static bool repl_eval(repl_session *repl, fstate *fst) {
+  cstate *cst = repl->cst;
+
+  dynamic_array added;
+  dynamic_array_init(&added, sizeof(sym_id));
+  volatile bool ok = false;
+
+  u64 bound = repl->variables.count;
+  u32 next_slot = repl->next_slot;
+
+  scu_sink sink;
+  scu_sink_begin(&sink);
+
+  // scu_check_errors jumps back here instead of exiting while a sink is active
+  if (setjmp(sink.bail) == 0) {
+    token_stream tokens;
+    token_stream_init(&tokens, &fst->sources, 0, &cst->includes);
+    parser_parse_program(&tokens, &fst->sources, &fst->program_ast);
+    token_stream_free(&tokens);
+
+    if (cst->options.verbose)
+      print_ast(&fst->program_ast);
+
+    repl_new_functions(repl, &fst->program_ast, &added);
+    check_semantics_incremental(&fst->program_ast, &repl->variables,
+                                &repl->functions, &repl->next_slot);
+
+    repl->backend.compile(cst, fst);
+    scu_check_errors();
+
+    repl->backend.optimize(cst, fst);
+    ok = repl->backend.eval(cst, fst);
+  }
+
+  repl->backend.cleanup(cst, fst);
+
+  scu_sink_end();
+  scu_sink_flush(&sink);
+
+  // a dropped input leaves nothing behind: its variables are unbound, their
+  // slots reused, and its functions can be defined again
+  if (!ok) {
+    scope_map_truncate(&repl->variables, bound);
+    repl->next_slot = next_slot;
+
+    for (u64 i = 0; i < added.count; i++) {
+      sym_id name;
+      dynamic_array_get(&added, i, &name);
+      sym_map_remove(&repl->functions, name);
+    }
+  }
+
+  dynamic_array_free(&added);
+  return ok;
+}
+
+int repl_run(cstate *cst) {
+  repl_session repl = {.cst = cst, .next_slot = 1};
+
+  backend_init(&repl.backend, cst);
+  scu_check_errors();
+
+  scope_map_init(&repl.variables, sizeof(variable));
+  sym_map_init(&repl.functions, sizeof(fn_ref));
+  dynamic_array_init(&repl.inputs, sizeof(repl_input));
+
+  // the input files are loaded first, in order
+  for (u64 i = 0; i < cst->files.count; i++) {
+    fstate *fst;
+    dynamic_array_get(&cst->files, i, &fst);
+    repl_eval(&repl, fst);
+  }
+
+  bool interactive = isatty(STDIN_FILENO);
+  if (interactive)
+    printf("scull repl, :quit or end of input to leave\n");
+
+  u64 len;
+  char *buffer;
+  while ((buffer = repl_read(interactive, &len)) != NULL) {
+    if (strspn(buffer, " \t\r\n") == len) {
+      free(buffer);
+      continue;
+    }
+
+    repl_input input = {
+        .fst = scu_checked_malloc(sizeof(fstate)),
+        .buffer = buffer,
+    };
+
+    char *name = scu_format_string("<input %lu>", repl.inputs.count + 1);
+    fstate_init_buffer(input.fst, name, buffer, len);
+    free(name);
+
+    dynamic_array_append(&repl.inputs, &input);
+    repl_eval(&repl, input.fst);
+  }
+
+  // the JIT goes first, nothing it runs is left to point into the inputs
+  repl.backend.eval_end(cst);
+  backend_free(&repl.backend);
+
+  for (u64 i = 0; i < repl.inputs.count; i++) {
+    repl_input input;
+    dynamic_array_get(&repl.inputs, i, &input);
+    fstate_free(input.fst);
+    free(input.fst);
+    free(input.buffer);
+  }
+  dynamic_array_free(&repl.inputs);
+
+  scope_map_free(&repl.variables);
+  sym_map_free(&repl.functions);
+
+  cstate_free(cst);
+  return 0;
+}
@@ -0,0 +1,333 @@
+#include "scan.h"
+#include "common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__SSE2__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#else
+#define SCAN_X86 0
+#endif
+
+/*
+ * Character classes of the portable implementation and of the first byte
+ * checks in the wrappers.
+ */
+#define SCAN_SPACE 1
+#define SCAN_IDENT 2
+#define SCAN_STRING_STOP 4
+
+static const u8 scan_class[256] = {
+    [' '] = SCAN_SPACE,
+    ['\t'] = SCAN_SPACE,
+    ['\n'] = SCAN_SPACE,
+    ['\v'] = SCAN_SPACE,
+    ['\f'] = SCAN_SPACE,
+    ['\r'] = SCAN_SPACE,
+    ['0' ... '9'] = SCAN_IDENT,
+    ['a' ... 'z'] = SCAN_IDENT,
+    ['A' ... 'Z'] = SCAN_IDENT,
+    ['_'] = SCAN_IDENT,
+    ['"'] = SCAN_STRING_STOP,
+    ['\\'] = SCAN_STRING_STOP,
+    ['\0'] = SCAN_STRING_STOP,
+};
+
+/*
+ * @struct scan_impl: one implementation of the scanning functions.
+ */
+typedef struct scan_impl {
+  const char *name;
+  u64 (*whitespace)(const char *buf, u64 pos);
+  u64 (*ident)(const char *buf, u64 pos);
+  u64 (*string)(const char *buf, u64 pos);
+  u64 (*count_newlines)(const char *buf, u64 len);
+  void (*line_starts)(const char *buf, u64 len, u32 *starts);
+} scan_impl;
+
+/*
+ * Portable implementation.
+ */
+
+static u64 scan_class_run(const char *buf, u64 pos, u8 class) {
+  while (scan_class[(u8)buf[pos]] & class)
+    pos++;
+  return pos;
+}
+
+static u64 scan_whitespace_portable(const char *buf, u64 pos) {
+  return scan_class_run(buf, pos, SCAN_SPACE);
+}
+
+static u64 scan_ident_portable(const char *buf, u64 pos) {
+  return scan_class_run(buf, pos, SCAN_IDENT);
+}
+
+static u64 scan_string_portable(const char *buf, u64 pos) {
+  while (!(scan_class[(u8)buf[pos]] & SCAN_STRING_STOP))
+    pos++;
+  return pos;
+}
+
+static u64 scan_count_newlines_portable(const char *buf, u64 len) {
+  u64 count = 0;
+  for (u64 i = 0; i < len; i++)
+    count += buf[i] == '\n';
+  return count;
+}
+
+static void scan_line_starts_portable(const char *buf, u64 len, u32 *starts) {
+  for (u64 i = 0; i < len; i++)
+    if (buf[i] == '\n')
+      *starts++ = i + 1;
+}
+
+static const scan_impl scan_portable = {
+    .name = "portable",
+    .whitespace = scan_whitespace_portable,
+    .ident = scan_ident_portable,
+    .string = scan_string_portable,
+    .count_newlines = scan_count_newlines_portable,
+    .line_starts = scan_line_starts_portable,
+};
+
+#if SCAN_X86
+
+/*
+ * SSE2, 16 bytes per step. Ranges are tested with signed compares, bytes
+ * >= 0x80 are negative and fall outside every ASCII range.
+ */
+
+static inline __m128i sse2_in_range(__m128i v, char lo, char hi) {
+  return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+                       _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1)));
+}
+
+static inline u32 sse2_whitespace_mask(__m128i v) {
+  __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                            sse2_in_range(v, '\t', '\r'));
+  return (u32)_mm_movemask_epi8(ws);
+}
+
+static inline u32 sse2_ident_mask(__m128i v) {
+  __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+  __m128i id = _mm_or_si128(sse2_in_range(lower, 'a', 'z'),
+                            sse2_in_range(v, '0', '9'));
+  id = _mm_or_si128(id, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+  return (u32)_mm_movemask_epi8(id);
+}
+
+static inline u32 sse2_string_stop_mask(__m128i v) {
+  __m128i stop = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                              _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+  stop = _mm_or_si128(stop, _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+  return (u32)_mm_movemask_epi8(stop);
+}
+
+static inline u32 sse2_newline_mask(__m128i v) {
+  return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+}
+
+static inline __m128i sse2_load(const char *p) {
+  return _mm_loadu_si128((const __m128i *)p);
+}
+
+static u64 scan_whitespace_sse2(const char *buf, u64 pos) {
+  for (;; pos += 16) {
+    u32 stop = ~sse2_whitespace_mask(sse2_load(buf + pos)) & 0xFFFF;
+    if (stop)
+      return pos + __builtin_ctz(stop);
+  }
+}
+
+static u64 scan_ident_sse2(const char *buf, u64 pos) {
+  for (;; pos += 16) {
+    u32 stop = ~sse2_ident_mask(sse2_load(buf + pos)) & 0xFFFF;
+    if (stop)
+      return pos + __builtin_ctz(stop);
+  }
+}
+
+static u64 scan_string_sse2(const char *buf, u64 pos) {
+  for (;; pos += 16) {
+    u32 stop = sse2_string_stop_mask(sse2_load(buf + pos));
+    if (stop)
+      return pos + __builtin_ctz(stop);
+  }
+}
+
+// the last vector reaches into the padding, which holds no newlines
+static u64 scan_count_newlines_sse2(const char *buf, u64 len) {
+  u64 count = 0;
+  for (u64 i = 0; i < len; i += 16)
+    count += __builtin_popcount(sse2_newline_mask(sse2_load(buf + i)));
+  return count;
+}
+
+static void scan_line_starts_sse2(const char *buf, u64 len, u32 *starts) {
+  for (u64 i = 0; i < len; i += 16) {
+    for (u32 m = sse2_newline_mask(sse2_load(buf + i)); m; m &= m - 1)
+      *starts++ = i + __builtin_ctz(m) + 1;
+  }
+}
+
+static const scan_impl scan_sse2 = {
+    .name = "sse2",
+    .whitespace = scan_whitespace_sse2,
+    .ident = scan_ident_sse2,
+    .string = scan_string_sse2,
+    .count_newlines = scan_count_newlines_sse2,
+    .line_starts = scan_line_starts_sse2,
+};
+
+/*
+ * AVX2, 32 bytes per step.
+ */
+
+#define SCAN_AVX2 __attribute__((target("avx2")))
+
+static SCAN_AVX2 inline __m256i avx2_in_range(__m256i v, char lo, char hi) {
+  return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)),
+                          _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v));
+}
+
+static SCAN_AVX2 inline u32 avx2_whitespace_mask(__m256i v) {
+  __m256i ws = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                               avx2_in_range(v, '\t', '\r'));
+  return (u32)_mm256_movemask_epi8(ws);
+}
+
+static SCAN_AVX2 inline u32 avx2_ident_mask(__m256i v) {
+  __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+  __m256i id = _mm256_or_si256(avx2_in_range(lower, 'a', 'z'),
+                               avx2_in_range(v, '0', '9'));
+  id = _mm256_or_si256(id, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+  return (u32)_mm256_movemask_epi8(id);
+}
+
+static SCAN_AVX2 inline u32 avx2_string_stop_mask(__m256i v) {
+  __m256i stop = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')),
+                                 _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+  stop = _mm256_or_si256(stop, _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+  return (u32)_mm256_movemask_epi8(stop);
+}
+
+static SCAN_AVX2 inline u32 avx2_newline_mask(__m256i v) {
+  return (u32)_mm256_movemask_epi8(
+      _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+}
+
+static SCAN_AVX2 inline __m256i avx2_load(const char *p) {
+  return _mm256_loadu_si256((const __m256i *)p);
+}
+
+static SCAN_AVX2 u64 scan_whitespace_avx2(const char *buf, u64 pos) {
+  for (;; pos += 32) {
+    u32 stop = ~avx2_whitespace_mask(avx2_load(buf + pos));
+    if (stop)
+      return pos + __builtin_ctz(stop);
+  }
+}
+
+static SCAN_AVX2 u64 scan_ident_avx2(const char *buf, u64 pos) {
+  for (;; pos += 32) {
+    u32 stop = ~avx2_ident_mask(avx2_load(buf + pos));
+    if (stop)
+      return pos + __builtin_ctz(stop);
+  }
+}
+
+static SCAN_AVX2 u64 scan_string_avx2(const char *buf, u64 pos) {
+  for (;; pos += 32) {
+    u32 stop = avx2_string_stop_mask(avx2_load(buf + pos));
+    if (stop)
+      return pos + __builtin_ctz(stop);
+  }
+}
+
+static SCAN_AVX2 u64 scan_count_newlines_avx2(const char *buf, u64 len) {
+  u64 count = 0;
+  for (u64 i = 0; i < len; i += 32)
+    count += __builtin_popcount(avx2_newline_mask(avx2_load(buf + i)));
+  return count;
+}
+
+static SCAN_AVX2 void scan_line_starts_avx2(const char *buf, u64 len,
+                                            u32 *starts) {
+  for (u64 i = 0; i < len; i += 32) {
+    for (u32 m = avx2_newline_mask(avx2_load(buf + i)); m; m &= m - 1)
+      *starts++ = i + __builtin_ctz(m) + 1;
+  }
+}
+
+#undef SCAN_AVX2
+
+static const scan_impl scan_avx2 = {
+    .name = "avx2",
+    .whitespace = scan_whitespace_avx2,
+    .ident = scan_ident_avx2,
+    .string = scan_string_avx2,
+    .count_newlines = scan_count_newlines_avx2,
+    .line_starts = scan_line_starts_avx2,
+};
+
+static const scan_impl *impl = &scan_sse2;
+
+#else
+
+static const scan_impl *impl = &scan_portable;
+
+#endif
+
+void scan_init() {
+  // SCLC_SCAN=portable|sse2 forces a slower implementation, for comparisons
+  const char *force = getenv("SCLC_SCAN");
+  if (force && strcmp(force, "portable") == 0) {
+    impl = &scan_portable;
+    return;
+  }
+
+#if SCAN_X86
+  if (force && strcmp(force, "sse2") == 0) {
+    impl = &scan_sse2;
+    return;
+  }
+
+  __builtin_cpu_init();
+  impl = __builtin_cpu_supports("avx2") ? &scan_avx2 : &scan_sse2;
+#endif
+}
+
+const char *scan_isa() { return impl->name; }
+
+u64 scan_whitespace(const char *buf, u64 pos) {
+  // most gaps between tokens are a single space, don't set up vectors for it
+  if (!(scan_class[(u8)buf[pos]] & SCAN_SPACE))
+    return pos;
+  if (!(scan_class[(u8)buf[pos + 1]] & SCAN_SPACE))
+    return pos + 1;
+  return impl->whitespace(buf, pos);
+}
+
+u64 scan_ident(const char *buf, u64 pos) { return impl->ident(buf, pos); }
+
+u64 scan_until(const char *buf, u64 pos, u64 len, char c) {
+  if (pos >= len)
+    return len;
+
+  // libc's memchr is already vectorized
+  const char *found = memchr(buf + pos, c, len - pos);
+  return found ? (u64)(found - buf) : len;
+}
+
+u64 scan_string(const char *buf, u64 pos) { return impl->string(buf, pos); }
+
+u64 scan_count_newlines(const char *buf, u64 len) {
+  return impl->count_newlines(buf, len);
+}
+
+void scan_line_starts(const char *buf, u64 len, u32 *starts) {
+  impl->line_starts(buf, len, starts);
+}
@@ -18,88 +18,373 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "backend/backend.h"
 #include "cstate.h"
+#include "ds/arena.h"
 #include "ds/dynamic_array.h"
 #include "fstate.h"
+#include "intern.h"
 #include "lexer.h"
+#include "memstat.h"
+#include "obj_cache.h"
 #include "parser.h"
+#include "repl.h"
+#include "scan.h"
 #include "semantic.h"
+#include "server.h"
+#include "timing.h"
+#include "tpool.h"
 #include "utils.h"
 
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
-int main(int argc, char *argv[]) {
-  // Initialize compiler state
-  cstate cst = {0};
-  cstate_init(&cst, (u32)argc, argv);
+/*
+ * @struct cached_artifact: an output of a file kept in the object cache.
+ */
+typedef struct cached_artifact {
+  obj_cache_kind kind;
+  char *path; // where the build writes it
+  char key[OBJ_CACHE_KEY_LEN];
+  char *entry; // the cached copy, NULL on a miss
+} cached_artifact;
+
+/*
+ * @brief: kind of the bitcode of a file, which -flto optimizes differently.
+ */
+static obj_cache_kind bitcode_kind(lto_mode lto) {
+  switch (lto) {
+  case LTO_NONE:
+    return OBJ_CACHE_BITCODE;
+  case LTO_FULL:
+    return OBJ_CACHE_BITCODE_FULL_LTO;
+  case LTO_THIN:
+    return OBJ_CACHE_BITCODE_THIN_LTO;
+  }
+
+  return OBJ_CACHE_BITCODE;
+}
+
+/*
+ * @brief: list the outputs of a file that are looked up in the object cache:
+ * its object (bitcode with -flto) and its .bc. Files are not looked up at
+ * all if IR or assembly is emitted, or with --run, which needs the module.
+ *
+ * @return: number of artifacts, 0 if the file is not cached.
+ */
+static u32 cached_artifacts(cstate *cst, fstate *fst, u64 index,
+                            cached_artifact artifacts[2]) {
+  u32 emit = cst->options.emit;
+  if (cst->cache.dir == NULL || (emit & (EMIT_LL | EMIT_ASM)) ||
+      cst->options.run)
+    return 0;
+
+  u32 count = 0;
+
+  if (emit & EMIT_OBJ) {
+    char *obj;
+    dynamic_array_get(&cst->obj_file_list, index, &obj);
+
+    artifacts[count++] = (cached_artifact){
+        .kind = cst->options.lto == LTO_NONE ? OBJ_CACHE_OBJECT
+                                             : bitcode_kind(cst->options.lto),
+        .path = strdup(obj),
+    };
+  }
+
+  if (emit & EMIT_BC) {
+    artifacts[count++] = (cached_artifact){
+        .kind = bitcode_kind(cst->options.lto),
+        .path = scu_format_string("%s.bc", fst->extracted_filepath),
+    };
+  }
+
+  return count;
+}
+
+/*
+ * @brief: use the cached copy of an artifact instead of building it. Objects
+ * that are linked are linked straight from the cache, everything else is
+ * copied to where the build would have written it.
+ */
+static void use_cached(cstate *cst, u64 index, cached_artifact *artifact) {
+  char *obj;
+  dynamic_array_get(&cst->obj_file_list, index, &obj);
+
+  bool linked = !cst->options.compile_only && strcmp(artifact->path, obj) == 0;
+  if (linked) {
+    dynamic_array_set(&cst->obj_file_list, index, &artifact->entry);
+    cstate_free_obj(obj);
+  } else {
+    if (!obj_cache_copy(artifact->entry, artifact->path))
+      scu_perror("Could not write %s\n", artifact->path);
+    free(artifact->entry);
+  }
+
+  free(artifact->path);
+}
+
+/*
+ * @brief: run the whole pipeline (lexing to object emission) for one file.
+ *
+ * @param cst: pointer to the compiler state.
+ * @param backend: pointer to an initialized backend.
+ * @param index: index of the file (and of its object in obj_file_list).
+ */
+static void compile_file(cstate *cst, backend *backend, u64 index) {
+  fstate *fst;
+  dynamic_array_get(&cst->files, index, &fst);
+  timing_begin_file(index, fst->filepath);
+
+  // Lexing debug statements, from a separate pass over the tokens
+  if (cst->options.verbose) {
+    scu_pdebug("Lexing Debug Statements for %s:\n", fst->filepath);
+
+    token_stream ts;
+    token_stream_init(&ts, &fst->sources, 0, &cst->includes);
+    token token;
+    do {
+      token = token_stream_next(&ts);
+      lexer_print_token(&token, &fst->sources);
+    } while (token.kind != TOKEN_END);
+    token_stream_free(&ts);
+  }
+
+  // Lexing and parsing, tokens are lexed as the parser asks for them and the
+  // lexer times itself out of the parse phase
+  u64 start = timing_phase_begin(PHASE_PARSE);
+  token_stream tokens;
+  token_stream_init(&tokens, &fst->sources, 0, &cst->includes);
+  parser_parse_program(&tokens, &fst->sources, &fst->program_ast);
+  token_stream_free(&tokens);
+  timing_phase_end(PHASE_PARSE, start);
+
+  // Parsing debug statements
+  if (cst->options.verbose) {
+    scu_pdebug("Parsing Debug Statements for %s:\n", fst->filepath);
+    print_ast(&fst->program_ast);
+  }
+
+  // Semantic Analysis
+  start = timing_phase_begin(PHASE_SEMANTIC);
+  check_semantics(&fst->program_ast, &fst->variables, &fst->functions);
+  timing_phase_end(PHASE_SEMANTIC, start);
+
+  // Semantic Debug Statement
+  if (cst->options.verbose)
+    scu_pdebug("Semantic Analysis Complete for %s\n", fst->filepath);
+
+  // Object cache, looked up once the sources (and so the keys) are known.
+  // Objects and bitcode are cached, the file is only compiled if one of them
+  // is missing
+  cached_artifact artifacts[2];
+  u32 count = cached_artifacts(cst, fst, index, artifacts);
+  bool hit = count > 0;
+
+  for (u32 i = 0; i < count; i++) {
+    cached_artifact *artifact = &artifacts[i];
+    u32 partitions =
+        artifact->kind == OBJ_CACHE_OBJECT ? cst->options.codegen_threads : 1;
+
+    obj_cache_key(&cst->cache, &fst->sources, cst->llvm_target_triple,
+                  cst->options.opt_level, partitions, artifact->kind,
+                  artifact->key);
+    artifact->entry = obj_cache_lookup(&cst->cache, artifact->key);
+    hit = hit && artifact->entry;
+  }
+
+  if (hit) {
+    for (u32 i = 0; i < count; i++)
+      use_cached(cst, index, &artifacts[i]);
 
+    if (cst->options.verbose)
+      scu_psuccess("CACHED %s\n", fst->filepath);
+    timing_end_file();
+    return;
+  }
+
+  // Initiate backend compilation
+  backend_compile(backend, cst, fst);
+
+  // Codegen Debug Statements
+  if (cst->options.verbose)
+    scu_pdebug("Codegen Complete for %s\n", fst->filepath);
+
+  scu_check_errors();
+  for (u32 i = 0; i < count; i++) {
+    obj_cache_store(&cst->cache, artifacts[i].key, artifacts[i].path);
+    free(artifacts[i].entry);
+    free(artifacts[i].path);
+  }
+
+  if (cst->options.verbose)
+    scu_psuccess("COMPILED %s\n", fst->filepath);
+  timing_end_file();
+}
+
+/*
+ * @struct compile_jobs: shared state of a parallel (-j) compilation.
+ */
+typedef struct compile_jobs {
+  cstate *cst;
+  backend *backend;
+
+  /*
+   * One sink per file, output is replayed in input order after all jobs are
+   * done.
+   */
+  scu_sink *sinks;
+} compile_jobs;
+
+/*
+ * @brief: tpool job compiling the index-th input file into its own sink.
+ */
+static void compile_job(void *ctx, u64 index) {
+  compile_jobs *jobs = ctx;
+  scu_sink *sink = &jobs->sinks[index];
+
+  scu_sink_begin(sink);
+
+  // scu_check_errors jumps back here instead of exiting while a sink is active
+  if (setjmp(sink->bail) == 0)
+    compile_file(jobs->cst, jobs->backend, index);
+
+  scu_sink_end();
+  arena_scratch_release();
+}
+
+/*
+ * @brief: compile (and link, or run) the files of an initialized compiler
+ * state, then free it.
+ *
+ * @param cst: pointer to the compiler state.
+ *
+ * @return: exit status, the program's with --run
+ */
+static int build(cstate *cst) {
   backend backend;
-  backend_init(&backend, &cst);
+  backend_init(&backend, cst);
+  scu_check_errors();
 
-  clock_t start, end;
+  // wall clock, clock() would sum the cpu time of all -j workers
+  struct timespec start, end;
   double time_taken;
-  start = clock();
+  clock_gettime(CLOCK_MONOTONIC, &start);
 
-  for (u64 i = 0; i < cst.files.count; i++) {
-    fstate *fst;
-    dynamic_array_get(&cst.files, i, &fst);
+  if (cst->options.jobs > 1 && cst->files.count > 1) {
+    compile_jobs jobs = {
+        .cst = cst,
+        .backend = &backend,
+        .sinks = scu_checked_malloc(cst->files.count * sizeof(scu_sink)),
+    };
 
-    // Lexing
-    lexer_tokenize(fst->code_buffer, fst->code_buffer_len, &fst->tokens,
-                   cst.include_dir);
+    tpool_run(cst->options.jobs, cst->files.count, compile_job, &jobs);
 
-    // Lexing debug statements
-    if (cst.options.verbose) {
-      scu_pdebug("Lexing Debug Statements for %s:\n", fst->filepath);
-      lexer_print_tokens(&fst->tokens);
-    }
+    for (u64 i = 0; i < cst->files.count; i++)
+      scu_sink_flush(&jobs.sinks[i]);
 
-    // Parsing
-    parser_parse_program(&fst->tokens, &fst->program_ast);
+    free(jobs.sinks);
+    scu_check_errors();
+  } else {
+    for (u64 i = 0; i < cst->files.count; i++)
+      compile_file(cst, &backend, i);
+  }
 
-    // Parsing debug statements
-    if (cst.options.verbose) {
-      scu_pdebug("Parsing Debug Statements for %s:\n", fst->filepath);
-      print_ast(&fst->program_ast);
-    }
+  // the program runs outside of any phase, what it prints follows the
+  // compiler's output
+  int status = 0;
+  if (cst->options.run) {
+    status = backend.run(cst);
+  } else if (!(cst->options.compile_only)) {
+    u64 link_start = timing_phase_begin(PHASE_LINK);
+    backend.link(cst);
+    timing_phase_end(PHASE_LINK, link_start);
+  }
 
-    // Semantic Analysis
-    check_semantics(&fst->program_ast.instrs, &fst->variables, &fst->functions);
+  backend_free(&backend);
+
+  if (cst->options.cache_stats)
+    obj_cache_print_stats(&cst->cache);
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  time_taken =
+      (double)(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
 
-    // Semantic Debug Statement
-    if (cst.options.verbose)
-      scu_pdebug("Semantic Analysis Complete for %s\n", fst->filepath);
+  if (cst->options.verbose && !cst->options.compile_only &&
+      !cst->options.run)
+    scu_psuccess("  LINKED %s - %.2fs total time taken\n", cst->output_filepath,
+                 time_taken);
+  else if (cst->options.verbose)
+    scu_psuccess("    DONE - %.2fs total time taken\n", time_taken);
+
+  timing_finish();
+  memstat_report(cst->options.mem_report_path);
 
-    // Initiate backend compilation
-    backend_compile(&backend, &cst, fst);
+  cstate_free(cst);
+  return status;
+}
 
-    // Codegen Debug Statements
-    if (cst.options.verbose)
-      scu_pdebug("Codegen Complete for %s\n", fst->filepath);
+/*
+ * @brief: server_handler running a request of --client in a worker forked
+ * from the server, with the interner, scanner and LLVM targets already
+ * initialized.
+ */
+static int serve(u32 argc, char *argv[]) {
+  cstate cst = {0};
+  cstate_init(&cst, argc, argv);
 
-    if (cst.options.verbose)
-      scu_psuccess("COMPILED %s\n", fst->filepath);
+  if (cst.options.server) {
+    scu_perror("--server cannot be forwarded to a server\n");
+    return 1;
   }
 
-  if (!(cst.options.compile_only))
-    backend.link(&cst);
+  return build(&cst);
+}
 
-  backend_free(&backend);
+int main(int argc, char *argv[]) {
+  // --client hands the command line to a running server, or compiles here if
+  // there is none
+  if (argc > 1 && strcmp(argv[1], "--client") == 0) {
+    argv[1] = argv[0];
+    argv++;
+    argc--;
 
-  if (cst.options.emit_llvm || cst.options.emit_asm) {
-    cstate_free(&cst);
-    return 0;
+    char *socket_path = server_socket_path(argc, argv);
+    int status = server_forward(socket_path, argc, argv);
+    free(socket_path);
+
+    if (status >= 0)
+      return status;
   }
 
-  end = clock();
-  time_taken = (double)(end - start) / CLOCKS_PER_SEC;
+  // Identifiers of all files share one interner
+  intern_init();
+  scan_init();
 
-  if (cst.options.verbose)
-    scu_psuccess("  LINKED %s - %.2fs total time taken\n", cst.output_filepath,
-                 time_taken);
+  // Initialize compiler state
+  cstate cst = {0};
+  cstate_init(&cst, (u32)argc, argv);
+
+  if (cst.options.server) {
+    // targets are initialized once, every request is forked from here
+    backend backend;
+    backend_init(&backend, &cst);
+    scu_check_errors();
+
+    int status = server_run(cst.options.socket_path, serve);
+
+    backend_free(&backend);
+    cstate_free(&cst);
+    intern_free();
+    return status;
+  }
 
-  cstate_free(&cst);
+  int status = cst.options.repl ? repl_run(&cst) : build(&cst);
+  intern_free();
 
-  return 0;
+  return status;
 }
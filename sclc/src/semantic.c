@@ -1,7 +1,8 @@
 #include "semantic.h"
 #include "ast.h"
-#include "ds/dynamic_array.h"
-#include "ds/ht.h"
+#include "ds/scope_map.h"
+#include "ds/sym_map.h"
+#include "intern.h"
 #include "utils.h"
 #include "var.h"
 
@@ -10,47 +11,50 @@
 #define _POSIX_C_SOURCE 200809L
 #include <string.h>
 
-u32 evaluate_const_expr(expr_node *expr) {
-  if (expr == NULL) {
+u32 evaluate_const_expr(ast *program_ast, expr_id id) {
+  if (id == 0) {
     return 0;
   }
 
+  expr_node *expr = ast_expr(program_ast, id);
   switch (expr->kind) {
-  case EXPR_TERM:
-    if (expr->term.kind == TERM_INT) {
-      return expr->term.value.integer;
+  case EXPR_TERM: {
+    term_node *term = ast_term(program_ast, expr->term);
+    if (term->kind == TERM_INT) {
+      return term->value.integer;
     }
     scu_perror("Array size must be a constant expression\n");
     return 0;
+  }
 
   case EXPR_ADD:
-    return evaluate_const_expr(expr->binary.left) +
-           evaluate_const_expr(expr->binary.right);
+    return evaluate_const_expr(program_ast, expr->binary.left) +
+           evaluate_const_expr(program_ast, expr->binary.right);
 
   case EXPR_SUBTRACT:
-    return evaluate_const_expr(expr->binary.left) -
-           evaluate_const_expr(expr->binary.right);
+    return evaluate_const_expr(program_ast, expr->binary.left) -
+           evaluate_const_expr(program_ast, expr->binary.right);
 
   case EXPR_MULTIPLY:
-    return evaluate_const_expr(expr->binary.left) *
-           evaluate_const_expr(expr->binary.right);
+    return evaluate_const_expr(program_ast, expr->binary.left) *
+           evaluate_const_expr(program_ast, expr->binary.right);
 
   case EXPR_DIVIDE: {
-    u32 right = evaluate_const_expr(expr->binary.right);
+    u32 right = evaluate_const_expr(program_ast, expr->binary.right);
     if (right == 0) {
       scu_perror("Division by zero in array size\n");
       return 0;
     }
-    return evaluate_const_expr(expr->binary.left) / right;
+    return evaluate_const_expr(program_ast, expr->binary.left) / right;
   }
 
   case EXPR_MODULO: {
-    u32 right = evaluate_const_expr(expr->binary.right);
+    u32 right = evaluate_const_expr(program_ast, expr->binary.right);
     if (right == 0) {
       scu_perror("Division by zero in array size\n");
       return 0;
     }
-    return evaluate_const_expr(expr->binary.left) % right;
+    return evaluate_const_expr(program_ast, expr->binary.left) % right;
   }
   }
 }
@@ -71,368 +75,168 @@ static const char *type_to_str(type type) {
   case TYPE_VOID:
     return "void";
   }
+
+  // the type of what could not be resolved (-1)
+  return "unknown";
 }
 
 /*
  * @brief: check function call validity (declaration)
  *
  * @param fn_call: pointer to the function call node.
- * @param functions: pointer to the functions hash table.
- * @param variables: pointer to the variables hash table (for argument
+ * @param functions: pointer to the functions symbol table.
+ * @param variables: pointer to the variables scope_map (for argument
  * expressions).
  * @param line: line number of the function call.
  */
-static void check_function_call(fn_call_node *fn_call, ht *functions,
-                                ht *variables, u64 line);
+static void check_function_call(fn_call_node *fn_call, sym_map *functions,
+                                scope_map *variables, u64 line);
 
 /*
- * @brief: check for types in an instr_node (declaration)
+ * @brief: check return statement validity within a function (declaration)
  *
- * @param instr: pointer to an instr_node.
- * @param variables: pointer to the variables hash table.
- */
-static void instr_typecheck(instr_node *instr, ht *variables, ht *functions);
-
-/*
- * @brief: running stack offset counter for allocating variables and arrays.
+ * @param ret: pointer to the return node.
+ * @param fn: pointer to the containing function node.
+ * @param variables: pointer to the variables scope_map.
+ * @param line: line number of the return statement.
  */
-static u64 current_stack_offset = 0;
+static void check_return_statement(return_node *ret, fn_node *fn,
+                                   scope_map *variables, sym_map *functions,
+                                   u64 line);
 
 /*
- * @brief: insert a new variable into the variables hash table.
+ * @brief: check an instr_node (declaration)
  *
- * @param var_to_declare: the variable struct to append.
- * @param variables: pointer to the variables hash table.
+ * @param instr: pointer to an instr_node.
+ * @param variables: pointer to the variables scope_map.
+ * @param functions: pointer to the functions symbol table.
  */
-static void declare_variables(variable *var_to_declare, ht *variables) {
-  if (!var_to_declare || !var_to_declare->name || !variables)
-    return;
-
-  variable *var = ht_search(variables, var_to_declare->name);
-  if (var)
-    return;
-
-  var_to_declare->stack_offset = current_stack_offset;
-  current_stack_offset += 1;
-  ht_insert(variables, var_to_declare->name, var_to_declare);
-}
+static void instr_check(instr_node *instr, scope_map *variables,
+                        sym_map *functions);
 
 /*
- * @brief: insert a new array into the variables hash table.
- *
- * @param var_to_declare: the variable struct to append.
- * @param variables: pointer to the variables hash table.
+ * @brief: next free local slot of the function being checked, slot 0 is left
+ * for unresolved variables.
  */
-static void declare_array(variable *arr_to_declare, expr_node *size_expr,
-                          ht *variables) {
-  if (!arr_to_declare || !arr_to_declare->name || !variables)
-    return;
-
-  variable *var = ht_search(variables, arr_to_declare->name);
-  if (var)
-    return;
-
-  u32 array_size = evaluate_const_expr(size_expr);
-  u64 size_bytes = array_size * 4;
-  arr_to_declare->stack_offset = current_stack_offset;
-  current_stack_offset += size_bytes;
-
-  ht_insert(variables, arr_to_declare->name, arr_to_declare);
-}
+static _Thread_local u32 current_slot = 1;
 
 /*
- * @brief: check variables in terms
- *
- * @param term: pointer to a term_node.
- * @param variables: pointer to the variables hash table.
- * @param functions: pointer to the functions hash table.
+ * @brief: the function whose body is being checked, NULL at the top level.
  */
-static void term_check_variables(term_node *term, ht *variables,
-                                 ht *functions) {
-
-  switch (term->kind) {
-  case TERM_IDENTIFIER:
-    variable *var = ht_search(variables, term->identifier.name);
-    if (!var) {
-      scu_perror("Use of undeclared variable: %s [line %u]\n",
-                 term->identifier.name, term->identifier.line);
-    }
-    break;
-
-  case TERM_FUNCTION_CALL:
-    check_function_call(&term->fn_call, functions, variables, term->line);
-    break;
-
-  default:
-    break;
-  }
-}
+static _Thread_local fn_node *current_fn = NULL;
 
 /*
- * @brief: check variables in expressions
- *
- * @param expr: pointer to an expr_node.
- * @param variables: pointer to the variables hash table.
- * @param functions: pointer to the functions hash table.
+ * @brief: the ast being checked, expressions and lists are resolved in it.
  */
-static void expr_check_variables(expr_node *expr, ht *variables,
-                                 ht *functions) {
-  switch (expr->kind) {
-  case EXPR_TERM:
-    term_check_variables(&expr->term, variables, functions);
-    break;
-  case EXPR_ADD:
-  case EXPR_SUBTRACT:
-  case EXPR_MULTIPLY:
-  case EXPR_DIVIDE:
-  case EXPR_MODULO:
-    expr_check_variables(expr->binary.left, variables, functions);
-    expr_check_variables(expr->binary.right, variables, functions);
-    break;
-  }
-}
+static _Thread_local ast *tree = NULL;
 
 /*
- * @brief: check variables in relational expressions
+ * @brief: insert a new variable into the variables scope_map.
  *
- * @param rel: pointer to a rel_node.
- * @param variables: pointer to the variables hash table.
- * @param functions: pointer to the functions hash table.
+ * @param var_to_declare: the variable struct to append.
+ * @param variables: pointer to the variables scope_map.
  */
-static void rel_check_variables(rel_node *rel, ht *variables, ht *functions) {
-  term_check_variables(&rel->comparison.lhs, variables, functions);
-  term_check_variables(&rel->comparison.rhs, variables, functions);
-}
-
-static void instr_check_variables(instr_node *instr, ht *variables,
-                                  ht *functions);
-
-static void cond_block_check_variables(cond_block_node *blk, ht *variables,
-                                       ht *functions) {
-  if (!blk)
+static void declare_variables(variable *var_to_declare, scope_map *variables) {
+  if (!var_to_declare || var_to_declare->name == SYM_NONE || !variables)
     return;
 
-  if (blk->kind == COND_SINGLE_INSTR) {
-    instr_check_variables(blk->single, variables, functions);
-    instr_typecheck(blk->single, variables, functions);
-  } else {
-    for (u64 i = 0; i < blk->multi.count; i++) {
-      instr_node instr_;
-      dynamic_array_get(&blk->multi, i, &instr_);
-      instr_check_variables(&instr_, variables, functions);
-      instr_typecheck(&instr_, variables, functions);
-    }
-  }
-}
-
-/*
- * @brief: check loop validity and body instructions
- *
- * @param loop: pointer to the loop node.
- * @param variables: pointer to the parent scope's variables hash table.
- * @param functions: pointer to the functions hash table.
- */
-static void check_loop(loop_node *loop, ht *parent_variables, ht *functions) {
-  if (!loop)
+  variable *var = scope_map_get(variables, var_to_declare->name);
+  if (var) {
+    var_to_declare->slot = var->slot;
     return;
-
-  // copying the parent scope's variables into current scope so that semantics
-  // dont break.
-  // This is just a temporary solution
-  // TODO THIS NEEDS TO BE BETTER (along with a lot of other things)
-  for (u64 i = 0; i < parent_variables->capacity; i++) {
-    ht_item *item = parent_variables->items[i];
-    if (item && item->key && item->value) {
-      ht_insert(loop->variables, item->key, item->value);
-    }
-  }
-
-  if (loop->kind == LOOP_WHILE || loop->kind == LOOP_DO_WHILE) {
-    rel_check_variables(&loop->conditional.break_condition, loop->variables,
-                        functions);
-  } else if (loop->kind == LOOP_FOR) {
-    expr_check_variables(loop->_for.range_start, loop->variables, functions);
-    expr_check_variables(loop->_for.range_end, loop->variables, functions);
-
-    declare_variables(&loop->_for.iterator, loop->variables);
   }
 
-  for (u64 i = 0; i < loop->instrs.count; i++) {
-    instr_node instr;
-    dynamic_array_get(&loop->instrs, i, &instr);
-
-    instr_check_variables(&instr, loop->variables, functions);
-    instr_typecheck(&instr, loop->variables, functions);
-  }
+  var_to_declare->slot = current_slot++;
+  scope_map_bind(variables, var_to_declare->name, var_to_declare);
 }
 
 /*
- * @brief: check variables in an individual instruction
+ * @brief: insert a new array into the variables scope_map.
  *
- * @param instr: pointer to an instr_node.
- * @param variables: pointer to the variables hash table.
- * @param functions: pointer to the functions hash table.
+ * @param var_to_declare: the variable struct to append.
+ * @param variables: pointer to the variables scope_map.
  */
-static void instr_check_variables(instr_node *instr, ht *variables,
-                                  ht *functions) {
-  switch (instr->kind) {
-  case INSTR_DECLARE:
-    declare_variables(&instr->declare_variable, variables);
-    break;
-
-  case INSTR_INITIALIZE:
-    expr_check_variables(instr->initialize_variable.expr, variables, functions);
-    declare_variables(&instr->initialize_variable.var, variables);
-    break;
-
-  case INSTR_DECLARE_ARRAY:
-    declare_array(&instr->declare_array.var, instr->declare_array.size_expr,
-                  variables);
-    break;
-
-  case INSTR_INITIALIZE_ARRAY:
-    declare_array(&instr->initialize_array.var,
-                  instr->initialize_array.size_expr, variables);
-    for (u64 i = 0; i < instr->initialize_array.literal.elements.count; i++) {
-      expr_node elem;
-      dynamic_array_get(&instr->initialize_array.literal.elements, i, &elem);
-      expr_check_variables(&elem, variables, functions);
-    }
-    break;
-
-  case INSTR_ASSIGN_TO_ARRAY_SUBSCRIPT:
-    variable *arr =
-        ht_search(variables, instr->assign_to_array_subscript.var.name);
-    if (!arr) {
-      scu_perror("Use of undeclared array: %s [line %u]\n",
-                 instr->assign_to_array_subscript.var.name,
-                 instr->assign_to_array_subscript.var.line);
-    }
-    expr_check_variables(instr->assign_to_array_subscript.index_expr, variables,
-                         functions);
-    expr_check_variables(instr->assign_to_array_subscript.expr_to_assign,
-                         variables, functions);
-    break;
-
-  case INSTR_ASSIGN:
-    expr_check_variables(instr->assign.expr, variables, functions);
-    break;
-
-  case INSTR_IF:
-    rel_check_variables(&instr->if_.rel, variables, functions);
-    cond_block_check_variables(&instr->if_.then, variables, functions);
-    if (instr->if_.else_)
-      cond_block_check_variables(instr->if_.else_, variables, functions);
-    break;
-
-  case INSTR_MATCH:
-    expr_check_variables(instr->match.expr, variables, functions);
-
-    for (u64 i = 0; i < instr->match.cases.count; i++) {
-      match_case_node case_node;
-      dynamic_array_get(&instr->match.cases, i, &case_node);
-
-      switch (case_node.kind) {
-      case MATCH_CASE_VALUES:
-        for (u64 j = 0; j < case_node.values.values.count; j++) {
-          expr_node *expr;
-          dynamic_array_get(&case_node.values.values, j, &expr);
-          expr_check_variables(expr, variables, functions);
-        }
-        break;
-      case MATCH_CASE_RANGE:
-        expr_check_variables(case_node.range.start, variables, functions);
-        expr_check_variables(case_node.range.end, variables, functions);
-        break;
-      case MATCH_CASE_DEFAULT:
-        break;
-      }
+static void declare_array(variable *arr_to_declare, expr_id size_expr,
+                          scope_map *variables) {
+  if (!arr_to_declare || arr_to_declare->name == SYM_NONE || !variables)
+    return;
 
-      cond_block_check_variables(&case_node.body, variables, functions);
-    }
-    break;
+  variable *var = scope_map_get(variables, arr_to_declare->name);
+  if (var) {
+    arr_to_declare->slot = var->slot;
+    return;
+  }
 
-  case INSTR_LOOP:
-    check_loop(&instr->loop, variables, functions);
-    break;
+  // only validated here, the backend sizes the array itself
+  evaluate_const_expr(tree, size_expr);
+  arr_to_declare->slot = current_slot++;
 
-  default:
-    break;
-  }
+  scope_map_bind(variables, arr_to_declare->name, arr_to_declare);
 }
 
 /*
  * @brief: make sure labels are properly declared and not duplicated
  *
- * @param labels: pointer to the labels dynamic_array.
+ * @param labels: pointer to the labels sym_map (label -> line).
  * @param instr: pointer to an instr_node.
  */
-static void check_label(dynamic_array *labels, instr_node *instr) {
-  const char *label_name = instr->label.label;
-  for (u64 i = 0; i < labels->count; i++) {
-    char *existing;
-    dynamic_array_get(labels, i, &existing);
-    if (strcmp(label_name, existing) == 0) {
-      scu_perror("Duplicate label declaration: %s [line %u]\n", label_name,
-                 instr->line);
-      return;
-    }
+static void check_label(sym_map *labels, instr_node *instr) {
+  sym_id label = instr->label.label;
+  if (sym_map_get(labels, label)) {
+    scu_perror("Duplicate label declaration: %s [line %u]\n",
+               intern_str(label), instr->line);
+    return;
   }
-  dynamic_array_append(labels, &label_name);
+  u64 line = instr->line;
+  sym_map_set(labels, label, &line);
 }
 
 /*
  * @brief: make sure labels are properly used in goto instructions
  *
- * @param labels: pointer to the labels dynamic_array.
+ * @param labels: pointer to the labels sym_map (label -> line).
  * @param instr: pointer to an instr_node.
  */
-static void check_goto(dynamic_array *labels, instr_node *instr) {
-  u32 found = 0;
-  for (u64 i = 0; i < labels->count; i++) {
-    char *label;
-    dynamic_array_get(labels, i, &label);
-    if (strcmp(label, instr->goto_.label) == 0) {
-      found = 1;
-      break;
-    }
-  }
-  if (!found) {
-    scu_perror("Use of undeclared label: %s [line %u]\n", instr->goto_.label,
-               instr->line);
+static void check_goto(sym_map *labels, instr_node *instr) {
+  if (!sym_map_get(labels, instr->goto_.label)) {
+    scu_perror("Use of undeclared label: %s [line %u]\n",
+               intern_str(instr->goto_.label), instr->line);
   }
 }
 
-static void instrs_check_labels(dynamic_array *instrs, dynamic_array *labels);
+static void instrs_check_labels(node_list instrs, sym_map *labels);
 
-static void cond_block_check_labels(cond_block_node *block,
-                                    dynamic_array *labels) {
+static void cond_block_check_labels(cond_block_node *block, sym_map *labels) {
   if (!block)
     return;
 
   if (block->kind == COND_SINGLE_INSTR) {
-    instr_node *instr = block->single;
+    instr_node *instr = ast_instr(tree, block->single);
 
-    if (instr->kind == INSTR_LABEL)
+    if (instr->kind == INSTR_LABEL) {
       check_label(labels, instr);
-    else if (instr->kind == INSTR_GOTO)
+    } else if (instr->kind == INSTR_GOTO) {
       check_goto(labels, instr);
-    else if (instr->kind == INSTR_IF)
-      instrs_check_labels(
-          &((dynamic_array){.items = instr, .count = 1, .capacity = 1}),
-          labels);
+    } else if (instr->kind == INSTR_IF) {
+      if_node *if_ = ast_if(tree, instr->if_);
+      cond_block_check_labels(&if_->then, labels);
+      if (if_->has_else)
+        cond_block_check_labels(&if_->else_, labels);
+    }
   } else {
     for (u64 i = 0; i < block->multi.count; i++) {
-      instr_node instr;
-      dynamic_array_get(&block->multi, i, &instr);
-
-      if (instr.kind == INSTR_LABEL)
-        check_label(labels, &instr);
-      else if (instr.kind == INSTR_GOTO)
-        check_goto(labels, &instr);
-      else if (instr.kind == INSTR_IF)
-        cond_block_check_labels(&instr.if_.then, labels),
-            cond_block_check_labels(instr.if_.else_, labels);
+      instr_node *instr = ast_instr(tree, ast_list(tree, block->multi)[i]);
+
+      if (instr->kind == INSTR_LABEL)
+        check_label(labels, instr);
+      else if (instr->kind == INSTR_GOTO)
+        check_goto(labels, instr);
+      else if (instr->kind == INSTR_IF) {
+        if_node *if_ = ast_if(tree, instr->if_);
+        cond_block_check_labels(&if_->then, labels);
+        if (if_->has_else)
+          cond_block_check_labels(&if_->else_, labels);
+      }
     }
   }
 }
@@ -441,37 +245,35 @@ static void cond_block_check_labels(cond_block_node *block,
  * @brief: check for declaration of labels AND the use of labels in goto
  * instructions
  *
- * @param instr: pointer to an instr_node.
- * @param labels: pointer to the labels dynamic_array.
+ * @param instrs: list of instruction ids.
+ * @param labels: pointer to the labels sym_map.
  */
-static void instrs_check_labels(dynamic_array *instrs, dynamic_array *labels) {
+static void instrs_check_labels(node_list instrs, sym_map *labels) {
   // check labels first
-  for (u64 i = 0; i < instrs->count; i++) {
-    instr_node instr;
-    dynamic_array_get(instrs, i, &instr);
+  for (u64 i = 0; i < instrs.count; i++) {
+    instr_node *instr = ast_instr(tree, ast_list(tree, instrs)[i]);
 
-    if (instr.kind == INSTR_LABEL)
-      check_label(labels, &instr);
+    if (instr->kind == INSTR_LABEL)
+      check_label(labels, instr);
   }
 
   // then check goto
-  for (u64 i = 0; i < instrs->count; i++) {
-    instr_node instr;
-    dynamic_array_get(instrs, i, &instr);
+  for (u64 i = 0; i < instrs.count; i++) {
+    instr_node *instr = ast_instr(tree, ast_list(tree, instrs)[i]);
 
-    if (instr.kind == INSTR_GOTO)
-      check_goto(labels, &instr);
+    if (instr->kind == INSTR_GOTO)
+      check_goto(labels, instr);
   }
 
   // then check if
-  for (u64 i = 0; i < instrs->count; i++) {
-    instr_node instr;
-    dynamic_array_get(instrs, i, &instr);
-
-    if (instr.kind == INSTR_IF) {
-      cond_block_check_labels(&instr.if_.then, labels);
-      if (instr.if_.else_)
-        cond_block_check_labels(instr.if_.else_, labels);
+  for (u64 i = 0; i < instrs.count; i++) {
+    instr_node *instr = ast_instr(tree, ast_list(tree, instrs)[i]);
+
+    if (instr->kind == INSTR_IF) {
+      if_node *if_ = ast_if(tree, instr->if_);
+      cond_block_check_labels(&if_->then, labels);
+      if (if_->has_else)
+        cond_block_check_labels(&if_->else_, labels);
     }
   }
 }
@@ -479,24 +281,23 @@ static void instrs_check_labels(dynamic_array *instrs, dynamic_array *labels) {
 /*
  * @brief: check for types in an expr_node (declaration)
  *
- * @param expr: pointer to an expr_node.
+ * @param id: id of an expr_node.
  * @param target_type: type enumeration for the type which is required in the
  * instruction.
- * @param variables: pointer to the variables hash table.
+ * @param variables: pointer to the variables scope_map.
  */
-static type expr_type(expr_node *expr, type target_type, ht *variables,
-                      ht *functions);
+static type expr_type(expr_id id, type target_type, scope_map *variables,
+                      sym_map *functions);
 
 /*
- * @brief: check for types in a term_node
+ * @brief: check for types in a term_node, resolving the variables it uses.
  *
  * @param term: pointer to a term_node.
- * @param target_type: type enumeration for the type which is required in the
- * instruction.
- * @param variables: pointer to the variables hash table.
- * @param line: where the term is situated in the source buffer.
+ * @param variables: pointer to the variables scope_map.
+ * @param functions: pointer to the functions symbol table.
  */
-static type term_type(term_node *term, ht *variables, ht *functions) {
+static type term_type(term_node *term, scope_map *variables,
+                      sym_map *functions) {
   switch (term->kind) {
   case TERM_INT:
     return TYPE_INT;
@@ -508,15 +309,13 @@ static type term_type(term_node *term, ht *variables, ht *functions) {
   case TERM_DEREF:
   case TERM_ADDOF:
   case TERM_IDENTIFIER:
-    return get_var_type(variables, &term->identifier);
+    return resolve_var(variables, &term->identifier);
 
   case TERM_ARRAY_ACCESS:
-    type array_type = get_var_type(variables, &term->array_access.array_var);
-    if (array_type == TYPE_VOID) {
-      scu_perror("Array '%s' not declared [line %zu]\n",
-                 term->array_access.array_var.name, term->line);
-      return TYPE_VOID;
-    }
+    type array_type = resolve_var(variables, &term->array_access.array_var);
+    // resolve_var reported the undeclared array
+    if (array_type == (type)-1)
+      return -1;
     type index_type = expr_type(term->array_access.index_expr, TYPE_INT,
                                 variables, functions);
     if (index_type != TYPE_INT) {
@@ -532,44 +331,48 @@ static type term_type(term_node *term, ht *variables, ht *functions) {
     break;
 
   case TERM_FUNCTION_CALL: {
-    fn_node *fn = ht_search(functions, term->fn_call.name);
-    if (!fn) {
+    fn_ref *ref = sym_map_get(functions, term->fn_call.name);
+    if (!ref) {
       scu_perror("Call to undeclared function: %s [line %zu]\n",
-                 term->fn_call.name, term->line);
+                 intern_str(term->fn_call.name), term->line);
       return TYPE_VOID;
     }
 
+    fn_node *fn = ast_fn(ref->program, ref->fn);
     if (!fn->is_variadic &&
         term->fn_call.parameters.count != fn->parameters.count) {
       scu_perror("Function '%s' expects %zu arguments, but %zu were provided "
                  "[line %zu]\n",
-                 term->fn_call.name, fn->parameters.count,
+                 intern_str(term->fn_call.name), fn->parameters.count,
                  term->fn_call.parameters.count, term->line);
     } else if (fn->is_variadic &&
                term->fn_call.parameters.count < fn->parameters.count) {
       scu_perror("Variadic function '%s' requires at least %zu fixed arguments "
                  "[line %zu]\n",
-                 term->fn_call.name, fn->parameters.count, term->line);
+                 intern_str(term->fn_call.name), fn->parameters.count,
+                 term->line);
     }
 
-    for (u64 i = 0;
-         i < term->fn_call.parameters.count && i < fn->parameters.count; i++) {
-      expr_node arg_expr;
-      dynamic_array_get(&term->fn_call.parameters, i, &arg_expr);
+    for (u64 i = 0; i < term->fn_call.parameters.count; i++) {
+      expr_id arg_expr = ast_list(tree, term->fn_call.parameters)[i];
+
+      if (i >= fn->parameters.count) {
+        expr_type(arg_expr, TYPE_VOID, variables, functions);
+        continue;
+      }
 
-      variable param;
-      dynamic_array_get(&fn->parameters, i, &param);
+      variable *param = ast_param(ref->program, fn, i);
 
-      type arg_type = expr_type(&arg_expr, param.type, variables, functions);
+      type arg_type = expr_type(arg_expr, param->type, variables, functions);
 
-      if (arg_type != param.type) {
-        if (!(param.type == TYPE_POINTER &&
+      if (arg_type != param->type) {
+        if (!(param->type == TYPE_POINTER &&
               (arg_type == TYPE_STRING || arg_type == TYPE_POINTER))) {
           scu_perror(
 
               "Type mismatch in argument %zu to function '%s': expected %s, "
               "got %s [line %zu]\n",
-              i + 1, term->fn_call.name, type_to_str(param.type),
+              i + 1, intern_str(term->fn_call.name), type_to_str(param->type),
               type_to_str(arg_type), term->line);
         }
       }
@@ -578,13 +381,11 @@ static type term_type(term_node *term, ht *variables, ht *functions) {
     if (fn->returntypes.count == 0) {
       scu_perror("Function '%s' has no return value but is used in expression "
                  "[line %zu]\n",
-                 term->fn_call.name, term->line);
+                 intern_str(term->fn_call.name), term->line);
       return TYPE_VOID;
     }
 
-    type return_type;
-    dynamic_array_get(&fn->returntypes, 0, &return_type);
-    return return_type;
+    return ast_returntype(ref->program, fn, 0);
   }
   }
 }
@@ -592,18 +393,19 @@ static type term_type(term_node *term, ht *variables, ht *functions) {
 /*
  * @brief: check for types in an expr_node (definition)
  *
- * @param expr: pointer to an expr_node.
+ * @param id: id of an expr_node.
  * @param target_type: type enumeration for the type which is required in the
  * instruction.
- * @param variables: pointer to the variables hash table.
+ * @param variables: pointer to the variables scope_map.
  */
-static type expr_type(expr_node *expr, type target_type, ht *variables,
-                      ht *functions) {
+static type expr_type(expr_id id, type target_type, scope_map *variables,
+                      sym_map *functions) {
+  expr_node *expr = ast_expr(tree, id);
   type lhs, rhs;
 
   switch (expr->kind) {
   case EXPR_TERM:
-    return term_type(&expr->term, variables, functions);
+    return term_type(ast_term(tree, expr->term), variables, functions);
   case EXPR_ADD:
   case EXPR_SUBTRACT:
   case EXPR_MULTIPLY:
@@ -628,13 +430,14 @@ static type expr_type(expr_node *expr, type target_type, ht *variables,
  * @brief: check for types in a rel_node
  *
  * @param rel: pointer to a rel_node.
- * @param variables: pointer to the variables hash table.
+ * @param variables: pointer to the variables scope_map.
  */
-static void rel_typecheck(rel_node *rel, ht *variables, ht *functions) {
+static void rel_typecheck(rel_node *rel, scope_map *variables,
+                          sym_map *functions) {
   type lhs, rhs;
 
-  lhs = term_type(&rel->comparison.lhs, variables, functions);
-  rhs = term_type(&rel->comparison.rhs, variables, functions);
+  lhs = term_type(ast_term(tree, rel->comparison.lhs), variables, functions);
+  rhs = term_type(ast_term(tree, rel->comparison.rhs), variables, functions);
 
   if (lhs != rhs) {
     const char *lhs_type_str = type_to_str(lhs);
@@ -645,35 +448,108 @@ static void rel_typecheck(rel_node *rel, ht *variables, ht *functions) {
 }
 
 /*
- * @brief: check for types in an instr_node
+ * @brief: check the instructions of a conditional block
+ *
+ * @param blk: pointer to a cond_block_node, may be NULL.
+ * @param variables: pointer to the variables scope_map.
+ * @param functions: pointer to the functions symbol table.
+ */
+static void cond_block_check(cond_block_node *blk, scope_map *variables,
+                             sym_map *functions) {
+  if (!blk)
+    return;
+
+  if (blk->kind == COND_SINGLE_INSTR) {
+    instr_check(ast_instr(tree, blk->single), variables, functions);
+  } else {
+    for (u64 i = 0; i < blk->multi.count; i++) {
+      instr_node *instr_ = ast_instr(tree, ast_list(tree, blk->multi)[i]);
+      instr_check(instr_, variables, functions);
+    }
+  }
+}
+
+/*
+ * @brief: check loop validity and body instructions
+ *
+ * @param loop: pointer to the loop node.
+ * @param variables: pointer to the variables scope_map, the loop body is a
+ * scope nested in the current one.
+ * @param functions: pointer to the functions symbol table.
+ */
+static void check_loop(loop_node *loop, scope_map *variables,
+                       sym_map *functions) {
+  if (!loop)
+    return;
+
+  scope_map_push(variables, false);
+
+  if (loop->kind == LOOP_WHILE || loop->kind == LOOP_DO_WHILE) {
+    rel_node *cond = &loop->conditional.break_condition;
+    term_type(ast_term(tree, cond->comparison.lhs), variables, functions);
+    term_type(ast_term(tree, cond->comparison.rhs), variables, functions);
+  } else if (loop->kind == LOOP_FOR) {
+    expr_type(loop->_for.range_start, TYPE_INT, variables, functions);
+    expr_type(loop->_for.range_end, TYPE_INT, variables, functions);
+
+    declare_variables(&loop->_for.iterator, variables);
+  }
+
+  for (u64 i = 0; i < loop->instrs.count; i++) {
+    instr_node *instr = ast_instr(tree, ast_list(tree, loop->instrs)[i]);
+    instr_check(instr, variables, functions);
+  }
+
+  scope_map_pop(variables);
+}
+
+/*
+ * @brief: check an instr_node, resolving its variables and checking its types
+ * in the same walk.
  *
  * @param instr: pointer to an instr_node.
- * @param variables: pointer to the variables hash table.
+ * @param variables: pointer to the variables scope_map.
+ * @param functions: pointer to the functions symbol table.
  */
-static void instr_typecheck(instr_node *instr, ht *variables, ht *functions) {
+static void instr_check(instr_node *instr, scope_map *variables,
+                        sym_map *functions) {
   switch (instr->kind) {
+  case INSTR_DECLARE:
+    declare_variables(&instr->declare_variable, variables);
+    break;
+
   case INSTR_INITIALIZE: {
-    type target_type = instr->initialize_variable.var.type;
-    type expr_result = expr_type(instr->initialize_variable.expr, target_type,
+    variable *var = &instr->initialize_variable.var;
+    type expr_result = expr_type(instr->initialize_variable.expr, var->type,
                                  variables, functions);
-    if (target_type == TYPE_POINTER) {
+    declare_variables(var, variables);
+
+    if (var->type == TYPE_POINTER) {
       return;
-    } else if (target_type != expr_result) {
-      const char *target_type_str = type_to_str(target_type);
+    } else if (var->type != expr_result) {
+      const char *target_type_str = type_to_str(var->type);
       const char *expr_result_str = type_to_str(expr_result);
       scu_perror("Type mismatch in initialization to %s - %s to %s [line %u]\n",
-                 instr->assign.identifier.name, expr_result_str,
-                 target_type_str, instr->line);
+                 intern_str(var->name), expr_result_str, target_type_str,
+                 instr->line);
     }
     break;
   }
 
+  case INSTR_DECLARE_ARRAY:
+    declare_array(&instr->declare_array.var, instr->declare_array.size_expr,
+                  variables);
+    break;
+
   case INSTR_INITIALIZE_ARRAY: {
-    type array_type = instr->initialize_array.var.type;
-    for (u64 i = 0; i < instr->initialize_array.literal.elements.count; i++) {
-      expr_node elem;
-      dynamic_array_get(&instr->initialize_array.literal.elements, i, &elem);
-      type elem_type = expr_type(&elem, array_type, variables, functions);
+    initialize_array_node *arr = ast_array_init(tree, instr->initialize_array);
+    declare_array(&arr->var, arr->size_expr, variables);
+
+    type array_type = arr->var.type;
+    node_list elements = arr->literal.elements;
+    for (u64 i = 0; i < elements.count; i++) {
+      expr_id elem = ast_list(tree, elements)[i];
+      type elem_type = expr_type(elem, array_type, variables, functions);
       if (array_type != elem_type && array_type != TYPE_POINTER) {
         const char *array_type_str = type_to_str(array_type);
         const char *elem_type_str = type_to_str(elem_type);
@@ -686,7 +562,7 @@ static void instr_typecheck(instr_node *instr, ht *variables, ht *functions) {
   }
 
   case INSTR_ASSIGN: {
-    type target_type = get_var_type(variables, &instr->assign.identifier);
+    type target_type = resolve_var(variables, &instr->assign.identifier);
     type expr_result =
         expr_type(instr->assign.expr, target_type, variables, functions);
     if (target_type == TYPE_POINTER) {
@@ -695,7 +571,7 @@ static void instr_typecheck(instr_node *instr, ht *variables, ht *functions) {
       const char *target_type_str = type_to_str(target_type);
       const char *expr_result_str = type_to_str(expr_result);
       scu_perror("Type mismatch in assignment to %s - %s to %s [line %u]\n",
-                 instr->assign.identifier.name, expr_result_str,
+                 intern_str(instr->assign.identifier.name), expr_result_str,
                  target_type_str, instr->line);
     }
     break;
@@ -703,7 +579,7 @@ static void instr_typecheck(instr_node *instr, ht *variables, ht *functions) {
 
   case INSTR_ASSIGN_TO_ARRAY_SUBSCRIPT: {
     type array_type =
-        get_var_type(variables, &instr->assign_to_array_subscript.var);
+        resolve_var(variables, &instr->assign_to_array_subscript.var);
 
     type index_type = expr_type(instr->assign_to_array_subscript.index_expr,
                                 TYPE_INT, variables, functions);
@@ -721,37 +597,41 @@ static void instr_typecheck(instr_node *instr, ht *variables, ht *functions) {
       scu_perror(
 
           "Type mismatch in array assignment to %s - %s to %s [line %u]\n",
-          instr->assign_to_array_subscript.var.name, expr_result_str,
-          array_type_str, instr->line);
+          intern_str(instr->assign_to_array_subscript.var.name),
+          expr_result_str, array_type_str, instr->line);
     }
     break;
   }
 
   case INSTR_IF: {
-    rel_typecheck(&instr->if_.rel, variables, functions);
-    if (instr->if_.else_ifs.count > 0) {
-      for (u64 i = 0; i < instr->if_.else_ifs.count; i++) {
-        if_node else_if_node;
-        dynamic_array_get(&instr->if_.else_ifs, i, &else_if_node);
-        rel_typecheck(&else_if_node.rel, variables, functions);
-      }
+    if_node *if_ = ast_if(tree, instr->if_);
+    rel_typecheck(&if_->rel, variables, functions);
+    cond_block_check(&if_->then, variables, functions);
+
+    for (u64 i = 0; i < if_->else_ifs.count; i++) {
+      if_node *else_if_node = ast_if(tree, ast_list(tree, if_->else_ifs)[i]);
+      rel_typecheck(&else_if_node->rel, variables, functions);
+      cond_block_check(&else_if_node->then, variables, functions);
     }
+
+    if (if_->has_else)
+      cond_block_check(&if_->else_, variables, functions);
     break;
   }
 
   case INSTR_MATCH: {
+    match_node *match = ast_match(tree, instr->match);
     type match_expr_type =
-        expr_type(instr->match.expr, TYPE_INT, variables, functions);
+        expr_type(match->expr, TYPE_INT, variables, functions);
 
-    for (u64 i = 0; i < instr->match.cases.count; i++) {
-      match_case_node case_node;
-      dynamic_array_get(&instr->match.cases, i, &case_node);
+    for (u64 i = 0; i < match->cases.count; i++) {
+      match_case_node *case_node =
+          ast_case(tree, ast_list(tree, match->cases)[i]);
 
-      switch (case_node.kind) {
+      switch (case_node->kind) {
       case MATCH_CASE_VALUES: {
-        for (u64 j = 0; j < case_node.values.values.count; j++) {
-          expr_node *expr;
-          dynamic_array_get(&case_node.values.values, j, &expr);
+        for (u64 j = 0; j < case_node->values.values.count; j++) {
+          expr_id expr = ast_list(tree, case_node->values.values)[j];
           type value_type =
               expr_type(expr, match_expr_type, variables, functions);
 
@@ -767,7 +647,7 @@ static void instr_typecheck(instr_node *instr, ht *variables, ht *functions) {
       }
 
       case MATCH_CASE_RANGE: {
-        type start_type = expr_type(case_node.range.start, match_expr_type,
+        type start_type = expr_type(case_node->range.start, match_expr_type,
                                     variables, functions);
         if (start_type != match_expr_type) {
           const char *match_type_str = type_to_str(match_expr_type);
@@ -777,7 +657,7 @@ static void instr_typecheck(instr_node *instr, ht *variables, ht *functions) {
                      match_type_str, start_type_str, instr->line);
         }
 
-        type end_type = expr_type(case_node.range.end, match_expr_type,
+        type end_type = expr_type(case_node->range.end, match_expr_type,
                                   variables, functions);
         if (end_type != match_expr_type) {
           const char *match_type_str = type_to_str(match_expr_type);
@@ -792,55 +672,77 @@ static void instr_typecheck(instr_node *instr, ht *variables, ht *functions) {
       case MATCH_CASE_DEFAULT:
         break;
       }
+
+      cond_block_check(&case_node->body, variables, functions);
     }
     break;
   }
 
+  case INSTR_LOOP:
+    check_loop(ast_loop(tree, instr->loop), variables, functions);
+    break;
+
+  case INSTR_RETURN:
+    if (current_fn)
+      check_return_statement(&instr->ret_node, current_fn, variables,
+                             functions, instr->line);
+    break;
+
+  case INSTR_FN_CALL:
+    check_function_call(&instr->fn_call, functions, variables, instr->line);
+    break;
+
   default:
     break;
   }
 }
 
 /*
- * @brief: insert a new function into the functions hash table.
+ * @brief: insert a new function into the functions symbol table.
  *
- * @param fn: pointer to the function node to register.
- * @param functions: pointer to the functions hash table.
+ * @param id: id of the function node to register.
+ * @param functions: pointer to the functions symbol table.
  */
-static void register_function(fn_node *fn, ht *functions) {
-  if (!fn || !fn->name || !functions)
+static void register_function(fn_id id, sym_map *functions) {
+  fn_node *fn = ast_fn(tree, id);
+  if (fn->name == SYM_NONE || !functions)
     return;
 
-  fn_node *existing = ht_search(functions, fn->name);
-  if (existing) {
+  fn_ref *ref = sym_map_get(functions, fn->name);
+  if (ref) {
+    fn_node *existing = ast_fn(ref->program, ref->fn);
+
     if (existing->is_variadic != fn->is_variadic) {
-      scu_perror("Function '%s' variadic mismatch\n", fn->name);
+      scu_perror("Function '%s' variadic mismatch\n", intern_str(fn->name));
       return;
     }
 
     if (!fn->is_variadic && existing->parameters.count != fn->parameters.count)
       scu_perror("Function '%s' parameter count mismatch: declared with %zu, "
                  "but has %zu\n",
-                 fn->name, existing->parameters.count, fn->parameters.count);
+                 intern_str(fn->name), existing->parameters.count,
+                 fn->parameters.count);
 
     if (fn->kind == FN_DEFINED && existing->kind == FN_DEFINED) {
-      scu_perror("Duplicate function definition: %s\n", fn->name);
+      scu_perror("Duplicate function definition: %s\n", intern_str(fn->name));
       return;
     }
 
     if (existing->parameters.count != fn->parameters.count)
       scu_perror("Function '%s' parameter count mismatch: declared with %zu, "
                  "but has %zu\n",
-                 fn->name, existing->parameters.count, fn->parameters.count);
+                 intern_str(fn->name), existing->parameters.count,
+                 fn->parameters.count);
 
     if (existing->returntypes.count != fn->returntypes.count)
-      scu_perror("Function '%s' return type count mismatch\n", fn->name);
+      scu_perror("Function '%s' return type count mismatch\n",
+                 intern_str(fn->name));
 
     if (fn->kind == FN_DECLARED && existing->kind == FN_DEFINED)
       return;
 
   } else {
-    ht_insert(functions, fn->name, fn);
+    sym_map_set(functions, fn->name, &(fn_ref){.program = tree, .fn = id});
   }
 }
 
@@ -848,91 +750,94 @@ static void register_function(fn_node *fn, ht *functions) {
  * @brief: check function call validity (definition)
  *
  * @param fn_call: pointer to the function call node.
- * @param functions: pointer to the functions hash table.
- * @param variables: pointer to the variables hash table (for argument
+ * @param functions: pointer to the functions symbol table.
+ * @param variables: pointer to the variables scope_map (for argument
  * expressions).
  * @param line: line number of the function call.
  */
-static void check_function_call(fn_call_node *fn_call, ht *functions,
-                                ht *variables, u64 line) {
-  if (!fn_call || !fn_call->name)
+static void check_function_call(fn_call_node *fn_call, sym_map *functions,
+                                scope_map *variables, u64 line) {
+  if (!fn_call || fn_call->name == SYM_NONE)
     return;
 
-  fn_node *fn = ht_search(functions, fn_call->name);
+  fn_ref *ref = sym_map_get(functions, fn_call->name);
 
-  if (!fn) {
-    scu_perror("Call to undeclared function: %s [line %zu]\n", fn_call->name,
-               line);
+  if (!ref) {
+    scu_perror("Call to undeclared function: %s [line %zu]\n",
+               intern_str(fn_call->name), line);
     return;
   }
 
+  fn_node *fn = ast_fn(ref->program, ref->fn);
   if (!fn->is_variadic && fn_call->parameters.count != fn->parameters.count) {
     scu_perror("Function '%s' expects %zu arguments, but %zu were provided "
                "[line %zu]\n",
-               fn_call->name, fn->parameters.count, fn_call->parameters.count,
-               line);
+               intern_str(fn_call->name), fn->parameters.count,
+               fn_call->parameters.count, line);
     return;
   } else if (fn->is_variadic &&
              fn_call->parameters.count < fn->parameters.count) {
     scu_perror("Variadic function '%s' requires at least %zu fixed arguments "
                "[line %zu]\n",
-               fn_call->name, fn->parameters.count, line);
+               intern_str(fn_call->name), fn->parameters.count, line);
     return;
   }
 
-  for (u64 i = 0; i < fn_call->parameters.count && i < fn->parameters.count;
-       i++) {
-    expr_node arg_expr;
-    dynamic_array_get(&fn_call->parameters, i, &arg_expr);
+  for (u64 i = 0; i < fn_call->parameters.count; i++) {
+    expr_id arg_expr = ast_list(tree, fn_call->parameters)[i];
+
+    if (i >= fn->parameters.count) {
+      expr_type(arg_expr, TYPE_VOID, variables, functions);
+      continue;
+    }
 
-    variable param;
-    dynamic_array_get(&fn->parameters, i, &param);
+    variable *param = ast_param(ref->program, fn, i);
 
-    type arg_type = expr_type(&arg_expr, param.type, variables, functions);
+    type arg_type = expr_type(arg_expr, param->type, variables, functions);
 
-    if (arg_type != param.type && param.type != TYPE_POINTER) {
+    if (arg_type != param->type && param->type != TYPE_POINTER) {
       scu_perror("Type mismatch in argument %zu to function '%s': expected %s, "
                  "got %s [line %zu]\n",
-                 i + 1, fn_call->name, type_to_str(param.type),
+                 i + 1, intern_str(fn_call->name), type_to_str(param->type),
                  type_to_str(arg_type), line);
     }
   }
 }
 
 /*
- * @brief: check return statement validity within a function
+ * @brief: check return statement validity within a function (definition)
  *
  * @param ret: pointer to the return node.
  * @param fn: pointer to the containing function node.
- * @param variables: pointer to the variables hash table.
+ * @param variables: pointer to the variables scope_map.
  * @param line: line number of the return statement.
  */
-static void check_return_statement(return_node *ret, fn_node *fn, ht *variables,
-                                   ht *functions, u64 line) {
+static void check_return_statement(return_node *ret, fn_node *fn,
+                                   scope_map *variables, sym_map *functions,
+                                   u64 line) {
   if (!ret || !fn)
     return;
 
   if (ret->returnvals.count != fn->returntypes.count) {
     scu_perror("Function '%s' expects %zu return values, but %zu were provided "
                "[line %zu]\n",
-               fn->name, fn->returntypes.count, ret->returnvals.count, line);
+               intern_str(fn->name), fn->returntypes.count,
+               ret->returnvals.count, line);
     return;
   }
 
   for (u64 i = 0; i < ret->returnvals.count; i++) {
-    expr_node ret_expr;
-    dynamic_array_get(&ret->returnvals, i, &ret_expr);
+    expr_id ret_expr = ast_list(tree, ret->returnvals)[i];
 
-    type expected_type;
-    dynamic_array_get(&fn->returntypes, i, &expected_type);
+    type expected_type = ast_returntype(tree, fn, i);
 
     type actual_type =
-        expr_type(&ret_expr, expected_type, variables, functions);
+        expr_type(ret_expr, expected_type, variables, functions);
     if (actual_type != expected_type && expected_type != TYPE_POINTER) {
       scu_perror("Return type mismatch in function '%s': expected %s, got %s "
                  "[line %zu]\n",
-                 fn->name, type_to_str(expected_type), type_to_str(actual_type),
-                 line);
+                 intern_str(fn->name), type_to_str(expected_type),
+                 type_to_str(actual_type), line);
     }
   }
 }
@@ -942,18 +847,17 @@ static void check_return_statement(return_node *ret, fn_node *fn, ht *variables,
  * scope
  *
  * @param fn: pointer to the containing function node.
+ * @param variables: pointer to the variables scope_map.
  */
-static void register_function_parameters(fn_node *fn) {
+static void register_function_parameters(fn_node *fn, scope_map *variables) {
   if (fn->kind != FN_DEFINED)
     return;
 
   for (u64 i = 0; i < fn->parameters.count; i++) {
-    variable param;
-    dynamic_array_get(&fn->parameters, i, &param);
-    param.stack_offset = i;
-    dynamic_array_set(&fn->parameters, i, &param);
+    variable *param = ast_param(tree, fn, i);
+    param->slot = current_slot++;
 
-    ht_insert(fn->defined.variables, param.name, &param);
+    scope_map_bind(variables, param->name, param);
   }
 }
 
@@ -961,66 +865,104 @@ static void register_function_parameters(fn_node *fn) {
  * @brief: recursively check function body instructions
  *
  * @param fn: pointer to the containing function node.
- * @param functions: pointer to the functions hash table.
+ * @param variables: pointer to the variables scope_map, the body is an
+ * isolated scope nested in the current one.
+ * @param functions: pointer to the functions symbol table.
  */
-static void check_function_body(fn_node *fn, ht *functions) {
+static void check_function_body(fn_node *fn, scope_map *variables,
+                                sym_map *functions) {
   if (fn->kind != FN_DEFINED)
     return;
 
-  register_function_parameters(fn);
+  scope_map_push(variables, true);
 
-  u64 saved_offset = current_stack_offset;
-  current_stack_offset = fn->parameters.count;
+  u32 saved_slot = current_slot;
+  current_slot = 1;
+  current_fn = fn;
+  register_function_parameters(fn, variables);
 
   for (u64 i = 0; i < fn->defined.instrs.count; i++) {
-    instr_node instr;
-    dynamic_array_get(&fn->defined.instrs, i, &instr);
-
-    instr_check_variables(&instr, fn->defined.variables, functions);
-    instr_typecheck(&instr, fn->defined.variables, functions);
-
-    if (instr.kind == INSTR_RETURN) {
-      check_return_statement(&instr.ret_node, fn, fn->defined.variables,
-                             functions, instr.line);
-    }
+    instr_node *instr =
+        ast_instr(tree, ast_list(tree, fn->defined.instrs)[i]);
+    instr_check(instr, variables, functions);
   }
 
-  current_stack_offset = saved_offset;
+  current_fn = NULL;
+  current_slot = saved_slot;
+  scope_map_pop(variables);
+}
+
+/*
+ * @brief: check the labels and gotos of the top level instructions.
+ */
+static void check_labels(node_list instrs) {
+  sym_map labels;
+  sym_map_init(&labels, sizeof(u64));
+  instrs_check_labels(instrs, &labels);
+  sym_map_free(&labels);
 }
 
-void check_semantics(dynamic_array *instrs, ht *variables, ht *functions) {
+void check_semantics(ast *program_ast, scope_map *variables,
+                     sym_map *functions) {
+  tree = program_ast;
+  current_slot = 1;
+  node_list instrs = program_ast->body;
+
   // Define and declare any / all functions
-  for (u64 i = 0; i < instrs->count; i++) {
-    instr_node instr;
-    dynamic_array_get(instrs, i, &instr);
+  for (u64 i = 0; i < instrs.count; i++) {
+    instr_node *instr = ast_instr(tree, ast_list(tree, instrs)[i]);
 
-    if (instr.kind == INSTR_FN_DECLARE || instr.kind == INSTR_FN_DEFINE) {
+    if (instr->kind == INSTR_FN_DECLARE || instr->kind == INSTR_FN_DEFINE) {
       // since this is a union anyways
-      register_function(&instr.fn_declare_node, functions);
+      register_function(instr->fn_declare_node, functions);
     }
+  }
+
+  // Validate everything, top level calls in order with the variables they
+  // use
+  for (u64 i = 0; i < instrs.count; i++) {
+    instr_node *instr = ast_instr(tree, ast_list(tree, instrs)[i]);
+
+    if (instr->kind == INSTR_FN_DEFINE)
+      check_function_body(ast_fn(tree, instr->fn_define_node), variables,
+                          functions);
+    else if (instr->kind != INSTR_FN_DECLARE)
+      instr_check(instr, variables, functions);
+  }
 
-    if (instr.kind == INSTR_FN_CALL)
-      check_function_call(&instr.fn_call, functions, variables, instr.line);
+  check_labels(instrs);
+  scu_check_errors();
+}
+
+void check_semantics_incremental(ast *program_ast, scope_map *variables,
+                                 sym_map *functions, u32 *next_slot) {
+  tree = program_ast;
+  current_slot = *next_slot;
+  node_list instrs = program_ast->body;
+
+  for (u64 i = 0; i < instrs.count; i++) {
+    instr_node *instr = ast_instr(tree, ast_list(tree, instrs)[i]);
+
+    if (instr->kind == INSTR_FN_DECLARE || instr->kind == INSTR_FN_DEFINE)
+      register_function(instr->fn_declare_node, functions);
   }
 
-  // Validate everything
-  for (u64 i = 0; i < instrs->count; i++) {
-    instr_node instr;
-    dynamic_array_get(instrs, i, &instr);
+  // top level statements run in order, so calls among them only see the
+  // variables declared before them
+  for (u64 i = 0; i < instrs.count; i++) {
+    instr_node *instr = ast_instr(tree, ast_list(tree, instrs)[i]);
 
-    if (instr.kind == INSTR_FN_DEFINE) {
-      check_function_body(&instr.fn_define_node, functions);
-    } else if (instr.kind != INSTR_FN_DECLARE) {
-      instr_check_variables(&instr, variables, functions);
-      instr_typecheck(&instr, variables, functions);
-    }
+    if (instr->kind == INSTR_FN_DEFINE)
+      check_function_body(ast_fn(tree, instr->fn_define_node), variables,
+                          functions);
+    else if (instr->kind != INSTR_FN_DECLARE)
+      instr_check(instr, variables, functions);
   }
 
-  // Check labels
-  dynamic_array labels;
-  dynamic_array_init(&labels, sizeof(char *));
-  instrs_check_labels(instrs, &labels);
-  dynamic_array_free(&labels);
+  check_labels(instrs);
 
+  // written before the errors are checked, the caller rolls back the slots
+  // and bindings of an input that fails
+  *next_slot = current_slot;
   scu_check_errors();
 }
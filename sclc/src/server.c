@@ -0,0 +1,450 @@
+#define _GNU_SOURCE
+
+#include "server.h"
+#include "common.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+ * Identifies the protocol, bumped whenever the request layout changes.
+ */
+#define SERVER_MAGIC 0x73636c01u
+
+/*
+ * Upper bound on the size of a request, cwd and arguments included.
+ */
+#define SERVER_MAX_REQUEST (1u << 20)
+
+/*
+ * @struct server_header: fixed part of a request, sent along with the
+ * client's stdin, stdout and stderr. It is followed by `len` bytes: the
+ * working directory and then the `argc` arguments, each null terminated.
+ */
+typedef struct server_header {
+  u32 magic;
+  u32 argc;
+  u32 len;
+} server_header;
+
+/*
+ * Socket removed when the server is interrupted.
+ */
+static const char *listening_path = NULL;
+
+/*
+ * @brief: directory of the default socket when there is no XDG_RUNTIME_DIR,
+ * private to the user.
+ *
+ * @return: malloc'd path
+ */
+static char *server_fallback_dir() {
+  return scu_format_string("/tmp/sclc-%u", (u32)geteuid());
+}
+
+char *server_default_socket() {
+  const char *runtime = getenv("XDG_RUNTIME_DIR");
+  if (runtime && *runtime)
+    return scu_format_string("%s/sclc.sock", runtime);
+
+  char *dir = server_fallback_dir();
+  char *path = scu_format_string("%s/sclc.sock", dir);
+  free(dir);
+  return path;
+}
+
+/*
+ * @brief: create the fallback directory if there is none. /tmp is shared, so
+ * a directory found there must belong to the user and be closed to everyone
+ * else, or another user could replace the socket.
+ *
+ * @return: whether the socket can be put in the directory
+ */
+static bool server_prepare_dir(const char *socket_path) {
+  char *dir = server_fallback_dir();
+  u64 len = strlen(dir);
+  bool fallback =
+      strncmp(socket_path, dir, len) == 0 && socket_path[len] == '/';
+
+  bool ready = true;
+  if (fallback) {
+    struct stat st;
+    ready = (mkdir(dir, 0700) == 0 || errno == EEXIST) &&
+            lstat(dir, &st) == 0 && S_ISDIR(st.st_mode) &&
+            st.st_uid == geteuid() && (st.st_mode & 077) == 0;
+  }
+
+  if (!ready)
+    scu_perror("%s is not a directory private to this user\n", dir);
+
+  free(dir);
+  return ready;
+}
+
+/*
+ * @brief: whether the process at the other end of a connection runs as this
+ * user. Requests carry file descriptors and write files as the server, so
+ * neither end talks to another user.
+ */
+static bool server_peer_trusted(int fd) {
+  struct ucred cred;
+  socklen_t len = sizeof(cred);
+
+  return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 &&
+         cred.uid == geteuid();
+}
+
+char *server_socket_path(u32 argc, char *argv[]) {
+  for (u32 i = 1; i + 1 < argc; i++) {
+    if (strcmp(argv[i], "--socket") == 0)
+      return strdup(argv[i + 1]);
+  }
+
+  return server_default_socket();
+}
+
+/*
+ * @brief: fill in the address of a socket path.
+ *
+ * @return: false if the path does not fit in sun_path
+ */
+static bool server_address(const char *path, struct sockaddr_un *addr) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+
+  if (strlen(path) >= sizeof(addr->sun_path))
+    return false;
+
+  strcpy(addr->sun_path, path);
+  return true;
+}
+
+/*
+ * @brief: read exactly len bytes, retrying on short reads.
+ */
+static bool server_read_all(int fd, void *buf, u64 len) {
+  char *p = buf;
+
+  while (len) {
+    ssize_t n = read(fd, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    len -= n;
+  }
+
+  return true;
+}
+
+/*
+ * @brief: write exactly len bytes to a socket, retrying on short writes.
+ */
+static bool server_write_all(int fd, const void *buf, u64 len) {
+  const char *p = buf;
+
+  while (len) {
+    ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    len -= n;
+  }
+
+  return true;
+}
+
+/*
+ * @struct server_request: a request as received by the server.
+ */
+typedef struct server_request {
+  int fds[3];
+  char *payload;
+  char *cwd;
+  u32 argc;
+  char **argv;
+} server_request;
+
+/*
+ * @brief: receive a request: the header with the client's descriptors, then
+ * the payload, split into cwd and argv.
+ */
+static bool server_recv_request(int conn, server_request *req) {
+  server_header header;
+  struct iovec iov = {.iov_base = &header, .iov_len = sizeof(header)};
+
+  union {
+    char buf[CMSG_SPACE(3 * sizeof(int))];
+    struct cmsghdr align;
+  } control;
+
+  struct msghdr msg = {
+      .msg_iov = &iov,
+      .msg_iovlen = 1,
+      .msg_control = control.buf,
+      .msg_controllen = sizeof(control.buf),
+  };
+
+  ssize_t n;
+  do {
+    n = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+  } while (n < 0 && errno == EINTR);
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (n != sizeof(header) || cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int)))
+    return false;
+
+  memcpy(req->fds, CMSG_DATA(cmsg), sizeof(req->fds));
+
+  if (header.magic != SERVER_MAGIC || header.argc == 0 ||
+      header.len > SERVER_MAX_REQUEST)
+    return false;
+
+  req->payload = scu_checked_malloc(header.len + 1);
+  if (!server_read_all(conn, req->payload, header.len))
+    return false;
+  req->payload[header.len] = '\0';
+
+  // cwd followed by the arguments, all null terminated
+  req->argc = header.argc;
+  req->argv = scu_checked_malloc((header.argc + 1) * sizeof(char *));
+  req->cwd = req->payload;
+
+  char *p = req->payload + strlen(req->payload) + 1;
+  char *end = req->payload + header.len;
+
+  for (u32 i = 0; i < header.argc; i++) {
+    if (p >= end)
+      return false;
+    req->argv[i] = p;
+    p += strlen(p) + 1;
+  }
+  req->argv[header.argc] = NULL;
+
+  return true;
+}
+
+/*
+ * @brief: serve one connection, in a process forked from the server. The
+ * request runs in a worker forked once more, so that its exit status (even
+ * from an exit() deep in the pipeline) can be reported to the client.
+ */
+static void server_handle(int conn, server_handler handler) {
+  server_request req = {0};
+  if (!server_recv_request(conn, &req))
+    _exit(1);
+
+  // the server ignores SIGCHLD, the worker has to be waited for, and only the
+  // server itself removes the socket when interrupted
+  listening_path = NULL;
+  signal(SIGCHLD, SIG_DFL);
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+
+  pid_t pid = fork();
+  if (pid < 0)
+    _exit(1);
+
+  if (pid == 0) {
+    for (int i = 0; i < 3; i++)
+      dup2(req.fds[i], i);
+    for (int i = 0; i < 3; i++)
+      if (req.fds[i] > STDERR_FILENO)
+        close(req.fds[i]);
+    close(conn);
+
+    if (chdir(req.cwd) != 0) {
+      scu_perror("Could not enter directory: %s\n", req.cwd);
+      exit(1);
+    }
+
+    exit(handler(req.argc, req.argv));
+  }
+
+  int status = 0;
+  while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+    ;
+
+  i32 code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+  server_write_all(conn, &code, sizeof(code));
+  _exit(0);
+}
+
+static void server_stop(int sig) {
+  if (listening_path)
+    unlink(listening_path);
+
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
+
+int server_run(const char *socket_path, server_handler handler) {
+  struct sockaddr_un addr;
+  if (!server_address(socket_path, &addr)) {
+    scu_perror("Socket path too long: %s\n", socket_path);
+    return 1;
+  }
+
+  if (!server_prepare_dir(socket_path))
+    return 1;
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    scu_perror("Could not create socket: %s\n", strerror(errno));
+    return 1;
+  }
+
+  // a socket nobody accepts on is left over from a server that died
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+    scu_perror("A server is already listening on %s\n", socket_path);
+    close(fd);
+    return 1;
+  }
+  unlink(socket_path);
+
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(fd, SOMAXCONN) != 0) {
+    scu_perror("Could not listen on %s: %s\n", socket_path, strerror(errno));
+    close(fd);
+    return 1;
+  }
+
+  listening_path = socket_path;
+  signal(SIGINT, server_stop);
+  signal(SIGTERM, server_stop);
+
+  // connection handlers are reaped automatically
+  signal(SIGCHLD, SIG_IGN);
+
+  scu_psuccess("Listening on %s\n", socket_path);
+
+  for (;;) {
+    int conn = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+    if (conn < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      scu_perror("Could not accept connection: %s\n", strerror(errno));
+      break;
+    }
+
+    if (!server_peer_trusted(conn)) {
+      scu_pwarning("Refused a connection from another user\n");
+      close(conn);
+      continue;
+    }
+
+    // buffered output would be written again by the children
+    fflush(NULL);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(fd);
+      server_handle(conn, handler);
+    }
+
+    if (pid < 0)
+      scu_pwarning("Could not fork: %s\n", strerror(errno));
+    close(conn);
+  }
+
+  unlink(socket_path);
+  listening_path = NULL;
+  close(fd);
+  return 1;
+}
+
+int server_forward(const char *socket_path, u32 argc, char *argv[]) {
+  struct sockaddr_un addr;
+  if (!server_address(socket_path, &addr))
+    return -1;
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return -1;
+
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  // nothing is sent to a server of another user
+  if (!server_peer_trusted(fd)) {
+    scu_pwarning("Server on %s runs as another user, compiling here\n",
+                 socket_path);
+    close(fd);
+    return -1;
+  }
+
+  char cwd[PATH_MAX];
+  if (getcwd(cwd, sizeof(cwd)) == NULL) {
+    close(fd);
+    return -1;
+  }
+
+  // payload: cwd and the arguments, null terminated
+  u64 len = strlen(cwd) + 1;
+  for (u32 i = 0; i < argc; i++)
+    len += strlen(argv[i]) + 1;
+
+  char *payload = scu_checked_malloc(len);
+  char *p = stpcpy(payload, cwd) + 1;
+  for (u32 i = 0; i < argc; i++)
+    p = stpcpy(p, argv[i]) + 1;
+
+  server_header header = {.magic = SERVER_MAGIC, .argc = argc, .len = len};
+  struct iovec iov = {.iov_base = &header, .iov_len = sizeof(header)};
+
+  union {
+    char buf[CMSG_SPACE(3 * sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  memset(&control, 0, sizeof(control));
+
+  struct msghdr msg = {
+      .msg_iov = &iov,
+      .msg_iovlen = 1,
+      .msg_control = control.buf,
+      .msg_controllen = sizeof(control.buf),
+  };
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(3 * sizeof(int));
+  int fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+  bool sent = sendmsg(fd, &msg, MSG_NOSIGNAL) == sizeof(header) &&
+              server_write_all(fd, payload, len);
+  free(payload);
+
+  if (!sent) {
+    close(fd);
+    return -1;
+  }
+
+  // the request may already be running, falling back would compile twice
+  i32 code;
+  if (!server_read_all(fd, &code, sizeof(code))) {
+    scu_perror("Lost connection to the server\n");
+    code = 1;
+  }
+
+  close(fd);
+  return code;
+}
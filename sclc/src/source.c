@@ -0,0 +1,176 @@
+#include "source.h"
+#include "common.h"
+#include "ds/arena.h"
+#include "ds/dynamic_array.h"
+#include "scan.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void source_map_init(source_map *map) {
+  dynamic_array_init(&map->files, sizeof(source_file));
+  map->next_base = 0;
+
+  dynamic_array_init(&map->strings, sizeof(char *));
+  arena_init(&map->string_arena, ARENA_DEFAULT_BLOCK_SIZE);
+}
+
+void source_map_free(source_map *map) {
+  for (u64 i = 0; i < map->files.count; i++) {
+    source_file *file = source_map_file(map, i);
+    free(file->path);
+    if (file->owned)
+      scu_unmap_file(file->buffer, file->len);
+    free(file->line_starts);
+  }
+  dynamic_array_free(&map->files);
+  map->next_base = 0;
+
+  dynamic_array_free(&map->strings);
+  arena_free(&map->string_arena);
+}
+
+/*
+ * @brief: register a source buffer.
+ *
+ * @param owned: whether the map frees the buffer.
+ */
+static u32 source_map_register(source_map *map, const char *path, char *buffer,
+                               u64 len, bool owned) {
+  // one extra location per file for its end, so every location is unique
+  if (len >= (u64)UINT32_MAX - map->next_base) {
+    scu_perror("Source files too large: %s\n", path);
+    exit(1);
+  }
+
+  u64 path_len = strlen(path) + 1;
+  source_file file = {
+      .path = scu_checked_malloc(path_len),
+      .buffer = buffer,
+      .len = len,
+      .owned = owned,
+      .base = map->next_base,
+      .line_starts = NULL,
+      .line_count = 0,
+      .last_line = 0,
+  };
+  memcpy(file.path, path, path_len);
+
+  map->next_base += len + 1;
+  dynamic_array_append(&map->files, &file);
+
+  return map->files.count - 1;
+}
+
+u32 source_map_add(source_map *map, const char *path, char *buffer, u64 len) {
+  return source_map_register(map, path, buffer, len, true);
+}
+
+u32 source_map_add_shared(source_map *map, const char *path, char *buffer,
+                          u64 len) {
+  return source_map_register(map, path, buffer, len, false);
+}
+
+source_file *source_map_file(source_map *map, u32 index) {
+  return (source_file *)map->files.items + index;
+}
+
+source_file *source_map_file_at(source_map *map, source_loc loc) {
+  source_file *files = map->files.items;
+  u64 lo = 0, hi = map->files.count;
+
+  // last file with base <= loc
+  while (hi - lo > 1) {
+    u64 mid = (lo + hi) / 2;
+    if (files[mid].base <= loc)
+      lo = mid;
+    else
+      hi = mid;
+  }
+
+  return &files[lo];
+}
+
+/*
+ * @brief: build the line start table of a file.
+ *
+ * @param file: pointer to a source_file without a line table.
+ */
+static void source_file_index_lines(source_file *file) {
+  u64 newlines = scan_count_newlines(file->buffer, file->len);
+
+  file->line_starts = scu_checked_malloc((newlines + 1) * sizeof(u32));
+  file->line_starts[0] = 0;
+  file->line_count = newlines + 1;
+
+  scan_line_starts(file->buffer, file->len, file->line_starts + 1);
+}
+
+/*
+ * @brief: check if offset lies on a given line of a file.
+ */
+static inline bool source_file_on_line(source_file *file, u32 line,
+                                       u32 offset) {
+  return file->line_starts[line] <= offset &&
+         (line + 1 == file->line_count || offset < file->line_starts[line + 1]);
+}
+
+u64 source_map_line(source_map *map, source_loc loc) {
+  source_file *file = source_map_file_at(map, loc);
+  u32 offset = loc - file->base;
+
+  if (!file->line_starts)
+    source_file_index_lines(file);
+
+  // lookups mostly hit the same or the next line
+  u32 line = file->last_line;
+  if (source_file_on_line(file, line, offset))
+    return line + 1;
+
+  if (line + 1 < file->line_count &&
+      source_file_on_line(file, line + 1, offset)) {
+    file->last_line = line + 1;
+    return line + 2;
+  }
+
+  // last line starting at or before offset
+  u32 lo = 0, hi = file->line_count;
+  while (hi - lo > 1) {
+    u32 mid = lo + (hi - lo) / 2;
+    if (file->line_starts[mid] <= offset)
+      lo = mid;
+    else
+      hi = mid;
+  }
+
+  file->last_line = lo;
+  return lo + 1;
+}
+
+const char *source_map_text(source_map *map, source_loc loc) {
+  source_file *file = source_map_file_at(map, loc);
+  return file->buffer + (loc - file->base);
+}
+
+u32 source_map_add_string(source_map *map, const char *str, u64 len) {
+  char *copy = arena_push(&map->string_arena, len + 1);
+  if (len)
+    memcpy(copy, str, len);
+  copy[len] = '\0';
+
+  dynamic_array_append(&map->strings, &copy);
+  return map->strings.count - 1;
+}
+
+u32 source_map_add_strings(source_map *map, char **strings, u32 count) {
+  u32 first = map->strings.count;
+  for (u32 i = 0; i < count; i++)
+    dynamic_array_append(&map->strings, &strings[i]);
+
+  return first;
+}
+
+char *source_map_string(source_map *map, u32 index) {
+  return ((char **)map->strings.items)[index];
+}
@@ -0,0 +1,301 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "timing.h"
+#include "common.h"
+#include "ds/arena.h"
+#include "ds/dynamic_array.h"
+#include "memstat.h"
+#include "utils.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Row of the phases that belong to no file (linking).
+ */
+#define TIMING_NO_FILE UINT32_MAX
+
+/*
+ * @struct timing_row: time spent in every phase for one file.
+ */
+typedef struct timing_row {
+  char *path;
+  u64 ns[PHASE_COUNT];
+} timing_row;
+
+/*
+ * @struct timing_event: a complete ("X") event of the trace.
+ */
+typedef struct timing_event {
+  const char *name;
+  const char *category;
+  u32 file;
+  u32 tid;
+  u64 start;
+  u64 dur;
+} timing_event;
+
+static struct {
+  bool enabled;
+  bool report;
+  char *trace_path;
+
+  u64 start;
+
+  u32 files;
+  timing_row *rows;
+  timing_row build;
+
+  /*
+   * Events of the trace and the storage of their names, shared by all
+   * threads.
+   */
+  pthread_mutex_t lock;
+  dynamic_array events;
+  mem_arena names;
+  _Atomic u32 next_tid;
+} timing = {0};
+
+static _Thread_local u32 current_file = TIMING_NO_FILE;
+static _Thread_local u32 current_tid = 0;
+
+/*
+ * Time added with timing_add since the open phase of the thread began.
+ */
+static _Thread_local u64 nested_ns = 0;
+
+void timing_init(u32 files, bool report, const char *trace_path) {
+  if (!report && trace_path == NULL)
+    return;
+
+  timing.enabled = true;
+  timing.report = report;
+  timing.trace_path = trace_path ? strdup(trace_path) : NULL;
+  timing.start = timing_now();
+
+  timing.files = files;
+  timing.rows = calloc(files ? files : 1, sizeof(timing_row));
+
+  pthread_mutex_init(&timing.lock, NULL);
+  dynamic_array_init(&timing.events, sizeof(timing_event));
+  arena_init(&timing.names, 0);
+}
+
+bool timing_enabled() { return timing.enabled; }
+
+bool timing_tracing() { return timing.trace_path != NULL; }
+
+u64 timing_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+void timing_begin_file(u32 index, const char *path) {
+  if (!timing.enabled || index >= timing.files)
+    return;
+
+  current_file = index;
+  if (timing.rows[index].path == NULL)
+    timing.rows[index].path = strdup(path);
+}
+
+void timing_end_file() { current_file = TIMING_NO_FILE; }
+
+/*
+ * @brief: add time to a phase in the row of the current file.
+ */
+static void timing_row_add(time_phase phase, u64 ns) {
+  // a row is only written by the thread compiling its file
+  timing_row *row = current_file == TIMING_NO_FILE ? &timing.build
+                                                   : &timing.rows[current_file];
+  row->ns[phase] += ns;
+}
+
+void timing_add(time_phase phase, u64 ns) {
+  if (!timing.enabled)
+    return;
+
+  timing_row_add(phase, ns);
+  nested_ns += ns;
+}
+
+u64 timing_phase_begin(time_phase phase) {
+  memstat_set_phase(phase);
+  nested_ns = 0;
+  return timing_now();
+}
+
+u64 timing_phase_end(time_phase phase, u64 start) {
+  memstat_set_phase(PHASE_COUNT);
+  memstat_phase_end(phase);
+
+  if (!timing.enabled)
+    return 0;
+
+  u64 end = timing_now();
+  u64 ns = end - start;
+  timing_row_add(phase, ns - (nested_ns < ns ? nested_ns : ns));
+  nested_ns = 0;
+
+  if (timing_tracing())
+    timing_span(time_phase_name(phase), strlen(time_phase_name(phase)),
+                "phase", start, end);
+
+  return ns;
+}
+
+void timing_span(const char *name, u64 len, const char *category, u64 start,
+                 u64 end) {
+  if (!timing_tracing())
+    return;
+
+  if (current_tid == 0)
+    current_tid = atomic_fetch_add(&timing.next_tid, 1) + 1;
+
+  pthread_mutex_lock(&timing.lock);
+
+  char *copy = arena_push(&timing.names, len + 1);
+  memcpy(copy, name, len);
+  copy[len] = '\0';
+
+  timing_event event = {
+      .name = copy,
+      .category = category,
+      .file = current_file,
+      .tid = current_tid,
+      .start = start,
+      .dur = end - start,
+  };
+  dynamic_array_append(&timing.events, &event);
+
+  pthread_mutex_unlock(&timing.lock);
+}
+
+/*
+ * @brief: print a string as a JSON string literal.
+ */
+static void timing_json_string(FILE *f, const char *str) {
+  fputc('"', f);
+
+  for (const char *c = str; *c; c++) {
+    if (*c == '"' || *c == '\\')
+      fprintf(f, "\\%c", *c);
+    else if ((unsigned char)*c < 0x20)
+      fprintf(f, "\\u%04x", *c);
+    else
+      fputc(*c, f);
+  }
+
+  fputc('"', f);
+}
+
+/*
+ * @brief: write the events in the Chrome trace event format, readable by
+ * chrome://tracing and Perfetto.
+ */
+static void timing_write_trace() {
+  FILE *f = fopen(timing.trace_path, "w");
+  if (!f) {
+    scu_pwarning("Could not write trace file: %s\n", timing.trace_path);
+    return;
+  }
+
+  fprintf(f, "{\"traceEvents\":[\n");
+  fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+             "\"args\":{\"name\":\"sclc\"}}");
+
+  for (u64 i = 0; i < timing.events.count; i++) {
+    timing_event *event = dynamic_array_at(&timing.events, i);
+
+    fprintf(f, ",\n{\"name\":");
+    timing_json_string(f, event->name);
+    fprintf(f,
+            ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+            "\"pid\":1,\"tid\":%u",
+            event->category, (event->start - timing.start) / 1e3,
+            event->dur / 1e3, event->tid);
+
+    if (event->file != TIMING_NO_FILE && timing.rows[event->file].path) {
+      fprintf(f, ",\"args\":{\"file\":");
+      timing_json_string(f, timing.rows[event->file].path);
+      fprintf(f, "}");
+    }
+
+    fprintf(f, "}");
+  }
+
+  fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+  if (fclose(f) != 0)
+    scu_pwarning("Could not write trace file: %s\n", timing.trace_path);
+}
+
+/*
+ * @brief: print one row of the report, durations in milliseconds.
+ */
+static void timing_print_row(const char *name, u64 ns[PHASE_COUNT]) {
+  u64 total = 0;
+  scu_printf("  %-24s", name);
+
+  for (u32 p = 0; p < PHASE_COUNT; p++) {
+    scu_printf(" %9.3f", ns[p] / 1e6);
+    total += ns[p];
+  }
+
+  scu_printf(" %9.3f\n", total / 1e6);
+}
+
+static void timing_print_report(u64 wall) {
+  u64 sum[PHASE_COUNT] = {0};
+
+  scu_printf("Time report (wall clock, ms):\n");
+  scu_printf("  %-24s", "file");
+  for (u32 p = 0; p < PHASE_COUNT; p++)
+    scu_printf(" %9s", time_phase_name(p));
+  scu_printf(" %9s\n", "total");
+
+  for (u32 i = 0; i < timing.files; i++) {
+    timing_row *row = &timing.rows[i];
+    if (row->path == NULL)
+      continue;
+
+    timing_print_row(row->path, row->ns);
+    for (u32 p = 0; p < PHASE_COUNT; p++)
+      sum[p] += row->ns[p];
+  }
+
+  for (u32 p = 0; p < PHASE_COUNT; p++)
+    sum[p] += timing.build.ns[p];
+
+  timing_print_row("total", sum);
+  scu_printf("  %-24s %9.3f\n", "wall", wall / 1e6);
+}
+
+void timing_finish() {
+  if (!timing.enabled)
+    return;
+
+  u64 wall = timing_now() - timing.start;
+
+  if (timing.report)
+    timing_print_report(wall);
+
+  if (timing.trace_path)
+    timing_write_trace();
+
+  for (u32 i = 0; i < timing.files; i++)
+    free(timing.rows[i].path);
+  free(timing.rows);
+  free(timing.trace_path);
+
+  dynamic_array_free(&timing.events);
+  arena_free(&timing.names);
+  pthread_mutex_destroy(&timing.lock);
+
+  memset(&timing, 0, sizeof(timing));
+}
@@ -1,5 +1,7 @@
 #include "token.h"
 
+#include "utils.h"
+
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -116,48 +118,35 @@ const char *lexer_token_kind_to_str(token_kind kind) {
   }
 }
 
-void lexer_print_tokens(dynamic_array *tokens) {
-  for (u64 i = 0; i < tokens->count; i++) {
-    token token;
-    dynamic_array_get(tokens, i, &token);
-
-    printf("[line %zu] ", token.line);
-
-    const char *kind = lexer_token_kind_to_str(token.kind);
-    printf("%s", kind);
-
-    switch (token.kind) {
-    case TOKEN_INT_LITERAL:
-      printf("(%d)", token.value.integer);
-      break;
-    case TOKEN_CHAR_LITERAL:
-      printf("(%c)", token.value.character);
-      break;
-    case TOKEN_STRING_LITERAL:
-      printf(" \"%s\"", token.value.str);
-      break;
-    case TOKEN_POINTER:
-    case TOKEN_ADDRESS_OF:
-    case TOKEN_LABEL:
-    case TOKEN_IDENTIFIER:
-    case TOKEN_INVALID:
-      printf("(%s)", token.value.str);
-      break;
-    default:
-      break;
-    }
-
-    printf("\n");
-  }
-}
+void lexer_print_token(token *token, source_map *sources) {
+  scu_printf("[line %zu] ", source_map_line(sources, token->loc));
+
+  const char *kind = lexer_token_kind_to_str(token->kind);
+  scu_printf("%s", kind);
 
-void free_tokens(dynamic_array *tokens) {
-  for (u64 i = 0; i < tokens->count; i++) {
-    token *token = tokens->items + (i * tokens->item_size);
-    if (token->kind == TOKEN_IDENTIFIER || token->kind == TOKEN_LABEL ||
-        token->kind == TOKEN_INVALID || token->kind == TOKEN_ADDRESS_OF ||
-        token->kind == TOKEN_POINTER || token->kind == TOKEN_STRING_LITERAL) {
-      free(token->value.str);
-    }
+  switch (token->kind) {
+  case TOKEN_INT_LITERAL:
+    scu_printf("(%d)", token->value.integer);
+    break;
+  case TOKEN_CHAR_LITERAL:
+    scu_printf("(%c)", token->value.character);
+    break;
+  case TOKEN_STRING_LITERAL:
+    scu_printf(" \"%s\"", source_map_string(sources, token->value.str));
+    break;
+  case TOKEN_POINTER:
+  case TOKEN_ADDRESS_OF:
+  case TOKEN_LABEL:
+  case TOKEN_IDENTIFIER:
+    scu_printf("(%s)", intern_str(token->value.sym));
+    break;
+  case TOKEN_INVALID:
+    scu_printf("(%.*s)", (int)token->len,
+               source_map_text(sources, token->loc));
+    break;
+  default:
+    break;
   }
+
+  scu_printf("\n");
 }
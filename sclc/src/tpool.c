@@ -0,0 +1,74 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "tpool.h"
+#include "common.h"
+#include "utils.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * @struct tpool: state shared by all workers of a single tpool_run call.
+ */
+typedef struct tpool {
+  _Atomic u64 next;
+  u64 njobs;
+  tpool_job_fn fn;
+  void *ctx;
+} tpool;
+
+/*
+ * @brief: worker loop, claims job indices until none are left.
+ *
+ * @param arg: pointer to the shared tpool.
+ */
+static void *tpool_worker(void *arg) {
+  tpool *pool = arg;
+
+  while (1) {
+    u64 index = atomic_fetch_add(&pool->next, 1);
+    if (index >= pool->njobs)
+      break;
+    pool->fn(pool->ctx, index);
+  }
+
+  return NULL;
+}
+
+void tpool_run(u32 nthreads, u64 njobs, tpool_job_fn fn, void *ctx) {
+  tpool pool = {.next = 0, .njobs = njobs, .fn = fn, .ctx = ctx};
+
+  if (nthreads > njobs)
+    nthreads = (u32)njobs;
+
+  if (nthreads <= 1) {
+    tpool_worker(&pool);
+    return;
+  }
+
+  // the calling thread works as well, so spawn one thread less
+  pthread_t *threads = scu_checked_malloc((nthreads - 1) * sizeof(pthread_t));
+  u32 spawned = 0;
+
+  for (; spawned < nthreads - 1; spawned++) {
+    if (pthread_create(&threads[spawned], NULL, tpool_worker, &pool) != 0) {
+      scu_pwarning("Failed to spawn worker thread, continuing with %u\n",
+                   spawned + 1);
+      break;
+    }
+  }
+
+  tpool_worker(&pool);
+
+  for (u32 i = 0; i < spawned; i++)
+    pthread_join(threads[i], NULL);
+
+  free(threads);
+}
+
+u32 tpool_cpu_count() {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (u32)n : 1;
+}
@@ -1,14 +1,31 @@
+#define _DEFAULT_SOURCE
+
 #include "utils.h"
+#include "memstat.h"
+#include "scan.h"
 
 #include <assert.h>
+#include <fcntl.h>
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
+
+static _Atomic u64 err_count = 0;
+
+/*
+ * Sink the calling thread's output is currently redirected to, if any.
+ */
+static _Thread_local scu_sink *current_sink = NULL;
+
+static FILE *scu_out() { return current_sink ? current_sink->out : stdout; }
 
-static u64 err_count = 0;
+static FILE *scu_err() { return current_sink ? current_sink->err : stderr; }
 
 void *scu_checked_malloc(u64 size) {
   if (size == 0)
@@ -18,6 +35,7 @@ void *scu_checked_malloc(u64 size) {
     scu_perror("Memory allocation failed.");
     exit(1);
   }
+  memstat_alloc(size);
   return ptr;
 }
 
@@ -29,6 +47,7 @@ void *scu_checked_realloc(void *ptr, u64 size) {
     scu_perror("Memory re-allocation failed.");
     exit(1);
   }
+  memstat_alloc(size);
   return newptr;
 }
 
@@ -49,50 +68,55 @@ char *scu_extract_name(const char *filename) {
   return name;
 }
 
-#define MAX_LEN 4096
+/*
+ * @brief: size of the mapping of a file of len bytes, whole pages holding the
+ * file followed by at least SCAN_PADDING zero bytes.
+ */
+static u64 scu_mapping_size(u64 len) {
+  u64 page = sysconf(_SC_PAGESIZE);
+  return (len + SCAN_PADDING + page - 1) / page * page;
+}
 
-u32 scu_read_file(const char *path, char **buffer) {
+char *scu_map_file(const char *path, u64 *len) {
+  i32 fd = open(path, O_RDONLY);
   struct stat path_stat;
-  stat(path, &path_stat);
 
-  if (!S_ISREG(path_stat.st_mode)) {
-    scu_perror("Given path is not a valid file.\n");
+  if (fd < 0 || fstat(fd, &path_stat) != 0 || !S_ISREG(path_stat.st_mode)) {
+    scu_perror("Given path is not a valid file: %s\n", path);
+    if (fd >= 0)
+      close(fd);
     scu_check_errors();
   }
 
-  u32 tmp_capacity = MAX_LEN;
-  char *tmp = scu_checked_malloc(tmp_capacity * sizeof(char));
-
-  u32 tmp_size = 0;
+  u64 size = path_stat.st_size;
+  u64 mapping_size = scu_mapping_size(size);
 
-  FILE *f = fopen(path, "r");
-
-  if (f == NULL) {
-    perror("fopen failed");
-    free(tmp);
+  // reserve zeroed pages for the whole mapping, then put the file over them
+  char *buffer = mmap(NULL, mapping_size, PROT_READ,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buffer == MAP_FAILED) {
+    perror("mmap failed");
     exit(1);
   }
 
-  u32 size = 0;
-
-  do {
-    if (tmp_size + MAX_LEN >= tmp_capacity) {
-      tmp_capacity *= 2;
-      tmp = scu_checked_realloc(tmp, tmp_capacity * sizeof(char));
+  if (size > 0) {
+    if (mmap(buffer, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) ==
+        MAP_FAILED) {
+      perror("mmap failed");
+      exit(1);
     }
+    madvise(buffer, size, MADV_SEQUENTIAL);
+  }
 
-    size = fread(tmp + tmp_size, sizeof(char), MAX_LEN, f);
-    tmp_size += size;
-  } while (size > 0);
-
-  fclose(f);
-
-  *buffer = tmp;
+  close(fd);
 
-  return tmp_size;
+  *len = size;
+  return buffer;
 }
 
-#undef MAX_LEN
+void scu_unmap_file(char *buffer, u64 len) {
+  munmap(buffer, scu_mapping_size(len));
+}
 
 char *scu_format_string(char *__restrict __format, ...) {
   va_list args;
@@ -119,39 +143,88 @@ char *scu_format_string(char *__restrict __format, ...) {
 void scu_psuccess(char *__restrict __format, ...) {
   va_list args;
   va_start(args, __format);
-  fprintf(stdout, "\033[1;32m[SUCCESS] \033[0m");
-  vfprintf(stdout, __format, args);
+  fprintf(scu_out(), "\033[1;32m[SUCCESS] \033[0m");
+  vfprintf(scu_out(), __format, args);
   va_end(args);
 }
 
 void scu_pdebug(char *__restrict __format, ...) {
   va_list args;
   va_start(args, __format);
-  fprintf(stdout, "\033[1;32m[DEBUG] \033[0m");
-  vfprintf(stdout, __format, args);
+  fprintf(scu_out(), "\033[1;32m[DEBUG] \033[0m");
+  vfprintf(scu_out(), __format, args);
   va_end(args);
 }
 
 void scu_pwarning(char *__restrict __format, ...) {
   va_list args;
   va_start(args, __format);
-  fprintf(stderr, "\033[1;33m[WARNING] \033[0m");
-  vfprintf(stderr, __format, args);
+  fprintf(scu_err(), "\033[1;33m[WARNING] \033[0m");
+  vfprintf(scu_err(), __format, args);
   va_end(args);
 }
 
 void scu_perror(char *__restrict __format, ...) {
   err_count++;
+  if (current_sink)
+    current_sink->err_count++;
   va_list args;
   va_start(args, __format);
-  fprintf(stderr, "\033[1;31m[ERROR] \033[0m");
-  vfprintf(stderr, __format, args);
+  fprintf(scu_err(), "\033[1;31m[ERROR] \033[0m");
+  vfprintf(scu_err(), __format, args);
+  va_end(args);
+}
+
+void scu_printf(char *__restrict __format, ...) {
+  va_list args;
+  va_start(args, __format);
+  vfprintf(scu_out(), __format, args);
   va_end(args);
 }
 
 void scu_check_errors() {
+  if (current_sink) {
+    if (current_sink->err_count)
+      longjmp(current_sink->bail, 1);
+    return;
+  }
+
   if (err_count) {
     scu_pwarning("%d error(s) found\n", err_count);
     exit(1);
   }
 }
+
+void scu_sink_begin(scu_sink *sink) {
+  sink->out_buf = NULL;
+  sink->out_len = 0;
+  sink->out = open_memstream(&sink->out_buf, &sink->out_len);
+
+  sink->err_buf = NULL;
+  sink->err_len = 0;
+  sink->err = open_memstream(&sink->err_buf, &sink->err_len);
+
+  if (sink->out == NULL || sink->err == NULL) {
+    perror("open_memstream failed");
+    exit(1);
+  }
+
+  sink->err_count = 0;
+  current_sink = sink;
+}
+
+void scu_sink_end() { current_sink = NULL; }
+
+void scu_sink_flush(scu_sink *sink) {
+  fclose(sink->out);
+  fclose(sink->err);
+
+  fwrite(sink->out_buf, 1, sink->out_len, stdout);
+  fflush(stdout);
+  fwrite(sink->err_buf, 1, sink->err_len, stderr);
+
+  free(sink->out_buf);
+  free(sink->err_buf);
+  sink->out = sink->err = NULL;
+  sink->out_buf = sink->err_buf = NULL;
+}
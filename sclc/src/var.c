@@ -2,32 +2,19 @@
 #include "common.h"
 #include "utils.h"
 
-type get_var_type(ht *variables, variable *var_to_find) {
-  if (!variables || !var_to_find || !var_to_find->name)
+type resolve_var(scope_map *variables, variable *use) {
+  if (!variables || !use || use->name == SYM_NONE)
     return -1;
 
-  variable *var = ht_search(variables, var_to_find->name);
+  variable *var = scope_map_get(variables, use->name);
 
   if (!var) {
-    scu_perror("Use of undeclared variable: %s [line %u]\n", var_to_find->name,
-               var_to_find->line);
+    scu_perror("Use of undeclared variable: %s [line %u]\n",
+               intern_str(use->name), use->line);
     return -1;
   }
 
+  use->type = var->type;
+  use->slot = var->slot;
   return var->type;
 }
-
-u64 get_var_stack_offset(ht *variables, variable *var_to_find) {
-  if (!variables || !var_to_find || !var_to_find->name)
-    return -1;
-
-  variable *var = ht_search(variables, var_to_find->name);
-
-  if (!var) {
-    scu_perror("Use of undeclared variable: %s [line %u]\n", var_to_find->name,
-               var_to_find->line);
-    return -1;
-  }
-
-  return var->stack_offset;
-}